@@ -34,9 +34,19 @@
 #include <qes_match.h>
 #include <qes_seqfile.h>
 #include <qes_seq.h>
+#include <qes_seqbatch.h>
+#include <qes_seqreader.h>
+#include <qes_seqwriter.h>
 #include <qes_sequtil.h>
+#include <qes_packedseq.h>
 #include <qes_str.h>
 #include <qes_util.h>
+#include <qes_arena.h>
 #include <qes_file.h>
+#include <qes_bgzf.h>
+#include <qes_scan.h>
+#include <qes_backend.h>
+#include <qes_gzindex.h>
+#include <qes_fai.h>
 
 #endif /* LIBQES_H */
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_arena.c
+ *
+ *    Description:  Bump allocation of many small objects, freed all at once
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_arena.h"
+
+
+/* Round ``len`` up to a multiple of QES_ARENA_ALIGN */
+static inline size_t
+__qes_arena_align (size_t len)
+{
+    return (len + QES_ARENA_ALIGN - 1) & ~(size_t)(QES_ARENA_ALIGN - 1);
+}
+
+static struct qes_arena_block *
+__qes_arena_block_create (size_t len)
+{
+    struct qes_arena_block *block = qes_malloc_errnil(sizeof(*block));
+
+    if (block == NULL) {
+        return NULL;
+    }
+    block->data = qes_malloc_errnil(len);
+    if (block->data == NULL) {
+        qes_free(block);
+        return NULL;
+    }
+    block->next = NULL;
+    block->len = len;
+    block->used = 0;
+    return block;
+}
+
+struct qes_arena *
+qes_arena_create (size_t block_len)
+{
+    struct qes_arena *arena = qes_calloc_errnil(1, sizeof(*arena));
+
+    if (arena == NULL) {
+        return NULL;
+    }
+    if (block_len == 0) {
+        block_len = QES_ARENA_DEFAULT_BLOCK_LEN;
+    }
+    arena->block_len = __qes_arena_align(block_len);
+    return arena;
+}
+
+void *
+qes_arena_alloc (struct qes_arena *arena, size_t len)
+{
+    struct qes_arena_block *block = NULL;
+    void *ptr = NULL;
+
+    if (arena == NULL) {
+        return NULL;
+    }
+    len = __qes_arena_align(len > 0 ? len : 1);
+    block = arena->current;
+    /* Move on to the next block with room, which after a reset will be one
+     * we used before */
+    while (block != NULL && block->len - block->used < len) {
+        if (block->next == NULL || block->next->len < len) {
+            block = NULL;
+            break;
+        }
+        block = block->next;
+        arena->current = block;
+    }
+    if (block == NULL) {
+        block = __qes_arena_block_create(len > arena->block_len ?
+                                         len : arena->block_len);
+        if (block == NULL) {
+            return NULL;
+        }
+        /* Goes after the current block, ahead of any left from before a
+         * reset */
+        if (arena->current == NULL) {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        } else {
+            block->next = arena->current->next;
+            arena->current->next = block;
+        }
+        arena->current = block;
+    }
+    ptr = block->data + block->used;
+    block->used += len;
+    return ptr;
+}
+
+int
+qes_arena_owns (const struct qes_arena *arena, const void *ptr)
+{
+    const struct qes_arena_block *block = NULL;
+    const char *cptr = ptr;
+
+    if (arena == NULL || ptr == NULL) {
+        return 0;
+    }
+    for (block = arena->blocks; block != NULL; block = block->next) {
+        if (cptr >= block->data && cptr < block->data + block->len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void
+qes_arena_reset (struct qes_arena *arena)
+{
+    struct qes_arena_block *block = NULL;
+
+    if (arena == NULL) {
+        return;
+    }
+    for (block = arena->blocks; block != NULL; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->blocks;
+}
+
+void
+qes_arena_destroy_ (struct qes_arena *arena)
+{
+    struct qes_arena_block *block = NULL;
+    struct qes_arena_block *next = NULL;
+
+    if (arena == NULL) {
+        return;
+    }
+    for (block = arena->blocks; block != NULL; block = next) {
+        next = block->next;
+        qes_free(block->data);
+        qes_free(block);
+    }
+    qes_free(arena);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_arena.h
+ *
+ *    Description:  Bump allocation of many small objects, freed all at once
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_ARENA_H
+#define QES_ARENA_H
+
+#include <qes_util.h>
+
+/* Size of each block of an arena, if not given */
+#define QES_ARENA_DEFAULT_BLOCK_LEN (1<<16)
+/* Alignment of every allocation, enough for any struct we put there */
+#define QES_ARENA_ALIGN (16)
+
+/* One chunk of memory, carved up from the start */
+struct qes_arena_block {
+    struct qes_arena_block *next;
+    size_t len;
+    size_t used;
+    char *data;
+};
+
+/* An arena hands out memory from large blocks by bumping a pointer, so each
+ * allocation costs a few instructions and nothing is zero-filled. Memory is
+ * only given back all at once, by qes_arena_reset or qes_arena_destroy. An
+ * arena is not thread safe; use one per thread. */
+struct qes_arena {
+    /* All blocks, in the order they're used */
+    struct qes_arena_block *blocks;
+    /* Block being allocated from */
+    struct qes_arena_block *current;
+    size_t block_len;
+};
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_arena_create
+Parameters:     size_t block_len: Size of each block, or 0 for
+                    QES_ARENA_DEFAULT_BLOCK_LEN. Larger allocations get a
+                    block of their own.
+Description:    Create an empty arena. No blocks are allocated until needed.
+Returns:        struct qes_arena *: A new arena, or NULL on error.
+ *===========================================================================*/
+struct qes_arena *qes_arena_create
+                               (size_t                  block_len);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_arena_alloc
+Parameters:     struct qes_arena *arena: Arena to allocate from.
+                size_t len: Number of bytes wanted.
+Description:    Allocate ``len`` bytes, aligned to QES_ARENA_ALIGN, from
+                ``arena``. The memory is not zeroed, and lives until
+                ``arena`` is reset or destroyed.
+Returns:        void *: The memory, or NULL on error.
+ *===========================================================================*/
+void *qes_arena_alloc          (struct qes_arena       *arena,
+                                size_t                  len);
+
+/* Returns non-zero if ``ptr`` was allocated from ``arena`` */
+int qes_arena_owns             (const struct qes_arena *arena,
+                                const void             *ptr);
+
+/* Free everything allocated from ``arena`` at once. Its blocks are kept, so
+ * filling it again to the same size allocates nothing. */
+void qes_arena_reset           (struct qes_arena       *arena);
+
+void qes_arena_destroy_        (struct qes_arena       *arena);
+#define qes_arena_destroy(arena) do {                                       \
+            qes_arena_destroy_(arena);                                      \
+            arena = NULL;                                                   \
+        } while(0)
+
+#endif /* QES_ARENA_H */
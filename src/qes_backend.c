@@ -0,0 +1,1349 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_backend.c
+ *
+ *    Description:  Streams that a struct qes_file can read from and write to
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_backend.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef MMAP_FOUND
+#   include <sys/mman.h>
+#endif
+#ifdef LIBDEFLATE_FOUND
+#   include <libdeflate.h>
+#endif
+#ifdef ZSTD_FOUND
+#   include <zstd.h>
+#endif
+#ifdef BZIP2_FOUND
+#   include <bzlib.h>
+#endif
+#ifdef LIBLZMA_FOUND
+#   include <lzma.h>
+#endif
+
+
+/* open(2) flags for an fopen-style ``mode`` */
+static int
+__qes_backend_flags (const char *mode)
+{
+    int rdwr = strchr(mode, '+') != NULL;
+
+    switch (mode[0]) {
+    case 'r':
+        return rdwr ? O_RDWR : O_RDONLY;
+    case 'w':
+        return (rdwr ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+    case 'a':
+        return (rdwr ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+    default:
+        return -1;
+    }
+}
+
+
+/*---------------------------------------------------------------------------
+  | fd backend                                                              |
+  ---------------------------------------------------------------------------*/
+
+struct __qes_backend_fd {
+    int fd;
+    /* errno of the last failure */
+    int err;
+};
+
+static void *
+__qes_backend_fd_dopen (int fd, const char *mode, void *arg)
+{
+    struct __qes_backend_fd *handle = NULL;
+
+    (void) mode;
+    (void) arg;
+    handle = qes_calloc_errnil(1, sizeof(*handle));
+    if (handle != NULL) {
+        handle->fd = fd;
+    }
+    return handle;
+}
+
+static void *
+__qes_backend_fd_open (const char *path, const char *mode, void *arg)
+{
+    struct __qes_backend_fd *handle = NULL;
+    int flags = __qes_backend_flags(mode);
+    int fd = -1;
+
+    if (flags < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    fd = open(path, flags, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+    handle = __qes_backend_fd_dopen(fd, mode, arg);
+    if (handle == NULL) {
+        close(fd);
+    }
+    return handle;
+}
+
+static ssize_t
+__qes_backend_fd_read (void *vhandle, void *buf, size_t len)
+{
+    struct __qes_backend_fd *handle = vhandle;
+    size_t got = 0;
+    ssize_t res = 0;
+
+    /* read(2) may return less than asked for before EOF, e.g. on pipes */
+    while (got < len) {
+        res = read(handle->fd, (char *)buf + got, len - got);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        } else if (res < 0) {
+            handle->err = errno;
+            return -1;
+        } else if (res == 0) {
+            break;
+        }
+        got += res;
+    }
+    return got;
+}
+
+static ssize_t
+__qes_backend_fd_write (void *vhandle, const void *buf, size_t len)
+{
+    struct __qes_backend_fd *handle = vhandle;
+    size_t done = 0;
+    ssize_t res = 0;
+
+    while (done < len) {
+        res = write(handle->fd, (const char *)buf + done, len - done);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        } else if (res < 0) {
+            handle->err = errno;
+            return -1;
+        }
+        done += res;
+    }
+    return len;
+}
+
+static int
+__qes_backend_fd_seek (void *vhandle, off_t offset)
+{
+    struct __qes_backend_fd *handle = vhandle;
+
+    if (lseek(handle->fd, offset, SEEK_SET) < 0) {
+        handle->err = errno;
+        return -1;
+    }
+    return 0;
+}
+
+static int
+__qes_backend_fd_close (void *vhandle)
+{
+    struct __qes_backend_fd *handle = vhandle;
+    int res = close(handle->fd);
+
+    qes_free(handle);
+    return res;
+}
+
+static const char *
+__qes_backend_fd_error (void *vhandle)
+{
+    struct __qes_backend_fd *handle = vhandle;
+
+    return handle->err != 0 ? strerror(handle->err) : "";
+}
+
+const struct qes_file_backend qes_file_backend_fd = {
+    "fd",
+    __qes_backend_fd_open,
+    __qes_backend_fd_dopen,
+    __qes_backend_fd_read,
+    __qes_backend_fd_write,
+    __qes_backend_fd_seek,
+    NULL,
+    __qes_backend_fd_close,
+    __qes_backend_fd_error,
+    NULL,
+    NULL,
+};
+
+
+/*---------------------------------------------------------------------------
+  | stdio backend                                                           |
+  ---------------------------------------------------------------------------*/
+
+static void *
+__qes_backend_stdio_open (const char *path, const char *mode, void *arg)
+{
+    (void) arg;
+    return fopen(path, mode);
+}
+
+static void *
+__qes_backend_stdio_dopen (int fd, const char *mode, void *arg)
+{
+    (void) arg;
+    return fdopen(fd, mode);
+}
+
+static ssize_t
+__qes_backend_stdio_read (void *handle, void *buf, size_t len)
+{
+    size_t res = fread(buf, 1, len, handle);
+
+    if (res < len && ferror((FILE *)handle)) {
+        return -1;
+    }
+    return res;
+}
+
+static ssize_t
+__qes_backend_stdio_write (void *handle, const void *buf, size_t len)
+{
+    return fwrite(buf, 1, len, handle) == len ? (ssize_t)len : -1;
+}
+
+static int
+__qes_backend_stdio_seek (void *handle, off_t offset)
+{
+    return fseeko(handle, offset, SEEK_SET);
+}
+
+static int
+__qes_backend_stdio_flush (void *handle)
+{
+    return fflush(handle);
+}
+
+static int
+__qes_backend_stdio_close (void *handle)
+{
+    return fclose(handle);
+}
+
+static const char *
+__qes_backend_stdio_error (void *handle)
+{
+    if (ferror((FILE *)handle)) {
+        clearerr(handle);
+        return strerror(errno);
+    }
+    return "";
+}
+
+static int
+__qes_backend_stdio_buffer (void *handle, size_t len)
+{
+    return setvbuf(handle, NULL, _IOFBF, len);
+}
+
+const struct qes_file_backend qes_file_backend_stdio = {
+    "stdio",
+    __qes_backend_stdio_open,
+    __qes_backend_stdio_dopen,
+    __qes_backend_stdio_read,
+    __qes_backend_stdio_write,
+    __qes_backend_stdio_seek,
+    __qes_backend_stdio_flush,
+    __qes_backend_stdio_close,
+    __qes_backend_stdio_error,
+    __qes_backend_stdio_buffer,
+    NULL,
+};
+
+
+/*---------------------------------------------------------------------------
+  | zlib backend                                                            |
+  ---------------------------------------------------------------------------*/
+
+#ifdef ZLIB_FOUND
+static void *
+__qes_backend_zlib_open (const char *path, const char *mode, void *arg)
+{
+    (void) arg;
+    return gzopen(path, mode);
+}
+
+static void *
+__qes_backend_zlib_dopen (int fd, const char *mode, void *arg)
+{
+    (void) arg;
+    return gzdopen(fd, mode);
+}
+
+static ssize_t
+__qes_backend_zlib_read (void *handle, void *buf, size_t len)
+{
+    size_t got = 0;
+    int res = 0;
+
+    /* gzread takes an unsigned, and returns an int */
+    while (got < len) {
+        res = gzread(handle, (char *)buf + got,
+                     len - got > INT_MAX ? INT_MAX : len - got);
+        if (res < 0) {
+            return -1;
+        } else if (res == 0) {
+            break;
+        }
+        got += res;
+    }
+    return got;
+}
+
+static ssize_t
+__qes_backend_zlib_write (void *handle, const void *buf, size_t len)
+{
+    size_t done = 0;
+    size_t chunk = 0;
+
+    while (done < len) {
+        chunk = len - done > INT_MAX ? INT_MAX : len - done;
+        if (gzwrite(handle, (const char *)buf + done, chunk) != (int)chunk) {
+            return -1;
+        }
+        done += chunk;
+    }
+    return len;
+}
+
+static int
+__qes_backend_zlib_seek (void *handle, off_t offset)
+{
+    return gzseek(handle, offset, SEEK_SET) < 0 ? -1 : 0;
+}
+
+static int
+__qes_backend_zlib_flush (void *handle)
+{
+    return gzflush(handle, Z_SYNC_FLUSH) == Z_OK ? 0 : -1;
+}
+
+static int
+__qes_backend_zlib_close (void *handle)
+{
+    return gzclose(handle) == Z_OK ? 0 : -1;
+}
+
+static const char *
+__qes_backend_zlib_error (void *handle)
+{
+    int error = 0;
+    const char *errstr = gzerror(handle, &error);
+
+    if (error == Z_ERRNO) {
+        return strerror(errno);
+    }
+    return errstr;
+}
+
+#ifdef GZBUFFER_FOUND
+static int
+__qes_backend_zlib_buffer (void *handle, size_t len)
+{
+    return gzbuffer(handle, len);
+}
+#endif
+
+const struct qes_file_backend qes_file_backend_zlib = {
+    "zlib",
+    __qes_backend_zlib_open,
+    __qes_backend_zlib_dopen,
+    __qes_backend_zlib_read,
+    __qes_backend_zlib_write,
+    __qes_backend_zlib_seek,
+    __qes_backend_zlib_flush,
+    __qes_backend_zlib_close,
+    __qes_backend_zlib_error,
+#ifdef GZBUFFER_FOUND
+    __qes_backend_zlib_buffer,
+#else
+    NULL,
+#endif
+    NULL,
+};
+#endif /* ZLIB_FOUND */
+
+
+/*---------------------------------------------------------------------------
+  | libdeflate backend                                                      |
+  ---------------------------------------------------------------------------*/
+
+#ifdef LIBDEFLATE_FOUND
+/* Output space for the first member if the gzip trailer doesn't say. BGZF
+ * blocks are never bigger. */
+#define QES_BACKEND_LIBDEFLATE_MINBUF (1<<16)
+/* The most that deflate can compress by */
+#define QES_BACKEND_LIBDEFLATE_MAXRATIO 1032
+
+struct __qes_backend_libdeflate {
+    int fd;
+    struct libdeflate_decompressor *dec;
+    /* All of the compressed stream, mapped or read in */
+    unsigned char *in;
+    size_t in_len;
+    size_t in_pos;
+    int in_mapped;
+    /* Not gzip, so read straight out of ``in`` */
+    int plain;
+    /* The current member, inflated */
+    char *out;
+    size_t out_cap;
+    size_t out_len;
+    size_t out_pos;
+    /* Offset of out[0] in the uncompressed stream */
+    off_t out_start;
+    /* errno of the last failure, or -1 for bad data */
+    int err;
+};
+
+static int
+__qes_backend_libdeflate_is_gzip (const unsigned char *buf, size_t len)
+{
+    return len >= 2 && buf[0] == 0x1f && buf[1] == 0x8b;
+}
+
+/* Map or read all of ``fd`` into ``handle->in`` */
+static int
+__qes_backend_libdeflate_slurp (struct __qes_backend_libdeflate *handle)
+{
+    struct stat st;
+    size_t cap = 1<<20;
+    ssize_t res = 0;
+    unsigned char *tmp = NULL;
+
+    if (fstat(handle->fd, &st) != 0) {
+        return -1;
+    }
+#ifdef MMAP_FOUND
+    if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+            (uintmax_t)st.st_size <= SIZE_MAX) {
+        tmp = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, handle->fd, 0);
+        if (tmp != MAP_FAILED) {
+            madvise(tmp, st.st_size, MADV_SEQUENTIAL);
+            handle->in = tmp;
+            handle->in_len = st.st_size;
+            handle->in_mapped = 1;
+            return 0;
+        }
+    }
+#endif
+    /* Pipes and the like are read in whole */
+    if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+            (uintmax_t)st.st_size < SIZE_MAX) {
+        cap = st.st_size + 1;
+    }
+    while (1) {
+        if (handle->in_len == cap || handle->in == NULL) {
+            if (handle->in != NULL) {
+                cap *= 2;
+            }
+            tmp = qes_realloc_errnil(handle->in, cap);
+            if (tmp == NULL) {
+                return -1;
+            }
+            handle->in = tmp;
+        }
+        res = read(handle->fd, handle->in + handle->in_len,
+                   cap - handle->in_len);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        } else if (res < 0) {
+            return -1;
+        } else if (res == 0) {
+            return 0;
+        }
+        handle->in_len += res;
+    }
+}
+
+/* Free all but the descriptor */
+static void
+__qes_backend_libdeflate_free (struct __qes_backend_libdeflate *handle)
+{
+#ifdef MMAP_FOUND
+    if (handle->in_mapped) {
+        munmap(handle->in, handle->in_len);
+    } else
+#endif
+    {
+        qes_free(handle->in);
+    }
+    if (handle->dec != NULL) {
+        libdeflate_free_decompressor(handle->dec);
+    }
+    qes_free(handle->out);
+    qes_free(handle);
+}
+
+static int
+__qes_backend_libdeflate_close (void *vhandle)
+{
+    struct __qes_backend_libdeflate *handle = vhandle;
+    int fd = handle->fd;
+
+    __qes_backend_libdeflate_free(handle);
+    return close(fd);
+}
+
+static void *
+__qes_backend_libdeflate_dopen (int fd, const char *mode, void *arg)
+{
+    struct __qes_backend_libdeflate *handle = NULL;
+    int err = 0;
+
+    (void) arg;
+    if (mode[0] != 'r' || strchr(mode, '+') != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    handle = qes_calloc_errnil(1, sizeof(*handle));
+    if (handle == NULL) {
+        return NULL;
+    }
+    handle->fd = fd;
+    handle->dec = libdeflate_alloc_decompressor();
+    if (handle->dec == NULL ||
+            __qes_backend_libdeflate_slurp(handle) != 0) {
+        /* The caller still owns fd if we fail */
+        err = handle->dec == NULL ? ENOMEM : errno;
+        __qes_backend_libdeflate_free(handle);
+        errno = err;
+        return NULL;
+    }
+    /* Like zlib, we pass through anything that isn't gzip */
+    handle->plain = !__qes_backend_libdeflate_is_gzip(handle->in,
+                                                      handle->in_len);
+    return handle;
+}
+
+static void *
+__qes_backend_libdeflate_open (const char *path, const char *mode, void *arg)
+{
+    struct __qes_backend_libdeflate *handle = NULL;
+    int fd = -1;
+
+    if (mode[0] != 'r' || strchr(mode, '+') != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    handle = __qes_backend_libdeflate_dopen(fd, mode, arg);
+    if (handle == NULL) {
+        close(fd);
+    }
+    return handle;
+}
+
+/* Inflate the next member into ``out``. Returns 1, 0 at EOF, or -1 on
+ * error. */
+static int
+__qes_backend_libdeflate_inflate (struct __qes_backend_libdeflate *handle)
+{
+    const unsigned char *in = handle->in + handle->in_pos;
+    size_t in_left = handle->in_len - handle->in_pos;
+    size_t in_used = 0;
+    size_t out_used = 0;
+    size_t want = 0;
+    char *tmp = NULL;
+    enum libdeflate_result res;
+
+    handle->out_start += handle->out_len;
+    handle->out_len = 0;
+    handle->out_pos = 0;
+    /* As gzread does, ignore anything after the last member */
+    if (!__qes_backend_libdeflate_is_gzip(in, in_left)) {
+        return 0;
+    }
+    if (handle->out == NULL && handle->in_len >= 4) {
+        /* The trailer of the last member gives its size (mod 2^32), which
+         * is all of it for the usual single-member file */
+        want = (size_t)handle->in[handle->in_len - 1] << 24 |
+               (size_t)handle->in[handle->in_len - 2] << 16 |
+               (size_t)handle->in[handle->in_len - 3] << 8 |
+               (size_t)handle->in[handle->in_len - 4];
+        if (want / QES_BACKEND_LIBDEFLATE_MAXRATIO > in_left) {
+            want = in_left * QES_BACKEND_LIBDEFLATE_MAXRATIO;
+        }
+    }
+    if (handle->out == NULL) {
+        if (want < QES_BACKEND_LIBDEFLATE_MINBUF) {
+            want = QES_BACKEND_LIBDEFLATE_MINBUF;
+        }
+        handle->out = qes_malloc_errnil(want);
+        if (handle->out == NULL) {
+            handle->err = ENOMEM;
+            return -1;
+        }
+        handle->out_cap = want;
+    }
+    while (1) {
+        res = libdeflate_gzip_decompress_ex(handle->dec, in, in_left,
+                                            handle->out, handle->out_cap,
+                                            &in_used, &out_used);
+        if (res == LIBDEFLATE_SUCCESS) {
+            break;
+        } else if (res != LIBDEFLATE_INSUFFICIENT_SPACE) {
+            handle->err = -1;
+            return -1;
+        }
+        /* Members don't record their size up front, so guess again */
+        tmp = qes_realloc_errnil(handle->out, handle->out_cap * 2);
+        if (tmp == NULL) {
+            handle->err = ENOMEM;
+            return -1;
+        }
+        handle->out = tmp;
+        handle->out_cap *= 2;
+    }
+    handle->in_pos += in_used;
+    handle->out_len = out_used;
+    return 1;
+}
+
+static ssize_t
+__qes_backend_libdeflate_read (void *vhandle, void *buf, size_t len)
+{
+    struct __qes_backend_libdeflate *handle = vhandle;
+    size_t got = 0;
+    size_t avail = 0;
+    int res = 0;
+
+    if (handle->plain) {
+        avail = handle->in_len - handle->in_pos;
+        got = len < avail ? len : avail;
+        memcpy(buf, handle->in + handle->in_pos, got);
+        handle->in_pos += got;
+        return got;
+    }
+    while (got < len) {
+        if (handle->out_pos == handle->out_len) {
+            /* Members may be empty, e.g. BGZF's EOF marker */
+            res = __qes_backend_libdeflate_inflate(handle);
+            if (res < 0) {
+                return -1;
+            } else if (res == 0) {
+                break;
+            }
+            continue;
+        }
+        avail = handle->out_len - handle->out_pos;
+        if (avail > len - got) {
+            avail = len - got;
+        }
+        memcpy((char *)buf + got, handle->out + handle->out_pos, avail);
+        handle->out_pos += avail;
+        got += avail;
+    }
+    return got;
+}
+
+static int
+__qes_backend_libdeflate_seek (void *vhandle, off_t offset)
+{
+    struct __qes_backend_libdeflate *handle = vhandle;
+    int res = 0;
+
+    if (offset < 0) {
+        handle->err = EINVAL;
+        return -1;
+    }
+    if (handle->plain) {
+        if ((uintmax_t)offset > handle->in_len) {
+            handle->err = EINVAL;
+            return -1;
+        }
+        handle->in_pos = offset;
+        return 0;
+    }
+    if (offset < handle->out_start) {
+        /* Back to the start */
+        handle->in_pos = 0;
+        handle->out_start = 0;
+        handle->out_len = 0;
+        handle->out_pos = 0;
+    }
+    /* And inflate forwards to offset */
+    while (offset > handle->out_start + (off_t)handle->out_len) {
+        res = __qes_backend_libdeflate_inflate(handle);
+        if (res <= 0) {
+            handle->err = res < 0 ? handle->err : EINVAL;
+            return -1;
+        }
+    }
+    handle->out_pos = offset - handle->out_start;
+    return 0;
+}
+
+static const char *
+__qes_backend_libdeflate_error (void *vhandle)
+{
+    struct __qes_backend_libdeflate *handle = vhandle;
+
+    if (handle->err < 0) {
+        return "invalid or corrupt gzip data";
+    }
+    return handle->err != 0 ? strerror(handle->err) : "";
+}
+
+const struct qes_file_backend qes_file_backend_libdeflate = {
+    "libdeflate",
+    __qes_backend_libdeflate_open,
+    __qes_backend_libdeflate_dopen,
+    __qes_backend_libdeflate_read,
+    NULL,
+    __qes_backend_libdeflate_seek,
+    NULL,
+    __qes_backend_libdeflate_close,
+    __qes_backend_libdeflate_error,
+    NULL,
+    NULL,
+};
+#endif /* LIBDEFLATE_FOUND */
+
+
+/*---------------------------------------------------------------------------
+  | Streaming decoders: zstd, bzip2 and xz                                  |
+  ---------------------------------------------------------------------------*/
+
+#if defined(ZSTD_FOUND) || defined(BZIP2_FOUND) || defined(LIBLZMA_FOUND)
+/* Compressed bytes read from the descriptor at once */
+#define QES_BACKEND_DECODE_INBUF_LEN (1<<17)
+
+/* What differs between the decoders */
+struct __qes_backend_codec {
+    void *(*create)(void);
+    /* Decode from ``*in`` to ``*out``, advancing both and decreasing the
+     * lengths. ``in_eof`` is set once ``*in`` holds the last of the input.
+     * Returns 1 at the end of a stream, 0 to go on, or -1 on bad data. */
+    int (*step)(void *state, const unsigned char **in, size_t *in_len,
+                char **out, size_t *out_len, int in_eof);
+    /* Get ready for another stream. Returns 0 on success. */
+    int (*reset)(void *state);
+    void (*destroy)(void *state);
+};
+
+struct __qes_backend_decode {
+    int fd;
+    const struct __qes_backend_codec *codec;
+    void *state;
+    unsigned char *in;
+    size_t in_pos;
+    size_t in_len;
+    int in_eof;
+    /* At the end of a stream, which may be followed by another */
+    int ended;
+    /* errno of the last failure, or -1 for bad data */
+    int err;
+};
+
+static void *
+__qes_backend_decode_dopen (const struct __qes_backend_codec *codec, int fd,
+                            const char *mode)
+{
+    struct __qes_backend_decode *handle = NULL;
+
+    if (mode[0] != 'r' || strchr(mode, '+') != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    handle = qes_calloc_errnil(1, sizeof(*handle));
+    if (handle == NULL) {
+        return NULL;
+    }
+    handle->fd = fd;
+    handle->codec = codec;
+    handle->in = qes_malloc_errnil(QES_BACKEND_DECODE_INBUF_LEN);
+    handle->state = codec->create();
+    if (handle->in == NULL || handle->state == NULL) {
+        if (handle->state != NULL) {
+            codec->destroy(handle->state);
+        }
+        qes_free(handle->in);
+        qes_free(handle);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return handle;
+}
+
+static void *
+__qes_backend_decode_open (const struct __qes_backend_codec *codec,
+                           const char *path, const char *mode)
+{
+    void *handle = NULL;
+    int fd = -1;
+
+    if (mode[0] != 'r' || strchr(mode, '+') != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    handle = __qes_backend_decode_dopen(codec, fd, mode);
+    if (handle == NULL) {
+        close(fd);
+    }
+    return handle;
+}
+
+static ssize_t
+__qes_backend_decode_read (void *vhandle, void *buf, size_t len)
+{
+    struct __qes_backend_decode *handle = vhandle;
+    const unsigned char *in = NULL;
+    size_t in_left = 0;
+    char *out = buf;
+    char *out_before = NULL;
+    size_t out_left = len;
+    ssize_t res = 0;
+
+    while (out_left > 0) {
+        if (handle->in_pos == handle->in_len && !handle->in_eof) {
+            res = read(handle->fd, handle->in, QES_BACKEND_DECODE_INBUF_LEN);
+            if (res < 0 && errno == EINTR) {
+                continue;
+            } else if (res < 0) {
+                handle->err = errno;
+                return -1;
+            }
+            handle->in_pos = 0;
+            handle->in_len = res;
+            handle->in_eof = res == 0;
+        }
+        if (handle->ended) {
+            if (handle->in_pos == handle->in_len) {
+                break;
+            }
+            /* Another stream follows, as from pbzip2 or cat */
+            if (handle->codec->reset(handle->state) != 0) {
+                handle->err = ENOMEM;
+                return -1;
+            }
+            handle->ended = 0;
+        }
+        in = handle->in + handle->in_pos;
+        in_left = handle->in_len - handle->in_pos;
+        out_before = out;
+        res = handle->codec->step(handle->state, &in, &in_left, &out,
+                                  &out_left, handle->in_eof);
+        if (res < 0 || (res == 0 && handle->in_eof && in_left == 0 &&
+                        out == out_before)) {
+            /* Bad data, or a truncated stream */
+            handle->err = -1;
+            return -1;
+        }
+        handle->in_pos = in - handle->in;
+        handle->ended = res == 1;
+    }
+    return len - out_left;
+}
+
+static int
+__qes_backend_decode_seek (void *vhandle, off_t offset)
+{
+    struct __qes_backend_decode *handle = vhandle;
+    char skip[4096];
+    ssize_t res = 0;
+
+    /* Compressed streams can only be rewound, and read forwards again */
+    if (offset < 0 || lseek(handle->fd, 0, SEEK_SET) < 0) {
+        handle->err = offset < 0 ? EINVAL : errno;
+        return -1;
+    }
+    if (handle->codec->reset(handle->state) != 0) {
+        handle->err = ENOMEM;
+        return -1;
+    }
+    handle->in_pos = 0;
+    handle->in_len = 0;
+    handle->in_eof = 0;
+    handle->ended = 0;
+    while (offset > 0) {
+        res = __qes_backend_decode_read(handle, skip,
+                offset < (off_t)sizeof(skip) ? (size_t)offset : sizeof(skip));
+        if (res <= 0) {
+            handle->err = res < 0 ? handle->err : EINVAL;
+            return -1;
+        }
+        offset -= res;
+    }
+    return 0;
+}
+
+static int
+__qes_backend_decode_close (void *vhandle)
+{
+    struct __qes_backend_decode *handle = vhandle;
+    int res = close(handle->fd);
+
+    handle->codec->destroy(handle->state);
+    qes_free(handle->in);
+    qes_free(handle);
+    return res;
+}
+
+static const char *
+__qes_backend_decode_error (void *vhandle)
+{
+    struct __qes_backend_decode *handle = vhandle;
+
+    if (handle->err < 0) {
+        return "invalid or truncated compressed data";
+    }
+    return handle->err != 0 ? strerror(handle->err) : "";
+}
+
+/* Define the backend ``name`` decoding with ``codec`` */
+#define QES_BACKEND_DECODER(name, codec)                                    \
+    static void *                                                           \
+    __qes_backend_##name##_open (const char *path, const char *mode,        \
+                                 void *arg)                                 \
+    {                                                                       \
+        (void) arg;                                                         \
+        return __qes_backend_decode_open(&codec, path, mode);               \
+    }                                                                       \
+    static void *                                                           \
+    __qes_backend_##name##_dopen (int fd, const char *mode, void *arg)      \
+    {                                                                       \
+        (void) arg;                                                         \
+        return __qes_backend_decode_dopen(&codec, fd, mode);                \
+    }                                                                       \
+    const struct qes_file_backend qes_file_backend_##name = {               \
+        #name,                                                              \
+        __qes_backend_##name##_open,                                        \
+        __qes_backend_##name##_dopen,                                       \
+        __qes_backend_decode_read,                                          \
+        NULL,                                                               \
+        __qes_backend_decode_seek,                                          \
+        NULL,                                                               \
+        __qes_backend_decode_close,                                         \
+        __qes_backend_decode_error,                                         \
+        NULL,                                                               \
+        NULL,                                                               \
+    };
+#endif
+
+#ifdef ZSTD_FOUND
+struct __qes_codec_zstd {
+    ZSTD_DStream *dstream;
+    /* Whether the last frame was finished */
+    int done;
+};
+
+static void *
+__qes_codec_zstd_create (void)
+{
+    struct __qes_codec_zstd *zstd = qes_calloc_errnil(1, sizeof(*zstd));
+
+    if (zstd == NULL) {
+        return NULL;
+    }
+    zstd->dstream = ZSTD_createDStream();
+    if (zstd->dstream == NULL ||
+            ZSTD_isError(ZSTD_initDStream(zstd->dstream))) {
+        ZSTD_freeDStream(zstd->dstream);
+        qes_free(zstd);
+        return NULL;
+    }
+    zstd->done = 1;
+    return zstd;
+}
+
+static int
+__qes_codec_zstd_step (void *state, const unsigned char **in, size_t *in_len,
+                       char **out, size_t *out_len, int in_eof)
+{
+    struct __qes_codec_zstd *zstd = state;
+    ZSTD_inBuffer ibuf = {*in, *in_len, 0};
+    ZSTD_outBuffer obuf = {*out, *out_len, 0};
+    size_t res = 0;
+
+    if (*in_len == 0 && zstd->done) {
+        /* Nothing left to flush */
+        return in_eof ? 1 : 0;
+    }
+    /* Frames follow one another without needing a reset */
+    res = ZSTD_decompressStream(zstd->dstream, &obuf, &ibuf);
+    if (ZSTD_isError(res)) {
+        return -1;
+    }
+    zstd->done = res == 0;
+    *in += ibuf.pos;
+    *in_len -= ibuf.pos;
+    *out += obuf.pos;
+    *out_len -= obuf.pos;
+    return in_eof && *in_len == 0 && zstd->done ? 1 : 0;
+}
+
+static int
+__qes_codec_zstd_reset (void *state)
+{
+    struct __qes_codec_zstd *zstd = state;
+
+    zstd->done = 1;
+    return ZSTD_isError(ZSTD_initDStream(zstd->dstream)) ? -1 : 0;
+}
+
+static void
+__qes_codec_zstd_destroy (void *state)
+{
+    struct __qes_codec_zstd *zstd = state;
+
+    ZSTD_freeDStream(zstd->dstream);
+    qes_free(zstd);
+}
+
+static const struct __qes_backend_codec __qes_codec_zstd = {
+    __qes_codec_zstd_create,
+    __qes_codec_zstd_step,
+    __qes_codec_zstd_reset,
+    __qes_codec_zstd_destroy,
+};
+
+QES_BACKEND_DECODER(zstd, __qes_codec_zstd)
+#endif /* ZSTD_FOUND */
+
+#ifdef BZIP2_FOUND
+static void *
+__qes_codec_bzip2_create (void)
+{
+    bz_stream *bz = qes_calloc_errnil(1, sizeof(*bz));
+
+    if (bz != NULL && BZ2_bzDecompressInit(bz, 0, 0) != BZ_OK) {
+        qes_free(bz);
+    }
+    return bz;
+}
+
+static int
+__qes_codec_bzip2_step (void *state, const unsigned char **in,
+                        size_t *in_len, char **out, size_t *out_len,
+                        int in_eof)
+{
+    bz_stream *bz = state;
+    unsigned int in_avail = *in_len > UINT_MAX ? UINT_MAX : *in_len;
+    unsigned int out_avail = *out_len > UINT_MAX ? UINT_MAX : *out_len;
+    int res = 0;
+
+    (void) in_eof;
+    bz->next_in = (char *)*in;
+    bz->avail_in = in_avail;
+    bz->next_out = *out;
+    bz->avail_out = out_avail;
+    res = BZ2_bzDecompress(bz);
+    *in += in_avail - bz->avail_in;
+    *in_len -= in_avail - bz->avail_in;
+    *out += out_avail - bz->avail_out;
+    *out_len -= out_avail - bz->avail_out;
+    if (res == BZ_STREAM_END) {
+        return 1;
+    }
+    return res == BZ_OK ? 0 : -1;
+}
+
+static int
+__qes_codec_bzip2_reset (void *state)
+{
+    bz_stream *bz = state;
+
+    BZ2_bzDecompressEnd(bz);
+    memset(bz, 0, sizeof(*bz));
+    return BZ2_bzDecompressInit(bz, 0, 0) == BZ_OK ? 0 : -1;
+}
+
+static void
+__qes_codec_bzip2_destroy (void *state)
+{
+    BZ2_bzDecompressEnd(state);
+    qes_free(state);
+}
+
+static const struct __qes_backend_codec __qes_codec_bzip2 = {
+    __qes_codec_bzip2_create,
+    __qes_codec_bzip2_step,
+    __qes_codec_bzip2_reset,
+    __qes_codec_bzip2_destroy,
+};
+
+QES_BACKEND_DECODER(bzip2, __qes_codec_bzip2)
+#endif /* BZIP2_FOUND */
+
+#ifdef LIBLZMA_FOUND
+static int
+__qes_codec_xz_reset (void *state)
+{
+    lzma_stream *xz = state;
+    const lzma_stream init = LZMA_STREAM_INIT;
+
+    lzma_end(xz);
+    *xz = init;
+    /* Concatenated streams are decoded as one */
+    return lzma_stream_decoder(xz, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK
+           ? 0 : -1;
+}
+
+static void *
+__qes_codec_xz_create (void)
+{
+    lzma_stream *xz = qes_calloc_errnil(1, sizeof(*xz));
+    const lzma_stream init = LZMA_STREAM_INIT;
+
+    if (xz == NULL) {
+        return NULL;
+    }
+    *xz = init;
+    if (__qes_codec_xz_reset(xz) != 0) {
+        lzma_end(xz);
+        qes_free(xz);
+    }
+    return xz;
+}
+
+static int
+__qes_codec_xz_step (void *state, const unsigned char **in, size_t *in_len,
+                     char **out, size_t *out_len, int in_eof)
+{
+    lzma_stream *xz = state;
+    lzma_ret res;
+
+    xz->next_in = *in;
+    xz->avail_in = *in_len;
+    xz->next_out = (uint8_t *)*out;
+    xz->avail_out = *out_len;
+    res = lzma_code(xz, in_eof ? LZMA_FINISH : LZMA_RUN);
+    *in += *in_len - xz->avail_in;
+    *in_len = xz->avail_in;
+    *out += *out_len - xz->avail_out;
+    *out_len = xz->avail_out;
+    if (res == LZMA_STREAM_END) {
+        return 1;
+    }
+    return res == LZMA_OK ? 0 : -1;
+}
+
+static void
+__qes_codec_xz_destroy (void *state)
+{
+    lzma_end(state);
+    qes_free(state);
+}
+
+static const struct __qes_backend_codec __qes_codec_xz = {
+    __qes_codec_xz_create,
+    __qes_codec_xz_step,
+    __qes_codec_xz_reset,
+    __qes_codec_xz_destroy,
+};
+
+QES_BACKEND_DECODER(xz, __qes_codec_xz)
+#endif /* LIBLZMA_FOUND */
+
+const struct qes_file_backend *
+qes_file_backend_sniff (const unsigned char *buf, size_t len)
+{
+#ifdef ZSTD_FOUND
+    const unsigned char zstd[] = {0x28, 0xb5, 0x2f, 0xfd};
+#endif
+#ifdef LIBLZMA_FOUND
+    const unsigned char xz[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+#endif
+
+    if (buf == NULL) {
+        return NULL;
+    }
+#ifdef ZSTD_FOUND
+    if (len >= sizeof(zstd) && memcmp(buf, zstd, sizeof(zstd)) == 0) {
+        return &qes_file_backend_zstd;
+    }
+#endif
+#ifdef BZIP2_FOUND
+    /* "BZh" and the block size, 1-9 */
+    if (len >= 4 && memcmp(buf, "BZh", 3) == 0 && buf[3] >= '1' &&
+            buf[3] <= '9') {
+        return &qes_file_backend_bzip2;
+    }
+#endif
+#ifdef LIBLZMA_FOUND
+    if (len >= sizeof(xz) && memcmp(buf, xz, sizeof(xz)) == 0) {
+        return &qes_file_backend_xz;
+    }
+#endif
+    (void) len;
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------------
+  | mmap backend                                                            |
+  ---------------------------------------------------------------------------*/
+
+#ifdef MMAP_FOUND
+struct __qes_backend_mmap {
+    int fd;
+    char *map;
+    size_t len;
+    /* Read position, for callers that copy out with read */
+    size_t pos;
+};
+
+static void *
+__qes_backend_mmap_dopen (int fd, const char *mode, void *arg)
+{
+    struct __qes_backend_mmap *handle = NULL;
+    struct stat st;
+    void *map = NULL;
+
+    (void) arg;
+    if (mode[0] != 'r' || strchr(mode, '+') != NULL) {
+        /* Maps are read-only */
+        errno = EINVAL;
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode) || (uintmax_t)st.st_size > SIZE_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    handle = qes_calloc_errnil(1, sizeof(*handle));
+    if (handle == NULL) {
+        return NULL;
+    }
+    /* Empty files can't be mapped, but are still valid */
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            qes_free(handle);
+            return NULL;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        handle->map = map;
+        handle->len = st.st_size;
+    }
+    /* Kept for hints such as readahead, though the map doesn't need it */
+    handle->fd = fd;
+    return handle;
+}
+
+static void *
+__qes_backend_mmap_open (const char *path, const char *mode, void *arg)
+{
+    void *handle = NULL;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    handle = __qes_backend_mmap_dopen(fd, mode, arg);
+    if (handle == NULL) {
+        close(fd);
+    }
+    return handle;
+}
+
+static ssize_t
+__qes_backend_mmap_read (void *vhandle, void *buf, size_t len)
+{
+    struct __qes_backend_mmap *handle = vhandle;
+
+    if (len > handle->len - handle->pos) {
+        len = handle->len - handle->pos;
+    }
+    if (len > 0) {
+        memcpy(buf, handle->map + handle->pos, len);
+    }
+    handle->pos += len;
+    return len;
+}
+
+static int
+__qes_backend_mmap_seek (void *vhandle, off_t offset)
+{
+    struct __qes_backend_mmap *handle = vhandle;
+
+    if (offset < 0 || (uintmax_t)offset > handle->len) {
+        return -1;
+    }
+    handle->pos = offset;
+    return 0;
+}
+
+static int
+__qes_backend_mmap_close (void *vhandle)
+{
+    struct __qes_backend_mmap *handle = vhandle;
+    int res = 0;
+
+    if (handle->map != NULL) {
+        res = munmap(handle->map, handle->len);
+    }
+    if (close(handle->fd) != 0) {
+        res = -1;
+    }
+    qes_free(handle);
+    return res;
+}
+
+static const char *
+__qes_backend_mmap_map (void *vhandle, size_t *len)
+{
+    struct __qes_backend_mmap *handle = vhandle;
+
+    *len = handle->len;
+    return handle->map;
+}
+
+const struct qes_file_backend qes_file_backend_mmap = {
+    "mmap",
+    __qes_backend_mmap_open,
+    __qes_backend_mmap_dopen,
+    __qes_backend_mmap_read,
+    NULL,
+    __qes_backend_mmap_seek,
+    NULL,
+    __qes_backend_mmap_close,
+    NULL,
+    NULL,
+    __qes_backend_mmap_map,
+};
+#endif /* MMAP_FOUND */
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_backend.h
+ *
+ *    Description:  Streams that a struct qes_file can read from and write to
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_BACKEND_H
+#define QES_BACKEND_H
+
+#include <qes_util.h>
+
+/* The stream under a struct qes_file. A backend opens a handle, which is
+ * passed to the other functions. Reads and writes must be complete, i.e. a
+ * read shorter than asked for means EOF or an error, as with fread. Members
+ * marked optional may be NULL. Users may supply their own backend (e.g. to
+ * read from memory or a socket) in struct qes_file_opts. */
+struct qes_file_backend {
+    const char *name;
+    /* Open ``path`` with ``mode`` (as for fopen, though backends may ignore
+     * anything after the first character). ``arg`` is passed through from
+     * struct qes_file_opts. Returns a handle, or NULL with errno set. */
+    void *(*open)(const char *path, const char *mode, void *arg);
+    /* Optional. As for open, but taking ownership of the open descriptor
+     * ``fd`` on success, so that close closes it. Used for "-" (stdin and
+     * stdout), and to give the kernel hints. */
+    void *(*dopen)(int fd, const char *mode, void *arg);
+    /* Returns the number of bytes read, 0 at EOF, or -1 on error */
+    ssize_t (*read)(void *handle, void *buf, size_t len);
+    /* Optional for read-only backends. Returns ``len``, or -1 on error. */
+    ssize_t (*write)(void *handle, const void *buf, size_t len);
+    /* Optional. Seek to ``offset`` bytes from the start (of the
+     * uncompressed stream). Returns 0 on success. */
+    int (*seek)(void *handle, off_t offset);
+    /* Optional. Returns 0 on success. */
+    int (*flush)(void *handle);
+    /* Close and free ``handle``. Returns 0 on success. */
+    int (*close)(void *handle);
+    /* Optional. Describe the last error, never returning NULL. */
+    const char *(*error)(void *handle);
+    /* Optional. Set the size of the backend's own buffer. Must be called
+     * before any IO. Returns 0 on success. */
+    int (*buffer)(void *handle, size_t len);
+    /* Optional. If the whole stream is in memory, return it and set ``*len``,
+     * so that it's read in place rather than copied. NULL otherwise. */
+    const char *(*map)(void *handle, size_t *len);
+};
+
+/* Plain descriptors, with read(2) and write(2). No decompression, but no
+ * library overhead either. */
+extern const struct qes_file_backend qes_file_backend_fd;
+/* stdio FILE streams */
+extern const struct qes_file_backend qes_file_backend_stdio;
+#ifdef ZLIB_FOUND
+/* zlib's gzFile streams, which decompress transparently */
+extern const struct qes_file_backend qes_file_backend_zlib;
+#endif
+#ifdef LIBDEFLATE_FOUND
+/* Read-only gzip, inflated a whole member at a time with libdeflate. Much
+ * faster than zlib, but the compressed file is mapped (or read) whole, and
+ * each member is inflated into memory, which for most gzip files means the
+ * whole uncompressed file. Like zlib, passes through non-gzip input. Used by
+ * default for gzip files that aren't BGZF. */
+extern const struct qes_file_backend qes_file_backend_libdeflate;
+#endif
+/* Read-only decoders for other compressed formats, which qes_file_open picks
+ * by their magic bytes. Concatenated streams are read as one. */
+#ifdef ZSTD_FOUND
+extern const struct qes_file_backend qes_file_backend_zstd;
+#endif
+#ifdef BZIP2_FOUND
+extern const struct qes_file_backend qes_file_backend_bzip2;
+#endif
+#ifdef LIBLZMA_FOUND
+extern const struct qes_file_backend qes_file_backend_xz;
+#endif
+#ifdef MMAP_FOUND
+/* Read-only memory maps of whole files, read in place */
+extern const struct qes_file_backend qes_file_backend_mmap;
+#endif
+
+/* The backend used if none is given: zlib if we have it, else stdio. Its
+ * handles are QES_ZTYPE, and are also available as qes_file.fp. Gzip files
+ * are read with qes_file_backend_libdeflate instead, if we have it. */
+#ifdef ZLIB_FOUND
+#   define QES_FILE_BACKEND_DEFAULT (&qes_file_backend_zlib)
+#else
+#   define QES_FILE_BACKEND_DEFAULT (&qes_file_backend_stdio)
+#endif
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_backend_sniff
+Parameters:     const unsigned char *buf: The first bytes of a file.
+                size_t len: Length of ``buf``. 6 bytes is enough.
+Description:    Find the decoder for a file from its magic bytes.
+Returns:        const struct qes_file_backend *: The zstd, bzip2 or xz
+                backend, or NULL if the default backend will do (e.g. for
+                gzip or uncompressed files), or libqes was built without the
+                decoder needed.
+ *===========================================================================*/
+const struct qes_file_backend *qes_file_backend_sniff(
+                                const unsigned char    *buf,
+                                size_t                  len);
+
+#endif /* QES_BACKEND_H */
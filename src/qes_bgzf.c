@@ -0,0 +1,590 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_bgzf.c
+ *
+ *    Description:  Block-gzip (BGZF) IO, with blocks (de)compressed in
+ *                  parallel.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_bgzf.h"
+
+#ifdef ZLIB_FOUND
+#include <zlib.h>
+#ifdef OPENMP_FOUND
+#   include <omp.h>
+#endif
+
+/* Fixed part of the gzip header, up to and including XLEN */
+#define BGZF_HDR_LEN 12
+/* CRC32 and ISIZE */
+#define BGZF_FTR_LEN 8
+
+struct qes_bgzf {
+    int fd;
+    int threads;
+    /* Number of blocks per batch, and the number in the current batch */
+    size_t max_blocks;
+    size_t n_blocks;
+    /* Raw blocks, one per QES_BGZF_BLOCK_LEN slot */
+    unsigned char *cdata;
+    /* Per-block offset & length of the deflate stream in cdata, expected
+     * CRC, and offset & length of the decompressed data in udata */
+    size_t *coff;
+    size_t *clen;
+    uint32_t *crc;
+    size_t *uoff;
+    size_t *ulen;
+    /* Decompressed blocks, contiguous */
+    char *udata;
+    int eof;
+    int error;
+    /* Writers collect ``wlen`` bytes in udata until it holds a batch */
+    int writing;
+    int level;
+    size_t wlen;
+};
+
+/* Header of a BGZF block, with the BSIZE field left as zero */
+static const unsigned char bgzf_header[] = {
+    31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 0, 0
+};
+#define BGZF_BLOCK_HDR_LEN (sizeof(bgzf_header))
+
+/* Empty block which marks the end of a BGZF file */
+static const unsigned char bgzf_eof_block[] = {
+    31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 27, 0, 3, 0,
+    0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static inline uint32_t
+__le32 (const unsigned char *buf)
+{
+    return (uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+           (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+static inline size_t
+__le16 (const unsigned char *buf)
+{
+    return (size_t)buf[0] | (size_t)buf[1] << 8;
+}
+
+static inline void
+__put_le32 (unsigned char *buf, uint32_t val)
+{
+    buf[0] = val & 0xff;
+    buf[1] = (val >> 8) & 0xff;
+    buf[2] = (val >> 16) & 0xff;
+    buf[3] = (val >> 24) & 0xff;
+}
+
+/* write(2) all of ``len`` bytes. Returns 0 on success. */
+static int
+__write_full (int fd, const void *buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t res = 0;
+
+    while (done < len) {
+        res = write(fd, (const char *)buf + done, len - done);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        } else if (res <= 0) {
+            return -1;
+        }
+        done += res;
+    }
+    return 0;
+}
+
+/* read(2) until we have ``len`` bytes, EOF or an error */
+static ssize_t
+__read_full (int fd, void *buf, size_t len)
+{
+    size_t got = 0;
+    ssize_t res = 0;
+
+    while (got < len) {
+        res = read(fd, (char *)buf + got, len - got);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        } else if (res < 0) {
+            return -1;
+        } else if (res == 0) {
+            break;
+        }
+        got += res;
+    }
+    return got;
+}
+
+int
+qes_bgzf_sniff (int fd)
+{
+    unsigned char hdr[BGZF_HDR_LEN + 6];
+
+    if (pread(fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        return 0;
+    }
+    return hdr[0] == 31 && hdr[1] == 139 && hdr[2] == 8 && (hdr[3] & 4) &&
+           __le16(hdr + 10) >= 6 && hdr[12] == 'B' && hdr[13] == 'C' &&
+           __le16(hdr + 14) == 2;
+}
+
+/* Read the block at the current offset into slot ``idx``. Returns 1 if a
+ * block was read, 0 at EOF, or -1 on error. */
+static int
+__qes_bgzf_read_block (struct qes_bgzf *bgzf, size_t idx)
+{
+    unsigned char *block = bgzf->cdata + idx * QES_BGZF_BLOCK_LEN;
+    ssize_t res = 0;
+    size_t xlen = 0;
+    size_t bsize = 0;
+    size_t pos = 0;
+    size_t rest = 0;
+
+    res = __read_full(bgzf->fd, block, BGZF_HDR_LEN);
+    if (res == 0) {
+        return 0;
+    } else if (res != BGZF_HDR_LEN) {
+        return -1;
+    }
+    if (block[0] != 31 || block[1] != 139 || block[2] != 8 ||
+            !(block[3] & 4)) {
+        return -1;
+    }
+    xlen = __le16(block + 10);
+    if (BGZF_HDR_LEN + xlen + BGZF_FTR_LEN > QES_BGZF_BLOCK_LEN ||
+            __read_full(bgzf->fd, block + BGZF_HDR_LEN, xlen) != (ssize_t)xlen) {
+        return -1;
+    }
+    /* Find the BC subfield, which holds the block size */
+    pos = BGZF_HDR_LEN;
+    while (pos + 4 <= BGZF_HDR_LEN + xlen) {
+        size_t slen = __le16(block + pos + 2);
+        if (block[pos] == 'B' && block[pos + 1] == 'C' && slen == 2 &&
+                pos + 6 <= BGZF_HDR_LEN + xlen) {
+            bsize = __le16(block + pos + 4) + 1;
+            break;
+        }
+        pos += 4 + slen;
+    }
+    if (bsize < BGZF_HDR_LEN + xlen + BGZF_FTR_LEN ||
+            bsize > QES_BGZF_BLOCK_LEN) {
+        return -1;
+    }
+    rest = bsize - BGZF_HDR_LEN - xlen;
+    if (__read_full(bgzf->fd, block + BGZF_HDR_LEN + xlen, rest) !=
+            (ssize_t)rest) {
+        return -1;
+    }
+    bgzf->coff[idx] = idx * QES_BGZF_BLOCK_LEN + BGZF_HDR_LEN + xlen;
+    bgzf->clen[idx] = rest - BGZF_FTR_LEN;
+    bgzf->crc[idx] = __le32(block + bsize - BGZF_FTR_LEN);
+    bgzf->ulen[idx] = __le32(block + bsize - BGZF_FTR_LEN + 4);
+    if (bgzf->ulen[idx] > QES_BGZF_BLOCK_LEN) {
+        return -1;
+    }
+    return 1;
+}
+
+/* Inflate slot ``idx`` into its place in udata. Returns 0 on success. This
+ * only touches the slot's own data, so is safe to run in parallel. */
+static int
+__qes_bgzf_inflate_block (struct qes_bgzf *bgzf, size_t idx)
+{
+    z_stream zs;
+    unsigned char *out = (unsigned char *)bgzf->udata + bgzf->uoff[idx];
+    int ret = 0;
+
+    /* Empty blocks, e.g. the EOF marker, have nothing to inflate */
+    if (bgzf->ulen[idx] == 0) {
+        return 0;
+    }
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        return -1;
+    }
+    zs.next_in = bgzf->cdata + bgzf->coff[idx];
+    zs.avail_in = bgzf->clen[idx];
+    zs.next_out = out;
+    zs.avail_out = bgzf->ulen[idx];
+    ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END || zs.total_out != bgzf->ulen[idx]) {
+        return -1;
+    }
+    if (crc32(0L, out, bgzf->ulen[idx]) != bgzf->crc[idx]) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Allocate a reader or writer. On failure, ``fd`` is left open. */
+static struct qes_bgzf *
+__qes_bgzf_create (int fd, int threads)
+{
+    struct qes_bgzf *bgzf = NULL;
+    size_t nblk = 0;
+
+    if (fd < 0) {
+        return NULL;
+    }
+#ifdef OPENMP_FOUND
+    if (threads < 1) {
+        threads = omp_get_max_threads();
+    }
+#endif
+    if (threads < 1) {
+        threads = 1;
+    }
+    bgzf = qes_calloc_errnil(1, sizeof(*bgzf));
+    if (bgzf == NULL) {
+        return NULL;
+    }
+    bgzf->fd = fd;
+    bgzf->threads = threads;
+    nblk = bgzf->max_blocks = threads * QES_BGZF_BLOCKS_PER_THREAD;
+    bgzf->cdata = qes_malloc_errnil(nblk * QES_BGZF_BLOCK_LEN);
+    bgzf->udata = qes_malloc_errnil(nblk * QES_BGZF_BLOCK_LEN + 1);
+    bgzf->coff = qes_calloc_errnil(nblk, sizeof(*bgzf->coff));
+    bgzf->clen = qes_calloc_errnil(nblk, sizeof(*bgzf->clen));
+    bgzf->crc = qes_calloc_errnil(nblk, sizeof(*bgzf->crc));
+    bgzf->uoff = qes_calloc_errnil(nblk, sizeof(*bgzf->uoff));
+    bgzf->ulen = qes_calloc_errnil(nblk, sizeof(*bgzf->ulen));
+    if (bgzf->cdata == NULL || bgzf->udata == NULL || bgzf->coff == NULL ||
+            bgzf->clen == NULL || bgzf->crc == NULL || bgzf->uoff == NULL ||
+            bgzf->ulen == NULL) {
+        bgzf->fd = -1;
+        qes_bgzf_close(bgzf);
+        return NULL;
+    }
+    bgzf->udata[0] = '\0';
+    return bgzf;
+}
+
+struct qes_bgzf *
+qes_bgzf_open_read (int fd, int threads)
+{
+    return __qes_bgzf_create(fd, threads);
+}
+
+struct qes_bgzf *
+qes_bgzf_open_write (int fd, int threads, int level)
+{
+    struct qes_bgzf *bgzf = NULL;
+
+    if (level < 0 || level > 9) {
+        return NULL;
+    }
+    bgzf = __qes_bgzf_create(fd, threads);
+    if (bgzf == NULL) {
+        return NULL;
+    }
+    bgzf->writing = 1;
+    bgzf->level = level == 0 ? Z_DEFAULT_COMPRESSION : level;
+    return bgzf;
+}
+
+ssize_t
+qes_bgzf_read_batch (struct qes_bgzf *bgzf, char **data)
+{
+    size_t total = 0;
+    long iii = 0;
+    int failed = 0;
+    int res = 0;
+
+    if (bgzf == NULL || data == NULL || bgzf->writing || bgzf->error) {
+        return -1;
+    }
+    /* Loop until we get some data, skipping batches of empty blocks */
+    do {
+        bgzf->n_blocks = 0;
+        total = 0;
+        /* Reading is serial, but cheap */
+        while (bgzf->n_blocks < bgzf->max_blocks && !bgzf->eof) {
+            res = __qes_bgzf_read_block(bgzf, bgzf->n_blocks);
+            if (res == 0) {
+                bgzf->eof = 1;
+            } else if (res < 0) {
+                bgzf->error = 1;
+                return -1;
+            } else {
+                bgzf->uoff[bgzf->n_blocks] = total;
+                total += bgzf->ulen[bgzf->n_blocks];
+                bgzf->n_blocks++;
+            }
+        }
+        /* The ISIZE footers tell us where each block goes, so they can be
+         * inflated independently and straight into place. */
+#ifdef OPENMP_FOUND
+        #pragma omp parallel for num_threads(bgzf->threads) \
+            schedule(dynamic) reduction(|:failed)
+#endif
+        for (iii = 0; iii < (long)bgzf->n_blocks; iii++) {
+            failed |= __qes_bgzf_inflate_block(bgzf, iii) != 0;
+        }
+        if (failed) {
+            bgzf->error = 1;
+            return -1;
+        }
+    } while (total == 0 && !bgzf->eof);
+    bgzf->udata[total] = '\0';
+    *data = bgzf->udata;
+    return total;
+}
+
+/* Compress the ``idx``th block of pending data into slot ``idx`` of cdata,
+ * as a complete BGZF block. Returns 0 on success. Like inflation, this only
+ * touches the slot's own data. */
+static int
+__qes_bgzf_deflate_block (struct qes_bgzf *bgzf, size_t idx)
+{
+    z_stream zs;
+    unsigned char *block = bgzf->cdata + idx * QES_BGZF_BLOCK_LEN;
+    unsigned char *in = (unsigned char *)bgzf->udata +
+                        idx * QES_BGZF_WRITE_BLOCK_LEN;
+    size_t len = bgzf->wlen - idx * QES_BGZF_WRITE_BLOCK_LEN;
+    size_t bsize = 0;
+    int ret = 0;
+
+    if (len > QES_BGZF_WRITE_BLOCK_LEN) {
+        len = QES_BGZF_WRITE_BLOCK_LEN;
+    }
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, bgzf->level, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+    zs.next_in = in;
+    zs.avail_in = len;
+    zs.next_out = block + BGZF_BLOCK_HDR_LEN;
+    zs.avail_out = QES_BGZF_BLOCK_LEN - BGZF_BLOCK_HDR_LEN - BGZF_FTR_LEN;
+    ret = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        return -1;
+    }
+    bsize = BGZF_BLOCK_HDR_LEN + zs.total_out + BGZF_FTR_LEN;
+    memcpy(block, bgzf_header, BGZF_BLOCK_HDR_LEN);
+    block[16] = (bsize - 1) & 0xff;
+    block[17] = ((bsize - 1) >> 8) & 0xff;
+    __put_le32(block + bsize - BGZF_FTR_LEN, crc32(0L, in, len));
+    __put_le32(block + bsize - BGZF_FTR_LEN + 4, len);
+    bgzf->clen[idx] = bsize;
+    return 0;
+}
+
+/* Compress all pending data in parallel, and write the blocks in order */
+static int
+__qes_bgzf_write_batch (struct qes_bgzf *bgzf)
+{
+    size_t n_blocks = 0;
+    size_t iii = 0;
+    long jjj = 0;
+    int failed = 0;
+
+    n_blocks = (bgzf->wlen + QES_BGZF_WRITE_BLOCK_LEN - 1) /
+               QES_BGZF_WRITE_BLOCK_LEN;
+#ifdef OPENMP_FOUND
+    #pragma omp parallel for num_threads(bgzf->threads) \
+        schedule(dynamic) reduction(|:failed)
+#endif
+    for (jjj = 0; jjj < (long)n_blocks; jjj++) {
+        failed |= __qes_bgzf_deflate_block(bgzf, jjj) != 0;
+    }
+    for (iii = 0; iii < n_blocks && !failed; iii++) {
+        failed = __write_full(bgzf->fd, bgzf->cdata + iii * QES_BGZF_BLOCK_LEN,
+                              bgzf->clen[iii]) != 0;
+    }
+    bgzf->wlen = 0;
+    if (failed) {
+        bgzf->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t
+qes_bgzf_write (struct qes_bgzf *bgzf, const void *data, size_t len)
+{
+    size_t batch_len = 0;
+    size_t done = 0;
+    size_t room = 0;
+
+    if (bgzf == NULL || data == NULL || !bgzf->writing || bgzf->error) {
+        return -1;
+    }
+    batch_len = bgzf->max_blocks * QES_BGZF_WRITE_BLOCK_LEN;
+    while (done < len) {
+        if (bgzf->wlen == batch_len && __qes_bgzf_write_batch(bgzf) != 0) {
+            return -1;
+        }
+        room = batch_len - bgzf->wlen;
+        if (room > len - done) {
+            room = len - done;
+        }
+        memcpy(bgzf->udata + bgzf->wlen, (const char *)data + done, room);
+        bgzf->wlen += room;
+        done += room;
+    }
+    return len;
+}
+
+int
+qes_bgzf_flush (struct qes_bgzf *bgzf)
+{
+    if (bgzf == NULL || !bgzf->writing || bgzf->error) {
+        return -1;
+    }
+    if (bgzf->wlen == 0) {
+        return 0;
+    }
+    return __qes_bgzf_write_batch(bgzf);
+}
+
+char *
+qes_bgzf_buffer (struct qes_bgzf *bgzf)
+{
+    return bgzf == NULL ? NULL : bgzf->udata;
+}
+
+int
+qes_bgzf_eof (const struct qes_bgzf *bgzf)
+{
+    return bgzf == NULL || bgzf->eof;
+}
+
+int
+qes_bgzf_rewind (struct qes_bgzf *bgzf)
+{
+    if (bgzf == NULL || bgzf->writing || lseek(bgzf->fd, 0, SEEK_SET) != 0) {
+        return -1;
+    }
+    bgzf->eof = 0;
+    bgzf->error = 0;
+    bgzf->n_blocks = 0;
+    return 0;
+}
+
+void
+qes_bgzf_close_ (struct qes_bgzf *bgzf)
+{
+    if (bgzf != NULL) {
+        if (bgzf->writing && qes_bgzf_flush(bgzf) == 0) {
+            __write_full(bgzf->fd, bgzf_eof_block, sizeof(bgzf_eof_block));
+        }
+        if (bgzf->fd >= 0) {
+            close(bgzf->fd);
+        }
+        qes_free(bgzf->cdata);
+        qes_free(bgzf->udata);
+        qes_free(bgzf->coff);
+        qes_free(bgzf->clen);
+        qes_free(bgzf->crc);
+        qes_free(bgzf->uoff);
+        qes_free(bgzf->ulen);
+        qes_free(bgzf);
+    }
+}
+
+#else /* ZLIB_FOUND */
+
+/* Without zlib, nothing is BGZF */
+int
+qes_bgzf_sniff (int fd)
+{
+    (void) fd;
+    return 0;
+}
+
+struct qes_bgzf *
+qes_bgzf_open_read (int fd, int threads)
+{
+    (void) fd;
+    (void) threads;
+    return NULL;
+}
+
+struct qes_bgzf *
+qes_bgzf_open_write (int fd, int threads, int level)
+{
+    (void) fd;
+    (void) threads;
+    (void) level;
+    return NULL;
+}
+
+ssize_t
+qes_bgzf_read_batch (struct qes_bgzf *bgzf, char **data)
+{
+    (void) bgzf;
+    (void) data;
+    return -1;
+}
+
+ssize_t
+qes_bgzf_write (struct qes_bgzf *bgzf, const void *data, size_t len)
+{
+    (void) bgzf;
+    (void) data;
+    (void) len;
+    return -1;
+}
+
+int
+qes_bgzf_flush (struct qes_bgzf *bgzf)
+{
+    (void) bgzf;
+    return -1;
+}
+
+char *
+qes_bgzf_buffer (struct qes_bgzf *bgzf)
+{
+    (void) bgzf;
+    return NULL;
+}
+
+int
+qes_bgzf_eof (const struct qes_bgzf *bgzf)
+{
+    (void) bgzf;
+    return 1;
+}
+
+int
+qes_bgzf_rewind (struct qes_bgzf *bgzf)
+{
+    (void) bgzf;
+    return -1;
+}
+
+void
+qes_bgzf_close_ (struct qes_bgzf *bgzf)
+{
+    (void) bgzf;
+}
+
+#endif /* ZLIB_FOUND */
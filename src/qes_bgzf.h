@@ -0,0 +1,135 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_bgzf.h
+ *
+ *    Description:  Block-gzip (BGZF) IO, with blocks (de)compressed in
+ *                  parallel.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_BGZF_H
+#define QES_BGZF_H
+
+#include <qes_util.h>
+
+/* Maximum size of a BGZF block, compressed or not */
+#define QES_BGZF_BLOCK_LEN (65536)
+/* Uncompressed data per block when writing. This leaves room for the
+ * header, footer and deflate's worst-case expansion within one block. */
+#define QES_BGZF_WRITE_BLOCK_LEN (0xff00)
+/* Number of blocks handled per thread in each batch */
+#define QES_BGZF_BLOCKS_PER_THREAD (4)
+
+struct qes_bgzf;
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_bgzf_sniff
+Parameters:     int fd: Open file descriptor.
+Description:    Checks if the file open as ``fd`` starts with a BGZF block
+                header. The file offset of ``fd`` is not changed.
+Returns:        1 if ``fd`` is a BGZF file, otherwise 0.
+ *===========================================================================*/
+int qes_bgzf_sniff             (int                     fd);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_bgzf_open_read
+Parameters:     int fd: File descriptor to read BGZF blocks from. This is owned
+                    by the returned object, and is closed by qes_bgzf_close.
+                    On failure, it is left open.
+                int threads: Number of threads to decompress with, or 0 for
+                    OpenMP's default.
+Description:    Create a reader of the BGZF stream in ``fd``.
+Returns:        A ``struct qes_bgzf *``, or NULL on error.
+ *===========================================================================*/
+struct qes_bgzf *qes_bgzf_open_read
+                               (int                     fd,
+                                int                     threads);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_bgzf_read_batch
+Parameters:     struct qes_bgzf *bgzf: BGZF reader.
+                char **data: Set to the start of the decompressed data.
+Description:    Reads and decompresses the next batch of blocks. ``*data`` is
+                owned by ``bgzf``, has room for a NUL after the returned
+                length, and is only valid until the next call.
+Returns:        ssize_t: Number of bytes in ``*data``, 0 at EOF, or -1 on
+                error.
+ *===========================================================================*/
+ssize_t qes_bgzf_read_batch    (struct qes_bgzf        *bgzf,
+                                char                  **data);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_bgzf_open_write
+Parameters:     int fd: File descriptor to write BGZF blocks to. This is owned
+                    by the returned object, and is closed by qes_bgzf_close.
+                    On failure, it is left open.
+                int threads: Number of threads to compress with, or 0 for
+                    OpenMP's default.
+                int level: zlib compression level, 1-9, or 0 for zlib's
+                    default.
+Description:    Create a writer of a BGZF stream to ``fd``. Data is collected
+                until a batch of blocks is full, then the blocks are
+                compressed in parallel and written out in order.
+Returns:        A ``struct qes_bgzf *``, or NULL on error.
+ *===========================================================================*/
+struct qes_bgzf *qes_bgzf_open_write
+                               (int                     fd,
+                                int                     threads,
+                                int                     level);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_bgzf_write
+Parameters:     struct qes_bgzf *bgzf: BGZF writer.
+                const void *data: Data to write.
+                size_t len: Length of ``data``.
+Description:    Append ``len`` bytes of ``data`` to the stream, compressing
+                and writing any batches this fills.
+Returns:        ssize_t: ``len``, or -1 on error.
+ *===========================================================================*/
+ssize_t qes_bgzf_write         (struct qes_bgzf        *bgzf,
+                                const void             *data,
+                                size_t                  len);
+
+/* Compress and write out any pending data, ending the current block. Returns
+ * 0 on success. */
+int qes_bgzf_flush             (struct qes_bgzf        *bgzf);
+
+/* The buffer qes_bgzf_read_batch returns data in. It is fixed for the life of
+ * ``bgzf``, and initially holds an empty string. */
+char *qes_bgzf_buffer          (struct qes_bgzf        *bgzf);
+
+/* Returns true if the last batch read included the final block */
+int qes_bgzf_eof               (const struct qes_bgzf  *bgzf);
+
+/* Seek back to the start of the stream. Returns 0 on success. */
+int qes_bgzf_rewind            (struct qes_bgzf        *bgzf);
+
+/* Close ``bgzf`` and its file descriptor. Writers are flushed, and the BGZF
+ * EOF marker block written, first. */
+void qes_bgzf_close_           (struct qes_bgzf        *bgzf);
+#define qes_bgzf_close(bgzf) do {                                           \
+            qes_bgzf_close_ (bgzf);                                         \
+            bgzf = NULL;                                                    \
+        } while(0)
+
+#endif /* QES_BGZF_H */
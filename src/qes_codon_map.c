@@ -0,0 +1,106 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_codon_map.c
+ *
+ *    Description:  Codon tables of each genetic code. Generated by
+ *                  util/make_codon_map.py; edit that, not this.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_sequtil.h"
+
+
+const char *const qes_codon_maps[QES_N_GENETIC_CODES] = {
+    /* 1: Standard */
+    [QES_GENETIC_CODE_STANDARD] =
+        /* T.. */ "FFLLSSSSYY**CC*W"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNKKSSRR"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 2: Vertebrate Mitochondrial */
+    [QES_GENETIC_CODE_VERT_MITO] =
+        /* T.. */ "FFLLSSSSYY**CCWW"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIMMTTTTNNKKSS**"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 3: Yeast Mitochondrial */
+    [QES_GENETIC_CODE_YEAST_MITO] =
+        /* T.. */ "FFLLSSSSYY**CCWW"
+        /* C.. */ "TTTTPPPPHHQQRRRR"
+        /* A.. */ "IIMMTTTTNNKKSSRR"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 4: Mold, Protozoan and Coelenterate Mitochondrial */
+    [QES_GENETIC_CODE_MOLD_MITO] =
+        /* T.. */ "FFLLSSSSYY**CCWW"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNKKSSRR"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 5: Invertebrate Mitochondrial */
+    [QES_GENETIC_CODE_INVERT_MITO] =
+        /* T.. */ "FFLLSSSSYY**CCWW"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIMMTTTTNNKKSSSS"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 6: Ciliate, Dasycladacean and Hexamita Nuclear */
+    [QES_GENETIC_CODE_CILIATE] =
+        /* T.. */ "FFLLSSSSYYQQCC*W"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNKKSSRR"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 9: Echinoderm and Flatworm Mitochondrial */
+    [QES_GENETIC_CODE_ECHINODERM_MITO] =
+        /* T.. */ "FFLLSSSSYY**CCWW"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNNKSSSS"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 10: Euplotid Nuclear */
+    [QES_GENETIC_CODE_EUPLOTID] =
+        /* T.. */ "FFLLSSSSYY**CCCW"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNKKSSRR"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 11: Bacterial, Archaeal and Plant Plastid */
+    [QES_GENETIC_CODE_BACTERIAL] =
+        /* T.. */ "FFLLSSSSYY**CC*W"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNKKSSRR"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 12: Alternative Yeast Nuclear */
+    [QES_GENETIC_CODE_ALT_YEAST] =
+        /* T.. */ "FFLLSSSSYY**CC*W"
+        /* C.. */ "LLLSPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNKKSSRR"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 13: Ascidian Mitochondrial */
+    [QES_GENETIC_CODE_ASCIDIAN_MITO] =
+        /* T.. */ "FFLLSSSSYY**CCWW"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIMMTTTTNNKKSSGG"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+    /* 14: Alternative Flatworm Mitochondrial */
+    [QES_GENETIC_CODE_ALT_FLATWORM_MITO] =
+        /* T.. */ "FFLLSSSSYYY*CCWW"
+        /* C.. */ "LLLLPPPPHHQQRRRR"
+        /* A.. */ "IIIMTTTTNNNKSSSS"
+        /* G.. */ "VVVVAAAADDEEGGGG",
+};
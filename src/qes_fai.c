@@ -0,0 +1,318 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_fai.c
+ *
+ *    Description:  FASTA indices, in samtools' .fai format
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_fai.h"
+
+
+static int
+__qes_fai_cmp_entries (const void *a, const void *b)
+{
+    const struct qes_fai_entry *const *ea = a;
+    const struct qes_fai_entry *const *eb = b;
+
+    return strcmp((*ea)->name, (*eb)->name);
+}
+
+static int
+__qes_fai_cmp_name (const void *key, const void *entry)
+{
+    const struct qes_fai_entry *const *e = entry;
+
+    return strcmp(key, (*e)->name);
+}
+
+/* Append a zeroed entry, returning it, or NULL if we're out of memory */
+static struct qes_fai_entry *
+__qes_fai_add (struct qes_fai *fai, size_t *cap)
+{
+    struct qes_fai_entry *entries = NULL;
+
+    if (fai->n_entries == *cap) {
+        *cap = *cap > 0 ? *cap * 2 : 64;
+        entries = qes_realloc_errnil(fai->entries, *cap * sizeof(*entries));
+        if (entries == NULL) {
+            return NULL;
+        }
+        fai->entries = entries;
+    }
+    memset(&fai->entries[fai->n_entries], 0, sizeof(*entries));
+    return &fai->entries[fai->n_entries++];
+}
+
+/* Sort the entries by name. Returns 0, or -1 if names aren't unique. */
+static int
+__qes_fai_sort (struct qes_fai *fai)
+{
+    size_t iii;
+
+    fai->by_name = qes_calloc_errnil(fai->n_entries > 0 ? fai->n_entries : 1,
+                                     sizeof(*fai->by_name));
+    if (fai->by_name == NULL) {
+        return -1;
+    }
+    for (iii = 0; iii < fai->n_entries; iii++) {
+        fai->by_name[iii] = &fai->entries[iii];
+    }
+    qsort(fai->by_name, fai->n_entries, sizeof(*fai->by_name),
+          __qes_fai_cmp_entries);
+    for (iii = 1; iii < fai->n_entries; iii++) {
+        if (strcmp(fai->by_name[iii - 1]->name, fai->by_name[iii]->name) == 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+struct qes_fai *
+qes_fai_build (struct qes_file *file)
+{
+    struct qes_fai *fai = NULL;
+    struct qes_fai_entry *entry = NULL;
+    struct qes_str line = {NULL, 0, 0, NULL};
+    size_t cap = 0;
+    size_t bases = 0;
+    size_t name_len = 0;
+    ssize_t len = 0;
+    off_t pos = 0;
+    /* Set by a short line, which must be the sequence's last */
+    int ended = 0;
+
+    if (!qes_file_ok(file) || !qes_file_readable(file)) {
+        return NULL;
+    }
+    fai = qes_calloc_errnil(1, sizeof(*fai));
+    qes_str_init(&line, __INIT_LINE_LEN);
+    if (fai == NULL || !qes_str_ok(&line)) {
+        goto error;
+    }
+    qes_file_rewind(file);
+    while ((len = qes_file_readline_str(file, &line)) > 0) {
+        pos += len;
+        if (line.str[0] == '>') {
+            name_len = strcspn(line.str + 1, " \t\r\n");
+            entry = __qes_fai_add(fai, &cap);
+            if (entry == NULL || name_len == 0) {
+                goto error;
+            }
+            entry->name = strndup(line.str + 1, name_len);
+            if (entry->name == NULL) {
+                goto error;
+            }
+            entry->offset = pos;
+            ended = 0;
+            continue;
+        }
+        bases = len;
+        if (bases > 0 && line.str[bases - 1] == '\n') bases--;
+        if (bases > 0 && line.str[bases - 1] == '\r') bases--;
+        if (entry == NULL) {
+            /* Only blank lines may come before the first header */
+            if (bases > 0) {
+                goto error;
+            }
+            continue;
+        }
+        if (entry->line_bases == 0) {
+            if (bases == 0) {
+                /* Skip blank lines before the sequence */
+                entry->offset = pos;
+                continue;
+            }
+            entry->line_bases = bases;
+            entry->line_width = len;
+        } else if (ended && bases > 0) {
+            goto error;
+        } else if (bases > entry->line_bases) {
+            goto error;
+        } else if (bases < entry->line_bases ||
+                   (size_t)len != entry->line_width) {
+            ended = 1;
+        }
+        entry->length += bases;
+    }
+    if (len != EOF || __qes_fai_sort(fai) != 0) {
+        goto error;
+    }
+    qes_str_destroy_cp(&line);
+    qes_file_rewind(file);
+    return fai;
+error:
+    qes_str_destroy_cp(&line);
+    qes_fai_destroy(fai);
+    qes_file_rewind(file);
+    return NULL;
+}
+
+int
+qes_fai_save (const struct qes_fai *fai, const char *path)
+{
+    const struct qes_fai_entry *entry = NULL;
+    FILE *fp = NULL;
+    size_t iii;
+    int ret = 0;
+
+    if (fai == NULL || path == NULL) {
+        return -2;
+    }
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+    for (iii = 0; iii < fai->n_entries; iii++) {
+        entry = &fai->entries[iii];
+        if (fprintf(fp, "%s\t%zu\t%lld\t%zu\t%zu\n", entry->name,
+                    entry->length, (long long)entry->offset,
+                    entry->line_bases, entry->line_width) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+    if (fclose(fp) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/* Parse the unsigned number at ``*str``, which must be followed by ``end``,
+ * and move ``*str`` past ``end``. Returns 0 on success. */
+static int
+__qes_fai_parse_num (char **str, char end, unsigned long long *num)
+{
+    char *numend = NULL;
+
+    if (!isdigit(**str)) {
+        return -1;
+    }
+    errno = 0;
+    *num = strtoull(*str, &numend, 10);
+    if (errno != 0 || *numend != end) {
+        return -1;
+    }
+    *str = numend + 1;
+    return 0;
+}
+
+struct qes_fai *
+qes_fai_load (const char *path)
+{
+    struct qes_fai *fai = NULL;
+    struct qes_fai_entry *entry = NULL;
+    struct qes_file *file = NULL;
+    struct qes_str line = {NULL, 0, 0, NULL};
+    unsigned long long nums[4];
+    char *tab = NULL;
+    char *field = NULL;
+    size_t cap = 0;
+    ssize_t len = 0;
+
+    if (path == NULL) {
+        return NULL;
+    }
+    file = qes_file_open_errnil(path, "r");
+    fai = qes_calloc_errnil(1, sizeof(*fai));
+    qes_str_init(&line, __INIT_LINE_LEN);
+    if (file == NULL || fai == NULL || !qes_str_ok(&line)) {
+        goto error;
+    }
+    while ((len = qes_file_readline_str(file, &line)) > 0) {
+        if (line.str[len - 1] != '\n') {
+            /* Add the missing line end, for __qes_fai_parse_num */
+            if (!qes_str_resize(&line, len + 1)) {
+                goto error;
+            }
+            line.str[len++] = '\n';
+            line.str[len] = '\0';
+        }
+        tab = strchr(line.str, '\t');
+        if (tab == NULL || tab == line.str) {
+            goto error;
+        }
+        field = tab + 1;
+        if (__qes_fai_parse_num(&field, '\t', &nums[0]) != 0 ||
+                __qes_fai_parse_num(&field, '\t', &nums[1]) != 0 ||
+                __qes_fai_parse_num(&field, '\t', &nums[2]) != 0 ||
+                __qes_fai_parse_num(&field, '\n', &nums[3]) != 0) {
+            goto error;
+        }
+        if ((nums[2] == 0 && nums[0] > 0) || nums[3] < nums[2] ||
+                (off_t)nums[1] < 0) {
+            goto error;
+        }
+        entry = __qes_fai_add(fai, &cap);
+        if (entry == NULL) {
+            goto error;
+        }
+        entry->name = strndup(line.str, tab - line.str);
+        if (entry->name == NULL) {
+            goto error;
+        }
+        entry->length = nums[0];
+        entry->offset = nums[1];
+        entry->line_bases = nums[2];
+        entry->line_width = nums[3];
+    }
+    if (len != EOF || __qes_fai_sort(fai) != 0) {
+        goto error;
+    }
+    qes_str_destroy_cp(&line);
+    qes_file_close(file);
+    return fai;
+error:
+    qes_str_destroy_cp(&line);
+    qes_file_close(file);
+    qes_fai_destroy(fai);
+    return NULL;
+}
+
+const struct qes_fai_entry *
+qes_fai_find (const struct qes_fai *fai, const char *name)
+{
+    struct qes_fai_entry **found = NULL;
+
+    if (fai == NULL || name == NULL || fai->n_entries == 0) {
+        return NULL;
+    }
+    found = bsearch(name, fai->by_name, fai->n_entries,
+                    sizeof(*fai->by_name), __qes_fai_cmp_name);
+    return found != NULL ? *found : NULL;
+}
+
+void
+qes_fai_destroy_ (struct qes_fai *fai)
+{
+    size_t iii;
+
+    if (fai != NULL) {
+        for (iii = 0; iii < fai->n_entries; iii++) {
+            qes_free(fai->entries[iii].name);
+        }
+        qes_free(fai->entries);
+        qes_free(fai->by_name);
+        qes_free(fai);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_fai.h
+ *
+ *    Description:  FASTA indices, in samtools' .fai format
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_FAI_H
+#define QES_FAI_H
+
+#include <qes_util.h>
+#include <qes_file.h>
+
+/* Appended to the FASTA file's path to name its index, as samtools does */
+#define QES_FAI_EXT ".fai"
+
+/* One sequence of a FASTA file. All lines of a sequence but its last must
+ * hold ``line_bases`` bases, so base ``i`` is at byte
+ * ``offset + i / line_bases * line_width + i % line_bases``. */
+struct qes_fai_entry {
+    /* Up to the first whitespace of the header */
+    char *name;
+    /* Number of bases */
+    size_t length;
+    /* Offset of the first base in the (uncompressed) file */
+    off_t offset;
+    size_t line_bases;
+    /* Bytes per line, including the line end */
+    size_t line_width;
+};
+
+struct qes_fai {
+    /* In file order */
+    struct qes_fai_entry *entries;
+    size_t n_entries;
+    /* Sorted by name, for qes_fai_find */
+    struct qes_fai_entry **by_name;
+};
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_fai_build
+Parameters:     struct qes_file *file: FASTA file open for reading.
+Description:    Rewind and read through the whole of ``file``, indexing each
+                sequence. ``file`` is rewound again afterwards.
+Returns:        struct qes_fai *: The index, or NULL on error or if ``file``
+                isn't FASTA with lines of equal length within each sequence,
+                or has two sequences of the same name.
+ *===========================================================================*/
+struct qes_fai *qes_fai_build  (struct qes_file        *file);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_fai_save
+Parameters:     const struct qes_fai *fai: Index to save.
+                const char *path: Path to save to, usually the FASTA file's
+                    path with QES_FAI_EXT appended.
+Description:    Write ``fai`` to ``path`` as samtools faidx would.
+Returns:        int: 0 on success, -2 on bad arguments, or -1 on error.
+ *===========================================================================*/
+int qes_fai_save               (const struct qes_fai   *fai,
+                                const char             *path);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_fai_load
+Parameters:     const char *path: Path of a .fai file, e.g. from samtools
+                    faidx or qes_fai_save.
+Description:    Read an index of a FASTA file. The FASTQ form of .fai files,
+                which has a fifth column, isn't supported.
+Returns:        struct qes_fai *: The index, or NULL if there isn't a valid
+                one at ``path``.
+ *===========================================================================*/
+struct qes_fai *qes_fai_load   (const char             *path);
+
+/* Returns the entry named ``name``, or NULL if there isn't one */
+const struct qes_fai_entry *qes_fai_find
+                               (const struct qes_fai   *fai,
+                                const char             *name);
+
+/* Returns the offset in the file of base ``pos`` of ``entry`` */
+static inline off_t
+qes_fai_entry_offset(const struct qes_fai_entry *entry, size_t pos)
+{
+    if (entry->line_bases == 0) {
+        return entry->offset;
+    }
+    return entry->offset + (off_t)(pos / entry->line_bases) *
+           entry->line_width + pos % entry->line_bases;
+}
+
+void qes_fai_destroy_          (struct qes_fai         *fai);
+#define qes_fai_destroy(fai) do {                                           \
+            qes_fai_destroy_ (fai);                                         \
+            fai = NULL;                                                     \
+        } while(0)
+
+#endif /* QES_FAI_H */
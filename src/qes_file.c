@@ -27,6 +27,334 @@
  */
 
 #include "qes_file.h"
+#include "qes_bgzf.h"
+#include "qes_scan.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef MMAP_FOUND
+#   include <sys/mman.h>
+#endif
+#ifdef PTHREADS_FOUND
+#   include <pthread.h>
+#endif
+
+
+/* The line ends in ``buffer`` at or after ``bufiter``, as offsets from
+ * ``buffer``, are ``ends[next]`` to ``ends[n - 1]``. ``buffer`` has been
+ * scanned for line ends up to ``scanned``. */
+struct qes_file_lines {
+    size_t ends[QES_FILE_LINES_LEN];
+    size_t next;
+    size_t n;
+    size_t scanned;
+};
+
+/* Forget the line ends found, as the buffer has changed under them */
+static inline void
+__qes_file_lines_reset (struct qes_file *file)
+{
+    if (file->lines != NULL) {
+        file->lines->next = 0;
+        file->lines->n = 0;
+        file->lines->scanned = 0;
+    }
+}
+
+/* Index at least ``n_lines`` line ends after ``bufiter`` if there are that
+ * many in the buffer. Returns the number indexed, or -1 on error. */
+static ssize_t
+__qes_file_index_lines (struct qes_file *file, size_t n_lines)
+{
+    struct qes_file_lines *lines = file->lines;
+    size_t pos = file->bufiter - file->buffer;
+    size_t len = file->bufend - file->buffer;
+    size_t n_new = 0;
+    size_t scanned = 0;
+    size_t iii;
+
+    if (lines == NULL) {
+        lines = file->lines = qes_calloc_errnil(1, sizeof(*lines));
+        if (lines == NULL) {
+            return -1;
+        }
+    }
+    /* Drop lines the caller has read past, by whatever means */
+    while (lines->next < lines->n && lines->ends[lines->next] < pos) {
+        lines->next++;
+    }
+    if (lines->scanned < pos) {
+        lines->scanned = pos;
+    }
+    if (lines->n - lines->next >= n_lines || lines->scanned >= len) {
+        return lines->n - lines->next;
+    }
+    /* Shift the remaining line ends down, then scan for more */
+    memmove(lines->ends, lines->ends + lines->next,
+            (lines->n - lines->next) * sizeof(*lines->ends));
+    lines->n -= lines->next;
+    lines->next = 0;
+    n_new = qes_scan_delim(file->buffer + lines->scanned, len - lines->scanned,
+                           '\n', lines->ends + lines->n,
+                           QES_FILE_LINES_LEN - lines->n, &scanned);
+    for (iii = lines->n; iii < lines->n + n_new; iii++) {
+        lines->ends[iii] += lines->scanned;
+    }
+    lines->n += n_new;
+    lines->scanned += scanned;
+    return lines->n;
+}
+
+/* Find ``delim`` between ``bufiter`` and ``bufend``, or return NULL */
+static inline char *
+__qes_file_find (struct qes_file *file, int delim)
+{
+    ssize_t n_lines = 0;
+
+    if (delim == '\n') {
+        n_lines = __qes_file_index_lines(file, 1);
+        if (n_lines > 0) {
+            return file->buffer + file->lines->ends[file->lines->next];
+        } else if (n_lines == 0) {
+            return NULL;
+        }
+    }
+    return memchr(file->bufiter, delim, file->bufend - file->bufiter);
+}
+
+#ifdef PTHREADS_FOUND
+/* The background reader fills a ring of ``n_bufs`` buffers from ``fp``, and
+ * the calling thread takes them in order in __qes_file_fill_buffer. The
+ * buffer the caller is currently reading from is held (``held``) until the
+ * next fill, so the reader never overwrites it. */
+struct qes_file_async {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    /* Signalled by the reader when a buffer has been filled */
+    pthread_cond_t filled;
+    /* Signalled by the caller when a buffer is released, or on shutdown */
+    pthread_cond_t emptied;
+    const struct qes_file_backend *backend;
+    void *handle;
+    char **bufs;
+    ssize_t *lens;
+    size_t n_bufs;
+    size_t buflen;
+    size_t head;
+    size_t tail;
+    size_t n_full;
+    int held;
+    /* Reader has hit EOF or an error, and has exited */
+    int done;
+    /* Reader has been asked to exit */
+    int stop;
+    /* There is a reader thread to join */
+    int running;
+};
+
+static void *
+__qes_file_async_reader (void *arg)
+{
+    struct qes_file_async *async = arg;
+    const ssize_t toread = async->buflen - 1;
+    ssize_t res = 0;
+    size_t idx = 0;
+
+    pthread_mutex_lock(&async->lock);
+    while (!async->stop) {
+        while (!async->stop &&
+                async->n_full + async->held >= async->n_bufs) {
+            pthread_cond_wait(&async->emptied, &async->lock);
+        }
+        if (async->stop) {
+            break;
+        }
+        idx = async->head;
+        pthread_mutex_unlock(&async->lock);
+        /* Only the reader touches the handle while it's running */
+        res = async->backend->read(async->handle, async->bufs[idx], toread);
+        pthread_mutex_lock(&async->lock);
+        async->lens[idx] = res;
+        async->head = (async->head + 1) % async->n_bufs;
+        async->n_full++;
+        pthread_cond_signal(&async->filled);
+        /* A short read is either EOF or an error, so we're done either way */
+        if (res < toread) {
+            break;
+        }
+    }
+    async->done = 1;
+    pthread_cond_signal(&async->filled);
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+static int
+__qes_file_async_start (struct qes_file_async *async)
+{
+    int res = 0;
+
+    async->head = 0;
+    async->tail = 0;
+    async->n_full = 0;
+    async->held = 0;
+    async->done = 0;
+    async->stop = 0;
+    res = pthread_create(&async->thread, NULL, __qes_file_async_reader,
+                         async);
+    if (res != 0) {
+        /* Make sure nobody waits on a reader that doesn't exist */
+        async->done = 1;
+    }
+    async->running = res == 0;
+    return res;
+}
+
+static void
+__qes_file_async_stop (struct qes_file_async *async)
+{
+    if (!async->running) {
+        return;
+    }
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_cond_signal(&async->emptied);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->thread, NULL);
+    async->running = 0;
+}
+
+static void
+__qes_file_async_destroy (struct qes_file_async *async)
+{
+    size_t iii;
+
+    if (async == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&async->lock);
+    pthread_cond_destroy(&async->filled);
+    pthread_cond_destroy(&async->emptied);
+    if (async->bufs != NULL) {
+        for (iii = 0; iii < async->n_bufs; iii++) {
+            qes_free(async->bufs[iii]);
+        }
+    }
+    qes_free(async->bufs);
+    qes_free(async->lens);
+    qes_free(async);
+}
+
+static struct qes_file_async *
+__qes_file_async_create (const struct qes_file_backend *backend, void *handle,
+                         size_t n_bufs, size_t buflen)
+{
+    struct qes_file_async *async = NULL;
+    size_t iii;
+
+    async = qes_calloc_errnil(1, sizeof(*async));
+    if (async == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->filled, NULL);
+    pthread_cond_init(&async->emptied, NULL);
+    async->backend = backend;
+    async->handle = handle;
+    async->n_bufs = n_bufs;
+    async->buflen = buflen;
+    async->bufs = qes_calloc_errnil(n_bufs, sizeof(*async->bufs));
+    async->lens = qes_calloc_errnil(n_bufs, sizeof(*async->lens));
+    if (async->bufs == NULL || async->lens == NULL) {
+        goto error;
+    }
+    for (iii = 0; iii < n_bufs; iii++) {
+        async->bufs[iii] = qes_calloc_errnil(buflen, sizeof(**async->bufs));
+        if (async->bufs[iii] == NULL) {
+            goto error;
+        }
+    }
+    if (__qes_file_async_start(async) != 0) {
+        /* There's no thread to join, so only free things */
+        __qes_file_async_destroy(async);
+        return NULL;
+    }
+    return async;
+error:
+    __qes_file_async_destroy(async);
+    return NULL;
+}
+
+/* Release the buffer we hold, and wait for the next filled one. Sets
+ * file->buffer to the new buffer, and returns its length as the backend's
+ * read would have. */
+static ssize_t
+__qes_file_async_next (struct qes_file *file)
+{
+    struct qes_file_async *async = file->async;
+    ssize_t res = 0;
+
+    pthread_mutex_lock(&async->lock);
+    if (async->held) {
+        async->held = 0;
+        pthread_cond_signal(&async->emptied);
+    }
+    while (async->n_full == 0 && !async->done) {
+        pthread_cond_wait(&async->filled, &async->lock);
+    }
+    if (async->n_full == 0) {
+        /* Reader has finished, and we've had everything it read */
+        pthread_mutex_unlock(&async->lock);
+        return 0;
+    }
+    file->buffer = async->bufs[async->tail];
+    res = async->lens[async->tail];
+    async->tail = (async->tail + 1) % async->n_bufs;
+    async->n_full--;
+    async->held = 1;
+    pthread_mutex_unlock(&async->lock);
+    return res;
+}
+#endif
+
+#ifdef READAHEAD_FOUND
+/* Keep the kernel reading ahead of us, asking for another window once we're
+ * half way through the last one */
+static void
+__qes_file_readahead (struct qes_file *file)
+{
+    off_t pos = 0;
+
+    if (file->fd < 0 || file->readahead == 0) {
+        return;
+    }
+    pos = lseek(file->fd, 0, SEEK_CUR);
+    if (pos < 0 || pos + (off_t)(file->readahead / 2) < file->ra_end) {
+        return;
+    }
+    readahead(file->fd, pos, file->readahead);
+    file->ra_end = pos + file->readahead;
+}
+#endif
+
+/* Give the kernel the hints asked for in ``opts`` about reading ``fd`` */
+static void
+__qes_file_hint (int fd, const struct qes_file_opts *opts)
+{
+#ifdef FADVISE_FOUND
+    if (opts->fadvise) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+    }
+#endif
+#ifdef READAHEAD_FOUND
+    if (opts->readahead > 0) {
+        readahead(fd, 0, opts->readahead);
+    }
+#endif
+    (void) fd;
+    (void) opts;
+}
 
 static int
 __qes_file_fill_buffer (struct qes_file *file)
@@ -40,7 +368,33 @@ __qes_file_fill_buffer (struct qes_file *file)
         file->eof = 1;
         return EOF;
     }
-    res = QES_ZREAD(file->fp, file->buffer, QES_FILEBUFFER_LEN - 1);
+    __qes_file_lines_reset(file);
+    if (file->mmapped) {
+        /* The whole file is already in memory, so "filling" the buffer just
+         * exposes the entire mapping. The next fill will hit EOF. */
+        file->bufiter = file->buffer;
+        file->bufend = file->buffer + file->mmap_len;
+        file->feof = 1;
+        return 1;
+    }
+    if (file->bgzf != NULL) {
+        res = qes_bgzf_read_batch(file->bgzf, &file->buffer);
+        if (res > 0 && qes_bgzf_eof(file->bgzf)) {
+            file->feof = 1;
+        }
+    } else
+#ifdef PTHREADS_FOUND
+    if (file->async != NULL) {
+        res = __qes_file_async_next(file);
+    } else
+#endif
+    {
+        res = file->backend->read(file->handle, file->buffer,
+                                  file->buflen - 1);
+#ifdef READAHEAD_FOUND
+        __qes_file_readahead(file);
+#endif
+    }
     if (res < 0) {
         /* Errored */
         return 0;
@@ -49,7 +403,7 @@ __qes_file_fill_buffer (struct qes_file *file)
         file->eof = 1;
         file->feof = 1;
         return EOF;
-    } else if (res < (QES_FILEBUFFER_LEN) - 1) {
+    } else if ((size_t)res < file->buflen - 1 && file->bgzf == NULL) {
         /* At file EOF */
         file->feof = 1;
     }
@@ -59,56 +413,394 @@ __qes_file_fill_buffer (struct qes_file *file)
     return 1;
 }
 
+/* Write out the pending data in ``buffer``. Returns 0 on success. */
+static int
+__qes_file_flush_buffer (struct qes_file *file)
+{
+    size_t len = file->bufiter - file->buffer;
+    ssize_t res = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (file->bgzf != NULL) {
+        res = qes_bgzf_write(file->bgzf, file->buffer, len);
+    } else {
+        res = file->backend->write(file->handle, file->buffer, len);
+    }
+    if (res < 0 || (size_t)res != len) {
+        return -1;
+    }
+    file->filepos += len;
+    file->bufiter = file->buffer;
+    return 0;
+}
+
+/* Append ``len`` bytes of ``data`` to the write buffer, flushing as needed.
+ * Writes bigger than the buffer skip it. Returns 0 on success. */
+static int
+__qes_file_write (struct qes_file *file, const char *data, size_t len)
+{
+    ssize_t res = 0;
+
+    if (len <= (size_t)(file->bufend - file->bufiter)) {
+        memcpy(file->bufiter, data, len);
+        file->bufiter += len;
+        return 0;
+    }
+    if (__qes_file_flush_buffer(file) != 0) {
+        return -1;
+    }
+    if (len < file->buflen) {
+        memcpy(file->bufiter, data, len);
+        file->bufiter += len;
+        return 0;
+    }
+    if (file->bgzf != NULL) {
+        res = qes_bgzf_write(file->bgzf, data, len);
+    } else {
+        res = file->backend->write(file->handle, data, len);
+    }
+    if (res < 0 || (size_t)res != len) {
+        return -1;
+    }
+    file->filepos += len;
+    return 0;
+}
+
+#ifdef MMAP_FOUND
+/* Map ``qf->path`` into ``qf->buffer`` if it is a non-empty, uncompressed,
+ * regular file. Returns 1 if the file was mapped, or 0 if the caller should
+ * fall back to buffered reads. */
+static int
+__qes_file_try_mmap (struct qes_file *qf, const struct qes_file_opts *opts)
+{
+    int fd = -1;
+    struct stat st;
+    void *map = NULL;
+    int ret = 0;
+#if defined(ZLIB_FOUND) || defined(LIBDEFLATE_FOUND)
+    unsigned char magic[2];
+#endif
+
+    fd = open(qf->path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 1 ||
+            (uintmax_t)st.st_size > SIZE_MAX) {
+        goto done;
+    }
+#if defined(ZLIB_FOUND) || defined(LIBDEFLATE_FOUND)
+    /* Gzipped files need to be inflated */
+    if (pread(fd, magic, 2, 0) != 2 ||
+            (magic[0] == 0x1f && magic[1] == 0x8b)) {
+        goto done;
+    }
+#endif
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        goto done;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    if (qf->fd < 0) {
+        /* Otherwise, the hints have already been given */
+        __qes_file_hint(fd, opts);
+    }
+    qf->buffer = map;
+    qf->mmap_len = st.st_size;
+    qf->mmapped = 1;
+    ret = 1;
+done:
+    close(fd);
+    return ret;
+}
+#endif
+
+#ifdef LIBDEFLATE_FOUND
+/* Should ``path`` be read with libdeflate, i.e. is it gzip, but not BGZF
+ * (which we read in parallel), nor too big to inflate in memory? */
+static int
+__qes_file_use_libdeflate (const char *path)
+{
+    int fd = -1;
+    struct stat st;
+    unsigned char magic[2];
+    unsigned char isize[4];
+    uint64_t size = 0;
+    int ret = 0;
+
+    /* As in __qes_file_sniff, don't probe FIFOs */
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 20 ||
+            (uint64_t)st.st_size > QES_FILE_LIBDEFLATE_MAX_ZSIZE) {
+        goto done;
+    }
+    if (pread(fd, magic, 2, 0) != 2 || magic[0] != 0x1f || magic[1] != 0x8b ||
+            pread(fd, isize, 4, st.st_size - 4) != 4 || qes_bgzf_sniff(fd)) {
+        goto done;
+    }
+    /* The last member's size, which is usually the only member's. Smaller
+     * than the compressed file means it has wrapped past 4GiB (or the data
+     * doesn't compress, and zlib does just as well). */
+    size = (uint32_t)isize[3] << 24 | (uint32_t)isize[2] << 16 |
+           (uint32_t)isize[1] << 8 | (uint32_t)isize[0];
+    ret = size >= (uint64_t)st.st_size && size <= QES_FILE_LIBDEFLATE_MAX_SIZE;
+done:
+    close(fd);
+    return ret;
+}
+#endif
+
+/* The decoder needed for ``path``, if it isn't gzip or uncompressed. Only
+ * regular files are sniffed, as a probe of a FIFO would be its only reader. */
+static const struct qes_file_backend *
+__qes_file_sniff (const char *path)
+{
+    int fd = -1;
+    struct stat st;
+    unsigned char magic[6];
+    ssize_t res = 0;
+
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    res = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+    return res > 0 ? qes_file_backend_sniff(magic, res) : NULL;
+}
+
+#ifdef ZLIB_FOUND
+/* Start a parallel reader if ``qf->path`` is a BGZF file */
+static void
+__qes_file_try_bgzf (struct qes_file *qf, int threads)
+{
+    int fd = open(qf->path, O_RDONLY);
+
+    if (fd < 0) {
+        return;
+    }
+    if (!qes_bgzf_sniff(fd)) {
+        close(fd);
+        return;
+    }
+    /* fd belongs to the reader, if it can be created */
+    qf->bgzf = qes_bgzf_open_read(fd, threads);
+    if (qf->bgzf == NULL) {
+        close(fd);
+    }
+}
+#endif
+
+#ifdef ZLIB_FOUND
+/* Open ``path`` as a parallel BGZF writer */
+static struct qes_bgzf *
+__qes_file_bgzf_writer (const char *path, const char *mode,
+                        const struct qes_file_opts *opts)
+{
+    struct qes_bgzf *bgzf = NULL;
+    int flags = O_WRONLY | O_CREAT | (mode[0] == 'a' ? O_APPEND : O_TRUNC);
+    int level = opts->level;
+    int fd = -1;
+    const char *chr = NULL;
+
+    /* As with gzopen, a digit in the mode gives the level */
+    for (chr = mode; level == 0 && *chr != '\0'; chr++) {
+        if (isdigit(*chr)) {
+            level = *chr - '0';
+        }
+    }
+    if (strcmp(path, "-") == 0) {
+        fd = dup(STDOUT_FILENO);
+    } else {
+        fd = open(path, flags, 0666);
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+    bgzf = qes_bgzf_open_write(fd, opts->threads, level);
+    if (bgzf == NULL) {
+        close(fd);
+    }
+    return bgzf;
+}
+#endif
+
 struct qes_file *
 qes_file_open_ (const char *path, const char *mode, qes_errhandler_func onerr,
                 const char *file, int line)
+{
+    return qes_file_open_opts_(path, mode, NULL, onerr, file, line);
+}
+
+struct qes_file *
+qes_file_open_opts_ (const char *path, const char *mode,
+                     const struct qes_file_opts *opts,
+                     qes_errhandler_func onerr, const char *file, int line)
 {
     struct qes_file *qf = NULL;
+    const struct qes_file_opts defaults = {0};
+    const struct qes_file_backend *backend = NULL;
+    const struct qes_file_backend *sniffed = NULL;
+    size_t async_buffers = 0;
+
+    if (opts == NULL) {
+        opts = &defaults;
+    }
 
     /* Error out with NULL */
     if (path == NULL || mode == NULL || onerr == NULL || file == NULL) {
         return NULL;
     }
+    backend = opts->backend != NULL ? opts->backend : QES_FILE_BACKEND_DEFAULT;
+    async_buffers = opts->async_buffers;
+    if (opts->backend == NULL &&
+            qes_file_guess_mode(mode) == QES_FILE_MODE_READ &&
+            strcmp(path, "-") != 0) {
+        /* Pick a decoder from the magic bytes */
+        sniffed = __qes_file_sniff(path);
+        if (sniffed != NULL) {
+            backend = sniffed;
+            /* They are slow enough to be worth a thread of their own */
+            if (async_buffers == 0) {
+                async_buffers = QES_FILE_DECODE_ASYNC_BUFFERS;
+            }
+        }
+#ifdef LIBDEFLATE_FOUND
+        else if (__qes_file_use_libdeflate(path)) {
+            backend = &qes_file_backend_libdeflate;
+        }
+#endif
+    }
 
     /* create file struct */
     qf = qes_calloc(1, sizeof(*qf));
+    qf->fd = -1;
+    qf->buflen = opts->buffer_len > 0 ? opts->buffer_len : QES_FILEBUFFER_LEN;
+    if (qf->buflen < 2) {
+        /* Room for at least one byte and a NUL */
+        qf->buflen = 2;
+    }
+    qf->readahead = opts->readahead;
+    qf->backend = backend;
     /* Open file, handling any errors */
-    if (strcmp(path, "-") == 0) {
+#ifdef ZLIB_FOUND
+    if (opts->bgzf && qes_file_guess_mode(mode) == QES_FILE_MODE_WRITE) {
+        qf->bgzf = __qes_file_bgzf_writer(path, mode, opts);
+    } else
+#endif
+    if (strcmp(path, "-") == 0 && backend->dopen != NULL) {
         if (tolower(mode[0]) == 'r') {
-            qf->fp = QES_ZDOPEN(STDIN_FILENO, mode);
+            qf->handle = backend->dopen(STDIN_FILENO, mode, opts->backend_arg);
         } else {
-            qf->fp = QES_ZDOPEN(STDOUT_FILENO, mode);
+            qf->handle = backend->dopen(STDOUT_FILENO, mode,
+                                        opts->backend_arg);
+        }
+    } else if (qes_file_guess_mode(mode) == QES_FILE_MODE_READ &&
+               (opts->fadvise || opts->readahead > 0) &&
+               backend->dopen != NULL) {
+        /* We need the descriptor to pass on hints */
+        qf->fd = open(path, O_RDONLY);
+        if (qf->fd >= 0) {
+            qf->handle = backend->dopen(qf->fd, mode, opts->backend_arg);
+            if (qf->handle == NULL) {
+                close(qf->fd);
+                qf->fd = -1;
+            }
         }
     } else {
-        qf->fp = QES_ZOPEN(path, mode);
+        qf->handle = backend->open(path, mode, opts->backend_arg);
     }
-    if (qf->fp == NULL) {
+    if (qf->handle == NULL && qf->bgzf == NULL) {
         (*onerr)("Opening file %s failed:\n%s\n", file, line,
                 path, strerror(errno));
         qes_free(qf);
         return(NULL);
     }
+    if (backend == QES_FILE_BACKEND_DEFAULT) {
+        qf->fp = qf->handle;
+    }
     qf->mode = qes_file_guess_mode(mode);
-    if (qf->mode == QES_FILE_MODE_UNKNOWN) {
-        QES_ZCLOSE(qf->fp);
+    if (qf->mode == QES_FILE_MODE_UNKNOWN ||
+            (qf->mode == QES_FILE_MODE_WRITE && qf->bgzf == NULL &&
+             backend->write == NULL)) {
+        backend->close(qf->handle);
         qes_free(qf);
         return NULL;
     }
-    qf->buffer = qes_calloc_(sizeof(*qf->buffer),  QES_FILEBUFFER_LEN,
-            onerr, file, line);
-    if (qf->buffer == NULL) {
-        QES_ZCLOSE(qf->fp);
-        qes_free(qf);
-        (*onerr)("Couldn't allocate buffer memory", file, line);
-        return NULL;
+    qf->path = strndup(path, QES_MAX_FN_LEN);
+    if (qf->fd >= 0) {
+        __qes_file_hint(qf->fd, opts);
+        qf->ra_end = opts->readahead;
+    }
+    if (qf->handle != NULL && opts->zbuffer_len > 0 &&
+            backend->buffer != NULL) {
+        backend->buffer(qf->handle, opts->zbuffer_len);
+    }
+    if (qf->mode == QES_FILE_MODE_READ && backend->map != NULL) {
+        qf->buffer = (char *)backend->map(qf->handle, &qf->mmap_len);
+        qf->mmapped = qf->buffer != NULL;
+    }
+    /* Only the default backend is second-guessed */
+    if (opts->backend == NULL && backend == QES_FILE_BACKEND_DEFAULT) {
+#ifdef MMAP_FOUND
+        if (qf->mode == QES_FILE_MODE_READ && strcmp(path, "-") != 0) {
+            __qes_file_try_mmap(qf, opts);
+        }
+#endif
+#ifdef ZLIB_FOUND
+        if (qf->mode == QES_FILE_MODE_READ && !qf->mmapped &&
+                strcmp(path, "-") != 0) {
+            __qes_file_try_bgzf(qf, opts->threads);
+        }
+#endif
+    }
+#ifdef PTHREADS_FOUND
+    if (qf->mode == QES_FILE_MODE_READ && !qf->mmapped &&
+            qf->bgzf == NULL && async_buffers > 0) {
+        /* If we can't start the reader, just read synchronously */
+        qf->async = __qes_file_async_create(backend, qf->handle,
+                                            async_buffers, qf->buflen);
+        if (qf->async != NULL) {
+            qf->buffer = qf->async->bufs[0];
+        }
+    }
+#endif
+    if (qf->bgzf != NULL && qf->mode == QES_FILE_MODE_READ) {
+        qf->buffer = qes_bgzf_buffer(qf->bgzf);
+    } else if (!qf->mmapped && qf->async == NULL) {
+        qf->buffer = qes_calloc_(sizeof(*qf->buffer), qf->buflen, onerr, file,
+                                 line);
+        if (qf->buffer == NULL) {
+            if (qf->handle != NULL) {
+                backend->close(qf->handle);
+            }
+            qes_free(qf->path);
+            qes_free(qf);
+            (*onerr)("Couldn't allocate buffer memory", file, line);
+            return NULL;
+        }
+        qf->buffer[0] = '\0';
     }
     qf->bufiter = qf->buffer;
-    qf->buffer[0] = '\0';
     qf->bufend = qf->buffer;
+    if (qf->mode == QES_FILE_MODE_WRITE) {
+        /* Writes are collected in the buffer, up to bufend */
+        qf->bufend = qf->buffer + qf->buflen;
+    }
     /* init struct fields */
     qf->eof = 0;
     qf->filepos = 0;
-    qf->path = strndup(path, QES_MAX_FN_LEN);
     return(qf);
 }
 
@@ -126,25 +818,237 @@ qes_file_guess_mode (const char *mode)
 void
 qes_file_rewind (struct qes_file *file)
 {
-    if (qes_file_ok(file)) {
-        QES_ZSEEK(file->fp, 0, SEEK_SET);
+    if (qes_file_ok(file) && file->mode == QES_FILE_MODE_WRITE) {
+        /* Compressed output can't be rewound, but pending data shouldn't be
+         * lost either */
+        __qes_file_flush_buffer(file);
+    } else if (qes_file_ok(file)) {
+#ifdef PTHREADS_FOUND
+        if (file->async != NULL) {
+            /* The reader owns the handle while it runs, so stop it before
+             * seeking */
+            __qes_file_async_stop(file->async);
+            if (file->backend->seek != NULL) {
+                file->backend->seek(file->handle, 0);
+            }
+            file->buffer = file->async->bufs[0];
+            __qes_file_async_start(file->async);
+        } else
+#endif
+        if (file->bgzf != NULL) {
+            qes_bgzf_rewind(file->bgzf);
+        } else if (!file->mmapped && file->backend->seek != NULL) {
+            file->backend->seek(file->handle, 0);
+        }
         file->filepos = 0;
         file->eof = 0;
         file->feof = 0;
         file->bufiter = file->buffer;
         file->bufend = file->buffer;
+        file->ra_end = 0;
+        __qes_file_lines_reset(file);
+    }
+}
+
+/* Path of the sidecar index of ``path``, to be freed */
+static char *
+__qes_file_index_path (const char *path)
+{
+    size_t len = strlen(path) + strlen(QES_GZINDEX_EXT) + 1;
+    char *idxpath = qes_malloc_errnil(len);
+
+    if (idxpath != NULL) {
+        snprintf(idxpath, len, "%s%s", path, QES_GZINDEX_EXT);
+    }
+    return idxpath;
+}
+
+int
+qes_file_build_index (struct qes_file *file, size_t span)
+{
+    struct qes_gzindex *index = NULL;
+    char *idxpath = NULL;
+    unsigned char magic[2];
+    int fd = -1;
+    int res = 0;
+
+    if (!qes_file_ok(file) || file->mode != QES_FILE_MODE_READ ||
+            file->path == NULL) {
+        return -2;
+    }
+    fd = open(file->path, O_RDONLY);
+    res = fd >= 0 ? pread(fd, magic, 2, 0) : -1;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (res != 2 || magic[0] != 0x1f || magic[1] != 0x8b) {
+        return -2;
+    }
+    index = qes_gzindex_build(file->path, span);
+    if (index == NULL) {
+        return -3;
+    }
+    idxpath = __qes_file_index_path(file->path);
+    res = idxpath != NULL && qes_gzindex_save(index, idxpath) == 0 ? 0 : -1;
+    qes_free(idxpath);
+#ifdef ZLIB_FOUND
+    if (file->backend == &qes_file_backend_gzindex) {
+        /* The reader uses the index we have, which is just as good */
+        qes_gzindex_destroy(index);
+        return res;
+    }
+#endif
+    qes_gzindex_destroy(file->index);
+    file->index = index;
+    return res;
+}
+
+#ifdef ZLIB_FOUND
+/* Switch ``file`` over to reading through its index */
+static int
+__qes_file_use_index (struct qes_file *file)
+{
+    void *handle = NULL;
+
+    handle = qes_file_backend_gzindex.open(file->path, "r", file->index);
+    if (handle == NULL) {
+        return -1;
+    }
+#ifdef PTHREADS_FOUND
+    if (file->async != NULL) {
+        /* Restarted once we've seeked */
+        __qes_file_async_stop(file->async);
+        file->async->backend = &qes_file_backend_gzindex;
+        file->async->handle = handle;
+    }
+#endif
+    file->backend->close(file->handle);
+    file->backend = &qes_file_backend_gzindex;
+    file->handle = handle;
+    file->fp = NULL;
+    /* Which was the old handle's */
+    file->fd = -1;
+    return 0;
+}
+#endif
+
+int
+qes_file_seek (struct qes_file *file, off_t offset)
+{
+    struct stat st;
+    char *idxpath = NULL;
+    int res = 0;
+
+    if (!qes_file_ok(file) || file->mode != QES_FILE_MODE_READ ||
+            offset < 0 || file->bgzf != NULL) {
+        return -2;
+    }
+    __qes_file_lines_reset(file);
+    file->eof = 0;
+    file->feof = 0;
+    file->ra_end = 0;
+    if (file->mmapped) {
+        if ((size_t)offset > file->mmap_len) {
+            res = -1;
+            goto done;
+        }
+        /* All of it is already in the buffer */
+        file->bufiter = file->buffer + offset;
+        file->bufend = file->buffer + file->mmap_len;
+        file->feof = 1;
+        file->filepos = offset;
+        return 0;
     }
+#ifdef ZLIB_FOUND
+    if (file->index == NULL && file->path != NULL &&
+            stat(file->path, &st) == 0) {
+        /* Use a saved index, if there's a current one */
+        idxpath = __qes_file_index_path(file->path);
+        if (idxpath != NULL) {
+            file->index = qes_gzindex_load(idxpath, st.st_size);
+        }
+        qes_free(idxpath);
+    }
+    if (file->index != NULL && file->backend != &qes_file_backend_gzindex &&
+            __qes_file_use_index(file) != 0) {
+        res = -1;
+        goto done;
+    }
+#else
+    (void) st;
+    (void) idxpath;
+#endif
+    if (file->backend->seek == NULL) {
+        return -2;
+    }
+#ifdef PTHREADS_FOUND
+    if (file->async != NULL) {
+        /* The reader owns the handle while it runs */
+        __qes_file_async_stop(file->async);
+        res = file->backend->seek(file->handle, offset);
+        file->buffer = file->async->bufs[0];
+        if (res == 0) {
+            __qes_file_async_start(file->async);
+        }
+    } else
+#endif
+    {
+        res = file->backend->seek(file->handle, offset);
+    }
+    res = res == 0 ? 0 : -1;
+done:
+    file->bufiter = file->buffer;
+    file->bufend = file->buffer;
+    file->filepos = offset;
+    if (res != 0) {
+        /* Where we are is anyone's guess, so go no further */
+        file->eof = 1;
+        file->feof = 1;
+    }
+    return res;
 }
 
 void
 qes_file_close_ (struct qes_file *file)
 {
     if (file != NULL) {
-        if (file->fp != NULL) {
-            QES_ZCLOSE(file->fp);
+        if (file->mode == QES_FILE_MODE_WRITE && qes_file_ok(file)) {
+            __qes_file_flush_buffer(file);
+        }
+#ifdef PTHREADS_FOUND
+        if (file->async != NULL) {
+            __qes_file_async_stop(file->async);
+            __qes_file_async_destroy(file->async);
+            file->async = NULL;
+            /* buffer was one of the reader's buffers */
+            file->buffer = NULL;
+        }
+#endif
+        if (file->bgzf != NULL) {
+            qes_bgzf_close(file->bgzf);
+            if (file->mode == QES_FILE_MODE_READ) {
+                /* buffer was the reader's */
+                file->buffer = NULL;
+            }
+        }
+        if (file->mmapped && file->backend->map != NULL) {
+            /* The backend's map, freed by its close */
+            file->buffer = NULL;
+        }
+        if (file->handle != NULL) {
+            file->backend->close(file->handle);
         }
         qes_free(file->path);
+#ifdef MMAP_FOUND
+        if (file->mmapped && file->buffer != NULL) {
+            munmap(file->buffer, file->mmap_len);
+            file->buffer = NULL;
+        }
+#endif
         qes_free(file->buffer);
+        qes_free(file->lines);
+        /* After the handle, which may have been using it */
+        qes_gzindex_destroy(file->index);
         file->bufiter = NULL;
         file->bufend = NULL;
         qes_free(file);
@@ -155,26 +1059,14 @@ qes_file_close_ (struct qes_file *file)
 const char *
 qes_file_error (struct qes_file *file)
 {
-    int error = 0;
-    const char *errstr = "";
-
     if (!qes_file_ok(file)) {
         /* Never return NULL, or we'll SIGSEGV printf */
         return "BAD FILE";
     }
-#ifdef ZLIB_FOUND
-    errstr = gzerror(file->fp, &error);
-    if (error == Z_ERRNO) {
-        return strerror(errno);
-    }
-#else
-    error = ferror(file->fp);
-    if (error != 0) {
-        errstr = strerror(errno);
-        clearerr(file->fp);
+    if (file->handle == NULL || file->backend->error == NULL) {
+        return "";
     }
-#endif
-    return errstr;
+    return file->backend->error(file->handle);
 }
 
 
@@ -225,33 +1117,61 @@ qes_file_peek(struct qes_file *file)
     return file->bufiter[0];
 }
 
+int
+qes_file_flush(struct qes_file *file)
+{
+    if (!qes_file_writable(file)) {
+        return -2;
+    }
+    if (__qes_file_flush_buffer(file) != 0) {
+        return -1;
+    }
+    if (file->bgzf != NULL) {
+        return qes_bgzf_flush(file->bgzf) == 0 ? 0 : -1;
+    }
+    if (file->backend->flush == NULL) {
+        return 0;
+    }
+    return file->backend->flush(file->handle) == 0 ? 0 : -1;
+}
+
 int
 qes_file_putstr(struct qes_file *stream, const struct qes_str *str)
 {
-    /* TODO: use the buffer in write mode */
-    return QES_ZWRITE(stream->fp, str->str, str->len);
+    if (!qes_file_writable(stream) || !qes_str_ok(str)) {
+        return -2;
+    }
+    if (__qes_file_write(stream, str->str, str->len) != 0) {
+        return -1;
+    }
+    return str->len;
 }
 
 int
 qes_file_puts(struct qes_file *file, const char *str)
 {
-    if (!qes_file_ok(file) || !qes_file_writable(file)) {
+    size_t len = 0;
+
+    if (!qes_file_writable(file) || str == NULL) {
         return -2;
     }
-    return QES_ZFPUTS(file->fp, str);
+    len = strlen(str);
+    if (__qes_file_write(file, str, len) != 0) {
+        return -1;
+    }
+    return len;
 }
 
 int
 qes_file_putc(struct qes_file *file, const int chr)
 {
-    int res = 0;
-    if (!qes_file_ok(file) || !qes_file_writable(file)) {
+    if (!qes_file_writable(file)) {
         return -2;
     }
-    res = QES_ZFPUTC(file->fp, chr);
-    if (res != chr) {
+    if (file->bufiter == file->bufend && __qes_file_flush_buffer(file) != 0) {
         return -1;
     }
+    *(file->bufiter++) = chr;
     return 1;
 }
 
@@ -268,6 +1188,33 @@ qes_file_getc(struct qes_file *file)
     return (file->bufiter++)[0];
 }
 
+size_t
+qes_file_buffered_lines (struct qes_file *file, const char **ends,
+                         size_t n_lines)
+{
+    ssize_t n_found = 0;
+    size_t iii;
+
+    if (!qes_file_ok(file) || file->mode != QES_FILE_MODE_READ ||
+            ends == NULL) {
+        return 0;
+    }
+    if (n_lines > QES_FILE_LINES_LEN) {
+        n_lines = QES_FILE_LINES_LEN;
+    }
+    n_found = __qes_file_index_lines(file, n_lines);
+    if (n_found < 0) {
+        return 0;
+    }
+    if ((size_t)n_found > n_lines) {
+        n_found = n_lines;
+    }
+    for (iii = 0; iii < (size_t)n_found; iii++) {
+        ends[iii] = file->buffer + file->lines->ends[file->lines->next + iii];
+    }
+    return n_found;
+}
+
 ssize_t
 qes_file_getuntil_realloc_(struct qes_file *file, int delim, char **bufref,
                            size_t *sizeref, qes_errhandler_func onerr,
@@ -301,8 +1248,7 @@ qes_file_getuntil_realloc_(struct qes_file *file, int delim, char **bufref,
      * then we don't lose the memory alloced above */
     *bufref = nextbuf = buf;
     /* Read until delim is in file->buffer, filling buffer */
-    while ((end = memchr(file->bufiter, delim, file->bufend - file->bufiter))
-            == NULL) {
+    while ((end = __qes_file_find(file, delim)) == NULL) {
         /* copy the remainder of the buffer */
         tocpy = file->bufend - file->bufiter;
         len += tocpy;
@@ -448,8 +1394,7 @@ qes_file_getuntil (struct qes_file *file, const int delim, char *dest,
     if (file->eof) {
         return EOF;
     }
-    while ((end = memchr(file->bufiter, delim, file->bufend - file->bufiter))
-            == NULL) {
+    while ((end = __qes_file_find(file, delim)) == NULL) {
         tocpy = file->bufend - file->bufiter;
         if (len + tocpy >= maxlen) {
             /* + 1 because we always leave space for \0 */
@@ -502,6 +1447,50 @@ qes_file_readline (struct qes_file *file, char *dest, size_t maxlen)
     return qes_file_getuntil(file, '\n', dest, maxlen);
 }
 
+/* qes_file_readline_realloc for strings from an arena, which can't be
+ * realloc-ed and so grow with qes_str_resize */
+static ssize_t
+__qes_file_readline_resize (struct qes_file *file, struct qes_str *str)
+{
+    char *end = NULL;
+    size_t tocpy = 0;
+    size_t len = 0;
+    int ret = 0;
+
+    if (file->eof) {
+        return EOF;
+    }
+    while (1) {
+        end = __qes_file_find(file, '\n');
+        tocpy = (end != NULL ? end + 1 : file->bufend) - file->bufiter;
+        if (!qes_str_resize(str, len + tocpy)) {
+            return -2;
+        }
+        memcpy(str->str + len, file->bufiter, tocpy);
+        file->bufiter += tocpy;
+        len += tocpy;
+        /* Keep ``str`` whole, as growing it copies only its string */
+        str->str[len] = '\0';
+        str->len = len;
+        if (end != NULL) {
+            break;
+        }
+        ret = __qes_file_fill_buffer(file);
+        if (ret == 0) {
+            return -2;
+        } else if (ret == EOF) {
+            break;
+        }
+    }
+    str->str[len] = '\0';
+    if (len == 0) {
+        file->eof = 1;
+        return EOF;
+    }
+    file->filepos += len;
+    return len;
+}
+
 ssize_t
 qes_file_readline_str (struct qes_file *file, struct qes_str *str)
 {
@@ -510,7 +1499,11 @@ qes_file_readline_str (struct qes_file *file, struct qes_str *str)
     if (file == NULL || !qes_str_ok(str)) {
         return -2; /* ERROR, not EOF */
     }
-    len = qes_file_readline_realloc(file, &(str->str), &(str->capacity));
+    if (str->arena != NULL) {
+        len = __qes_file_readline_resize(file, str);
+    } else {
+        len = qes_file_readline_realloc(file, &(str->str), &(str->capacity));
+    }
     if (len < 0) {
         qes_str_nullify(str);
         return len;
@@ -31,6 +31,26 @@
 
 #include <qes_util.h>
 #include <qes_str.h>
+#include <qes_backend.h>
+#include <qes_gzindex.h>
+
+/* Number of line ends indexed ahead of the read position, see
+ * qes_file_buffered_lines */
+#define QES_FILE_LINES_LEN (1024)
+
+/* Gzip files are only read with libdeflate by default if they are smaller
+ * than QES_FILE_LIBDEFLATE_MAX_ZSIZE, and claim to inflate to less than
+ * QES_FILE_LIBDEFLATE_MAX_SIZE, as the whole of each member is inflated into
+ * memory. The claimed size is mod 2^32, so files compressing better than
+ * QES_FILE_LIBDEFLATE_MAX_RATIO could hide a wrapped size; few do. */
+#define QES_FILE_LIBDEFLATE_MAX_RATIO (16)
+#define QES_FILE_LIBDEFLATE_MAX_ZSIZE \
+    (((uint64_t)1<<32) / QES_FILE_LIBDEFLATE_MAX_RATIO)
+#define QES_FILE_LIBDEFLATE_MAX_SIZE (1<<30)
+
+/* zstd, bzip2 and xz files are decoded this many buffers ahead on a
+ * background thread, unless qes_file_opts.async_buffers asks for more */
+#define QES_FILE_DECODE_ASYNC_BUFFERS (2)
 
 enum qes_file_mode {
     QES_FILE_MODE_UNKNOWN,
@@ -38,23 +58,104 @@ enum qes_file_mode {
     QES_FILE_MODE_WRITE
 };
 
+/* Options for qes_file_open_opts. A zeroed struct gives the defaults used by
+ * qes_file_open. */
+struct qes_file_opts {
+    /* If non-zero, read this many buffers ahead of the caller on a background
+     * thread, so that reading and decompression overlap with parsing.
+     * Ignored for memory-mapped files, for write mode, and if libqes was
+     * built without threads. */
+    size_t async_buffers;
+    /* Number of threads used to (de)compress block-gzipped (BGZF) files. 0
+     * uses OpenMP's default. */
+    int threads;
+    /* If non-zero, files opened for writing are written as BGZF, with blocks
+     * compressed on ``threads`` threads. Needs zlib. */
+    int bgzf;
+    /* Compression level for BGZF output, 1-9. If 0, a digit in the mode
+     * string (e.g. "w9") is used, else zlib's default. */
+    int level;
+    /* Size of the read or write buffer, i.e. how much is asked of the
+     * underlying stream at once. 0 uses QES_FILEBUFFER_LEN. Larger buffers
+     * mean fewer syscalls, which matters on network filesystems. */
+    size_t buffer_len;
+    /* Size of zlib's (or stdio's) own buffer, see gzbuffer(3). 0 leaves the
+     * library's default. */
+    size_t zbuffer_len;
+    /* If non-zero, tell the kernel the file will be read sequentially and
+     * once (posix_fadvise SEQUENTIAL and NOREUSE), for reads. */
+    int fadvise;
+    /* If non-zero, ask the kernel to read this many bytes ahead of us
+     * (readahead(2)), topping the window up as the file is read. Memory-mapped
+     * files and background readers only get the first window. */
+    size_t readahead;
+    /* Stream to read or write with, see qes_backend.h. If NULL, the default
+     * backend is used, and memory-mapping and BGZF are tried when reading.
+     * With any other backend, the file is used exactly as given. */
+    const struct qes_file_backend *backend;
+    /* Passed to the backend's open function */
+    void *backend_arg;
+};
+
+/* Background reader state, private to qes_file.c */
+struct qes_file_async;
+/* Parallel BGZF reader or writer, see qes_bgzf.h */
+struct qes_bgzf;
+/* Index of line ends in the buffer, private to qes_file.c */
+struct qes_file_lines;
+
 struct qes_file {
+    /* The backend's handle, if the default backend is in use, else NULL */
     QES_ZTYPE fp;
+    const struct qes_file_backend *backend;
+    void *handle;
     char *path;
+    /* In write mode, buffer to bufiter holds data not yet written out, and
+     * filepos counts the bytes written */
     char *buffer;
     char *bufiter;
     char *bufend;
     off_t filepos;
+    /* Size of ``buffer``. Unused for memory-mapped or BGZF input. */
+    size_t buflen;
+    /* Descriptor behind the handle, if we opened it ourselves to give the
+     * kernel hints (see struct qes_file_opts), else -1 */
+    int fd;
+    /* Readahead window, and the raw file offset it has been asked up to */
+    size_t readahead;
+    off_t ra_end;
     enum qes_file_mode mode;
-    /* Is the fp at EOF, AND do we have nothing left to copy from the buffer */
+    /* Is the stream at EOF, AND do we have nothing left to copy from the
+     * buffer */
     int eof;
-    /* Is the fp at EOF */
+    /* Is the stream at EOF */
     int feof;
+    /* Is ``buffer`` a read-only mapping of the whole file? If so, we never
+     * read from the backend, and ``mmap_len`` is the length of the mapping.
+     * The mapping is ours unless the backend's map function gave it us. */
+    int mmapped;
+    size_t mmap_len;
+    /* Background reader, or NULL if we read on the calling thread. If set,
+     * ``buffer`` points into the reader's ring of buffers. */
+    struct qes_file_async *async;
+    /* Parallel BGZF reader or writer, or NULL if this isn't a BGZF file. If
+     * set, the backend is never used (and is NULL when writing), and
+     * ``buffer`` is owned by the reader. */
+    struct qes_bgzf *bgzf;
+    /* Offsets of the '\n's ahead of ``bufiter``, found many at a time with
+     * qes_scan_delim. Allocated on first use, and reset on each refill. */
+    struct qes_file_lines *lines;
+    /* Checkpoints for seeking in gzip files, see qes_file_build_index */
+    struct qes_gzindex *index;
 };
 
 /* qes_file_open:
     Create a `struct qes_file` and open `path` with mode `mode` and
-    errorhandler `onerr`
+    errorhandler `onerr`. Uncompressed regular files opened for reading are
+    memory-mapped where possible, and are then read directly from the mapping
+    rather than copied through `buffer`. Block-gzipped (BGZF) files are
+    decompressed a batch of blocks at a time, in parallel. Pipes, stdin and
+    other gzipped files use the buffered path.
  */
 struct qes_file *qes_file_open_(const char             *path,
                                 const char             *mode,
@@ -70,6 +171,25 @@ struct qes_file *qes_file_open_(const char             *path,
 #define qes_file_open_errprintexit(pth, mod)                                \
     qes_file_open_(pth, mod, errprintexit, __FILE__, __LINE__)
 
+/* qes_file_open_opts:
+    As for qes_file_open, but with the options given in `opts` (see struct
+    qes_file_opts). `opts` may be NULL, which is equivalent to qes_file_open.
+ */
+struct qes_file *qes_file_open_opts_(const char             *path,
+                                     const char             *mode,
+                                     const struct qes_file_opts *opts,
+                                     qes_errhandler_func     onerr,
+                                     const char             *file,
+                                     int                     line);
+#define qes_file_open_opts(pth, mod, opt)                                   \
+    qes_file_open_opts_(pth, mod, opt, QES_DEFAULT_ERR_FN, __FILE__, __LINE__)
+#define qes_file_open_opts_errnil(pth, mod, opt)                            \
+    qes_file_open_opts_(pth, mod, opt, errnil, __FILE__, __LINE__)
+#define qes_file_open_opts_errprint(pth, mod, opt)                          \
+    qes_file_open_opts_(pth, mod, opt, errprint, __FILE__, __LINE__)
+#define qes_file_open_opts_errprintexit(pth, mod, opt)                      \
+    qes_file_open_opts_(pth, mod, opt, errprintexit, __FILE__, __LINE__)
+
 
 /*===  FUNCTION  ============================================================*
 Name:           qes_file_close
@@ -92,12 +212,62 @@ enum qes_file_mode qes_file_guess_mode
 void qes_file_rewind           (struct qes_file        *file);
 int qes_file_peek              (struct qes_file        *file);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_build_index
+Parameters:     struct qes_file *file: A gzip file open for reading.
+                size_t span: Uncompressed bytes between checkpoints, or 0 for
+                    QES_GZINDEX_SPAN.
+Description:    Inflate the whole of ``file`` (independently of its read
+                position) to build a struct qes_gzindex, which qes_file_seek
+                then uses. The index is saved beside the file, with
+                QES_GZINDEX_EXT appended to its path, so that later opens of
+                the file (e.g. by other workers) can seek without building it
+                again.
+Returns:        int: 0 on success, -1 if the index was built but couldn't be
+                saved, -2 on bad arguments or if ``file`` isn't gzip, or -3 on
+                error.
+ *===========================================================================*/
+int qes_file_build_index       (struct qes_file        *file,
+                                size_t                  span);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_seek
+Parameters:     struct qes_file *file: File open for reading.
+                off_t offset: Offset in the (uncompressed) stream.
+Description:    Continue reading ``file`` from ``offset``. Memory-mapped files
+                are seeked directly. Gzip files with an index, built by
+                qes_file_build_index or saved beside them by it, are inflated
+                from the nearest checkpoint before ``offset``, rather than
+                from the start. Other files are seeked by their backend, if
+                it can.
+Returns:        int: 0 on success, -1 on error (e.g. ``offset`` is past the
+                end), after which ``file`` is at EOF, or -2 on bad arguments
+                or if ``file`` can't seek (e.g. BGZF files, pipes).
+ *===========================================================================*/
+int qes_file_seek              (struct qes_file        *file,
+                                off_t                   offset);
+
+/* Writes are collected in ``buffer``, which is written out when full, by
+ * qes_file_flush, or on close. qes_file_putstr and qes_file_puts return the
+ * number of bytes written, and qes_file_putc returns 1. All return -1 on
+ * error, or -2 if ``file`` isn't writable. */
 int qes_file_putstr            (struct qes_file        *stream,
                                 const struct qes_str   *str);
 int qes_file_puts              (struct qes_file        *file,
                                 const char             *str);
 int qes_file_putc              (struct qes_file        *stream,
                                 const int               chr);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_flush
+Parameters:     struct qes_file *file: File to flush.
+Description:    Writes out any data buffered in ``file``, and flushes the
+                underlying stream. Flushing compressed streams ends the
+                current block, so calling this often hurts compression.
+Returns:        int: 0 on success, -1 on error, or -2 if ``file`` isn't
+                writable.
+ *===========================================================================*/
+int qes_file_flush             (struct qes_file        *file);
 int qes_file_getc              (struct qes_file        *file);
 
 
@@ -129,6 +299,26 @@ Returns:        ssize_t set to either the length of the line copied to the
 ssize_t qes_file_readline_str  (struct qes_file        *file,
                                 struct qes_str         *str);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_file_buffered_lines
+Parameters:     struct qes_file *file: File to look in.
+                const char **ends: Array to fill with pointers to line ends.
+                size_t n_lines: Length of ``ends``, at most
+                    QES_FILE_LINES_LEN.
+Description:    Finds the '\n's ending the next ``n_lines`` lines which are
+                entirely within ``file``'s buffer, without reading from
+                ``file`` or moving its read position. Line ends are found in
+                bulk with SIMD, and indexed until the buffer is refilled, so
+                calling this for each record or line is cheap. The pointers
+                are valid until ``file`` is next refilled, i.e. until the
+                read position passes the last line end found.
+Returns:        size_t: The number of line ends found, which is fewer than
+                ``n_lines`` if the buffer runs out first.
+ *===========================================================================*/
+size_t qes_file_buffered_lines (struct qes_file        *file,
+                                const char            **ends,
+                                size_t                  n_lines);
+
 /*===  FUNCTION  ============================================================*
 Name:           qes_file_getuntil
 Parameters:     struct qes_file *file: File to read
@@ -220,7 +410,7 @@ qes_file_ok                    (const struct qes_file  *qf)
      * NULLness for all pointers we care about in current modes. Which, unless
      * we're Write-only, is all of them */
     return  qf != NULL && \
-            qf->fp != NULL && \
+            (qf->handle != NULL || qf->bgzf != NULL) && \
             qf->bufiter != NULL && \
             qf->buffer != NULL;
 }
@@ -0,0 +1,724 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_gzindex.c
+ *
+ *    Description:  Random access to gzip files, from inflate checkpoints
+ *                  taken at deflate block boundaries (as zlib's zran.c)
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_gzindex.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef ZLIB_FOUND
+#   include <zlib.h>
+#endif
+
+/* Compressed bytes read at once */
+#define QES_GZINDEX_INBUF_LEN (1<<16)
+/* Sidecar files start with this, then the version */
+#define QES_GZINDEX_MAGIC "QESGZI\0\1"
+#define QES_GZINDEX_MAGIC_LEN 8
+/* Header: magic, then compressed size, uncompressed size, span and number of
+ * points. Points: out, in, bits, window length, compressed window length. */
+#define QES_GZINDEX_HDR_LEN (QES_GZINDEX_MAGIC_LEN + 4 * 8)
+#define QES_GZINDEX_POINT_LEN (2 * 8 + 1 + 2 * 4)
+
+
+static inline void
+__put_le32 (unsigned char *buf, uint32_t val)
+{
+    size_t iii;
+
+    for (iii = 0; iii < 4; iii++) {
+        buf[iii] = (val >> (8 * iii)) & 0xff;
+    }
+}
+
+static inline void
+__put_le64 (unsigned char *buf, uint64_t val)
+{
+    __put_le32(buf, val & 0xffffffff);
+    __put_le32(buf + 4, val >> 32);
+}
+
+static inline uint32_t
+__get_le32 (const unsigned char *buf)
+{
+    return (uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+           (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+static inline uint64_t
+__get_le64 (const unsigned char *buf)
+{
+    return (uint64_t)__get_le32(buf) | (uint64_t)__get_le32(buf + 4) << 32;
+}
+
+void
+qes_gzindex_destroy_ (struct qes_gzindex *index)
+{
+    size_t iii;
+
+    if (index == NULL) {
+        return;
+    }
+    for (iii = 0; iii < index->n_points; iii++) {
+        qes_free(index->points[iii].window);
+    }
+    qes_free(index->points);
+    qes_free(index);
+}
+
+const struct qes_gzindex_point *
+qes_gzindex_find (const struct qes_gzindex *index, off_t offset)
+{
+    size_t lo = 0;
+    size_t hi = 0;
+    size_t mid = 0;
+
+    if (index == NULL || index->n_points == 0 ||
+            offset < index->points[0].out) {
+        return NULL;
+    }
+    /* The last point with out <= offset is in [lo, hi) */
+    hi = index->n_points;
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (index->points[mid].out <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return &index->points[lo];
+}
+
+#ifdef ZLIB_FOUND
+/* Read from ``fd``, retrying on EINTR */
+static ssize_t
+__qes_gzindex_read (int fd, void *buf, size_t len)
+{
+    ssize_t res = 0;
+
+    do {
+        res = read(fd, buf, len);
+    } while (res < 0 && errno == EINTR);
+    return res;
+}
+
+/* Add a point, taking its window from the last ``member_out`` bytes of
+ * ``ring``, whose oldest byte is at ``ring + QES_GZINDEX_WINDOW_LEN -
+ * left``. Returns 0 on success. */
+static int
+__qes_gzindex_add (struct qes_gzindex *index, size_t *cap, off_t in,
+                   off_t out, int bits, const unsigned char *ring, size_t left,
+                   off_t member_out)
+{
+    struct qes_gzindex_point *point = NULL;
+    unsigned char window[QES_GZINDEX_WINDOW_LEN];
+    const size_t winlen = QES_GZINDEX_WINDOW_LEN;
+
+    if (index->n_points == *cap) {
+        *cap = *cap > 0 ? *cap * 2 : 64;
+        point = qes_realloc_errnil(index->points, *cap * sizeof(*point));
+        if (point == NULL) {
+            return -1;
+        }
+        index->points = point;
+    }
+    point = &index->points[index->n_points];
+    point->in = in;
+    point->out = out;
+    point->bits = bits;
+    point->window = NULL;
+    point->window_len = member_out < (off_t)winlen ? (size_t)member_out
+                                                   : winlen;
+    if (point->window_len > 0) {
+        point->window = qes_malloc_errnil(point->window_len);
+        if (point->window == NULL) {
+            return -1;
+        }
+        /* Unwrap the ring, oldest first, then keep the end of it */
+        memcpy(window, ring + winlen - left, left);
+        memcpy(window + left, ring, winlen - left);
+        memcpy(point->window, window + winlen - point->window_len,
+               point->window_len);
+    }
+    index->n_points++;
+    return 0;
+}
+
+struct qes_gzindex *
+qes_gzindex_build (const char *path, size_t span)
+{
+    struct qes_gzindex *index = NULL;
+    struct stat st;
+    z_stream strm;
+    unsigned char *inbuf = NULL;
+    unsigned char *ring = NULL;
+    off_t totin = 0;
+    off_t totout = 0;
+    off_t last = 0;
+    off_t member_start = 0;
+    size_t cap = 0;
+    size_t before_in = 0;
+    size_t before_out = 0;
+    ssize_t res = 0;
+    int live = 0;
+    int ret = 0;
+    int fd = -1;
+
+    if (path == NULL) {
+        return NULL;
+    }
+    if (span == 0) {
+        span = QES_GZINDEX_SPAN;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        goto error;
+    }
+    index = qes_calloc_errnil(1, sizeof(*index));
+    inbuf = qes_malloc_errnil(QES_GZINDEX_INBUF_LEN);
+    ring = qes_calloc_errnil(QES_GZINDEX_WINDOW_LEN, 1);
+    if (index == NULL || inbuf == NULL || ring == NULL) {
+        goto error;
+    }
+    index->span = span;
+    index->zsize = st.st_size;
+    memset(&strm, 0, sizeof(strm));
+    /* gzip only; zlib streams and raw deflate aren't indexed */
+    if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+        goto error;
+    }
+    live = 1;
+    while (1) {
+        if (strm.avail_in == 0) {
+            res = __qes_gzindex_read(fd, inbuf, QES_GZINDEX_INBUF_LEN);
+            if (res <= 0) {
+                /* Errored, or truncated */
+                goto error;
+            }
+            strm.next_in = inbuf;
+            strm.avail_in = res;
+        }
+        if (strm.avail_out == 0) {
+            strm.next_out = ring;
+            strm.avail_out = QES_GZINDEX_WINDOW_LEN;
+        }
+        before_in = strm.avail_in;
+        before_out = strm.avail_out;
+        /* Stop at each block boundary, so we can take a checkpoint there */
+        ret = inflate(&strm, Z_BLOCK);
+        totin += before_in - strm.avail_in;
+        totout += before_out - strm.avail_out;
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            goto error;
+        }
+        /* At a block boundary that isn't the end of the stream, i.e. just
+         * after the header or an end-of-block code, but not the last */
+        if ((strm.data_type & 0xc0) == 0x80 &&
+                (index->n_points == 0 || totout - last >= (off_t)span)) {
+            if (__qes_gzindex_add(index, &cap, totin, totout,
+                                  strm.data_type & 7, ring, strm.avail_out,
+                                  totout - member_start) != 0) {
+                goto error;
+            }
+            last = totout;
+        }
+        if (ret == Z_STREAM_END) {
+            /* Look for another member, ignoring anything else after */
+            if (strm.avail_in < 2) {
+                memmove(inbuf, strm.next_in, strm.avail_in);
+                res = __qes_gzindex_read(fd, inbuf + strm.avail_in,
+                                         QES_GZINDEX_INBUF_LEN -
+                                         strm.avail_in);
+                if (res < 0) {
+                    goto error;
+                }
+                strm.next_in = inbuf;
+                strm.avail_in += res;
+            }
+            if (strm.avail_in < 2 || strm.next_in[0] != 0x1f ||
+                    strm.next_in[1] != 0x8b) {
+                break;
+            }
+            inflateReset(&strm);
+            member_start = totout;
+        }
+    }
+    index->size = totout;
+    inflateEnd(&strm);
+    close(fd);
+    qes_free(inbuf);
+    qes_free(ring);
+    return index;
+error:
+    if (live) {
+        inflateEnd(&strm);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    qes_free(inbuf);
+    qes_free(ring);
+    qes_gzindex_destroy(index);
+    return NULL;
+}
+
+int
+qes_gzindex_save (const struct qes_gzindex *index, const char *path)
+{
+    FILE *fp = NULL;
+    unsigned char hdr[QES_GZINDEX_HDR_LEN];
+    unsigned char *cwin = NULL;
+    uLongf clen = 0;
+    const struct qes_gzindex_point *point = NULL;
+    size_t iii;
+    int ret = -1;
+
+    if (index == NULL || path == NULL) {
+        return -2;
+    }
+    cwin = qes_malloc_errnil(compressBound(QES_GZINDEX_WINDOW_LEN));
+    fp = fopen(path, "wb");
+    if (cwin == NULL || fp == NULL) {
+        goto done;
+    }
+    memcpy(hdr, QES_GZINDEX_MAGIC, QES_GZINDEX_MAGIC_LEN);
+    __put_le64(hdr + QES_GZINDEX_MAGIC_LEN, index->zsize);
+    __put_le64(hdr + QES_GZINDEX_MAGIC_LEN + 8, index->size);
+    __put_le64(hdr + QES_GZINDEX_MAGIC_LEN + 16, index->span);
+    __put_le64(hdr + QES_GZINDEX_MAGIC_LEN + 24, index->n_points);
+    if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+        goto done;
+    }
+    for (iii = 0; iii < index->n_points; iii++) {
+        point = &index->points[iii];
+        clen = 0;
+        if (point->window_len > 0) {
+            clen = compressBound(QES_GZINDEX_WINDOW_LEN);
+            if (compress2(cwin, &clen, point->window, point->window_len,
+                          Z_BEST_SPEED) != Z_OK) {
+                goto done;
+            }
+        }
+        __put_le64(hdr, point->out);
+        __put_le64(hdr + 8, point->in);
+        hdr[16] = point->bits;
+        __put_le32(hdr + 17, point->window_len);
+        __put_le32(hdr + 21, clen);
+        if (fwrite(hdr, 1, QES_GZINDEX_POINT_LEN, fp) !=
+                QES_GZINDEX_POINT_LEN ||
+                fwrite(cwin, 1, clen, fp) != clen) {
+            goto done;
+        }
+    }
+    ret = 0;
+done:
+    if (fp != NULL && fclose(fp) != 0) {
+        ret = -1;
+    }
+    qes_free(cwin);
+    return ret;
+}
+
+struct qes_gzindex *
+qes_gzindex_load (const char *path, off_t zsize)
+{
+    struct qes_gzindex *index = NULL;
+    struct qes_gzindex_point *point = NULL;
+    FILE *fp = NULL;
+    unsigned char hdr[QES_GZINDEX_HDR_LEN];
+    unsigned char *cwin = NULL;
+    const size_t max_clen = compressBound(QES_GZINDEX_WINDOW_LEN);
+    uLongf len = 0;
+    size_t clen = 0;
+    uint64_t n_points = 0;
+    size_t iii;
+
+    if (path == NULL) {
+        return NULL;
+    }
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    index = qes_calloc_errnil(1, sizeof(*index));
+    cwin = qes_malloc_errnil(max_clen);
+    if (index == NULL || cwin == NULL ||
+            fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+            memcmp(hdr, QES_GZINDEX_MAGIC, QES_GZINDEX_MAGIC_LEN) != 0) {
+        goto error;
+    }
+    index->zsize = __get_le64(hdr + QES_GZINDEX_MAGIC_LEN);
+    index->size = __get_le64(hdr + QES_GZINDEX_MAGIC_LEN + 8);
+    index->span = __get_le64(hdr + QES_GZINDEX_MAGIC_LEN + 16);
+    n_points = __get_le64(hdr + QES_GZINDEX_MAGIC_LEN + 24);
+    if ((zsize >= 0 && index->zsize != zsize) ||
+            n_points > SIZE_MAX / sizeof(*index->points)) {
+        goto error;
+    }
+    index->points = qes_calloc_errnil(n_points > 0 ? n_points : 1,
+                                      sizeof(*index->points));
+    if (index->points == NULL) {
+        goto error;
+    }
+    for (iii = 0; iii < n_points; iii++) {
+        point = &index->points[iii];
+        if (fread(hdr, 1, QES_GZINDEX_POINT_LEN, fp) !=
+                QES_GZINDEX_POINT_LEN) {
+            goto error;
+        }
+        point->out = __get_le64(hdr);
+        point->in = __get_le64(hdr + 8);
+        point->bits = hdr[16];
+        point->window_len = __get_le32(hdr + 17);
+        clen = __get_le32(hdr + 21);
+        index->n_points++;
+        if (point->bits > 7 || point->window_len > QES_GZINDEX_WINDOW_LEN ||
+                clen > max_clen || (point->window_len > 0) != (clen > 0) ||
+                point->out > index->size || point->in > index->zsize ||
+                (iii > 0 && point->out < point[-1].out)) {
+            goto error;
+        }
+        if (point->window_len == 0) {
+            continue;
+        }
+        point->window = qes_malloc_errnil(point->window_len);
+        len = point->window_len;
+        if (point->window == NULL || fread(cwin, 1, clen, fp) != clen ||
+                uncompress(point->window, &len, cwin, clen) != Z_OK ||
+                len != point->window_len) {
+            goto error;
+        }
+    }
+    fclose(fp);
+    qes_free(cwin);
+    return index;
+error:
+    fclose(fp);
+    qes_free(cwin);
+    qes_gzindex_destroy(index);
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------------
+  | gzindex backend                                                         |
+  ---------------------------------------------------------------------------*/
+
+struct __qes_gzindex_reader {
+    int fd;
+    const struct qes_gzindex *index;
+    z_stream strm;
+    unsigned char *in;
+    int in_eof;
+    /* Restarted mid-member, so inflating raw deflate, and the member's
+     * trailer must be skipped by hand */
+    int raw;
+    /* Past the last member */
+    int ended;
+    /* errno of the last failure, or -1 for bad data */
+    int err;
+};
+
+/* Read until there are at least ``want`` bytes of input, or EOF. Returns 0,
+ * or -1 on error. */
+static int
+__qes_gzindex_reader_fill (struct __qes_gzindex_reader *reader, size_t want)
+{
+    z_stream *strm = &reader->strm;
+    ssize_t res = 0;
+
+    if (strm->avail_in >= want) {
+        return 0;
+    }
+    memmove(reader->in, strm->next_in, strm->avail_in);
+    strm->next_in = reader->in;
+    while (strm->avail_in < want && !reader->in_eof) {
+        res = __qes_gzindex_read(reader->fd, reader->in + strm->avail_in,
+                                 QES_GZINDEX_INBUF_LEN - strm->avail_in);
+        if (res < 0) {
+            reader->err = errno;
+            return -1;
+        }
+        reader->in_eof = res == 0;
+        strm->avail_in += res;
+    }
+    return 0;
+}
+
+/* Start inflating from the beginning of the file. Returns 0 on success. */
+static int
+__qes_gzindex_reader_restart (struct __qes_gzindex_reader *reader)
+{
+    if (lseek(reader->fd, 0, SEEK_SET) < 0) {
+        reader->err = errno;
+        return -1;
+    }
+    reader->strm.next_in = reader->in;
+    reader->strm.avail_in = 0;
+    reader->in_eof = 0;
+    reader->raw = 0;
+    reader->ended = 0;
+    return inflateReset2(&reader->strm, 15 + 16) == Z_OK ? 0 : -1;
+}
+
+static void *
+__qes_gzindex_reader_dopen (int fd, const char *mode, void *arg)
+{
+    struct __qes_gzindex_reader *reader = NULL;
+
+    if (arg == NULL || mode[0] != 'r' || strchr(mode, '+') != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    reader = qes_calloc_errnil(1, sizeof(*reader));
+    if (reader == NULL) {
+        return NULL;
+    }
+    reader->fd = fd;
+    reader->index = arg;
+    reader->in = qes_malloc_errnil(QES_GZINDEX_INBUF_LEN);
+    if (reader->in == NULL ||
+            inflateInit2(&reader->strm, 15 + 16) != Z_OK) {
+        qes_free(reader->in);
+        qes_free(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+    reader->strm.next_in = reader->in;
+    return reader;
+}
+
+static void *
+__qes_gzindex_reader_open (const char *path, const char *mode, void *arg)
+{
+    void *reader = NULL;
+    int fd = -1;
+
+    if (arg == NULL || mode[0] != 'r' || strchr(mode, '+') != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    reader = __qes_gzindex_reader_dopen(fd, mode, arg);
+    if (reader == NULL) {
+        close(fd);
+    }
+    return reader;
+}
+
+static ssize_t
+__qes_gzindex_reader_read (void *handle, void *buf, size_t len)
+{
+    struct __qes_gzindex_reader *reader = handle;
+    z_stream *strm = &reader->strm;
+    size_t got = 0;
+    size_t avail = 0;
+    int ret = 0;
+
+    while (got < len && !reader->ended) {
+        if (__qes_gzindex_reader_fill(reader, 1) != 0) {
+            return -1;
+        }
+        avail = len - got > UINT_MAX ? UINT_MAX : len - got;
+        strm->next_out = (unsigned char *)buf + got;
+        strm->avail_out = avail;
+        ret = inflate(strm, Z_NO_FLUSH);
+        got += avail - strm->avail_out;
+        if (ret == Z_BUF_ERROR && strm->avail_in == 0 && reader->in_eof) {
+            /* Truncated */
+            reader->err = -1;
+            return -1;
+        } else if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            reader->err = -1;
+            return -1;
+        } else if (ret != Z_STREAM_END) {
+            continue;
+        }
+        if (reader->raw) {
+            /* Skip the CRC and length, as inflate didn't see the header */
+            if (__qes_gzindex_reader_fill(reader, 8) != 0) {
+                return -1;
+            } else if (strm->avail_in < 8) {
+                reader->err = -1;
+                return -1;
+            }
+            strm->next_in += 8;
+            strm->avail_in -= 8;
+        }
+        /* Another member follows, or we're done */
+        if (__qes_gzindex_reader_fill(reader, 2) != 0) {
+            return -1;
+        }
+        if (strm->avail_in < 2 || strm->next_in[0] != 0x1f ||
+                strm->next_in[1] != 0x8b) {
+            reader->ended = 1;
+        } else {
+            inflateReset2(strm, 15 + 16);
+            reader->raw = 0;
+        }
+    }
+    return got;
+}
+
+static int
+__qes_gzindex_reader_seek (void *handle, off_t offset)
+{
+    struct __qes_gzindex_reader *reader = handle;
+    const struct qes_gzindex_point *point = NULL;
+    unsigned char skip[4096];
+    off_t start = 0;
+    ssize_t res = 0;
+
+    if (offset < 0 || offset > reader->index->size) {
+        reader->err = EINVAL;
+        return -1;
+    }
+    point = qes_gzindex_find(reader->index, offset);
+    if (point == NULL) {
+        if (__qes_gzindex_reader_restart(reader) != 0) {
+            return -1;
+        }
+    } else {
+        /* Restart raw inflate at the checkpoint, taking any bits of the
+         * byte before it that are part of the next block */
+        start = point->in - (point->bits ? 1 : 0);
+        if (lseek(reader->fd, start, SEEK_SET) < 0) {
+            reader->err = errno;
+            return -1;
+        }
+        reader->strm.next_in = reader->in;
+        reader->strm.avail_in = 0;
+        reader->in_eof = 0;
+        reader->raw = 1;
+        reader->ended = 0;
+        if (inflateReset2(&reader->strm, -15) != Z_OK) {
+            reader->err = -1;
+            return -1;
+        }
+        if (point->bits) {
+            if (__qes_gzindex_reader_fill(reader, 1) != 0 ||
+                    reader->strm.avail_in < 1) {
+                reader->err = reader->err != 0 ? reader->err : -1;
+                return -1;
+            }
+            inflatePrime(&reader->strm, point->bits,
+                         reader->strm.next_in[0] >> (8 - point->bits));
+            reader->strm.next_in++;
+            reader->strm.avail_in--;
+        }
+        if (point->window_len > 0 &&
+                inflateSetDictionary(&reader->strm, point->window,
+                                     point->window_len) != Z_OK) {
+            reader->err = -1;
+            return -1;
+        }
+        offset -= point->out;
+    }
+    /* And inflate forwards to offset */
+    while (offset > 0) {
+        res = __qes_gzindex_reader_read(reader, skip,
+                offset < (off_t)sizeof(skip) ? (size_t)offset : sizeof(skip));
+        if (res <= 0) {
+            reader->err = res < 0 ? reader->err : EINVAL;
+            return -1;
+        }
+        offset -= res;
+    }
+    return 0;
+}
+
+static int
+__qes_gzindex_reader_close (void *handle)
+{
+    struct __qes_gzindex_reader *reader = handle;
+    int res = close(reader->fd);
+
+    inflateEnd(&reader->strm);
+    qes_free(reader->in);
+    qes_free(reader);
+    return res;
+}
+
+static const char *
+__qes_gzindex_reader_error (void *handle)
+{
+    struct __qes_gzindex_reader *reader = handle;
+
+    if (reader->err < 0) {
+        return "invalid or truncated gzip data";
+    }
+    return reader->err != 0 ? strerror(reader->err) : "";
+}
+
+const struct qes_file_backend qes_file_backend_gzindex = {
+    "gzindex",
+    __qes_gzindex_reader_open,
+    __qes_gzindex_reader_dopen,
+    __qes_gzindex_reader_read,
+    NULL,
+    __qes_gzindex_reader_seek,
+    NULL,
+    __qes_gzindex_reader_close,
+    __qes_gzindex_reader_error,
+    NULL,
+    NULL,
+};
+
+#else /* ZLIB_FOUND */
+
+/* Without zlib, there is nothing to index */
+struct qes_gzindex *
+qes_gzindex_build (const char *path, size_t span)
+{
+    (void) path;
+    (void) span;
+    return NULL;
+}
+
+int
+qes_gzindex_save (const struct qes_gzindex *index, const char *path)
+{
+    (void) index;
+    (void) path;
+    return -1;
+}
+
+struct qes_gzindex *
+qes_gzindex_load (const char *path, off_t zsize)
+{
+    (void) path;
+    (void) zsize;
+    return NULL;
+}
+
+#endif /* ZLIB_FOUND */
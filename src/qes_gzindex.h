@@ -0,0 +1,127 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_gzindex.h
+ *
+ *    Description:  Random access to gzip files, from inflate checkpoints
+ *                  taken at deflate block boundaries (as zlib's zran.c)
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_GZINDEX_H
+#define QES_GZINDEX_H
+
+#include <qes_util.h>
+#include <qes_backend.h>
+
+/* Default uncompressed distance between checkpoints */
+#define QES_GZINDEX_SPAN (1<<22)
+/* Inflate's window, which is kept at each checkpoint */
+#define QES_GZINDEX_WINDOW_LEN (32768)
+/* Appended to the gzip file's path to name its sidecar index file */
+#define QES_GZINDEX_EXT ".qgzi"
+
+/* A point that inflate can be restarted from */
+struct qes_gzindex_point {
+    /* Offset in the uncompressed stream */
+    off_t out;
+    /* Offset in the compressed file of the first whole byte, and the number
+     * of bits of the byte before it which are also needed */
+    off_t in;
+    int bits;
+    /* The uncompressed data before ``out``, as much of the last
+     * QES_GZINDEX_WINDOW_LEN as there is in this member */
+    unsigned char *window;
+    size_t window_len;
+};
+
+struct qes_gzindex {
+    struct qes_gzindex_point *points;
+    size_t n_points;
+    size_t span;
+    /* Size of the compressed file, to spot stale indices */
+    off_t zsize;
+    /* Size of the uncompressed stream */
+    off_t size;
+};
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_build
+Parameters:     const char *path: Path of a gzip file.
+                size_t span: Uncompressed bytes between checkpoints, or 0 for
+                    QES_GZINDEX_SPAN.
+Description:    Inflate all of ``path``, taking a checkpoint at the first
+                deflate block boundary after each ``span`` bytes. Files of
+                concatenated gzip members are indexed as one stream.
+Returns:        struct qes_gzindex *: The index, or NULL if ``path`` isn't
+                valid gzip or can't be read.
+ *===========================================================================*/
+struct qes_gzindex *qes_gzindex_build
+                               (const char             *path,
+                                size_t                  span);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_save
+Parameters:     const struct qes_gzindex *index: Index to save.
+                const char *path: Path to save to, usually the gzip file's
+                    path with QES_GZINDEX_EXT appended.
+Description:    Write ``index`` to ``path``. Windows are stored compressed.
+Returns:        int: 0 on success, -2 on bad arguments, or -1 on error.
+ *===========================================================================*/
+int qes_gzindex_save           (const struct qes_gzindex *index,
+                                const char             *path);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_gzindex_load
+Parameters:     const char *path: Path of an index written by
+                    qes_gzindex_save.
+                off_t zsize: Size of the gzip file it indexes, or -1 to skip
+                    checking.
+Description:    Read back an index. Indices of a file of a different size
+                than ``zsize`` are stale, and are not loaded.
+Returns:        struct qes_gzindex *: The index, or NULL if there isn't a
+                valid and current one at ``path``.
+ *===========================================================================*/
+struct qes_gzindex *qes_gzindex_load
+                               (const char             *path,
+                                off_t                   zsize);
+
+/* Returns the last checkpoint at or before uncompressed offset ``offset``,
+ * or NULL if there are none */
+const struct qes_gzindex_point *qes_gzindex_find
+                               (const struct qes_gzindex *index,
+                                off_t                   offset);
+
+void qes_gzindex_destroy_      (struct qes_gzindex     *index);
+#define qes_gzindex_destroy(index) do {                                     \
+            qes_gzindex_destroy_ (index);                                   \
+            index = NULL;                                                   \
+        } while(0)
+
+#ifdef ZLIB_FOUND
+/* Read-only gzip, seeking from the nearest checkpoint in the struct
+ * qes_gzindex given as the ``arg`` of open. The index must outlive the
+ * handle. */
+extern const struct qes_file_backend qes_file_backend_gzindex;
+#endif
+
+#endif /* QES_GZINDEX_H */
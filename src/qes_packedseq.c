@@ -0,0 +1,504 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_packedseq.c
+ *
+ *    Description:  Nucleotide sequences packed at two bits per base
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_packedseq.h"
+
+#ifdef X86_SIMD_FOUND
+#   include <immintrin.h>
+#endif
+
+
+/* Each base's code plus one, or 0 if it's ambiguous */
+static const uint8_t __qes_packedseq_codes[256] = {
+    ['A'] = 1, ['C'] = 2, ['T'] = 3, ['G'] = 4,
+    ['a'] = 1, ['c'] = 2, ['t'] = 3, ['g'] = 4,
+};
+
+#define QES_PACKEDSEQ_N_BASES(len) (((len) + 31) / 32)
+#define QES_PACKEDSEQ_N_MASK(len) (((len) + 63) / 64)
+
+/* Put bit ``i`` of ``x`` at bit ``2i`` of the result */
+static inline uint64_t
+__qes_packedseq_spread (uint32_t x)
+{
+    uint64_t v = x;
+
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+    v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+    v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+}
+
+/* The inverse of __qes_packedseq_spread: bit ``2i`` of ``v`` goes to bit
+ * ``i`` */
+static inline uint32_t
+__qes_packedseq_compact (uint64_t v)
+{
+    v &= 0x5555555555555555ULL;
+    v = (v | (v >> 1)) & 0x3333333333333333ULL;
+    v = (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | (v >> 4)) & 0x00FF00FF00FF00FFULL;
+    v = (v | (v >> 8)) & 0x0000FFFF0000FFFFULL;
+    v = (v | (v >> 16)) & 0x00000000FFFFFFFFULL;
+    return (uint32_t)v;
+}
+
+typedef void (*qes_packedseq_pack_fn)(struct qes_packedseq *ps,
+                                      const char *seq);
+typedef void (*qes_packedseq_unpack_fn)(const struct qes_packedseq *ps,
+                                        char *dest);
+
+struct qes_packedseq_kernels {
+    qes_packedseq_pack_fn pack;
+    qes_packedseq_unpack_fn unpack;
+};
+
+/* Pack ``seq`` from base ``from`` into ``ps``, whose words must be zeroed.
+ * Also finishes off the SIMD packing. */
+static void
+__qes_packedseq_pack_from (struct qes_packedseq *ps, const char *seq,
+                           size_t from)
+{
+    size_t iii;
+    uint64_t code;
+
+    for (iii = from; iii < ps->len; iii++) {
+        code = __qes_packedseq_codes[(uint8_t)seq[iii]];
+        if (code == 0) {
+            ps->nmask[iii / 64] |= 1ULL << (iii % 64);
+        } else {
+            ps->bases[iii / 32] |= (code - 1) << (2 * (iii % 32));
+        }
+    }
+}
+
+static void
+__qes_packedseq_unpack_from (const struct qes_packedseq *ps, char *dest,
+                             size_t from)
+{
+    size_t iii;
+
+    for (iii = from; iii < ps->len; iii++) {
+        dest[iii] = qes_packedseq_base(ps, iii);
+    }
+}
+
+static void
+__qes_packedseq_pack_scalar (struct qes_packedseq *ps, const char *seq)
+{
+    __qes_packedseq_pack_from(ps, seq, 0);
+}
+
+static void
+__qes_packedseq_unpack_scalar (const struct qes_packedseq *ps, char *dest)
+{
+    __qes_packedseq_unpack_from(ps, dest, 0);
+}
+
+static const struct qes_packedseq_kernels __qes_packedseq_scalar = {
+    __qes_packedseq_pack_scalar,
+    __qes_packedseq_unpack_scalar,
+};
+
+#ifdef X86_SIMD_FOUND
+/* Pack 32 bases at a time. A base's code is bits 1 and 2 of its ASCII
+ * value, in either case, so two movemasks of shifted bytes give the low and
+ * high bits of 32 codes, and one more of a compare gives the ambiguous
+ * bases. */
+__attribute__((target("avx2")))
+static void
+__qes_packedseq_pack_avx2 (struct qes_packedseq *ps, const char *seq)
+{
+    const __m256i upper = _mm256_set1_epi8((char)0xDF);
+    const __m256i a = _mm256_set1_epi8('A');
+    const __m256i c = _mm256_set1_epi8('C');
+    const __m256i g = _mm256_set1_epi8('G');
+    const __m256i t = _mm256_set1_epi8('T');
+    __m256i v;
+    __m256i up;
+    __m256i acgt;
+    uint32_t valid;
+    uint32_t lo;
+    uint32_t hi;
+    size_t word = 0;
+
+    for (word = 0; word < ps->len / 32; word++) {
+        v = _mm256_loadu_si256((const __m256i *)(seq + word * 32));
+        up = _mm256_and_si256(v, upper);
+        acgt = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(up, a),
+                                _mm256_cmpeq_epi8(up, c)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(up, g),
+                                _mm256_cmpeq_epi8(up, t)));
+        valid = (uint32_t)_mm256_movemask_epi8(acgt);
+        lo = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 6));
+        hi = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 5));
+        ps->bases[word] = (__qes_packedseq_spread(lo) |
+                           __qes_packedseq_spread(hi) << 1) &
+                          (__qes_packedseq_spread(valid) * 3);
+        ps->nmask[word / 2] |= (uint64_t)(~valid) << (32 * (word % 2));
+    }
+    __qes_packedseq_pack_from(ps, seq, word * 32);
+}
+
+/* Set each byte of the result to 0xFF if its bit of ``mask`` is set */
+__attribute__((target("avx2")))
+static inline __m256i
+__qes_packedseq_mask_bytes (uint32_t mask)
+{
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0,
+                                            1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2,
+                                            3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x(0x8040201008040201LL);
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32((int)mask), spread);
+
+    return _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+}
+
+/* Unpack 32 bases at a time, turning codes into bytes and looking their
+ * letters up with a byte shuffle */
+__attribute__((target("avx2")))
+static void
+__qes_packedseq_unpack_avx2 (const struct qes_packedseq *ps, char *dest)
+{
+    const __m256i letters = _mm256_setr_epi8('A', 'C', 'T', 'G', 0, 0, 0, 0,
+                                             0, 0, 0, 0, 0, 0, 0, 0,
+                                             'A', 'C', 'T', 'G', 0, 0, 0, 0,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+    const __m256i n = _mm256_set1_epi8('N');
+    __m256i codes;
+    __m256i out;
+    uint64_t bases;
+    size_t word = 0;
+
+    for (word = 0; word < ps->len / 32; word++) {
+        bases = ps->bases[word];
+        codes = _mm256_or_si256(
+            _mm256_and_si256(__qes_packedseq_mask_bytes(
+                    __qes_packedseq_compact(bases)), one),
+            _mm256_and_si256(__qes_packedseq_mask_bytes(
+                    __qes_packedseq_compact(bases >> 1)), two));
+        out = _mm256_shuffle_epi8(letters, codes);
+        out = _mm256_blendv_epi8(out, n, __qes_packedseq_mask_bytes(
+                    (uint32_t)(ps->nmask[word / 2] >> (32 * (word % 2)))));
+        _mm256_storeu_si256((__m256i *)(dest + word * 32), out);
+    }
+    __qes_packedseq_unpack_from(ps, dest, word * 32);
+}
+
+static const struct qes_packedseq_kernels __qes_packedseq_avx2 = {
+    __qes_packedseq_pack_avx2,
+    __qes_packedseq_unpack_avx2,
+};
+#endif
+
+/* Returns the kernels for ``impl``, or NULL if they aren't supported */
+static const struct qes_packedseq_kernels *
+__qes_packedseq_resolve (enum qes_packedseq_impl impl)
+{
+    switch (impl) {
+    case QES_PACKEDSEQ_SCALAR:
+        return &__qes_packedseq_scalar;
+#ifdef X86_SIMD_FOUND
+    case QES_PACKEDSEQ_AVX2:
+        return __builtin_cpu_supports("avx2") ? &__qes_packedseq_avx2 : NULL;
+    case QES_PACKEDSEQ_AUTO:
+        if (__builtin_cpu_supports("avx2")) {
+            return &__qes_packedseq_avx2;
+        }
+        return &__qes_packedseq_scalar;
+#else
+    case QES_PACKEDSEQ_AUTO:
+        return &__qes_packedseq_scalar;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/* The kernels in use, picked on first use as in qes_scan.c */
+static const struct qes_packedseq_kernels *__qes_packedseq_impl = NULL;
+
+static const struct qes_packedseq_kernels *
+__qes_packedseq_kernels (void)
+{
+    const struct qes_packedseq_kernels *kernels =
+        __atomic_load_n(&__qes_packedseq_impl, __ATOMIC_RELAXED);
+
+    if (kernels == NULL) {
+        kernels = __qes_packedseq_resolve(QES_PACKEDSEQ_AUTO);
+        __atomic_store_n(&__qes_packedseq_impl, kernels, __ATOMIC_RELAXED);
+    }
+    return kernels;
+}
+
+int
+qes_packedseq_use (enum qes_packedseq_impl impl)
+{
+    const struct qes_packedseq_kernels *kernels =
+        __qes_packedseq_resolve(impl);
+
+    if (kernels == NULL) {
+        return -1;
+    }
+    __atomic_store_n(&__qes_packedseq_impl, kernels, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Make room for ``len`` bases, and zero the words holding them. Returns 0, or
+ * -1 if we're out of memory. */
+static int
+__qes_packedseq_clear (struct qes_packedseq *ps, size_t len)
+{
+    uint64_t *bases = NULL;
+    uint64_t *nmask = NULL;
+    size_t capacity = ps->capacity;
+
+    if (len > capacity) {
+        capacity = qes_roundupz(len);
+        /* Whole mask words, so the capacity always fits both arrays */
+        capacity = (capacity + 63) & ~(size_t)63;
+        bases = qes_realloc_errnil(ps->bases, QES_PACKEDSEQ_N_BASES(capacity) *
+                                              sizeof(*bases));
+        if (bases == NULL) {
+            return -1;
+        }
+        ps->bases = bases;
+        nmask = qes_realloc_errnil(ps->nmask, QES_PACKEDSEQ_N_MASK(capacity) *
+                                              sizeof(*nmask));
+        if (nmask == NULL) {
+            return -1;
+        }
+        ps->nmask = nmask;
+        ps->capacity = capacity;
+    }
+    memset(ps->bases, 0, QES_PACKEDSEQ_N_BASES(len) * sizeof(*ps->bases));
+    memset(ps->nmask, 0, QES_PACKEDSEQ_N_MASK(len) * sizeof(*ps->nmask));
+    ps->len = len;
+    return 0;
+}
+
+struct qes_packedseq *
+qes_packedseq_create (size_t capacity)
+{
+    struct qes_packedseq *ps = qes_calloc_errnil(1, sizeof(*ps));
+
+    if (ps == NULL) {
+        return NULL;
+    }
+    /* So that qes_packedseq_base never sees NULL words */
+    if (__qes_packedseq_clear(ps, capacity > 0 ? capacity : 64) != 0) {
+        qes_packedseq_destroy(ps);
+        return NULL;
+    }
+    ps->len = 0;
+    return ps;
+}
+
+int
+qes_packedseq_pack_str (struct qes_packedseq *ps, const char *seq, size_t len)
+{
+    if (ps == NULL || (seq == NULL && len > 0)) {
+        return -2;
+    }
+    if (__qes_packedseq_clear(ps, len) != 0) {
+        return -1;
+    }
+    if (len > 0) {
+        __qes_packedseq_kernels()->pack(ps, seq);
+    }
+    return 0;
+}
+
+int
+qes_packedseq_pack (struct qes_packedseq *ps, const struct qes_seq *seq)
+{
+    if (!qes_seq_ok_no_comment_or_qual(seq)) {
+        return -2;
+    }
+    return qes_packedseq_pack_str(ps, seq->seq.str, seq->seq.len);
+}
+
+int
+qes_packedseq_unpack_str (const struct qes_packedseq *ps, char *dest)
+{
+    if (ps == NULL || dest == NULL) {
+        return -2;
+    }
+    __qes_packedseq_kernels()->unpack(ps, dest);
+    dest[ps->len] = '\0';
+    return 0;
+}
+
+int
+qes_packedseq_unpack (const struct qes_packedseq *ps, struct qes_seq *seq)
+{
+    if (ps == NULL || !qes_seq_ok_no_comment_or_qual(seq)) {
+        return -2;
+    }
+    if (!qes_str_reserve(&seq->seq, ps->len)) {
+        return -1;
+    }
+    qes_packedseq_unpack_str(ps, seq->seq.str);
+    seq->seq.len = ps->len;
+    return 0;
+}
+
+int
+qes_packedseq_equal (const struct qes_packedseq *a,
+                     const struct qes_packedseq *b)
+{
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    if (a->len != b->len) {
+        return 0;
+    }
+    return memcmp(a->bases, b->bases,
+                  QES_PACKEDSEQ_N_BASES(a->len) * sizeof(*a->bases)) == 0 &&
+           memcmp(a->nmask, b->nmask,
+                  QES_PACKEDSEQ_N_MASK(a->len) * sizeof(*a->nmask)) == 0;
+}
+
+/* The 64-bit finaliser of MurmurHash3 */
+static inline uint64_t
+__qes_packedseq_mix (uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t
+qes_packedseq_hash (const struct qes_packedseq *ps)
+{
+    uint64_t hash;
+    size_t iii;
+
+    if (ps == NULL) {
+        return 0;
+    }
+    hash = __qes_packedseq_mix(ps->len);
+    for (iii = 0; iii < QES_PACKEDSEQ_N_BASES(ps->len); iii++) {
+        hash = __qes_packedseq_mix(hash ^ ps->bases[iii]);
+    }
+    for (iii = 0; iii < QES_PACKEDSEQ_N_MASK(ps->len); iii++) {
+        hash = __qes_packedseq_mix(hash ^ ps->nmask[iii]);
+    }
+    return hash;
+}
+
+/* Reverse the order of the 2-bit codes in ``x`` */
+static inline uint64_t
+__qes_packedseq_reverse_codes (uint64_t x)
+{
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+/* Reverse the order of the bits in ``x`` */
+static inline uint64_t
+__qes_packedseq_reverse_bits (uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    return __qes_packedseq_reverse_codes(x);
+}
+
+/* Shift the ``n_words`` words of ``words`` down by ``shift`` bits, as if
+ * they were one little-endian number */
+static void
+__qes_packedseq_shift_down (uint64_t *words, size_t n_words, unsigned shift)
+{
+    size_t iii;
+
+    if (shift == 0) {
+        return;
+    }
+    for (iii = 0; iii < n_words; iii++) {
+        words[iii] >>= shift;
+        if (iii + 1 < n_words) {
+            words[iii] |= words[iii + 1] << (64 - shift);
+        }
+    }
+}
+
+int
+qes_packedseq_revcomp (struct qes_packedseq *dest,
+                       const struct qes_packedseq *src)
+{
+    size_t n_bases;
+    size_t n_mask;
+    size_t word;
+    size_t iii;
+    uint32_t ambig;
+
+    if (dest == NULL || src == NULL || dest == src) {
+        return -2;
+    }
+    if (__qes_packedseq_clear(dest, src->len) != 0) {
+        return -1;
+    }
+    n_bases = QES_PACKEDSEQ_N_BASES(src->len);
+    n_mask = QES_PACKEDSEQ_N_MASK(src->len);
+    /* Complement all but the ambiguous bases, which stay packed as A */
+    for (iii = 0; iii < n_bases; iii++) {
+        word = n_bases - 1 - iii;
+        ambig = (uint32_t)(src->nmask[word / 2] >> (32 * (word % 2)));
+        dest->bases[iii] = __qes_packedseq_reverse_codes(src->bases[word] ^
+                (0xAAAAAAAAAAAAAAAAULL & ~(__qes_packedseq_spread(ambig) * 3)));
+    }
+    for (iii = 0; iii < n_mask; iii++) {
+        dest->nmask[iii] = __qes_packedseq_reverse_bits(
+                src->nmask[n_mask - 1 - iii]);
+    }
+    /* The last word was partly empty, and now the first is */
+    __qes_packedseq_shift_down(dest->bases, n_bases,
+                               2 * (unsigned)((32 - src->len % 32) % 32));
+    __qes_packedseq_shift_down(dest->nmask, n_mask,
+                               (unsigned)((64 - src->len % 64) % 64));
+    return 0;
+}
+
+void
+qes_packedseq_destroy_ (struct qes_packedseq *ps)
+{
+    if (ps != NULL) {
+        qes_free(ps->bases);
+        qes_free(ps->nmask);
+        qes_free(ps);
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_packedseq.h
+ *
+ *    Description:  Nucleotide sequences packed at two bits per base
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_PACKEDSEQ_H
+#define QES_PACKEDSEQ_H
+
+#include <qes_util.h>
+#include <qes_seq.h>
+
+/* Bases per word of ``bases`` */
+#define QES_PACKEDSEQ_WORD_BASES (32)
+
+enum qes_packedseq_impl {
+    /* Pick the fastest the CPU supports. This is what is used by default. */
+    QES_PACKEDSEQ_AUTO,
+    QES_PACKEDSEQ_SCALAR,
+    QES_PACKEDSEQ_AVX2,
+};
+
+/* A sequence of ``len`` bases. Base ``i`` is the two bits at
+ * ``2 * (i % 32)`` of ``bases[i / 32]``, coded A=0, C=1, T=2, G=3, so that a
+ * base's complement is its code XOR 2. Anything but ACGT (in either case) is
+ * packed as A, with bit ``i % 64`` of ``nmask[i / 64]`` set, and unpacked as
+ * N. Bits past ``len`` are always 0, so equal sequences have equal words. */
+struct qes_packedseq {
+    uint64_t *bases;
+    uint64_t *nmask;
+    size_t len;
+    /* Number of bases there is room for */
+    size_t capacity;
+};
+
+/* Create an empty packed sequence with room for ``capacity`` bases (it
+ * grows as needed). Returns NULL on error. */
+struct qes_packedseq *qes_packedseq_create
+                               (size_t                  capacity);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_packedseq_pack_str
+Parameters:     struct qes_packedseq *ps: Packed sequence to fill.
+                const char *seq: ASCII bases.
+                size_t len: Number of bases in ``seq``.
+Description:    Pack ``seq`` into ``ps``, replacing what it held. 32 bases are
+                packed at once with AVX2 where the CPU has it.
+Returns:        int: 0 on success, -1 on error, or -2 on bad arguments.
+ *===========================================================================*/
+int qes_packedseq_pack_str     (struct qes_packedseq   *ps,
+                                const char             *seq,
+                                size_t                  len);
+
+/* Pack the ``seq`` member of ``seq``, as per qes_packedseq_pack_str */
+int qes_packedseq_pack         (struct qes_packedseq   *ps,
+                                const struct qes_seq   *seq);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_packedseq_unpack_str
+Parameters:     const struct qes_packedseq *ps: Packed sequence to unpack.
+                char *dest: Buffer of at least ``ps->len + 1`` bytes.
+Description:    Write the bases of ``ps`` to ``dest`` as upper-case ASCII,
+                with N for ambiguous bases, and NUL-terminate it.
+Returns:        int: 0 on success, or -2 on bad arguments.
+ *===========================================================================*/
+int qes_packedseq_unpack_str   (const struct qes_packedseq *ps,
+                                char                   *dest);
+
+/* Unpack ``ps`` into the ``seq`` member of ``seq``, as per
+ * qes_packedseq_unpack_str. Other members are left alone. */
+int qes_packedseq_unpack       (const struct qes_packedseq *ps,
+                                struct qes_seq         *seq);
+
+/* Returns base ``idx`` of ``ps``, as qes_packedseq_unpack_str would */
+static inline char
+qes_packedseq_base (const struct qes_packedseq *ps, size_t idx)
+{
+    if ((ps->nmask[idx / 64] >> (idx % 64)) & 1) {
+        return 'N';
+    }
+    return "ACTG"[(ps->bases[idx / 32] >> (2 * (idx % 32))) & 3];
+}
+
+/* Returns non-zero if ``a`` and ``b`` hold the same sequence. Whole words
+ * are compared. */
+int qes_packedseq_equal        (const struct qes_packedseq *a,
+                                const struct qes_packedseq *b);
+
+/* Returns a hash of ``ps``, mixing a word of 32 bases at a time */
+uint64_t qes_packedseq_hash    (const struct qes_packedseq *ps);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_packedseq_revcomp
+Parameters:     struct qes_packedseq *dest: Filled with the reverse
+                    complement. May not be ``src``.
+                const struct qes_packedseq *src: Sequence to reverse
+                    complement.
+Description:    Reverse complement ``src`` a word at a time: each word is
+                complemented with one XOR and its bases reversed with a few
+                shifts and a byte swap. Ambiguous bases stay ambiguous.
+Returns:        int: 0 on success, -1 on error, or -2 on bad arguments.
+ *===========================================================================*/
+int qes_packedseq_revcomp      (struct qes_packedseq   *dest,
+                                const struct qes_packedseq *src);
+
+/* Use ``impl`` for all later packing and unpacking. Returns 0, or -1 if
+ * ``impl`` isn't supported by this CPU or build. Mostly useful for
+ * testing. */
+int qes_packedseq_use          (enum qes_packedseq_impl impl);
+
+void qes_packedseq_destroy_    (struct qes_packedseq   *ps);
+#define qes_packedseq_destroy(ps) do {                                      \
+            qes_packedseq_destroy_(ps);                                     \
+            ps = NULL;                                                      \
+        } while(0)
+
+#endif /* QES_PACKEDSEQ_H */
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_scan.c
+ *
+ *    Description:  Find every occurrence of a delimiter in a buffer in one
+ *                  pass, using SIMD where the CPU has it.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_scan.h"
+
+#ifdef X86_SIMD_FOUND
+#   include <immintrin.h>
+#endif
+
+
+typedef size_t (*qes_scan_fn)(const char *buf, size_t len, int delim,
+                              size_t *hits, size_t max_hits, size_t *scanned);
+
+/* Scan ``buf`` from ``pos`` with memchr. Also finishes off the SIMD scans. */
+static size_t
+__qes_scan_scalar_from (const char *buf, size_t pos, size_t len, int delim,
+                        size_t *hits, size_t n_hits, size_t max_hits,
+                        size_t *scanned)
+{
+    const char *found = NULL;
+
+    while (n_hits < max_hits && pos < len &&
+            (found = memchr(buf + pos, delim, len - pos)) != NULL) {
+        pos = found - buf + 1;
+        hits[n_hits++] = pos - 1;
+    }
+    *scanned = n_hits == max_hits ? pos : len;
+    return n_hits;
+}
+
+static size_t
+__qes_scan_scalar (const char *buf, size_t len, int delim, size_t *hits,
+                   size_t max_hits, size_t *scanned)
+{
+    return __qes_scan_scalar_from(buf, 0, len, delim, hits, 0, max_hits,
+                                  scanned);
+}
+
+#ifdef X86_SIMD_FOUND
+/* Record the set bits of ``mask``, matches in the block at ``pos``. Returns
+ * 1 if ``hits`` is full, setting ``*scanned``. */
+#define QES_SCAN_TAKE_MASK(mask, pos)                                       \
+    while (mask != 0) {                                                     \
+        hits[n_hits++] = pos + __builtin_ctz(mask);                         \
+        mask &= mask - 1;                                                   \
+        if (n_hits == max_hits) {                                           \
+            *scanned = hits[n_hits - 1] + 1;                                \
+            return n_hits;                                                  \
+        }                                                                   \
+    }
+
+__attribute__((target("sse2")))
+static size_t
+__qes_scan_sse2 (const char *buf, size_t len, int delim, size_t *hits,
+                 size_t max_hits, size_t *scanned)
+{
+    const __m128i needle = _mm_set1_epi8((char)delim);
+    __m128i block;
+    unsigned int mask = 0;
+    size_t pos = 0;
+    size_t n_hits = 0;
+
+    if (max_hits == 0) {
+        *scanned = 0;
+        return 0;
+    }
+    for (pos = 0; pos + 16 <= len; pos += 16) {
+        block = _mm_loadu_si128((const __m128i *)(buf + pos));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        QES_SCAN_TAKE_MASK(mask, pos)
+    }
+    return __qes_scan_scalar_from(buf, pos, len, delim, hits, n_hits,
+                                  max_hits, scanned);
+}
+
+__attribute__((target("avx2")))
+static size_t
+__qes_scan_avx2 (const char *buf, size_t len, int delim, size_t *hits,
+                 size_t max_hits, size_t *scanned)
+{
+    const __m256i needle = _mm256_set1_epi8((char)delim);
+    __m256i lo;
+    __m256i hi;
+    uint64_t mask = 0;
+    size_t pos = 0;
+    size_t n_hits = 0;
+
+    if (max_hits == 0) {
+        *scanned = 0;
+        return 0;
+    }
+    /* Two vectors per iteration, giving one 64-bit mask */
+    for (pos = 0; pos + 64 <= len; pos += 64) {
+        lo = _mm256_loadu_si256((const __m256i *)(buf + pos));
+        hi = _mm256_loadu_si256((const __m256i *)(buf + pos + 32));
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle));
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(hi, needle)) << 32;
+        while (mask != 0) {
+            hits[n_hits++] = pos + __builtin_ctzll(mask);
+            mask &= mask - 1;
+            if (n_hits == max_hits) {
+                *scanned = hits[n_hits - 1] + 1;
+                return n_hits;
+            }
+        }
+    }
+    for (; pos + 32 <= len; pos += 32) {
+        lo = _mm256_loadu_si256((const __m256i *)(buf + pos));
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle));
+        QES_SCAN_TAKE_MASK(mask, pos)
+    }
+    return __qes_scan_scalar_from(buf, pos, len, delim, hits, n_hits,
+                                  max_hits, scanned);
+}
+#undef QES_SCAN_TAKE_MASK
+#endif
+
+/* Returns the scanner for ``impl``, or NULL if it isn't supported */
+static qes_scan_fn
+__qes_scan_resolve (enum qes_scan_impl impl)
+{
+    switch (impl) {
+    case QES_SCAN_SCALAR:
+        return __qes_scan_scalar;
+#ifdef X86_SIMD_FOUND
+    case QES_SCAN_SSE2:
+        return __builtin_cpu_supports("sse2") ? __qes_scan_sse2 : NULL;
+    case QES_SCAN_AVX2:
+        return __builtin_cpu_supports("avx2") ? __qes_scan_avx2 : NULL;
+    case QES_SCAN_AUTO:
+        if (__builtin_cpu_supports("avx2")) {
+            return __qes_scan_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            return __qes_scan_sse2;
+        }
+        return __qes_scan_scalar;
+#else
+    case QES_SCAN_AUTO:
+        return __qes_scan_scalar;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/* The scanner in use, picked on first use. Threads racing to set it will all
+ * pick the same one. */
+static qes_scan_fn __qes_scan_impl = NULL;
+
+size_t
+qes_scan_delim (const char *buf, size_t len, int delim, size_t *hits,
+                size_t max_hits, size_t *scanned)
+{
+    qes_scan_fn scan = __atomic_load_n(&__qes_scan_impl, __ATOMIC_RELAXED);
+
+    if (buf == NULL || hits == NULL || scanned == NULL) {
+        if (scanned != NULL) {
+            *scanned = 0;
+        }
+        return 0;
+    }
+    if (scan == NULL) {
+        scan = __qes_scan_resolve(QES_SCAN_AUTO);
+        __atomic_store_n(&__qes_scan_impl, scan, __ATOMIC_RELAXED);
+    }
+    return scan(buf, len, delim, hits, max_hits, scanned);
+}
+
+int
+qes_scan_use (enum qes_scan_impl impl)
+{
+    qes_scan_fn scan = __qes_scan_resolve(impl);
+
+    if (scan == NULL) {
+        return -1;
+    }
+    __atomic_store_n(&__qes_scan_impl, scan, __ATOMIC_RELAXED);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_scan.h
+ *
+ *    Description:  Find every occurrence of a delimiter in a buffer in one
+ *                  pass, using SIMD where the CPU has it.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_SCAN_H
+#define QES_SCAN_H
+
+#include <qes_util.h>
+
+enum qes_scan_impl {
+    /* Pick the fastest the CPU supports. This is what is used by default. */
+    QES_SCAN_AUTO,
+    QES_SCAN_SCALAR,
+    QES_SCAN_SSE2,
+    QES_SCAN_AVX2,
+};
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_scan_delim
+Parameters:     const char *buf: Buffer to scan.
+                size_t len: Length of ``buf``.
+                int delim: Character to find.
+                size_t *hits: Array to fill with offsets of ``delim`` in
+                    ``buf``, in increasing order.
+                size_t max_hits: Length of ``hits``.
+                size_t *scanned: Set to the number of bytes of ``buf`` looked
+                    at, i.e. where to resume scanning from.
+Description:    Find the first ``max_hits`` occurrences of ``delim`` in
+                ``buf``. Blocks of 16 or 32 bytes are compared at once, and
+                the matches in each taken from a bitmask, so this is much
+                cheaper than calling memchr per occurrence when they are
+                close together, as newlines are.
+Returns:        size_t: The number of occurrences found. If this is
+                ``max_hits``, ``*scanned`` is one past the last of them,
+                otherwise it is ``len``.
+ *===========================================================================*/
+size_t qes_scan_delim          (const char             *buf,
+                                size_t                  len,
+                                int                     delim,
+                                size_t                 *hits,
+                                size_t                  max_hits,
+                                size_t                 *scanned);
+
+/* Use ``impl`` for all later scans. Returns 0, or -1 if ``impl`` isn't
+ * supported by this CPU or build. Mostly useful for testing. */
+int qes_scan_use               (enum qes_scan_impl      impl);
+
+#endif /* QES_SCAN_H */
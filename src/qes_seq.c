@@ -27,6 +27,7 @@
  */
 
 #include "qes_seq.h"
+#include "qes_sequtil.h"
 
 
 void
@@ -61,6 +62,7 @@ qes_seq_create_no_qual (void)
     seq->qual.capacity = 0;
     seq->qual.len = 0;
     seq->qual.str = NULL;
+    seq->qual.arena = NULL;
     return seq;
 }
 
@@ -73,9 +75,29 @@ qes_seq_create_no_qual_or_comment (void)
     seq->qual.capacity = 0;
     seq->qual.len = 0;
     seq->qual.str = NULL;
+    seq->qual.arena = NULL;
     seq->comment.capacity = 0;
     seq->comment.len = 0;
     seq->comment.str = NULL;
+    seq->comment.arena = NULL;
+    return seq;
+}
+
+struct qes_seq *
+qes_seq_create_in (struct qes_arena *arena)
+{
+    struct qes_seq *seq = qes_arena_alloc(arena, sizeof(*seq));
+
+    if (seq == NULL) {
+        return NULL;
+    }
+    qes_str_init_in(arena, &seq->name, __INIT_LINE_LEN);
+    qes_str_init_in(arena, &seq->comment, __INIT_LINE_LEN);
+    qes_str_init_in(arena, &seq->seq, __INIT_LINE_LEN);
+    qes_str_init_in(arena, &seq->qual, __INIT_LINE_LEN);
+    if (!qes_seq_ok(seq)) {
+        return NULL;
+    }
     return seq;
 }
 
@@ -86,7 +108,9 @@ qes_seq_fill_name (struct qes_seq *seqobj, const char *name, size_t len)
     if (seqobj == NULL || name == NULL || len < 1) {
         return 1;
     }
-    qes_str_fill_charptr(&seqobj->name, name, len);
+    if (!qes_str_fill_charptr(&seqobj->name, name, len)) {
+        return 1;
+    }
     return 0;
 }
 
@@ -96,7 +120,9 @@ qes_seq_fill_comment (struct qes_seq *seqobj, const char *comment, size_t len)
     if (seqobj == NULL || comment == NULL || len < 1) {
         return 1;
     }
-    qes_str_fill_charptr(&seqobj->comment, comment, len);
+    if (!qes_str_fill_charptr(&seqobj->comment, comment, len)) {
+        return 1;
+    }
     return 0;
 }
 
@@ -106,7 +132,9 @@ qes_seq_fill_seq (struct qes_seq *seqobj, const char *seq, size_t len)
     if (seqobj == NULL || seq == NULL || len < 1) {
         return 1;
     }
-    qes_str_fill_charptr(&seqobj->seq, seq, len);
+    if (!qes_str_fill_charptr(&seqobj->seq, seq, len)) {
+        return 1;
+    }
     return 0;
 }
 
@@ -116,7 +144,9 @@ qes_seq_fill_qual (struct qes_seq *seqobj, const char *qual, size_t len)
     if (seqobj == NULL || qual == NULL || len < 1) {
         return 1;
     }
-    qes_str_fill_charptr(&seqobj->qual, qual, len);
+    if (!qes_str_fill_charptr(&seqobj->qual, qual, len)) {
+        return 1;
+    }
     return 0;
 }
 
@@ -138,11 +168,16 @@ qes_seq_fill_header (struct qes_seq *seqobj, char *header, size_t len)
     tmp = memchr(header, ' ', len);
     startfrom = header[0] == '@' || header[0] == '>' ? 1 : 0;
     if (tmp != NULL) {
-        qes_str_fill_charptr(&seqobj->name, header + startfrom,
-                tmp - header - startfrom);
-        qes_str_fill_charptr(&seqobj->comment, tmp + 1, 0);
+        if (!qes_str_fill_charptr(&seqobj->name, header + startfrom,
+                                  tmp - header - startfrom) ||
+                !qes_str_fill_charptr(&seqobj->comment, tmp + 1, 0)) {
+            return 1;
+        }
     } else {
-        qes_str_fill_charptr(&seqobj->name, header + startfrom, len - startfrom);
+        if (!qes_str_fill_charptr(&seqobj->name, header + startfrom,
+                                  len - startfrom)) {
+            return 1;
+        }
         qes_str_nullify(&seqobj->comment);
     }
     return 0;
@@ -177,6 +212,11 @@ Returns:        void.
 void
 qes_seq_destroy_(struct qes_seq *seq)
 {
+    if (seq != NULL && seq->name.arena != NULL &&
+            qes_arena_owns(seq->name.arena, seq)) {
+        /* From qes_seq_create_in, so freed with its arena */
+        return;
+    }
     if (seq != NULL) {
         qes_str_destroy_cp(&seq->name);
         qes_str_destroy_cp(&seq->comment);
@@ -186,6 +226,70 @@ qes_seq_destroy_(struct qes_seq *seq)
     }
 }
 
+struct qes_seq_pool *
+qes_seq_pool_create (void)
+{
+    return qes_calloc_errnil(1, sizeof(struct qes_seq_pool));
+}
+
+struct qes_seq *
+qes_seq_pool_get (struct qes_seq_pool *pool)
+{
+    struct qes_seq *seq = NULL;
+
+    if (pool == NULL) {
+        return NULL;
+    }
+    if (pool->n_seqs == 0) {
+        return qes_seq_create();
+    }
+    seq = pool->seqs[--pool->n_seqs];
+    qes_str_nullify(&seq->name);
+    qes_str_nullify(&seq->comment);
+    qes_str_nullify(&seq->seq);
+    qes_str_nullify(&seq->qual);
+    return seq;
+}
+
+void
+qes_seq_pool_put (struct qes_seq_pool *pool, struct qes_seq *seq)
+{
+    struct qes_seq **seqs = NULL;
+    size_t capacity = 0;
+
+    /* Seqs from an arena are left to it */
+    if (pool == NULL || !qes_seq_ok(seq) || seq->name.arena != NULL) {
+        qes_seq_destroy(seq);
+        return;
+    }
+    if (pool->n_seqs == pool->capacity) {
+        capacity = pool->capacity > 0 ? pool->capacity * 2 : 64;
+        seqs = qes_realloc_errnil(pool->seqs, capacity * sizeof(*seqs));
+        if (seqs == NULL) {
+            qes_seq_destroy(seq);
+            return;
+        }
+        pool->seqs = seqs;
+        pool->capacity = capacity;
+    }
+    pool->seqs[pool->n_seqs++] = seq;
+}
+
+void
+qes_seq_pool_destroy_ (struct qes_seq_pool *pool)
+{
+    size_t iii;
+
+    if (pool == NULL) {
+        return;
+    }
+    for (iii = 0; iii < pool->n_seqs; iii++) {
+        qes_seq_destroy(pool->seqs[iii]);
+    }
+    qes_free(pool->seqs);
+    qes_free(pool);
+}
+
 static inline void
 _printstr_linewrap(const struct qes_str *str, size_t linelen, FILE *stream)
 {
@@ -198,6 +302,33 @@ _printstr_linewrap(const struct qes_str *str, size_t linelen, FILE *stream)
     }
 }
 
+int
+qes_seq_revcomp (struct qes_seq *seq)
+{
+    char *qual = NULL;
+    size_t len;
+    size_t iii;
+    char tmp;
+
+    if (!qes_seq_ok_no_comment_or_qual(seq)) {
+        return -2;
+    }
+    len = seq->seq.len;
+    if (qes_seq_has_qual(seq) && seq->qual.len != len) {
+        return -2;
+    }
+    qes_sequtil_revcomp_into(seq->seq.str, seq->seq.str, len, 1);
+    if (qes_seq_has_qual(seq)) {
+        qual = seq->qual.str;
+        for (iii = 0; iii < len / 2; iii++) {
+            tmp = qual[iii];
+            qual[iii] = qual[len - 1 - iii];
+            qual[len - 1 - iii] = tmp;
+        }
+    }
+    return 0;
+}
+
 int
 qes_seq_print(const struct qes_seq *seq, FILE *stream, bool fasta, int tag)
 {
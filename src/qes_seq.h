@@ -46,6 +46,15 @@ struct qes_seq {
     struct qes_str qual;
 };
 
+/* Like a struct qes_seq, but each member is a view into a buffer owned by
+ * something else (see qes_seqfile_read_view). */
+struct qes_seqview {
+    struct qes_strview name;
+    struct qes_strview comment;
+    struct qes_strview seq;
+    struct qes_strview qual;
+};
+
 /* PROTOTYPES */
 
 /*===  FUNCTION  ============================================================*
@@ -60,6 +69,17 @@ struct qes_seq *qes_seq_create (void);
 struct qes_seq *qes_seq_create_no_qual (void);
 struct qes_seq *qes_seq_create_no_qual_or_comment (void);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_seq_create_in
+Parameters:     struct qes_arena *arena: Arena to allocate from.
+Description:    As for qes_seq_create, but the ``struct qes_seq`` and all its
+                members are allocated from ``arena`` (see qes_str_init_in),
+                in one go and without zero-filling. The seq is freed with the
+                arena; qes_seq_destroy leaves it alone.
+Returns:        struct qes_seq *: A new seq, or NULL on error.
+ *===========================================================================*/
+struct qes_seq *qes_seq_create_in (struct qes_arena *arena);
+
 void qes_seq_init               (struct qes_seq        *seq);
 
 /*===  FUNCTION  ============================================================*
@@ -178,6 +198,17 @@ extern int qes_seq_fill_qual(struct qes_seq *seqobj, const char *qual,
 extern int qes_seq_fill(struct qes_seq *seqobj, const char *name,
                         const char *comment, const char *seq, const char *qual);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_seq_revcomp
+Parameters:     struct qes_seq *seq: Seq to reverse complement.
+Description:    Reverse complement the seq member of ``seq`` in place, keeping
+                the case of each base, and reverse the qual member (if any)
+                alongside it, so each quality stays with its base.
+Returns:        int: 0 on success, or -2 if ``seq`` isn't usable or has
+                qualities of a different length to its sequence.
+ *===========================================================================*/
+int qes_seq_revcomp            (struct qes_seq         *seq);
+
 /*===  FUNCTION  ============================================================*
 Name:           qes_seq_print
 Parameters:     const struct qes_seq *seq: seq to print
@@ -204,6 +235,33 @@ void qes_seq_destroy_(struct qes_seq *seq);
             seq = NULL;             \
         } while(0)
 
+/* A free list of heap seqs, so that seqs (and the memory their members have
+ * grown to) can be reused between batches rather than created anew. Not
+ * thread safe; use one per thread. */
+struct qes_seq_pool {
+    struct qes_seq **seqs;
+    size_t n_seqs;
+    size_t capacity;
+};
+
+struct qes_seq_pool *qes_seq_pool_create (void);
+
+/* Returns an empty seq, reused from ``pool`` if there is one, else from
+ * qes_seq_create. NULL on error. */
+struct qes_seq *qes_seq_pool_get (struct qes_seq_pool *pool);
+
+/* Give ``seq`` back to ``pool``, for qes_seq_pool_get to hand out again */
+void qes_seq_pool_put           (struct qes_seq_pool   *pool,
+                                 struct qes_seq        *seq);
+
+/* Free ``pool`` and all the seqs in it. Seqs taken from it and not put back
+ * must be destroyed as usual. */
+void qes_seq_pool_destroy_      (struct qes_seq_pool   *pool);
+#define qes_seq_pool_destroy(pool) do {                                     \
+            qes_seq_pool_destroy_(pool);                                    \
+            pool = NULL;                                                    \
+        } while(0)
+
 static inline int
 qes_seq_copy(struct qes_seq *dest, const struct qes_seq *src)
 {
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_seqbatch.c
+ *
+ *    Description:  Batches of sequences, stored in one contiguous arena
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_seqbatch.h"
+
+
+/* Resize each per-record array to ``capacity`` records. Returns 0 on
+ * success, leaving the batch unchanged on failure. */
+static int
+__qes_seq_batch_resize (struct qes_seq_batch *batch, size_t capacity)
+{
+    size_t **arrays[] = {
+        &batch->name_off, &batch->name_len,
+        &batch->comment_off, &batch->comment_len,
+        &batch->seq_off, &batch->seq_len,
+        &batch->qual_off, &batch->qual_len,
+    };
+    const size_t n_arrays = sizeof(arrays) / sizeof(*arrays);
+    size_t *tmp = NULL;
+    size_t iii;
+
+    for (iii = 0; iii < n_arrays; iii++) {
+        tmp = qes_realloc_errnil(*arrays[iii], capacity * sizeof(*tmp));
+        if (tmp == NULL) {
+            /* Those already resized are still big enough for n_records */
+            return -1;
+        }
+        *arrays[iii] = tmp;
+    }
+    batch->capacity = capacity;
+    return 0;
+}
+
+struct qes_seq_batch *
+qes_seq_batch_create (size_t n_records, size_t n_bytes)
+{
+    struct qes_seq_batch *batch = qes_calloc_errnil(1, sizeof(*batch));
+
+    if (batch == NULL) {
+        return NULL;
+    }
+    if (n_records == 0) {
+        n_records = QES_SEQBATCH_DEFAULT_RECORDS;
+    }
+    if (n_bytes == 0) {
+        n_bytes = QES_FILEBUFFER_LEN;
+    }
+    batch->arena = qes_malloc_errnil(n_bytes);
+    batch->arena_cap = n_bytes;
+    if (batch->arena == NULL ||
+            __qes_seq_batch_resize(batch, n_records) != 0) {
+        qes_seq_batch_destroy(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+/* Copy ``sv`` into the arena at ``*pos``, NUL-terminated */
+static inline void
+__qes_seq_batch_put (struct qes_seq_batch *batch, const struct qes_strview *sv,
+                     size_t *off, size_t *len, size_t *pos)
+{
+    *off = *pos;
+    *len = sv->len;
+    if (sv->len > 0) {
+        memcpy(batch->arena + *pos, sv->str, sv->len);
+    }
+    batch->arena[*pos + sv->len] = '\0';
+    *pos += sv->len + 1;
+}
+
+int
+qes_seq_batch_append (struct qes_seq_batch *batch,
+                      const struct qes_seqview *view)
+{
+    size_t need = 0;
+    size_t newcap = 0;
+    size_t pos = 0;
+    size_t idx = 0;
+    char *tmp = NULL;
+
+    if (!qes_seq_batch_ok(batch) || view == NULL) {
+        return -1;
+    }
+    if (batch->n_records == batch->capacity &&
+            __qes_seq_batch_resize(batch, batch->capacity * 2) != 0) {
+        return -1;
+    }
+    /* Each member plus its NUL */
+    need = batch->arena_len + view->name.len + view->comment.len +
+           view->seq.len + view->qual.len + 4;
+    if (need > batch->arena_cap) {
+        newcap = qes_roundupz(need);
+        tmp = qes_realloc_errnil(batch->arena, newcap);
+        if (tmp == NULL) {
+            return -1;
+        }
+        batch->arena = tmp;
+        batch->arena_cap = newcap;
+    }
+    idx = batch->n_records;
+    pos = batch->arena_len;
+    __qes_seq_batch_put(batch, &view->name, &batch->name_off[idx],
+                        &batch->name_len[idx], &pos);
+    __qes_seq_batch_put(batch, &view->comment, &batch->comment_off[idx],
+                        &batch->comment_len[idx], &pos);
+    __qes_seq_batch_put(batch, &view->seq, &batch->seq_off[idx],
+                        &batch->seq_len[idx], &pos);
+    __qes_seq_batch_put(batch, &view->qual, &batch->qual_off[idx],
+                        &batch->qual_len[idx], &pos);
+    batch->arena_len = pos;
+    batch->n_records++;
+    return 0;
+}
+
+/* Copy ``sv`` into ``str``, if ``str`` has been allocated. Returns 0, or -1
+ * if ``str`` couldn't grow to fit it. */
+static inline int
+__qes_seq_batch_get_member (struct qes_str *str, const struct qes_strview *sv)
+{
+    if (!qes_str_ok(str)) {
+        return 0;
+    }
+    if (!qes_str_resize(str, sv->len)) {
+        return -1;
+    }
+    memcpy(str->str, sv->str, sv->len);
+    str->str[sv->len] = '\0';
+    str->len = sv->len;
+    return 0;
+}
+
+ssize_t
+qes_seq_batch_get (const struct qes_seq_batch *batch, size_t idx,
+                   struct qes_seq *seq)
+{
+    struct qes_seqview view;
+
+    if (seq == NULL || qes_seq_batch_view(batch, idx, &view) != 0) {
+        return -2;
+    }
+    if (__qes_seq_batch_get_member(&seq->name, &view.name) != 0 ||
+            __qes_seq_batch_get_member(&seq->comment, &view.comment) != 0 ||
+            __qes_seq_batch_get_member(&seq->seq, &view.seq) != 0 ||
+            __qes_seq_batch_get_member(&seq->qual, &view.qual) != 0) {
+        return -1;
+    }
+    return view.seq.len;
+}
+
+void
+qes_seq_batch_destroy_ (struct qes_seq_batch *batch)
+{
+    if (batch != NULL) {
+        qes_free(batch->arena);
+        qes_free(batch->name_off);
+        qes_free(batch->name_len);
+        qes_free(batch->comment_off);
+        qes_free(batch->comment_len);
+        qes_free(batch->seq_off);
+        qes_free(batch->seq_len);
+        qes_free(batch->qual_off);
+        qes_free(batch->qual_len);
+        qes_free(batch);
+    }
+}
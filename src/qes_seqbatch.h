@@ -0,0 +1,153 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_seqbatch.h
+ *
+ *    Description:  Batches of sequences, stored in one contiguous arena
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_SEQBATCH_H
+#define QES_SEQBATCH_H
+
+#include <qes_util.h>
+#include <qes_seq.h>
+
+/* Number of records a batch is read up to, if no limit is given */
+#define QES_SEQBATCH_DEFAULT_RECORDS (1024)
+
+
+/*---------------------------------------------------------------------------
+  | qes_seqbatch module -- many records, with one allocation per member     |
+  ---------------------------------------------------------------------------*/
+
+/* A batch of records. The members of every record are stored back to back in
+ * ``arena``, each NUL-terminated, and located by the per-member offset and
+ * length arrays. As these are offsets rather than pointers, they survive the
+ * arena being reallocated, and batches can be reused across reads without
+ * further allocation. Missing members (e.g. qual for FASTA) have length 0. */
+struct qes_seq_batch {
+    char *arena;
+    size_t arena_len;
+    size_t arena_cap;
+    /* Number of records, and the number the arrays below have room for */
+    size_t n_records;
+    size_t capacity;
+    size_t *name_off;
+    size_t *name_len;
+    size_t *comment_off;
+    size_t *comment_len;
+    size_t *seq_off;
+    size_t *seq_len;
+    size_t *qual_off;
+    size_t *qual_len;
+};
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seq_batch_create
+Parameters:     size_t n_records: Initial number of records to make room for.
+                size_t n_bytes: Initial size of the arena.
+Description:    Create an empty ``struct qes_seq_batch`` on the heap. Either
+                size may be 0 for a sensible default; both grow as needed.
+Returns:        struct qes_seq_batch *: A new batch, or NULL on error.
+ *===========================================================================*/
+struct qes_seq_batch *qes_seq_batch_create
+                               (size_t                  n_records,
+                                size_t                  n_bytes);
+
+static inline int
+qes_seq_batch_ok (const struct qes_seq_batch *batch)
+{
+    return batch != NULL && batch->arena != NULL && batch->name_off != NULL;
+}
+
+/* Empty ``batch``, keeping its memory for reuse */
+static inline void
+qes_seq_batch_clear (struct qes_seq_batch *batch)
+{
+    if (batch == NULL) return;
+    batch->n_records = 0;
+    batch->arena_len = 0;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seq_batch_append
+Parameters:     struct qes_seq_batch *batch: Batch to append to.
+                const struct qes_seqview *view: Record to copy into ``batch``.
+Description:    Copy the record in ``view`` to the end of ``batch``, growing
+                its arena and arrays if needed.
+Returns:        int: 0 on success, or -1 on error.
+ *===========================================================================*/
+int qes_seq_batch_append       (struct qes_seq_batch   *batch,
+                                const struct qes_seqview *view);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seq_batch_view
+Parameters:     const struct qes_seq_batch *batch: Batch to look in.
+                size_t idx: Index of the record.
+                struct qes_seqview *view: View to fill.
+Description:    Point ``view`` at the ``idx``th record of ``batch``. Unlike
+                views filled by qes_seqfile_read_view, each member is
+                NUL-terminated. The view is valid until ``batch`` is next
+                appended to, cleared or destroyed.
+Returns:        int: 0 on success, or -1 if ``idx`` is out of range.
+ *===========================================================================*/
+static inline int
+qes_seq_batch_view (const struct qes_seq_batch *batch, size_t idx,
+                    struct qes_seqview *view)
+{
+    if (batch == NULL || view == NULL || idx >= batch->n_records) {
+        return -1;
+    }
+    view->name.str = batch->arena + batch->name_off[idx];
+    view->name.len = batch->name_len[idx];
+    view->comment.str = batch->arena + batch->comment_off[idx];
+    view->comment.len = batch->comment_len[idx];
+    view->seq.str = batch->arena + batch->seq_off[idx];
+    view->seq.len = batch->seq_len[idx];
+    view->qual.str = batch->arena + batch->qual_off[idx];
+    view->qual.len = batch->qual_len[idx];
+    return 0;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seq_batch_get
+Parameters:     const struct qes_seq_batch *batch: Batch to look in.
+                size_t idx: Index of the record.
+                struct qes_seq *seq: Sequence to copy the record into.
+Description:    Copy the ``idx``th record of ``batch`` into ``seq``. Members
+                of ``seq`` that weren't allocated (see
+                qes_seq_create_no_qual) are left alone.
+Returns:        ssize_t: The length of the sequence, -2 on bad arguments, or
+                -1 if a member of ``seq`` couldn't grow to fit the record.
+ *===========================================================================*/
+ssize_t qes_seq_batch_get      (const struct qes_seq_batch *batch,
+                                size_t                  idx,
+                                struct qes_seq         *seq);
+
+void qes_seq_batch_destroy_    (struct qes_seq_batch   *batch);
+#define qes_seq_batch_destroy(batch) do {                                   \
+            qes_seq_batch_destroy_(batch);                                  \
+            batch = NULL;                                                   \
+        } while(0)
+
+#endif /* QES_SEQBATCH_H */
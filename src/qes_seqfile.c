@@ -29,6 +29,70 @@
 #include "qes_seqfile.h"
 
 
+/* Parse the next FASTQ record straight out of the file's buffer, using its
+ * index of line ends. Returns 1 on success, or 0 if the record isn't wholly
+ * in the buffer or is malformed, leaving the file untouched so the caller can
+ * fall back to the line-by-line reader. */
+static inline int
+read_fastq_buffered(struct qes_seqfile *seqfile, struct qes_seq *seq)
+{
+    struct qes_file *qf = seqfile->qf;
+    const char *start = qf->bufiter;
+    const char *ends[4];
+    const char *hdr = NULL;
+    const char *space = NULL;
+    size_t hdr_len = 0;
+    size_t seq_len = 0;
+
+    if (qes_file_buffered_lines(qf, ends, 4) != 4) {
+        return 0;
+    }
+    /* Empty sequences are rare, so leave them to the slow path */
+    seq_len = ends[1] - ends[0] - 1;
+    if (seq_len < 1 || start[0] != FASTQ_DELIM ||
+            ends[1][1] != FASTQ_QUAL_DELIM ||
+            (size_t)(ends[3] - ends[2] - 1) != seq_len) {
+        return 0;
+    }
+    /* Header, without its delimiter or trailing whitespace */
+    hdr = start + 1;
+    hdr_len = ends[0] - hdr;
+    while (hdr_len > 0 && isspace(hdr[hdr_len - 1])) {
+        hdr_len--;
+    }
+    if (hdr_len > 0 && (hdr[0] == FASTQ_DELIM || hdr[0] == FASTA_DELIM)) {
+        /* qes_seq_fill_header strips a second one too */
+        hdr++;
+        hdr_len--;
+    }
+    space = memchr(hdr, ' ', hdr_len);
+    if (hdr_len < 1 || space == hdr) {
+        /* Odd headers are handled as qes_seq_fill_header does */
+        return 0;
+    }
+    /* If ``seq`` can't grow, the slow path will report it */
+    if (space != NULL) {
+        if (!qes_str_fill_charptr(&seq->name, hdr, space - hdr) ||
+                !qes_str_fill_charptr(&seq->comment, space + 1,
+                                      hdr + hdr_len - space - 1)) {
+            return 0;
+        }
+    } else {
+        if (!qes_str_fill_charptr(&seq->name, hdr, hdr_len)) {
+            return 0;
+        }
+        qes_str_nullify(&seq->comment);
+    }
+    if (qes_seq_fill_seq(seq, ends[0] + 1, seq_len) != 0 ||
+            qes_seq_fill_qual(seq, ends[2] + 1, seq_len) != 0) {
+        return 0;
+    }
+    qf->filepos += ends[3] + 1 - start;
+    qf->bufiter = (char *)ends[3] + 1;
+    seqfile->n_records++;
+    return 1;
+}
+
 static inline ssize_t
 read_fastq_seqfile(struct qes_seqfile *seqfile, struct qes_seq *seq)
 {
@@ -43,6 +107,9 @@ read_fastq_seqfile(struct qes_seqfile *seqfile, struct qes_seq *seq)
     int next = '\0';
     int errcode = -1;
 
+    if (read_fastq_buffered(seqfile, seq)) {
+        return seq->seq.len;
+    }
     /* Fast-forward past the delimiter '@', ensuring it exists */
     next = qes_file_getc(seqfile->qf);
     if (next == EOF) {
@@ -58,7 +125,10 @@ read_fastq_seqfile(struct qes_seqfile *seqfile, struct qes_seq *seq)
         errcode = -3;
         goto error;
     }
-    qes_seq_fill_header(seq, seqfile->scratch.str, seqfile->scratch.len);
+    if (qes_seq_fill_header(seq, seqfile->scratch.str,
+                            seqfile->scratch.len) != 0) {
+        goto error;
+    }
     /* Fill the actual sequence directly */
     len = qes_file_readline_str(seqfile->qf, &seq->seq);
     errcode = -4;
@@ -96,18 +166,82 @@ error:
 #undef CHECK_AND_TRIM
 }
 
+/* qes_file_peek, but giving EOF rather than an error once at EOF */
+static inline int
+fasta_peek(struct qes_file *qf)
+{
+    return qf->eof ? EOF : qes_file_peek(qf);
+}
+
+/* Append the bases of a FASTA sequence to ``str`` straight from the file's
+ * buffer, a batch of lines at a time, until the next header, EOF, or ``str``
+ * holds ``limit`` bases. Line ends are found in bulk by
+ * qes_file_buffered_lines. ``*line_start`` says whether the file is at the
+ * start of a line, and is kept up to date. ``str`` is NOT NUL-terminated.
+ * Returns 0, or -2 on error. */
+static int
+fasta_append_bases(struct qes_file *qf, struct qes_str *str, size_t limit,
+                   int *line_start)
+{
+    const char *ends[QES_FILE_LINES_LEN];
+    const char *line = NULL;
+    const char *end = NULL;
+    size_t n_lines = 0;
+    size_t len = 0;
+    size_t iii;
+    int next = '\0';
+
+    while (str->len < limit) {
+        next = fasta_peek(qf);
+        if (next == EOF || (next == FASTA_DELIM && *line_start)) {
+            return 0;
+        } else if (next < 0) {
+            return -2;
+        }
+        n_lines = qes_file_buffered_lines(qf, ends, QES_FILE_LINES_LEN);
+        /* If no line ends in the buffer, the line goes on past it, so take
+         * what there is */
+        end = n_lines > 0 ? ends[n_lines - 1] : qf->bufend;
+        len = end - qf->bufiter;
+        if (len > limit - str->len) {
+            len = limit - str->len;
+        }
+        if (!qes_str_resize(str, str->len + len)) {
+            return -2;
+        }
+        line = qf->bufiter;
+        for (iii = 0; iii < n_lines || (iii == 0 && n_lines == 0); iii++) {
+            if (str->len >= limit ||
+                    ((iii > 0 || *line_start) && line[0] == FASTA_DELIM)) {
+                break;
+            }
+            end = n_lines > 0 ? ends[iii] : qf->bufend;
+            len = end - line;
+            if (len > limit - str->len) {
+                /* Stop part way along */
+                len = limit - str->len;
+                end = line + len;
+            }
+            memcpy(str->str + str->len, line, len);
+            str->len += len;
+            if (len > 0 && str->str[str->len - 1] == '\r') {
+                str->len--;
+            }
+            *line_start = end < qf->bufend && end[0] == '\n';
+            line = *line_start ? end + 1 : end;
+        }
+        qf->filepos += line - qf->bufiter;
+        qf->bufiter = (char *)line;
+    }
+    return 0;
+}
+
 static inline ssize_t
 read_fasta_seqfile(struct qes_seqfile *seqfile, struct qes_seq *seq)
 {
-    /* Convenience macro, this happens a lot */
-#define CHECK_AND_TRIM(subrec) if (len < 1) { \
-            goto error;     \
-        } else {        \
-            subrec.str[--len] = '\0'; \
-            subrec.len = len; \
-        }
     ssize_t len = 0;
     int next = '\0';
+    int line_start = 1;
 
     /* This bit is basically a copy-paste from above */
     /* Fast-forward past the delimiter '>', ensuring it exists */
@@ -122,19 +256,14 @@ read_fasta_seqfile(struct qes_seqfile *seqfile, struct qes_seq *seq)
     if (len < 1) {
         goto error;
     }
-    qes_seq_fill_header(seq, seqfile->scratch.str, seqfile->scratch.len);
-    /* we need to nullify seq, as we rely on seq.len being 0 as we enter this
-     *  while loop */
+    if (qes_seq_fill_header(seq, seqfile->scratch.str,
+                            seqfile->scratch.len) != 0) {
+        goto error;
+    }
     qes_str_nullify(&seq->seq);
-    qes_str_nullify(&seqfile->scratch);
-    /* While the next char is not a '>', i.e. until next header line */
-    while ((next = qes_file_peek(seqfile->qf)) != EOF && next != FASTA_DELIM) {
-        len = qes_file_readline_str(seqfile->qf, &seqfile->scratch);
-        CHECK_AND_TRIM(seqfile->scratch)
-        if (len < 0) {
-            goto error;
-        }
-        qes_str_cat(&seq->seq, &seqfile->scratch);
+    if (fasta_append_bases(seqfile->qf, &seq->seq, SIZE_MAX,
+                           &line_start) != 0) {
+        goto error;
     }
     seq->seq.str[seq->seq.len] = '\0';
     /* return seq len */
@@ -147,24 +276,296 @@ error:
     qes_str_nullify(&seq->seq);
     qes_str_nullify(&seq->qual);
     return -2;
-#undef CHECK_AND_TRIM
+}
+
+/* Grow ``seq`` to fit the longest record read so far */
+static inline void
+presize_seq(const struct qes_seqfile *seqfile, struct qes_seq *seq)
+{
+    qes_str_reserve(&seq->name, seqfile->max_name_len);
+    qes_str_reserve(&seq->comment, seqfile->max_comment_len);
+    /* Sequence and quality lines are read with their line end, and
+     * qes_file_readline_str wants a byte to spare after that */
+    qes_str_reserve(&seq->seq, seqfile->max_seq_len + 2);
+    if (seqfile->format == FASTQ_FMT) {
+        qes_str_reserve(&seq->qual, seqfile->max_seq_len + 2);
+    }
+}
+
+/* Note the sizes of the record just read into ``seq`` */
+static inline void
+learn_seq_sizes(struct qes_seqfile *seqfile, const struct qes_seq *seq)
+{
+    if (seq->name.len > seqfile->max_name_len) {
+        seqfile->max_name_len = seq->name.len;
+    }
+    if (seq->comment.len > seqfile->max_comment_len) {
+        seqfile->max_comment_len = seq->comment.len;
+    }
+    if (seq->seq.len > seqfile->max_seq_len) {
+        seqfile->max_seq_len = seq->seq.len;
+    }
 }
 
 ssize_t
 qes_seqfile_read (struct qes_seqfile *seqfile, struct qes_seq *seq)
 {
+    ssize_t res = 0;
+
     if (!qes_seqfile_ok(seqfile) || !qes_seq_ok(seq)) {
         return -2;
     }
     if (seqfile->qf->eof) {
         return EOF;
     }
+    presize_seq(seqfile, seq);
     if (seqfile->format == FASTQ_FMT) {
-        return read_fastq_seqfile(seqfile, seq);
+        res = read_fastq_seqfile(seqfile, seq);
     } else if (seqfile->format == FASTA_FMT) {
-        return read_fasta_seqfile(seqfile, seq);
+        res = read_fasta_seqfile(seqfile, seq);
+    } else {
+        /* If we reach here, bail out with an error */
+        qes_str_nullify(&seq->name);
+        qes_str_nullify(&seq->comment);
+        qes_str_nullify(&seq->seq);
+        qes_str_nullify(&seq->qual);
+        return -2;
+    }
+    if (res >= 0) {
+        learn_seq_sizes(seqfile, seq);
+    }
+    return res;
+}
+
+static inline void
+view_from_seq(struct qes_seqview *view, const struct qes_seq *seq)
+{
+    view->name.str = seq->name.str;
+    view->name.len = seq->name.len;
+    view->comment.str = seq->comment.str;
+    view->comment.len = seq->comment.len;
+    view->seq.str = seq->seq.str;
+    view->seq.len = seq->seq.len;
+    view->qual.str = seq->qual.str;
+    view->qual.len = seq->qual.len;
+}
+
+/* Split a header line (without its delimiter and '\n') into name & comment, in
+ * the same way as qes_seq_fill_header. Returns 0 if the header is empty. */
+static inline int
+view_fill_header(struct qes_seqview *view, const char *header, size_t len)
+{
+    const char *space = NULL;
+
+    while (len > 0 && isspace(header[len - 1])) {
+        len--;
+    }
+    if (len < 1) {
+        return 0;
+    }
+    if (header[0] == FASTQ_DELIM || header[0] == FASTA_DELIM) {
+        header++;
+        len--;
+    }
+    space = memchr(header, ' ', len);
+    if (space != NULL) {
+        view->name.str = header;
+        view->name.len = space - header;
+        view->comment.str = space + 1;
+        view->comment.len = len - view->name.len - 1;
+    } else {
+        view->name.str = header;
+        view->name.len = len;
+        view->comment.str = header + len;
+        view->comment.len = 0;
     }
-    /* If we reach here, bail out with an error */
+    return 1;
+}
+
+/* Try to view the next record in place in the file's buffer. Returns 1 on
+ * success, or 0 if the record must be copied out with the normal reader. */
+static inline int
+view_in_buffer(struct qes_seqfile *seqfile, struct qes_seqview *view)
+{
+    struct qes_file *qf = seqfile->qf;
+    const char *start = qf->bufiter;
+    const char *end = qf->bufend;
+    const char *nl[4] = {NULL, NULL, NULL, NULL};
+    const char *line = NULL;
+    size_t n_lines = seqfile->format == FASTQ_FMT ? 4 : 2;
+
+    if (start >= end) {
+        return 0;
+    }
+    if (qes_file_buffered_lines(qf, nl, n_lines) != n_lines) {
+        return 0;
+    }
+    line = nl[n_lines - 1] + 1;
+    if (seqfile->format == FASTQ_FMT) {
+        if (start[0] != FASTQ_DELIM || nl[1][1] != FASTQ_QUAL_DELIM) {
+            return 0;
+        }
+        view->seq.str = nl[0] + 1;
+        view->seq.len = nl[1] - view->seq.str;
+        view->qual.str = nl[2] + 1;
+        view->qual.len = nl[3] - view->qual.str;
+        if (view->seq.len != view->qual.len) {
+            return 0;
+        }
+    } else {
+        /* Only single-line FASTA records can be viewed, i.e. the sequence
+         * must be followed by the next header or the end of the file. */
+        if (start[0] != FASTA_DELIM || nl[0][1] == FASTA_DELIM) {
+            return 0;
+        }
+        if (line < end ? line[0] != FASTA_DELIM : !qf->feof) {
+            return 0;
+        }
+        view->seq.str = nl[0] + 1;
+        view->seq.len = nl[1] - view->seq.str;
+        view->qual.str = nl[1];
+        view->qual.len = 0;
+    }
+    if (!view_fill_header(view, start + 1, nl[0] - start - 1)) {
+        return 0;
+    }
+    qf->filepos += line - start;
+    qf->bufiter = (char *)line;
+    seqfile->n_records++;
+    return 1;
+}
+
+ssize_t
+qes_seqfile_read_view (struct qes_seqfile *seqfile, struct qes_seqview *view)
+{
+    ssize_t res = 0;
+    int readable = 0;
+
+    if (!qes_seqfile_ok(seqfile) || view == NULL) {
+        return -2;
+    }
+    memset(view, 0, sizeof(*view));
+    if (seqfile->qf->eof) {
+        return EOF;
+    }
+    if (seqfile->format != FASTQ_FMT && seqfile->format != FASTA_FMT) {
+        return -2;
+    }
+    readable = qes_file_readable(seqfile->qf);
+    if (readable == EOF) {
+        return EOF;
+    }
+    if (readable == 1 && view_in_buffer(seqfile, view)) {
+        return view->seq.len;
+    }
+    /* Slow path: copy the record out */
+    if (seqfile->viewseq == NULL) {
+        seqfile->viewseq = qes_seq_create();
+    }
+    res = qes_seqfile_read(seqfile, seqfile->viewseq);
+    if (res >= 0) {
+        view_from_seq(view, seqfile->viewseq);
+    }
+    return res;
+}
+
+ssize_t
+qes_seqfile_read_batch (struct qes_seqfile *seqfile,
+                        struct qes_seq_batch *batch, size_t max_records,
+                        size_t max_bytes)
+{
+    struct qes_seqview view;
+    ssize_t res = 0;
+
+    if (!qes_seqfile_ok(seqfile) || !qes_seq_batch_ok(batch)) {
+        return -2;
+    }
+    if (max_records == 0 && max_bytes == 0) {
+        max_records = QES_SEQBATCH_DEFAULT_RECORDS;
+    }
+    qes_seq_batch_clear(batch);
+    while ((max_records == 0 || batch->n_records < max_records) &&
+           (max_bytes == 0 || batch->arena_len < max_bytes)) {
+        res = qes_seqfile_read_view(seqfile, &view);
+        if (res == EOF) {
+            break;
+        } else if (res < 0) {
+            return res;
+        }
+        if (qes_seq_batch_append(batch, &view) != 0) {
+            return -2;
+        }
+    }
+    if (batch->n_records == 0) {
+        return EOF;
+    }
+    return batch->n_records;
+}
+
+ssize_t
+qes_seqfile_read_window (struct qes_seqfile *seqfile, struct qes_seq *seq,
+                         size_t window, size_t overlap,
+                         struct qes_seqfile_window *pos)
+{
+    struct qes_file *qf = NULL;
+    size_t keep = 0;
+    ssize_t res = 0;
+    int next = '\0';
+    int line_start = 1;
+
+    if (!qes_seqfile_ok(seqfile) || !qes_seq_ok_no_qual(seq) ||
+            seqfile->format != FASTA_FMT || overlap >= window) {
+        return -2;
+    }
+    qf = seqfile->qf;
+    if (seqfile->window_more) {
+        /* Carry the overlap over from the last window */
+        keep = seq->seq.len < overlap ? seq->seq.len : overlap;
+        memmove(seq->seq.str, seq->seq.str + seq->seq.len - keep, keep);
+        seqfile->window_start += seq->seq.len - keep;
+    } else {
+        next = fasta_peek(qf) == EOF ? EOF : qes_file_getc(qf);
+        if (next == EOF) {
+            return EOF;
+        } else if (next != FASTA_DELIM) {
+            goto error;
+        }
+        res = qes_file_readline_str(qf, &seqfile->scratch);
+        if (res < 1) {
+            goto error;
+        }
+        if (qes_seq_fill_header(seq, seqfile->scratch.str,
+                                seqfile->scratch.len) != 0) {
+            goto error;
+        }
+        qes_str_nullify(&seq->qual);
+        seqfile->window_start = 0;
+        seqfile->n_records++;
+    }
+    if (!qes_str_resize(&seq->seq, window)) {
+        goto error;
+    }
+    seq->seq.len = keep;
+    if (fasta_append_bases(qf, &seq->seq, window, &line_start) != 0) {
+        goto error;
+    }
+    seq->seq.str[seq->seq.len] = '\0';
+    /* Skip line ends, to see if the sequence goes on */
+    while ((next = fasta_peek(qf)) == '\n' || next == '\r') {
+        qes_file_getc(qf);
+        line_start = next == '\n' || line_start;
+    }
+    if (next < 0 && next != EOF) {
+        goto error;
+    }
+    seqfile->window_more = next != EOF && !(next == FASTA_DELIM && line_start);
+    if (pos != NULL) {
+        pos->start = seqfile->window_start;
+        pos->last = !seqfile->window_more;
+    }
+    return seq->seq.len;
+error:
+    seqfile->window_more = 0;
     qes_str_nullify(&seq->name);
     qes_str_nullify(&seq->comment);
     qes_str_nullify(&seq->seq);
@@ -172,13 +573,149 @@ qes_seqfile_read (struct qes_seqfile *seqfile, struct qes_seq *seq)
     return -2;
 }
 
+/* Find the end of the line starting at ``line``, i.e. its '\n' or ``end`` */
+static inline const char *
+chunk_line_end(const char *line, const char *end)
+{
+    const char *nl = memchr(line, '\n', end - line);
+    return nl == NULL ? end : nl;
+}
+
+/* Is there a FASTQ record starting at ``start``? A '@' at the start of a
+ * line isn't enough, as quality lines may start with '@' too. We check for
+ * four lines with '@' and '+' in the right places, equal length sequence and
+ * quality, and another header (or the end) after them. Quality lines which
+ * start with '@' then fail, as two lines later is a sequence line. */
+static int
+chunk_is_record_start(const char *start, const char *end)
+{
+    const char *eol[4];
+    const char *line = start;
+    size_t iii;
+
+    if (start >= end || start[0] != FASTQ_DELIM) {
+        return 0;
+    }
+    for (iii = 0; iii < 4; iii++) {
+        if (line >= end) {
+            return 0;
+        }
+        eol[iii] = chunk_line_end(line, end);
+        line = eol[iii] + 1;
+    }
+    if (eol[1] + 1 >= end || eol[1][1] != FASTQ_QUAL_DELIM) {
+        return 0;
+    }
+    if (eol[1] - eol[0] != eol[3] - eol[2]) {
+        return 0;
+    }
+    return line >= end || line[0] == FASTQ_DELIM;
+}
+
+ssize_t
+qes_seqfile_split (struct qes_seqfile *seqfile,
+                   struct qes_seqfile_chunk *chunks, size_t n_chunks)
+{
+    const char *begin = NULL;
+    const char *end = NULL;
+    const char *prev = NULL;
+    const char *cut = NULL;
+    size_t size = 0;
+    size_t n_split = 0;
+    size_t iii;
+
+    if (!qes_seqfile_ok(seqfile) || chunks == NULL || n_chunks == 0) {
+        return -2;
+    }
+    if (!seqfile->qf->mmapped || seqfile->format != FASTQ_FMT) {
+        return -2;
+    }
+    begin = prev = seqfile->qf->bufiter;
+    end = seqfile->qf->bufend;
+    size = end - begin;
+    for (iii = 1; iii < n_chunks && prev < end; iii++) {
+        cut = begin + size / n_chunks * iii;
+        if (cut <= prev) {
+            continue;
+        }
+        /* Move to the start of the next line, then to a record */
+        if (cut[-1] != '\n') {
+            cut = chunk_line_end(cut, end);
+            cut += cut < end;
+        }
+        while (cut < end && !chunk_is_record_start(cut, end)) {
+            cut = chunk_line_end(cut, end);
+            cut += cut < end;
+        }
+        if (cut > prev) {
+            chunks[n_split].start = prev;
+            chunks[n_split].end = cut;
+            n_split++;
+            prev = cut;
+        }
+    }
+    if (prev < end) {
+        chunks[n_split].start = prev;
+        chunks[n_split].end = end;
+        n_split++;
+    }
+    return n_split;
+}
+
+ssize_t
+qes_seqfile_chunk_read_view (struct qes_seqfile_chunk *chunk,
+                             struct qes_seqview *view)
+{
+    const char *eol[4];
+    const char *line = NULL;
+    const char *end = NULL;
+    size_t iii;
+
+    if (chunk == NULL || view == NULL) {
+        return -2;
+    }
+    if (chunk->start >= chunk->end) {
+        return EOF;
+    }
+    line = chunk->start;
+    end = chunk->end;
+    for (iii = 0; iii < 4; iii++) {
+        if (line >= end) {
+            return -2;
+        }
+        eol[iii] = chunk_line_end(line, end);
+        line = eol[iii] + 1;
+    }
+    if (chunk->start[0] != FASTQ_DELIM || eol[1][1] != FASTQ_QUAL_DELIM) {
+        return -2;
+    }
+    view->seq.str = eol[0] + 1;
+    view->seq.len = eol[1] - view->seq.str;
+    view->qual.str = eol[2] + 1;
+    view->qual.len = eol[3] - view->qual.str;
+    if (view->seq.len != view->qual.len ||
+            !view_fill_header(view, chunk->start + 1,
+                              eol[0] - chunk->start - 1)) {
+        return -2;
+    }
+    chunk->start = line < end ? line : end;
+    return view->seq.len;
+}
+
 struct qes_seqfile *
 qes_seqfile_create (const char *path, const char *mode)
+{
+    return qes_seqfile_create_opts(path, mode, NULL);
+}
+
+struct qes_seqfile *
+qes_seqfile_create_opts (const char *path, const char *mode,
+                         const struct qes_file_opts *opts)
 {
     struct qes_seqfile *sf = NULL;
     if (path == NULL || mode == NULL) return NULL;
     sf = qes_calloc(1, sizeof(*sf));
-    sf->qf = qes_file_open(path, mode);
+    sf->qf = qes_file_open_opts(path, mode, opts);
     if (sf->qf == NULL) {
         qes_free(sf->qf);
         qes_free(sf);
@@ -226,10 +763,129 @@ qes_seqfile_destroy_(struct qes_seqfile *seqfile)
     if (seqfile != NULL) {
         qes_file_close(seqfile->qf);
         qes_str_destroy_cp(&seqfile->scratch);
+        qes_seq_destroy(seqfile->viewseq);
+        qes_fai_destroy(seqfile->fai);
         qes_free(seqfile);
     }
 }
 
+/* Path of the .fai index of ``seqfile``, to be freed, or NULL */
+static char *
+fai_path(const struct qes_seqfile *seqfile)
+{
+    const char *path = seqfile->qf->path;
+    size_t len = 0;
+    char *fpath = NULL;
+
+    if (path == NULL || strcmp(path, "-") == 0) {
+        return NULL;
+    }
+    len = strlen(path) + strlen(QES_FAI_EXT) + 1;
+    fpath = qes_malloc_errnil(len);
+    if (fpath != NULL) {
+        snprintf(fpath, len, "%s%s", path, QES_FAI_EXT);
+    }
+    return fpath;
+}
+
+int
+qes_seqfile_build_fai (struct qes_seqfile *seqfile)
+{
+    struct qes_fai *fai = NULL;
+    char *fpath = NULL;
+    int ret = -1;
+
+    if (!qes_seqfile_ok(seqfile) || !qes_file_readable(seqfile->qf) ||
+            seqfile->format != FASTA_FMT) {
+        return -2;
+    }
+    fai = qes_fai_build(seqfile->qf);
+    seqfile->n_records = 0;
+    seqfile->window_more = 0;
+    if (fai == NULL) {
+        return -3;
+    }
+    qes_fai_destroy(seqfile->fai);
+    seqfile->fai = fai;
+    fpath = fai_path(seqfile);
+    if (fpath != NULL) {
+        ret = qes_fai_save(fai, fpath) == 0 ? 0 : -1;
+    }
+    qes_free(fpath);
+    return ret;
+}
+
+ssize_t
+qes_seqfile_fetch (struct qes_seqfile *seqfile, const char *name,
+                   size_t start, size_t end, struct qes_seq *seq)
+{
+    const struct qes_fai_entry *entry = NULL;
+    struct qes_str *line = NULL;
+    char *fpath = NULL;
+    size_t want = 0;
+    size_t got = 0;
+    size_t bases = 0;
+    ssize_t len = 0;
+    int res = 0;
+
+    if (!qes_seqfile_ok(seqfile) || name == NULL || !qes_seq_ok_no_qual(seq)) {
+        return -2;
+    }
+    if (seqfile->fai == NULL) {
+        fpath = fai_path(seqfile);
+        seqfile->fai = qes_fai_load(fpath);
+        qes_free(fpath);
+    }
+    entry = qes_fai_find(seqfile->fai, name);
+    if (entry == NULL) {
+        return -2;
+    }
+    if (end > entry->length) {
+        end = entry->length;
+    }
+    if (start > end) {
+        return -2;
+    }
+    want = end - start;
+    qes_str_nullify(&seq->comment);
+    qes_str_nullify(&seq->qual);
+    if (!qes_str_fill_charptr(&seq->name, entry->name, strlen(entry->name)) ||
+            !qes_str_resize(&seq->seq, want)) {
+        res = -1;
+        goto error;
+    }
+    if (want > 0) {
+        res = qes_file_seek(seqfile->qf, qes_fai_entry_offset(entry, start));
+        if (res != 0) {
+            goto error;
+        }
+    }
+    line = &seqfile->scratch;
+    while (got < want) {
+        /* The first line is read from part way along */
+        len = qes_file_readline_str(seqfile->qf, line);
+        if (len < 1) {
+            res = -1;
+            goto error;
+        }
+        bases = len;
+        if (bases > 0 && line->str[bases - 1] == '\n') bases--;
+        if (bases > 0 && line->str[bases - 1] == '\r') bases--;
+        if (bases > want - got) {
+            bases = want - got;
+        }
+        memcpy(seq->seq.str + got, line->str, bases);
+        got += bases;
+    }
+    seq->seq.str[got] = '\0';
+    seq->seq.len = got;
+    return got;
+error:
+    qes_str_nullify(&seq->name);
+    qes_str_nullify(&seq->seq);
+    return res;
+}
+
 size_t
 qes_seqfile_format_seq(const struct qes_seq *seq, enum qes_seqfile_format fmt,
                        char *buffer, size_t maxlen)
@@ -271,11 +927,11 @@ qes_seqfile_format_seq(const struct qes_seq *seq, enum qes_seqfile_format fmt,
 ssize_t
 qes_seqfile_write (struct qes_seqfile *seqfile, struct qes_seq *seq)
 {
-#define sf_putc_check(c) ret = QES_ZFPUTC(seqfile->qf->fp, c);              \
-    if (ret != c) {return -2;}                                              \
+#define sf_putc_check(c) ret = qes_file_putc(seqfile->qf, c);               \
+    if (ret != 1) {return -2;}                                              \
     else {res_len += 1;}                                                    \
     ret = 0
-#define sf_puts_check(s) ret = QES_ZFPUTS(seqfile->qf->fp, s.str);          \
+#define sf_puts_check(s) ret = qes_file_putstr(seqfile->qf, &s);             \
     if (ret < 0) {return -2;}                                               \
     else {res_len += s.len;}                                                \
     ret = 0
@@ -325,3 +981,75 @@ qes_seqfile_write (struct qes_seqfile *seqfile, struct qes_seq *seq)
 #undef sf_putc_check
 #undef sf_puts_check
 }
+
+ssize_t
+qes_seqfile_write_view (struct qes_seqfile *seqfile,
+                        const struct qes_seqview *view)
+{
+#define sf_putc_check(c) ret = qes_file_putc(seqfile->qf, c);               \
+    if (ret != 1) {return -2;}                                              \
+    else {res_len += 1;}                                                    \
+    ret = 0
+#define sf_putv_check(v) str.str = (char *)v.str;                           \
+    str.len = v.len;                                                        \
+    str.capacity = v.len + 1;                                               \
+    ret = qes_file_putstr(seqfile->qf, &str);                               \
+    if (ret < 0) {return -2;}                                               \
+    else {res_len += v.len;}                                                \
+    ret = 0
+
+    struct qes_str str = {NULL, 0, 0, NULL};
+    int ret = 0;
+    ssize_t res_len = 0;
+
+    if (!qes_seqfile_ok(seqfile) || view == NULL || view->name.str == NULL ||
+            view->seq.str == NULL) {
+        return -2;
+    }
+    if (seqfile->format != FASTA_FMT && seqfile->format != FASTQ_FMT) {
+        return -2;
+    }
+    sf_putc_check(seqfile->format == FASTA_FMT ? FASTA_DELIM : FASTQ_DELIM);
+    sf_putv_check(view->name);
+    if (view->comment.len > 0) {
+        sf_putc_check(' ');
+        sf_putv_check(view->comment);
+    }
+    sf_putc_check('\n');
+    sf_putv_check(view->seq);
+    sf_putc_check('\n');
+    if (seqfile->format == FASTQ_FMT && view->qual.len > 0) {
+        sf_putc_check('+');
+        sf_putc_check('\n');
+        sf_putv_check(view->qual);
+        sf_putc_check('\n');
+    }
+    return res_len;
+#undef sf_putc_check
+#undef sf_putv_check
+}
+
+ssize_t
+qes_seqfile_write_batch (struct qes_seqfile *seqfile,
+                         const struct qes_seq_batch *batch)
+{
+    struct qes_seqview view;
+    ssize_t res = 0;
+    ssize_t res_len = 0;
+    size_t iii;
+
+    if (!qes_seqfile_ok(seqfile) || batch == NULL) {
+        return -2;
+    }
+    for (iii = 0; iii < batch->n_records; iii++) {
+        if (qes_seq_batch_view(batch, iii, &view) != 0) {
+            return -2;
+        }
+        res = qes_seqfile_write_view(seqfile, &view);
+        if (res < 0) {
+            return res;
+        }
+        res_len += res;
+    }
+    return res_len;
+}
@@ -32,6 +32,9 @@
 #include <qes_util.h>
 #include <qes_seq.h>
 #include <qes_file.h>
+#include <qes_seqbatch.h>
+#include <qes_seqreader.h>
+#include <qes_fai.h>
 
 
 /*--------------------------------------------------------------------------
@@ -55,6 +58,29 @@ struct qes_seqfile {
     /* A buffer to store misc shit in while reading.
        One per file to keep it re-entrant */
     struct qes_str scratch;
+    /* Owned copy of the last record, used by qes_seqfile_read_view when a
+       record can't be viewed in place. Allocated on first use. */
+    struct qes_seq *viewseq;
+    /* Longest name, comment and sequence read so far. Seqs are grown to fit
+       these before each read, so once the longest records have been seen,
+       reads don't grow them a piece at a time, even into fresh seqs. */
+    size_t max_name_len;
+    size_t max_comment_len;
+    size_t max_seq_len;
+    /* Index of a FASTA file, for qes_seqfile_fetch. Loaded on first use. */
+    struct qes_fai *fai;
+    /* Set by qes_seqfile_read_window while its sequence goes on, with the
+       offset in it of the last window */
+    int window_more;
+    size_t window_start;
+};
+
+/* Where a window from qes_seqfile_read_window lies in its sequence */
+struct qes_seqfile_window {
+    /* Offset of the window's first base in the sequence */
+    size_t start;
+    /* True if the window ends the sequence */
+    int last;
 };
 
 
@@ -68,6 +94,20 @@ Returns:        A fully usable ``struct qes_seqfile *`` or NULL.
  *===========================================================================*/
 struct qes_seqfile *qes_seqfile_create (const char *path, const char *mode);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_create_opts
+Parameters:     const char *path: Path to open.
+                const char *mode: Mode to pass to the fopen equivalent used.
+                const struct qes_file_opts *opts: Options for the underlying
+                    ``struct qes_file``, or NULL for the defaults.
+Description:    As for qes_seqfile_create, but opens the internal file handle
+                with qes_file_open_opts.
+Returns:        A fully usable ``struct qes_seqfile *`` or NULL.
+ *===========================================================================*/
+struct qes_seqfile *qes_seqfile_create_opts (const char *path,
+                                             const char *mode,
+                                             const struct qes_file_opts *opts);
+
 
 /*===  FUNCTION  ============================================================*
 Name:           qes_seqfile_ok
@@ -104,8 +144,171 @@ void qes_seqfile_set_format (struct qes_seqfile *file,
 
 ssize_t qes_seqfile_read (struct qes_seqfile *file, struct qes_seq *seq);
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_read_view
+Parameters:     struct qes_seqfile *file: File to read from.
+                struct qes_seqview *view: View to fill.
+Description:    Reads the next record from ``file`` like qes_seqfile_read,
+                but rather than copying each member into a ``struct qes_seq``,
+                ``view`` is pointed at the record's bytes in the file's
+                buffer. Records that span a buffer refill, multi-line FASTA
+                records and malformed records are read into an owned copy
+                instead, so ``view`` is always filled if a record is returned.
+                The members of ``view`` are NOT NUL-terminated, and are only
+                valid until the next read from ``file``, or until ``file`` is
+                destroyed.
+Returns:        The length of the sequence, EOF, or a negative error code as
+                per qes_seqfile_read.
+ *===========================================================================*/
+ssize_t qes_seqfile_read_view (struct qes_seqfile *file,
+                               struct qes_seqview *view);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_read_batch
+Parameters:     struct qes_seqfile *file: File to read from.
+                struct qes_seq_batch *batch: Batch to fill. Any records
+                    already in ``batch`` are cleared first.
+                size_t max_records: Read at most this many records, or 0 for
+                    no limit.
+                size_t max_bytes: Stop reading once the batch's arena holds at
+                    least this many bytes, or 0 for no limit. If both limits
+                    are 0, QES_SEQBATCH_DEFAULT_RECORDS records are read.
+Description:    Read the next records from ``file`` into ``batch``. Records
+                are copied straight from the file's buffer into the batch's
+                arena where possible (see qes_seqfile_read_view), so no
+                per-record allocation is done once the batch has grown to
+                size.
+Returns:        The number of records read, EOF if there were none left, or a
+                negative error code as per qes_seqfile_read. On error,
+                ``batch`` holds the records before the one in error.
+ *===========================================================================*/
+ssize_t qes_seqfile_read_batch (struct qes_seqfile *file,
+                                struct qes_seq_batch *batch,
+                                size_t max_records,
+                                size_t max_bytes);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_read_window
+Parameters:     struct qes_seqfile *file: FASTA file to read from.
+                struct qes_seq *seq: Filled with the window, and the header
+                    of its sequence. Pass the same ``seq``, unchanged, for
+                    each window of a sequence.
+                size_t window: Maximum bases per window.
+                size_t overlap: Bases at the end of each window that are
+                    repeated at the start of the next window of the same
+                    sequence, e.g. k - 1 for k-mers. Must be less than
+                    ``window``.
+                struct qes_seqfile_window *pos: Filled with the window's place
+                    in its sequence. May be NULL.
+Description:    Read the next window of a FASTA file, copying bases straight
+                from the file's buffer. Each sequence is split into windows of
+                ``window`` bases (bar its last), so memory use is bounded by
+                ``window`` however long sequences are, and ``seq`` is only
+                allocated once. A window's ``start`` is 0 at the start of
+                each sequence. Windows and whole records shouldn't be read
+                from the same sequence.
+Returns:        ssize_t: The number of bases in the window, including those
+                overlapping the last window, EOF, or -2 on bad arguments or
+                malformed input.
+ *===========================================================================*/
+ssize_t qes_seqfile_read_window (struct qes_seqfile *file,
+                                 struct qes_seq *seq,
+                                 size_t window,
+                                 size_t overlap,
+                                 struct qes_seqfile_window *pos);
+
+/* A byte range of a memory-mapped FASTQ file, starting and ending on record
+ * boundaries. See qes_seqfile_split. */
+struct qes_seqfile_chunk {
+    const char *start;
+    const char *end;
+};
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_split
+Parameters:     struct qes_seqfile *file: File to split.
+                struct qes_seqfile_chunk *chunks: Array to fill.
+                size_t n_chunks: Length of ``chunks``.
+Description:    Split the rest of ``file`` into up to ``n_chunks`` ranges of
+                about equal size, each starting at a record. As quality lines
+                may start with '@', a record start is only accepted if the
+                four lines from it look like a FASTQ record (see
+                chunk_is_record_start). The chunks can then be read
+                independently, e.g. one per thread, with
+                qes_seqfile_chunk_read_view. This needs the whole file to be
+                in memory, so only works for memory-mapped (i.e. uncompressed)
+                FASTQ files. ``file`` itself is not read from, and the chunks
+                are only valid until it is.
+Returns:        The number of chunks filled (fewer than ``n_chunks`` for
+                small files), or -2 on error or if ``file`` can't be split.
+ *===========================================================================*/
+ssize_t qes_seqfile_split (struct qes_seqfile *file,
+                           struct qes_seqfile_chunk *chunks,
+                           size_t n_chunks);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_chunk_read_view
+Parameters:     struct qes_seqfile_chunk *chunk: Chunk to read from.
+                struct qes_seqview *view: View to fill.
+Description:    Read the next record of ``chunk`` into ``view``, as for
+                qes_seqfile_read_view. This only touches ``chunk``, so
+                different chunks of one file may be read concurrently.
+Returns:        The length of the sequence, EOF at the end of the chunk, or
+                -2 if the record is malformed.
+ *===========================================================================*/
+ssize_t qes_seqfile_chunk_read_view (struct qes_seqfile_chunk *chunk,
+                                     struct qes_seqview *view);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_build_fai
+Parameters:     struct qes_seqfile *file: FASTA file to index.
+Description:    Read through the whole of ``file`` to index it for
+                qes_seqfile_fetch, and save the index beside it, with
+                QES_FAI_EXT appended to its path, as samtools faidx would.
+                ``file`` is rewound afterwards.
+Returns:        int: 0 on success, -1 if the index was built but couldn't be
+                saved, -2 on bad arguments or if ``file`` isn't FASTA, or -3
+                if ``file`` couldn't be indexed, e.g. as the lines of a
+                sequence are of different lengths.
+ *===========================================================================*/
+int qes_seqfile_build_fai (struct qes_seqfile *file);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqfile_fetch
+Parameters:     struct qes_seqfile *file: FASTA file to read from.
+                const char *name: Name of the sequence.
+                size_t start: First base to fetch, from 0.
+                size_t end: Base after the last to fetch. Ranges past the end
+                    of the sequence are cut short, so SIZE_MAX fetches to its
+                    end.
+                struct qes_seq *seq: Filled with the bases, and ``name``.
+Description:    Fetch part of a sequence, seeking straight to it with the
+                file's index, from qes_seqfile_build_fai or samtools faidx.
+                The index is loaded on first use, and must be current.
+                Uncompressed files are seeked directly, and gzip files from
+                the nearest checkpoint of their qes_file_build_index index,
+                if they have one. Record-by-record reading of ``file``
+                continues from wherever the last fetch left off, so rewind
+                ``file->qf`` before reading records again.
+Returns:        ssize_t: The number of bases fetched, -1 on error, or -2 on
+                bad arguments, if there is no index or ``name`` isn't in it,
+                or if ``file`` can't seek.
+ *===========================================================================*/
+ssize_t qes_seqfile_fetch (struct qes_seqfile *file, const char *name,
+                           size_t start, size_t end, struct qes_seq *seq);
+
 ssize_t qes_seqfile_write (struct qes_seqfile *file, struct qes_seq *seq);
 
+/* As for qes_seqfile_write, but writes the record in ``view``, e.g. from
+ * qes_seq_batch_view. Empty comments and quality scores are left out. */
+ssize_t qes_seqfile_write_view (struct qes_seqfile *file,
+                                const struct qes_seqview *view);
+
+/* Write every record of ``batch`` to ``file``, in order. Returns the number
+ * of bytes written, or -2 on error. */
+ssize_t qes_seqfile_write_batch (struct qes_seqfile *file,
+                                 const struct qes_seq_batch *batch);
+
 size_t qes_seqfile_format_seq(const struct qes_seq *seq, enum qes_seqfile_format fmt,
         char *buffer, size_t maxlen);
 
@@ -116,70 +319,131 @@ void qes_seqfile_destroy_(struct qes_seqfile *seqfile);
         } while(0)
 
 #ifdef OPENMP_FOUND
+/* The parallel iterators hand each thread whole batches from a
+ * struct qes_seqreader, so threads only synchronise once per batch. Each
+ * thread then copies its batch's records, one at a time, into its own
+ * ``sq``. As before, a ``break`` in the loop body stops that thread, and a
+ * thread stops if a record can't be copied. */
+#define QES_SEQFILE_ITER_PARALLEL_BEGIN_(rdr, mode, fle1, fle2)              \
+    {                                                                       \
+        struct qes_seqreader *rdr = qes_seqreader_create(mode, fle1, fle2,  \
+                                                         0, 0);
+
+/* Move on to the next record of the thread's batch, taking a new batch once
+ * it runs out. Breaks when there are no more. */
+#define QES_SEQFILE_ITER_PARALLEL_NEXT_(rdr, work, idx)                      \
+            if (work != NULL && idx >= work->r1->n_records) {               \
+                qes_seqreader_put(rdr, work);                               \
+                work = NULL;                                                \
+            }                                                               \
+            if (work == NULL) {                                             \
+                work = qes_seqreader_get(rdr);                              \
+                idx = 0;                                                    \
+                if (work == NULL) {                                         \
+                    break;                                                  \
+                }                                                           \
+                continue;                                                   \
+            }
+
+/* Number of chunks the chunked iterator splits files into. More chunks than
+ * threads evens out the load. */
+#define QES_SEQFILE_ITER_CHUNKS 64
+
+/* Iterate over an uncompressed FASTQ file by parsing chunks of it in
+ * parallel (see qes_seqfile_split), giving a ``struct qes_seqview vw`` per
+ * record. Records are visited in no particular order. Files which can't be
+ * split aren't iterated over, so check with qes_seqfile_split first if that
+ * matters. */
+#define QES_SEQFILE_ITER_PARALLEL_CHUNKED_BEGIN(fle, vw, ln, opts)          \
+    {                                                                       \
+        struct qes_seqfile_chunk __qes_chunks[QES_SEQFILE_ITER_CHUNKS];     \
+        long __qes_n_chunks = qes_seqfile_split(fle, __qes_chunks,          \
+                                                QES_SEQFILE_ITER_CHUNKS);   \
+        long __qes_chunk = 0;                                               \
+    _Pragma(STRINGIFY(omp parallel for schedule(dynamic) shared(fle, __qes_chunks, __qes_n_chunks) opts default(none)))\
+        for (__qes_chunk = 0; __qes_chunk < __qes_n_chunks; __qes_chunk++) {\
+            struct qes_seqview vw;                                          \
+            ssize_t ln = 0;                                                 \
+            while ((ln = qes_seqfile_chunk_read_view(                       \
+                            &__qes_chunks[__qes_chunk], &vw)) >= 0) {
+
+#define QES_SEQFILE_ITER_PARALLEL_CHUNKED_END(vw)                           \
+            }                                                               \
+        }                                                                   \
+    }
+
 #define QES_SEQFILE_ITER_PARALLEL_SINGLE_BEGIN(fle, sq, ln, opts)           \
-    _Pragma(STRINGIFY(omp parallel shared(fle) opts default(none)))         \
+    QES_SEQFILE_ITER_PARALLEL_BEGIN_(__qes_reader, QES_SEQREADER_SINGLE,    \
+                                     fle, NULL)                             \
+    _Pragma(STRINGIFY(omp parallel shared(fle, __qes_reader) opts default(none)))\
     {                                                                       \
         struct qes_seq *sq = qes_seq_create();                              \
+        struct qes_seqwork *__qes_work = NULL;                              \
+        size_t __qes_idx = 0;                                               \
         ssize_t ln = 0;                                                     \
         while(1) {                                                          \
-            _Pragma(STRINGIFY(omp critical))                                \
-            {                                                               \
-                ln = qes_seqfile_read(fle, sq);                             \
-            }                                                               \
+            QES_SEQFILE_ITER_PARALLEL_NEXT_(__qes_reader, __qes_work,       \
+                                            __qes_idx)                      \
+            ln = qes_seq_batch_get(__qes_work->r1, __qes_idx++, sq);        \
             if (ln < 0) {                                                   \
                 break;                                                      \
             }
 
 #define QES_SEQFILE_ITER_PARALLEL_SINGLE_END(sq)                            \
         }                                                                   \
+        if (__qes_work != NULL) {                                           \
+            qes_seqreader_put(__qes_reader, __qes_work);                    \
+        }                                                                   \
         qes_seq_destroy(sq);                                                \
+    }                                                                       \
+        qes_seqreader_destroy(__qes_reader);                                \
     }
 
-#define QES_SEQFILE_ITER_PARALLEL_PAIRED_BEGIN(fle1, fle2, sq1, sq2, ln1, ln2, opts)\
-    _Pragma(STRINGIFY(omp parallel shared(fle1, fle2) opts default(none)))  \
+#define QES_SEQFILE_ITER_PARALLEL_PAIRS_BEGIN_(sq1, sq2, ln1, ln2)           \
     {                                                                       \
         struct qes_seq *sq1 = qes_seq_create();                             \
         struct qes_seq *sq2 = qes_seq_create();                             \
+        struct qes_seqwork *__qes_work = NULL;                              \
+        size_t __qes_idx = 0;                                               \
         ssize_t ln1 = 0;                                                    \
         ssize_t ln2 = 0;                                                    \
         while(1) {                                                          \
-            _Pragma(STRINGIFY(omp critical))                                \
-            {                                                               \
-                ln1 = qes_seqfile_read(fle1, sq1);                          \
-                ln2 = qes_seqfile_read(fle2, sq2);                          \
-            }                                                               \
+            QES_SEQFILE_ITER_PARALLEL_NEXT_(__qes_reader, __qes_work,       \
+                                            __qes_idx)                      \
+            ln1 = qes_seq_batch_get(__qes_work->r1, __qes_idx, sq1);        \
+            ln2 = qes_seq_batch_get(__qes_work->r2, __qes_idx++, sq2);      \
             if (ln1 < 0 || ln2 < 0) {                                       \
                 break;                                                      \
             }
 
-#define QES_SEQFILE_ITER_PARALLEL_PAIRED_END(sq1, sq2)                      \
+#define QES_SEQFILE_ITER_PARALLEL_PAIRS_END_(sq1, sq2)                       \
+        }                                                                   \
+        if (__qes_work != NULL) {                                           \
+            qes_seqreader_put(__qes_reader, __qes_work);                    \
         }                                                                   \
         qes_seq_destroy(sq1);                                               \
         qes_seq_destroy(sq2);                                               \
+    }                                                                       \
+        qes_seqreader_destroy(__qes_reader);                                \
     }
 
+#define QES_SEQFILE_ITER_PARALLEL_PAIRED_BEGIN(fle1, fle2, sq1, sq2, ln1, ln2, opts)\
+    QES_SEQFILE_ITER_PARALLEL_BEGIN_(__qes_reader, QES_SEQREADER_PAIRED,    \
+                                     fle1, fle2)                            \
+    _Pragma(STRINGIFY(omp parallel shared(fle1, fle2, __qes_reader) opts default(none)))\
+    QES_SEQFILE_ITER_PARALLEL_PAIRS_BEGIN_(sq1, sq2, ln1, ln2)
+
+#define QES_SEQFILE_ITER_PARALLEL_PAIRED_END(sq1, sq2)                      \
+    QES_SEQFILE_ITER_PARALLEL_PAIRS_END_(sq1, sq2)
+
 #define QES_SEQFILE_ITER_PARALLEL_INTERLEAVED_BEGIN(fle, sq1, sq2, ln1, ln2, opts)\
-    _Pragma(STRINGIFY(omp parallel shared(fle) opts default(none)))         \
-    {                                                                       \
-        struct qes_seq *sq1 = qes_seq_create();                             \
-        struct qes_seq *sq2 = qes_seq_create();                             \
-        ssize_t ln1 = 0;                                                    \
-        ssize_t ln2 = 0;                                                    \
-        while(1) {                                                          \
-            _Pragma(STRINGIFY(omp critical))                                \
-            {                                                               \
-                ln1 = qes_seqfile_read(fle, sq1);                           \
-                ln2 = qes_seqfile_read(fle, sq2);                           \
-            }                                                               \
-            if (ln1 < 0 || ln2 < 0) {                                       \
-                break;                                                      \
-            }
+    QES_SEQFILE_ITER_PARALLEL_BEGIN_(__qes_reader,                          \
+                                     QES_SEQREADER_INTERLEAVED, fle, NULL)  \
+    _Pragma(STRINGIFY(omp parallel shared(fle, __qes_reader) opts default(none)))\
+    QES_SEQFILE_ITER_PARALLEL_PAIRS_BEGIN_(sq1, sq2, ln1, ln2)
 
 #define QES_SEQFILE_ITER_PARALLEL_INTERLEAVED_END(sq1, sq2)                 \
-        }                                                                   \
-        qes_seq_destroy(sq1);                                               \
-        qes_seq_destroy(sq2);                                               \
-    }
+    QES_SEQFILE_ITER_PARALLEL_PAIRS_END_(sq1, sq2)
 
 #endif /* OPENMP_FOUND */
 
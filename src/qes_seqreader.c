@@ -0,0 +1,609 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_seqreader.c
+ *
+ *    Description:  Pipelined reading of batches of sequences, for parallel
+ *                  consumers.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_seqreader.h"
+#include "qes_seqfile.h"
+
+#include <sched.h>
+#include <time.h>
+#ifdef PTHREADS_FOUND
+#   include <pthread.h>
+#endif
+#ifdef OPENMP_FOUND
+#   include <omp.h>
+#endif
+
+/* Number of times a waiting thread yields before it starts sleeping */
+#define QES_SEQREADER_SPINS 64
+
+/* A bounded multi-producer, multi-consumer queue of work, after Dmitry
+ * Vyukov's design. Each slot's sequence number says whether it is ready to
+ * be pushed to or popped from in the current lap of the ring, so pushes and
+ * pops only contend on a single compare-and-swap. */
+struct qes_seqreader_slot {
+    size_t seq;
+    struct qes_seqwork *work;
+};
+
+struct qes_seqreader_queue {
+    struct qes_seqreader_slot *slots;
+    size_t mask;
+    size_t head;
+    size_t tail;
+};
+
+struct qes_seqreader {
+    enum qes_seqreader_mode mode;
+    struct qes_seqfile *sf1;
+    struct qes_seqfile *sf2;
+    size_t batch_records;
+    /* All units of work, which are either in one of the queues, being
+     * filled, or held by a consumer */
+    struct qes_seqwork *works;
+    size_t n_works;
+    struct qes_seqreader_queue full;
+    struct qes_seqreader_queue empty;
+    /* Batches from the first file, waiting for their mates to be read on
+     * the mates thread */
+    struct qes_seqreader_queue half;
+    size_t next_id;
+    int check_names;
+    /* Set once the last batch has been queued, or on error */
+    int done;
+    /* Set to ask the reader thread to exit */
+    int stop;
+    int error;
+#ifdef PTHREADS_FOUND
+    pthread_t thread;
+    int running;
+    /* Reads the second file in paired mode, if asked to */
+    pthread_t mates_thread;
+    int mates_running;
+    /* Set once the reader thread has queued its last half-filled batch, and
+     * how it ended */
+    int first_done;
+    int first_res;
+#endif
+};
+
+static int
+__qes_seqreader_queue_init (struct qes_seqreader_queue *queue, size_t len)
+{
+    size_t iii;
+
+    len = qes_roundupz(len);
+    queue->slots = qes_calloc_errnil(len, sizeof(*queue->slots));
+    if (queue->slots == NULL) {
+        return -1;
+    }
+    for (iii = 0; iii < len; iii++) {
+        queue->slots[iii].seq = iii;
+    }
+    queue->mask = len - 1;
+    queue->head = 0;
+    queue->tail = 0;
+    return 0;
+}
+
+/* Returns 0 on success, or -1 if the queue is full */
+static int
+__qes_seqreader_push (struct qes_seqreader_queue *queue,
+                      struct qes_seqwork *work)
+{
+    struct qes_seqreader_slot *slot = NULL;
+    size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    size_t seq = 0;
+
+    while (1) {
+        slot = &queue->slots[pos & queue->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if ((ssize_t)(seq - pos) < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+    slot->work = work;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Returns the work at the head of the queue, or NULL if it's empty */
+static struct qes_seqwork *
+__qes_seqreader_pop (struct qes_seqreader_queue *queue)
+{
+    struct qes_seqreader_slot *slot = NULL;
+    struct qes_seqwork *work = NULL;
+    size_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    size_t seq = 0;
+
+    while (1) {
+        slot = &queue->slots[pos & queue->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos + 1) {
+            if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if ((ssize_t)(seq - (pos + 1)) < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+    work = slot->work;
+    __atomic_store_n(&slot->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    return work;
+}
+
+/* Wait a little while for another thread. Yield at first, as batches don't
+ * take long, then sleep so idle threads don't burn CPU. */
+static void
+__qes_seqreader_backoff (size_t *spins)
+{
+    struct timespec ts = {0, 100000};
+
+    if (*spins < QES_SEQREADER_SPINS) {
+        sched_yield();
+    } else {
+        nanosleep(&ts, NULL);
+    }
+    (*spins)++;
+}
+
+/* Read the second of a pair. A missing mate is an error. */
+static inline int
+__qes_seqreader_read_mate (struct qes_seqfile *sf, struct qes_seq_batch *batch)
+{
+    struct qes_seqview view;
+    ssize_t res = qes_seqfile_read_view(sf, &view);
+
+    if (res == EOF) {
+        return -2;
+    } else if (res < 0) {
+        return res;
+    }
+    return qes_seq_batch_append(batch, &view) == 0 ? 0 : -2;
+}
+
+/* Check that each pair in ``work`` is named as mates should be, if asked
+ * to. Returns 0, or -2 if a pair doesn't match. */
+static int
+__qes_seqreader_check_names (const struct qes_seqreader *reader,
+                             const struct qes_seqwork *work)
+{
+    const struct qes_seq_batch *r1 = work->r1;
+    const struct qes_seq_batch *r2 = work->r2;
+    size_t iii;
+
+    if (!reader->check_names) {
+        return 0;
+    }
+    if (r1->n_records != r2->n_records) {
+        return -2;
+    }
+    for (iii = 0; iii < r1->n_records; iii++) {
+        if (!qes_seqreader_names_pair(r1->arena + r1->name_off[iii],
+                                      r1->name_len[iii],
+                                      r2->arena + r2->name_off[iii],
+                                      r2->name_len[iii])) {
+            return -2;
+        }
+    }
+    return 0;
+}
+
+/* Fill ``work`` with the next batch, except for the mates from the second
+ * file in paired mode. Returns 1 on success, 0 at the end of input, or a
+ * negative error code. */
+static int
+__qes_seqreader_fill_first (struct qes_seqreader *reader,
+                            struct qes_seqwork *work)
+{
+    struct qes_seqview view;
+    ssize_t res = 0;
+    size_t iii;
+
+    qes_seq_batch_clear(work->r1);
+    qes_seq_batch_clear(work->r2);
+    switch (reader->mode) {
+        case QES_SEQREADER_SINGLE:
+        case QES_SEQREADER_PAIRED:
+            res = qes_seqfile_read_batch(reader->sf1, work->r1,
+                                         reader->batch_records, 0);
+            if (res < 0) {
+                return res == EOF ? 0 : res;
+            }
+            break;
+        case QES_SEQREADER_INTERLEAVED:
+            for (iii = 0; iii < reader->batch_records; iii++) {
+                res = qes_seqfile_read_view(reader->sf1, &view);
+                if (res == EOF) {
+                    break;
+                } else if (res < 0) {
+                    return res;
+                }
+                if (qes_seq_batch_append(work->r1, &view) != 0) {
+                    return -2;
+                }
+                res = __qes_seqreader_read_mate(reader->sf1, work->r2);
+                if (res < 0) {
+                    return res;
+                }
+            }
+            if (work->r1->n_records == 0) {
+                return 0;
+            }
+            res = __qes_seqreader_check_names(reader, work);
+            if (res < 0) {
+                return res;
+            }
+            break;
+        default:
+            return -2;
+    }
+    work->id = reader->next_id++;
+    return 1;
+}
+
+/* Read the mates of ``work->r1`` from the second file. Returns 1 on
+ * success, or a negative error code. */
+static int
+__qes_seqreader_fill_mates (struct qes_seqreader *reader,
+                            struct qes_seqwork *work)
+{
+    ssize_t res = qes_seqfile_read_batch(reader->sf2, work->r2,
+                                         work->r1->n_records, 0);
+
+    if (res == EOF || (res >= 0 && (size_t)res != work->r1->n_records)) {
+        return -2;
+    } else if (res < 0) {
+        return res;
+    }
+    res = __qes_seqreader_check_names(reader, work);
+    return res < 0 ? res : 1;
+}
+
+/* At the end of the first file, the second file should have ended too.
+ * Returns 0 if so, otherwise -2. */
+static int
+__qes_seqreader_end_mates (struct qes_seqreader *reader)
+{
+    struct qes_seqview view;
+
+    return qes_seqfile_read_view(reader->sf2, &view) == EOF ? 0 : -2;
+}
+
+/* Fill ``work`` with the next batch. Returns 1 on success, 0 at the end of
+ * input, or a negative error code. */
+static int
+__qes_seqreader_fill (struct qes_seqreader *reader, struct qes_seqwork *work)
+{
+    int res = __qes_seqreader_fill_first(reader, work);
+
+    if (reader->mode != QES_SEQREADER_PAIRED || res < 0) {
+        return res;
+    }
+    if (res == 0) {
+        return __qes_seqreader_end_mates(reader);
+    }
+    return __qes_seqreader_fill_mates(reader, work);
+}
+
+/* Record the end of input, and why */
+static void
+__qes_seqreader_finish (struct qes_seqreader *reader, int res)
+{
+    if (res < 0) {
+        __atomic_store_n(&reader->error, res, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&reader->done, 1, __ATOMIC_RELEASE);
+}
+
+#ifdef PTHREADS_FOUND
+/* Fills batches, or only their first halves if there is a mates thread to
+ * finish them */
+static void *
+__qes_seqreader_thread (void *arg)
+{
+    struct qes_seqreader *reader = arg;
+    struct qes_seqwork *work = NULL;
+    const int split = reader->mates_running;
+    size_t spins = 0;
+    int res = 0;
+
+    while (!__atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+        spins = 0;
+        while ((work = __qes_seqreader_pop(&reader->empty)) == NULL) {
+            if (__atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+                res = 0;
+                goto out;
+            }
+            __qes_seqreader_backoff(&spins);
+        }
+        if (split) {
+            res = __qes_seqreader_fill_first(reader, work);
+        } else {
+            res = __qes_seqreader_fill(reader, work);
+        }
+        if (res <= 0) {
+            __qes_seqreader_push(&reader->empty, work);
+            break;
+        }
+        __qes_seqreader_push(split ? &reader->half : &reader->full, work);
+    }
+out:
+    if (split) {
+        reader->first_res = res;
+        __atomic_store_n(&reader->first_done, 1, __ATOMIC_RELEASE);
+    } else {
+        __qes_seqreader_finish(reader, res);
+    }
+    return NULL;
+}
+
+/* Reads the mates of each half-filled batch from the second file, in the
+ * order the reader thread filled them */
+static void *
+__qes_seqreader_mates_thread (void *arg)
+{
+    struct qes_seqreader *reader = arg;
+    struct qes_seqwork *work = NULL;
+    size_t spins = 0;
+    int res = 0;
+
+    while (!__atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+        work = __qes_seqreader_pop(&reader->half);
+        if (work == NULL) {
+            if (!__atomic_load_n(&reader->first_done, __ATOMIC_ACQUIRE)) {
+                __qes_seqreader_backoff(&spins);
+                continue;
+            }
+            /* The last batch may have been queued since we looked */
+            work = __qes_seqreader_pop(&reader->half);
+            if (work == NULL) {
+                res = reader->first_res;
+                if (res == 0) {
+                    res = __qes_seqreader_end_mates(reader);
+                }
+                break;
+            }
+        }
+        spins = 0;
+        res = __qes_seqreader_fill_mates(reader, work);
+        if (res < 0) {
+            __qes_seqreader_push(&reader->empty, work);
+            break;
+        }
+        __qes_seqreader_push(&reader->full, work);
+        res = 0;
+    }
+    __qes_seqreader_finish(reader, res);
+    return NULL;
+}
+#endif
+
+struct qes_seqreader *
+qes_seqreader_create (enum qes_seqreader_mode mode, struct qes_seqfile *sf1,
+                      struct qes_seqfile *sf2, size_t batch_records,
+                      size_t n_batches)
+{
+    struct qes_seqreader_opts opts;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.batch_records = batch_records;
+    opts.n_batches = n_batches;
+    return qes_seqreader_create_opts(mode, sf1, sf2, &opts);
+}
+
+struct qes_seqreader *
+qes_seqreader_create_opts (enum qes_seqreader_mode mode,
+                           struct qes_seqfile *sf1, struct qes_seqfile *sf2,
+                           const struct qes_seqreader_opts *opts)
+{
+    struct qes_seqreader *reader = NULL;
+    size_t batch_records = opts != NULL ? opts->batch_records : 0;
+    size_t n_batches = opts != NULL ? opts->n_batches : 0;
+    size_t iii;
+
+    if (!qes_seqfile_ok(sf1) ||
+            (mode == QES_SEQREADER_PAIRED && !qes_seqfile_ok(sf2))) {
+        return NULL;
+    }
+    if (batch_records == 0) {
+        batch_records = QES_SEQBATCH_DEFAULT_RECORDS;
+    }
+    if (n_batches == 0) {
+        n_batches = QES_SEQREADER_DEFAULT_BATCHES;
+#ifdef OPENMP_FOUND
+        /* Enough that every thread can hold one while more are read */
+        if (n_batches < 2 * (size_t)omp_get_max_threads()) {
+            n_batches = 2 * omp_get_max_threads();
+        }
+#endif
+    }
+    reader = qes_calloc_errnil(1, sizeof(*reader));
+    if (reader == NULL) {
+        return NULL;
+    }
+    reader->mode = mode;
+    reader->sf1 = sf1;
+    reader->sf2 = sf2;
+    reader->batch_records = batch_records;
+    reader->check_names = opts != NULL && opts->check_names;
+    reader->works = qes_calloc_errnil(n_batches, sizeof(*reader->works));
+    if (reader->works == NULL ||
+            __qes_seqreader_queue_init(&reader->full, n_batches) != 0 ||
+            __qes_seqreader_queue_init(&reader->empty, n_batches) != 0 ||
+            __qes_seqreader_queue_init(&reader->half, n_batches) != 0) {
+        goto error;
+    }
+    reader->n_works = n_batches;
+    for (iii = 0; iii < n_batches; iii++) {
+        reader->works[iii].r1 = qes_seq_batch_create(batch_records, 0);
+        reader->works[iii].r2 = qes_seq_batch_create(
+                mode == QES_SEQREADER_SINGLE ? 1 : batch_records, 0);
+        if (reader->works[iii].r1 == NULL || reader->works[iii].r2 == NULL) {
+            goto error;
+        }
+        __qes_seqreader_push(&reader->empty, &reader->works[iii]);
+    }
+#ifdef PTHREADS_FOUND
+    /* The mates thread must be running before the reader thread starts, as
+     * the reader thread decides whether to leave it the second file */
+    if (mode == QES_SEQREADER_PAIRED && opts != NULL && opts->io_threads > 1) {
+        reader->mates_running = pthread_create(&reader->mates_thread, NULL,
+                __qes_seqreader_mates_thread, reader) == 0;
+    }
+    /* If we can't start the thread, consumers read batches themselves */
+    reader->running = pthread_create(&reader->thread, NULL,
+                                     __qes_seqreader_thread, reader) == 0;
+    if (!reader->running && reader->mates_running) {
+        __atomic_store_n(&reader->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(reader->mates_thread, NULL);
+        reader->mates_running = 0;
+        reader->stop = 0;
+        reader->done = 0;
+    }
+#endif
+    return reader;
+error:
+    qes_seqreader_destroy(reader);
+    return NULL;
+}
+
+struct qes_seqwork *
+qes_seqreader_get (struct qes_seqreader *reader)
+{
+    struct qes_seqwork *work = NULL;
+    size_t spins = 0;
+    int res = 0;
+    int done = 0;
+
+    if (reader == NULL) {
+        return NULL;
+    }
+    while (1) {
+#ifdef PTHREADS_FOUND
+        if (reader->running) {
+            work = __qes_seqreader_pop(&reader->full);
+            if (work != NULL) {
+                return work;
+            }
+            if (__atomic_load_n(&reader->done, __ATOMIC_ACQUIRE)) {
+                /* The last batches may have been queued since we looked */
+                return __qes_seqreader_pop(&reader->full);
+            }
+            __qes_seqreader_backoff(&spins);
+            continue;
+        }
+#endif
+        /* No reader thread, so take turns to read a batch ourselves */
+#ifdef OPENMP_FOUND
+        #pragma omp critical (qes_seqreader)
+#endif
+        {
+            done = reader->done;
+            if (!done) {
+                work = __qes_seqreader_pop(&reader->empty);
+                if (work != NULL) {
+                    res = __qes_seqreader_fill(reader, work);
+                    if (res <= 0) {
+                        __qes_seqreader_push(&reader->empty, work);
+                        __qes_seqreader_finish(reader, res);
+                        work = NULL;
+                        done = 1;
+                    }
+                }
+            }
+        }
+        if (work != NULL || done) {
+            return work;
+        }
+        /* Every batch is held by another consumer */
+        __qes_seqreader_backoff(&spins);
+    }
+}
+
+void
+qes_seqreader_put (struct qes_seqreader *reader, struct qes_seqwork *work)
+{
+    if (reader == NULL || work == NULL) {
+        return;
+    }
+    /* There is a slot for every unit of work, so this can't fail */
+    __qes_seqreader_push(&reader->empty, work);
+}
+
+int
+qes_seqreader_error (struct qes_seqreader *reader)
+{
+    if (reader == NULL) {
+        return -2;
+    }
+    return __atomic_load_n(&reader->error, __ATOMIC_RELAXED);
+}
+
+void
+qes_seqreader_destroy_ (struct qes_seqreader *reader)
+{
+    size_t iii;
+
+    if (reader == NULL) {
+        return;
+    }
+#ifdef PTHREADS_FOUND
+    if (reader->running) {
+        __atomic_store_n(&reader->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(reader->thread, NULL);
+        reader->running = 0;
+    }
+    if (reader->mates_running) {
+        __atomic_store_n(&reader->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(reader->mates_thread, NULL);
+        reader->mates_running = 0;
+    }
+#endif
+    if (reader->works != NULL) {
+        for (iii = 0; iii < reader->n_works; iii++) {
+            qes_seq_batch_destroy(reader->works[iii].r1);
+            qes_seq_batch_destroy(reader->works[iii].r2);
+        }
+    }
+    qes_free(reader->works);
+    qes_free(reader->full.slots);
+    qes_free(reader->empty.slots);
+    qes_free(reader->half.slots);
+    qes_free(reader);
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_seqreader.h
+ *
+ *    Description:  Pipelined reading of batches of sequences, for parallel
+ *                  consumers.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_SEQREADER_H
+#define QES_SEQREADER_H
+
+#include <qes_util.h>
+#include <qes_seqbatch.h>
+
+/* Number of batches in flight, if not given */
+#define QES_SEQREADER_DEFAULT_BATCHES (8)
+
+struct qes_seqfile;
+
+enum qes_seqreader_mode {
+    /* One record at a time from one file */
+    QES_SEQREADER_SINGLE,
+    /* Pairs of records, one from each of two files */
+    QES_SEQREADER_PAIRED,
+    /* Pairs of consecutive records from one file */
+    QES_SEQREADER_INTERLEAVED,
+};
+
+/* A unit of work. In paired and interleaved modes, record ``i`` of ``r1``
+ * and of ``r2`` make a pair; in single mode ``r2`` is empty. */
+struct qes_seqwork {
+    struct qes_seq_batch *r1;
+    struct qes_seq_batch *r2;
+    /* Batches are numbered from 0 in the order they were read */
+    size_t id;
+};
+
+struct qes_seqreader;
+
+/* Options for qes_seqreader_create_opts. A zeroed struct gives the defaults
+ * used by qes_seqreader_create. */
+struct qes_seqreader_opts {
+    /* Records (or pairs) per batch. 0 uses QES_SEQBATCH_DEFAULT_RECORDS. */
+    size_t batch_records;
+    /* Batches in flight. 0 uses QES_SEQREADER_DEFAULT_BATCHES or two per
+     * OpenMP thread, whichever is more. */
+    size_t n_batches;
+    /* In paired mode, read each file on a thread of its own, so that both
+     * are parsed (and decompressed) at once. Ignored in other modes, and if
+     * libqes was built without threads. */
+    int io_threads;
+    /* If non-zero, check that the names of each pair match (see
+     * qes_seqreader_names_pair), and stop with error -2 if they don't */
+    int check_names;
+};
+
+/* Returns non-zero if reads named ``name1`` and ``name2`` are mates, i.e.
+ * their names match once any "/1" or "/2" suffix is removed */
+static inline int
+qes_seqreader_names_pair (const char *name1, size_t len1, const char *name2,
+                          size_t len2)
+{
+    if (len1 >= 2 && name1[len1 - 2] == '/' &&
+            (name1[len1 - 1] == '1' || name1[len1 - 1] == '2')) {
+        len1 -= 2;
+    }
+    if (len2 >= 2 && name2[len2 - 2] == '/' &&
+            (name2[len2 - 1] == '1' || name2[len2 - 1] == '2')) {
+        len2 -= 2;
+    }
+    return len1 == len2 && memcmp(name1, name2, len1) == 0;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqreader_create
+Parameters:     enum qes_seqreader_mode mode: How records are read.
+                struct qes_seqfile *sf1: File to read.
+                struct qes_seqfile *sf2: Second file in paired mode,
+                    otherwise NULL.
+                size_t batch_records: Records (or pairs) per batch, or 0 for
+                    QES_SEQBATCH_DEFAULT_RECORDS.
+                size_t n_batches: Number of batches in flight, or 0 for
+                    QES_SEQREADER_DEFAULT_BATCHES or two per OpenMP thread,
+                    whichever is more.
+Description:    Create a reader which fills batches from ``sf1`` (and
+                ``sf2``) on a background thread, and hands them out through
+                a bounded lock-free queue. Consumers only synchronise once
+                per batch. Without threads, batches are read on the calling
+                thread, one consumer at a time. The files must not be used
+                elsewhere until the reader is destroyed.
+Returns:        A ``struct qes_seqreader *``, or NULL on error.
+ *===========================================================================*/
+struct qes_seqreader *qes_seqreader_create
+                               (enum qes_seqreader_mode mode,
+                                struct qes_seqfile     *sf1,
+                                struct qes_seqfile     *sf2,
+                                size_t                  batch_records,
+                                size_t                  n_batches);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqreader_create_opts
+Parameters:     enum qes_seqreader_mode mode: How records are read.
+                struct qes_seqfile *sf1: File to read.
+                struct qes_seqfile *sf2: Second file in paired mode,
+                    otherwise NULL.
+                const struct qes_seqreader_opts *opts: Options, or NULL for
+                    the defaults.
+Description:    As for qes_seqreader_create, with the options in ``opts``.
+                With two I/O threads in paired mode, one thread reads a batch
+                from ``sf1`` and hands it to the other, which reads as many
+                mates from ``sf2`` into the same unit of work before queueing
+                it, so batches stay matched and in order.
+Returns:        A ``struct qes_seqreader *``, or NULL on error.
+ *===========================================================================*/
+struct qes_seqreader *qes_seqreader_create_opts
+                               (enum qes_seqreader_mode mode,
+                                struct qes_seqfile     *sf1,
+                                struct qes_seqfile     *sf2,
+                                const struct qes_seqreader_opts *opts);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqreader_get
+Parameters:     struct qes_seqreader *reader: Reader to take work from.
+Description:    Take the next batch from ``reader``, waiting for one if need
+                be. This may be called from many threads at once. Each batch
+                must be handed back with qes_seqreader_put once used.
+Returns:        struct qes_seqwork *: The next batch, or NULL once all input
+                has been read (or on error, see qes_seqreader_error).
+ *===========================================================================*/
+struct qes_seqwork *qes_seqreader_get
+                               (struct qes_seqreader   *reader);
+
+/* Hand ``work`` back to ``reader``, to be refilled */
+void qes_seqreader_put         (struct qes_seqreader   *reader,
+                                struct qes_seqwork     *work);
+
+/* Returns 0, or the error which stopped ``reader``: a negative code from
+ * qes_seqfile_read, or -2 if paired input doesn't pair up (including, if
+ * checked, mates whose names don't match). */
+int qes_seqreader_error        (struct qes_seqreader   *reader);
+
+/* Stop reading, and free ``reader``. The files are not closed. */
+void qes_seqreader_destroy_    (struct qes_seqreader   *reader);
+#define qes_seqreader_destroy(reader) do {                                  \
+            qes_seqreader_destroy_(reader);                                 \
+            reader = NULL;                                                  \
+        } while(0)
+
+#endif /* QES_SEQREADER_H */
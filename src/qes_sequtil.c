@@ -28,245 +28,425 @@
 
 #include "qes_sequtil.h"
 
+#ifdef X86_SIMD_FOUND
+#   include <immintrin.h>
+#endif
 
-/*
- * ===  FUNCTION  =============================================================
- *         Name:  qes_sequtil_translate_codon
- *  Description:  translate a codon to an amino acid.
- * ============================================================================
- */
+
+/* Each base's number in qes_codon_maps plus one, or 0 if it's not ACGTU */
+static const uint8_t __qes_sequtil_base_codes[256] = {
+    ['T'] = 1, ['C'] = 2, ['A'] = 3, ['G'] = 4, ['U'] = 1,
+    ['t'] = 1, ['c'] = 2, ['a'] = 3, ['g'] = 4, ['u'] = 1,
+};
+
+/* Returns the table for ``code``, or NULL if there isn't one */
+static inline const char *
+__qes_sequtil_code_map (enum qes_genetic_code code)
+{
+    if ((int)code <= 0 || code >= QES_N_GENETIC_CODES) {
+        return NULL;
+    }
+    return qes_codon_maps[code];
+}
+
+/* Returns the amino acid ``map`` gives the three bases at ``codon`` */
+static inline char
+__qes_sequtil_translate (const char *map, const char *codon)
+{
+    unsigned b1 = __qes_sequtil_base_codes[(uint8_t)codon[0]];
+    unsigned b2 = __qes_sequtil_base_codes[(uint8_t)codon[1]];
+    unsigned b3 = __qes_sequtil_base_codes[(uint8_t)codon[2]];
+
+    if (b1 == 0 || b2 == 0 || b3 == 0) {
+        return 'X';
+    }
+    return map[16 * (b1 - 1) + 4 * (b2 - 1) + (b3 - 1)];
+}
 
 inline int
 qes_sequtil_translate_codon (const char *codon)
 {
-    if (codon == NULL || strnlen(codon, 4) != 3) {
+    if (codon == NULL || codon[0] == '\0' || codon[1] == '\0' ||
+            codon[2] == '\0' || codon[3] != '\0') {
         return -1;
     }
-    if (codon[0] == 'A') {
-        if (codon[1] == 'A') {
-            if (codon[2] == 'A') return 'K';
-            else if (codon[2] == 'C') return 'N';
-            else if (codon[2] == 'G') return 'K';
-            else if (codon[2] == 'T') return 'N';
-            else if (codon[2] == 'U') return 'N';
-         }
-        else if (codon[1] == 'C') {
-            if (codon[2] == 'A') return 'T';
-            else if (codon[2] == 'C') return 'T';
-            else if (codon[2] == 'G') return 'T';
-            else if (codon[2] == 'T') return 'T';
-            else if (codon[2] == 'U') return 'T';
-         }
-        else if (codon[1] == 'G') {
-            if (codon[2] == 'A') return 'R';
-            else if (codon[2] == 'C') return 'S';
-            else if (codon[2] == 'G') return 'R';
-            else if (codon[2] == 'T') return 'S';
-            else if (codon[2] == 'U') return 'S';
-         }
-        else if (codon[1] == 'T') {
-            if (codon[2] == 'A') return 'I';
-            else if (codon[2] == 'C') return 'I';
-            else if (codon[2] == 'G') return 'M';
-            else if (codon[2] == 'T') return 'I';
-            else if (codon[2] == 'U') return 'I';
-         }
-        else if (codon[1] == 'U') {
-            if (codon[2] == 'A') return 'I';
-            else if (codon[2] == 'C') return 'I';
-            else if (codon[2] == 'G') return 'M';
-            else if (codon[2] == 'T') return 'I';
-            else if (codon[2] == 'U') return 'I';
-         }
+    return __qes_sequtil_translate(qes_codon_maps[QES_GENETIC_CODE_STANDARD],
+                                   codon);
+}
+
+ssize_t
+qes_sequtil_translate_seq (char *dest, const char *seq, size_t len,
+                           enum qes_genetic_code code)
+{
+    const char *map = __qes_sequtil_code_map(code);
+    size_t n_aas = len / 3;
+    size_t iii;
+
+    if (dest == NULL || map == NULL || (seq == NULL && len > 0)) {
+        return -2;
+    }
+    for (iii = 0; iii < n_aas; iii++) {
+        dest[iii] = __qes_sequtil_translate(map, seq + 3 * iii);
+    }
+    dest[n_aas] = '\0';
+    return n_aas;
+}
+
+int
+qes_sequtil_translate_6frame (char *frames[6], const char *seq, size_t len,
+                              enum qes_genetic_code code)
+{
+    const char *map = __qes_sequtil_code_map(code);
+    /* The codon ending at the current base, and its reverse complement */
+    unsigned fwd = 0;
+    unsigned rev = 0;
+    unsigned base;
+    /* How many bases up to the current one are ACGTU */
+    size_t good = 0;
+    size_t start;
+    size_t n_aas;
+    size_t iii;
+
+    if (frames == NULL || map == NULL || (seq == NULL && len > 0)) {
+        return -2;
+    }
+    for (iii = 0; iii < 6; iii++) {
+        if (frames[iii] == NULL) {
+            return -2;
+        }
+    }
+    for (iii = 0; iii < len; iii++) {
+        base = __qes_sequtil_base_codes[(uint8_t)seq[iii]];
+        if (base == 0) {
+            good = 0;
+            base = 1;
+        } else {
+            good++;
+        }
+        base--;
+        fwd = ((fwd << 2) | base) & 63;
+        /* Complementing swaps T and A, and C and G */
+        rev = (rev >> 2) | ((base ^ 2) << 4);
+        if (iii < 2) {
+            continue;
+        }
+        start = iii - 2;
+        frames[start % 3][start / 3] = good >= 3 ? map[fwd] : 'X';
+        /* Where this codon starts in the reverse complement */
+        start = len - 1 - iii;
+        frames[3 + start % 3][start / 3] = good >= 3 ? map[rev] : 'X';
+    }
+    for (iii = 0; iii < 3; iii++) {
+        n_aas = len > iii ? (len - iii) / 3 : 0;
+        frames[iii][n_aas] = '\0';
+        frames[3 + iii][n_aas] = '\0';
+    }
+    return 0;
+}
+
+
+/* Complements of each byte, for qes_sequtil_revcomp_into. IUPAC codes are
+ * complemented, gaps kept, and anything else made N. */
+static const char __qes_sequtil_comp_upper[256] =
+    /* 0x00 */ "NNNNNNNNNNNNNNNN"
+    /* 0x10 */ "NNNNNNNNNNNNNNNN"
+    /* 0x20 */ "NNNNNNNNNNNNN-.N"
+    /* 0x30 */ "NNNNNNNNNNNNNNNN"
+    /* 0x40 */ "NTVGHNNCDNNMNKNN"
+    /* 0x50 */ "NNYSAABWNRNNNNNN"
+    /* 0x60 */ "NTVGHNNCDNNMNKNN"
+    /* 0x70 */ "NNYSAABWNRNNNNNN"
+    /* 0x80 */ "NNNNNNNNNNNNNNNN"
+    /* 0x90 */ "NNNNNNNNNNNNNNNN"
+    /* 0xA0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xB0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xC0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xD0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xE0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xF0 */ "NNNNNNNNNNNNNNNN";
+/* As above, but keeping the case of letters */
+static const char __qes_sequtil_comp_keep[256] =
+    /* 0x00 */ "NNNNNNNNNNNNNNNN"
+    /* 0x10 */ "NNNNNNNNNNNNNNNN"
+    /* 0x20 */ "NNNNNNNNNNNNN-.N"
+    /* 0x30 */ "NNNNNNNNNNNNNNNN"
+    /* 0x40 */ "NTVGHNNCDNNMNKNN"
+    /* 0x50 */ "NNYSAABWNRNNNNNN"
+    /* 0x60 */ "Ntvghnncdnnmnknn"
+    /* 0x70 */ "nnysaabwnrnNNNNN"
+    /* 0x80 */ "NNNNNNNNNNNNNNNN"
+    /* 0x90 */ "NNNNNNNNNNNNNNNN"
+    /* 0xA0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xB0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xC0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xD0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xE0 */ "NNNNNNNNNNNNNNNN"
+    /* 0xF0 */ "NNNNNNNNNNNNNNNN";
+
+typedef void (*qes_revcomp_fn)(char *dest, const char *seq, size_t len,
+                               int keep_case);
+
+/* Reverse complement ``n`` pairs of bases, from ``lo`` and ``hi - 1``
+ * inwards. Both bases of a pair are read before either is written, so
+ * ``dest`` may be ``seq``. */
+static inline void
+__qes_sequtil_revcomp_pairs (char *dest, const char *seq, size_t lo,
+                             size_t hi, size_t n, const char *comp)
+{
+    size_t iii;
+    char a;
+    char b;
+
+    for (iii = 0; iii < n; iii++) {
+        a = seq[lo + iii];
+        b = seq[hi - 1 - iii];
+        dest[lo + iii] = comp[(uint8_t)b];
+        dest[hi - 1 - iii] = comp[(uint8_t)a];
+    }
+}
+
+static void
+__qes_sequtil_revcomp_scalar (char *dest, const char *seq, size_t len,
+                              int keep_case)
+{
+    const char *comp = keep_case ? __qes_sequtil_comp_keep
+                                 : __qes_sequtil_comp_upper;
+
+    __qes_sequtil_revcomp_pairs(dest, seq, 0, len, (len + 1) / 2, comp);
+}
+
+#ifdef X86_SIMD_FOUND
+/* Complements of 'A' + i - 1, by the low five bits of a letter, split in two
+ * for byte shuffles. Non-letters are handled by the scalar code. */
+#define QES_SEQUTIL_COMP_LO \
+    'N', 'T', 'V', 'G', 'H', 'N', 'N', 'C', \
+    'D', 'N', 'N', 'M', 'N', 'K', 'N', 'N'
+#define QES_SEQUTIL_COMP_HI \
+    'N', 'N', 'Y', 'S', 'A', 'A', 'B', 'W', \
+    'N', 'R', 'N', 'N', 'N', 'N', 'N', 'N'
+
+/* Reverse complement 16 letters, looking up their complements by their low
+ * five bits. Sets ``*ok`` to 0 if any byte isn't a letter. */
+__attribute__((target("ssse3")))
+static inline __m128i
+__qes_sequtil_revcomp_16 (__m128i v, int keep_case, int *ok)
+{
+    const __m128i lo_table = _mm_setr_epi8(QES_SEQUTIL_COMP_LO);
+    const __m128i hi_table = _mm_setr_epi8(QES_SEQUTIL_COMP_HI);
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i lower = _mm_set1_epi8(0x20);
+    __m128i idx = _mm_and_si128(v, _mm_set1_epi8(0x1F));
+    __m128i from_a = _mm_sub_epi8(_mm_andnot_si128(lower, v),
+                                  _mm_set1_epi8('A'));
+    __m128i letters = _mm_and_si128(
+            _mm_cmpgt_epi8(from_a, _mm_set1_epi8(-1)),
+            _mm_cmpgt_epi8(_mm_set1_epi8(26), from_a));
+    __m128i high = _mm_cmpgt_epi8(idx, _mm_set1_epi8(15));
+    __m128i comp = _mm_or_si128(
+            _mm_and_si128(high, _mm_shuffle_epi8(hi_table, idx)),
+            _mm_andnot_si128(high, _mm_shuffle_epi8(lo_table, idx)));
+
+    *ok &= _mm_movemask_epi8(letters) == 0xFFFF;
+    if (keep_case) {
+        comp = _mm_or_si128(comp, _mm_and_si128(v, lower));
+    }
+    return _mm_shuffle_epi8(comp, reverse);
+}
+
+/* Reverse complement 16 bases from each end at a time, swapping the blocks.
+ * Blocks with anything but letters in them are done by table instead. */
+__attribute__((target("ssse3")))
+static void
+__qes_sequtil_revcomp_ssse3 (char *dest, const char *seq, size_t len,
+                             int keep_case)
+{
+    const char *comp = keep_case ? __qes_sequtil_comp_keep
+                                 : __qes_sequtil_comp_upper;
+    size_t lo = 0;
+    size_t hi = len;
+    __m128i a;
+    __m128i b;
+    int ok;
+
+    for (; hi - lo >= 32; lo += 16, hi -= 16) {
+        ok = 1;
+        a = __qes_sequtil_revcomp_16(
+                _mm_loadu_si128((const __m128i *)(seq + lo)), keep_case, &ok);
+        b = __qes_sequtil_revcomp_16(
+                _mm_loadu_si128((const __m128i *)(seq + hi - 16)), keep_case,
+                &ok);
+        if (!ok) {
+            __qes_sequtil_revcomp_pairs(dest, seq, lo, hi, 16, comp);
+            continue;
+        }
+        _mm_storeu_si128((__m128i *)(dest + lo), b);
+        _mm_storeu_si128((__m128i *)(dest + hi - 16), a);
     }
-    else if (codon[0] == 'C') {
-        if (codon[1] == 'A') {
-            if (codon[2] == 'A') return 'Q';
-            else if (codon[2] == 'C') return 'H';
-            else if (codon[2] == 'G') return 'Q';
-            else if (codon[2] == 'T') return 'H';
-            else if (codon[2] == 'U') return 'H';
-         }
-        else if (codon[1] == 'C') {
-            if (codon[2] == 'A') return 'P';
-            else if (codon[2] == 'C') return 'P';
-            else if (codon[2] == 'G') return 'P';
-            else if (codon[2] == 'T') return 'P';
-            else if (codon[2] == 'U') return 'P';
-         }
-        else if (codon[1] == 'G') {
-            if (codon[2] == 'A') return 'R';
-            else if (codon[2] == 'C') return 'R';
-            else if (codon[2] == 'G') return 'R';
-            else if (codon[2] == 'T') return 'R';
-            else if (codon[2] == 'U') return 'R';
-         }
-        else if (codon[1] == 'T') {
-            if (codon[2] == 'A') return 'L';
-            else if (codon[2] == 'C') return 'L';
-            else if (codon[2] == 'G') return 'L';
-            else if (codon[2] == 'T') return 'L';
-            else if (codon[2] == 'U') return 'L';
-         }
-        else if (codon[1] == 'U') {
-            if (codon[2] == 'A') return 'L';
-            else if (codon[2] == 'C') return 'L';
-            else if (codon[2] == 'G') return 'L';
-            else if (codon[2] == 'T') return 'L';
-            else if (codon[2] == 'U') return 'L';
-         }
+    __qes_sequtil_revcomp_pairs(dest, seq, lo, hi, (hi - lo + 1) / 2, comp);
+}
+
+/* As __qes_sequtil_revcomp_16, but 32 at a time. The shuffles work within
+ * 128-bit lanes, so the lanes are swapped after. */
+__attribute__((target("avx2")))
+static inline __m256i
+__qes_sequtil_revcomp_32 (__m256i v, int keep_case, int *ok)
+{
+    const __m256i lo_table = _mm256_setr_epi8(QES_SEQUTIL_COMP_LO,
+                                              QES_SEQUTIL_COMP_LO);
+    const __m256i hi_table = _mm256_setr_epi8(QES_SEQUTIL_COMP_HI,
+                                              QES_SEQUTIL_COMP_HI);
+    const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0,
+                                             15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    __m256i idx = _mm256_and_si256(v, _mm256_set1_epi8(0x1F));
+    __m256i from_a = _mm256_sub_epi8(_mm256_andnot_si256(lower, v),
+                                     _mm256_set1_epi8('A'));
+    __m256i letters = _mm256_and_si256(
+            _mm256_cmpgt_epi8(from_a, _mm256_set1_epi8(-1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(26), from_a));
+    __m256i comp = _mm256_blendv_epi8(_mm256_shuffle_epi8(lo_table, idx),
+                                      _mm256_shuffle_epi8(hi_table, idx),
+                                      _mm256_slli_epi16(idx, 3));
+
+    *ok &= _mm256_movemask_epi8(letters) == -1;
+    if (keep_case) {
+        comp = _mm256_or_si256(comp, _mm256_and_si256(v, lower));
     }
-    else if (codon[0] == 'G') {
-        if (codon[1] == 'A') {
-            if (codon[2] == 'A') return 'E';
-            else if (codon[2] == 'C') return 'D';
-            else if (codon[2] == 'G') return 'E';
-            else if (codon[2] == 'T') return 'D';
-            else if (codon[2] == 'U') return 'D';
-         }
-        else if (codon[1] == 'C') {
-            if (codon[2] == 'A') return 'A';
-            else if (codon[2] == 'C') return 'A';
-            else if (codon[2] == 'G') return 'A';
-            else if (codon[2] == 'T') return 'A';
-            else if (codon[2] == 'U') return 'A';
-         }
-        else if (codon[1] == 'G') {
-            if (codon[2] == 'A') return 'G';
-            else if (codon[2] == 'C') return 'G';
-            else if (codon[2] == 'G') return 'G';
-            else if (codon[2] == 'T') return 'G';
-            else if (codon[2] == 'U') return 'G';
-         }
-        else if (codon[1] == 'T') {
-            if (codon[2] == 'A') return 'V';
-            else if (codon[2] == 'C') return 'V';
-            else if (codon[2] == 'G') return 'V';
-            else if (codon[2] == 'T') return 'V';
-            else if (codon[2] == 'U') return 'V';
-         }
-        else if (codon[1] == 'U') {
-            if (codon[2] == 'A') return 'V';
-            else if (codon[2] == 'C') return 'V';
-            else if (codon[2] == 'G') return 'V';
-            else if (codon[2] == 'T') return 'V';
-            else if (codon[2] == 'U') return 'V';
-         }
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(comp, reverse), 0x4E);
+}
+
+__attribute__((target("avx2")))
+static void
+__qes_sequtil_revcomp_avx2 (char *dest, const char *seq, size_t len,
+                            int keep_case)
+{
+    const char *comp = keep_case ? __qes_sequtil_comp_keep
+                                 : __qes_sequtil_comp_upper;
+    size_t lo = 0;
+    size_t hi = len;
+    __m256i a;
+    __m256i b;
+    int ok;
+
+    for (; hi - lo >= 64; lo += 32, hi -= 32) {
+        ok = 1;
+        a = __qes_sequtil_revcomp_32(
+                _mm256_loadu_si256((const __m256i *)(seq + lo)), keep_case,
+                &ok);
+        b = __qes_sequtil_revcomp_32(
+                _mm256_loadu_si256((const __m256i *)(seq + hi - 32)),
+                keep_case, &ok);
+        if (!ok) {
+            __qes_sequtil_revcomp_pairs(dest, seq, lo, hi, 32, comp);
+            continue;
+        }
+        _mm256_storeu_si256((__m256i *)(dest + lo), b);
+        _mm256_storeu_si256((__m256i *)(dest + hi - 32), a);
     }
-    else if (codon[0] == 'T') {
-        if (codon[1] == 'A') {
-            if (codon[2] == 'A') return '*';
-            else if (codon[2] == 'C') return 'Y';
-            else if (codon[2] == 'G') return '*';
-            else if (codon[2] == 'T') return 'Y';
-            else if (codon[2] == 'U') return 'Y';
-         }
-        else if (codon[1] == 'C') {
-            if (codon[2] == 'A') return 'S';
-            else if (codon[2] == 'C') return 'S';
-            else if (codon[2] == 'G') return 'S';
-            else if (codon[2] == 'T') return 'S';
-            else if (codon[2] == 'U') return 'S';
-         }
-        else if (codon[1] == 'G') {
-            if (codon[2] == 'A') return '*';
-            else if (codon[2] == 'C') return 'C';
-            else if (codon[2] == 'G') return 'W';
-            else if (codon[2] == 'T') return 'C';
-            else if (codon[2] == 'U') return 'C';
-         }
-        else if (codon[1] == 'T') {
-            if (codon[2] == 'A') return 'L';
-            else if (codon[2] == 'C') return 'F';
-            else if (codon[2] == 'G') return 'L';
-            else if (codon[2] == 'T') return 'F';
-            else if (codon[2] == 'U') return 'F';
-         }
-        else if (codon[1] == 'U') {
-            if (codon[2] == 'A') return 'L';
-            else if (codon[2] == 'C') return 'F';
-            else if (codon[2] == 'G') return 'L';
-            else if (codon[2] == 'T') return 'F';
-            else if (codon[2] == 'U') return 'F';
-         }
+    /* Less than 64 left, which the SSSE3 code can still help with */
+    __qes_sequtil_revcomp_ssse3(dest + lo, seq + lo, hi - lo, keep_case);
+}
+#undef QES_SEQUTIL_COMP_LO
+#undef QES_SEQUTIL_COMP_HI
+#endif
+
+/* Returns the reverse complementer for ``impl``, or NULL if it isn't
+ * supported */
+static qes_revcomp_fn
+__qes_sequtil_resolve (enum qes_sequtil_impl impl)
+{
+    switch (impl) {
+    case QES_SEQUTIL_SCALAR:
+        return __qes_sequtil_revcomp_scalar;
+#ifdef X86_SIMD_FOUND
+    case QES_SEQUTIL_SSSE3:
+        return __builtin_cpu_supports("ssse3") ? __qes_sequtil_revcomp_ssse3
+                                               : NULL;
+    case QES_SEQUTIL_AVX2:
+        return __builtin_cpu_supports("avx2") ? __qes_sequtil_revcomp_avx2
+                                              : NULL;
+    case QES_SEQUTIL_AUTO:
+        if (__builtin_cpu_supports("avx2")) {
+            return __qes_sequtil_revcomp_avx2;
+        } else if (__builtin_cpu_supports("ssse3")) {
+            return __qes_sequtil_revcomp_ssse3;
+        }
+        return __qes_sequtil_revcomp_scalar;
+#else
+    case QES_SEQUTIL_AUTO:
+        return __qes_sequtil_revcomp_scalar;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/* The reverse complementer in use, picked on first use as in qes_scan.c */
+static qes_revcomp_fn __qes_sequtil_revcomp_impl = NULL;
+
+void
+qes_sequtil_revcomp_into (char *dest, const char *seq, size_t len,
+                          int keep_case)
+{
+    qes_revcomp_fn revcomp = __atomic_load_n(&__qes_sequtil_revcomp_impl,
+                                             __ATOMIC_RELAXED);
+
+    if (dest == NULL || seq == NULL) {
+        return;
     }
-    else if (codon[0] == 'U') {
-        if (codon[1] == 'A') {
-            if (codon[2] == 'A') return '*';
-            else if (codon[2] == 'C') return 'Y';
-            else if (codon[2] == 'G') return '*';
-            else if (codon[2] == 'T') return 'Y';
-            else if (codon[2] == 'U') return 'Y';
-         }
-        else if (codon[1] == 'C') {
-            if (codon[2] == 'A') return 'S';
-            else if (codon[2] == 'C') return 'S';
-            else if (codon[2] == 'G') return 'S';
-            else if (codon[2] == 'T') return 'S';
-            else if (codon[2] == 'U') return 'S';
-         }
-        else if (codon[1] == 'G') {
-            if (codon[2] == 'A') return '*';
-            else if (codon[2] == 'C') return 'C';
-            else if (codon[2] == 'G') return 'W';
-            else if (codon[2] == 'T') return 'C';
-            else if (codon[2] == 'U') return 'C';
-         }
-        else if (codon[1] == 'T') {
-            if (codon[2] == 'A') return 'L';
-            else if (codon[2] == 'C') return 'F';
-            else if (codon[2] == 'G') return 'L';
-            else if (codon[2] == 'T') return 'F';
-            else if (codon[2] == 'U') return 'F';
-         }
-        else if (codon[1] == 'U') {
-            if (codon[2] == 'A') return 'L';
-            else if (codon[2] == 'C') return 'F';
-            else if (codon[2] == 'G') return 'L';
-            else if (codon[2] == 'T') return 'F';
-            else if (codon[2] == 'U') return 'F';
-         }
+    if (revcomp == NULL) {
+        revcomp = __qes_sequtil_resolve(QES_SEQUTIL_AUTO);
+        __atomic_store_n(&__qes_sequtil_revcomp_impl, revcomp,
+                         __ATOMIC_RELAXED);
     }
-    return 'X';
+    revcomp(dest, seq, len, keep_case);
 }
 
+int
+qes_sequtil_use (enum qes_sequtil_impl impl)
+{
+    qes_revcomp_fn revcomp = __qes_sequtil_resolve(impl);
+
+    if (revcomp == NULL) {
+        return -1;
+    }
+    __atomic_store_n(&__qes_sequtil_revcomp_impl, revcomp, __ATOMIC_RELAXED);
+    return 0;
+}
 
 inline char *
 qes_sequtil_revcomp (const char *seq, size_t len)
 {
-    size_t seqlen = strlen(seq);
-    char *outseq = strdup(seq);
-    seqlen = seqlen < len ? seqlen : len - 1;
+    char *outseq = NULL;
 
-    if (outseq[seqlen - 1] == '\n') {
-        outseq[seqlen - 1] = '\0';
-        seqlen--;
+    if (seq == NULL) {
+        return NULL;
     }
-
-    qes_sequtil_revcomp_inplace(outseq, len);
+    /* Trim trailing whitespace */
+    while (len > 0 && isspace(seq[len - 1])) {
+        len--;
+    }
+    outseq = qes_malloc_errnil(len + 1);
+    if (outseq == NULL) {
+        return NULL;
+    }
+    qes_sequtil_revcomp_into(outseq, seq, len, 0);
+    outseq[len] = '\0';
     return outseq;
 }
 
 inline void
 qes_sequtil_revcomp_inplace (char *seq, size_t len)
 {
-    size_t iii;
+    if (seq == NULL) {
+        return;
+    }
     /* Trim trailing whitespace */
     while (len > 0 && isspace(seq[len - 1])) {
         seq[--len] = '\0';
     }
-    for (iii = 0; iii < len && seq[iii] != '\0'; iii++) {
-        size_t endpos = len - iii - 1;
-        char endchar = seq[endpos];
-        if (seq[iii] == 'a' || seq[iii] == 'A') seq[endpos] = 'T';
-        else if (seq[iii] == 'c' || seq[iii] == 'C') seq[endpos] = 'G';
-        else if (seq[iii] == 'g' || seq[iii] == 'G') seq[endpos] = 'C';
-        else if (seq[iii] == 't' || seq[iii] == 'T') seq[endpos] = 'A';
-        else seq[endpos] = 'N';
-        if (endchar == 'a' || endchar == 'A') seq[iii] = 'T';
-        else if (endchar == 'c' || endchar == 'C') seq[iii] = 'G';
-        else if (endchar == 'g' || endchar == 'G') seq[iii] = 'C';
-        else if (endchar == 't' || endchar == 'T') seq[iii] = 'A';
-        else seq[iii] = 'N';
-    }
+    qes_sequtil_revcomp_into(seq, seq, len, 0);
 }
@@ -32,8 +32,109 @@
 #include <qes_util.h>
 
 
+enum qes_sequtil_impl {
+    /* Pick the fastest the CPU supports. This is what is used by default. */
+    QES_SEQUTIL_AUTO,
+    QES_SEQUTIL_SCALAR,
+    QES_SEQUTIL_SSSE3,
+    QES_SEQUTIL_AVX2,
+};
+
+/* Genetic codes, numbered as NCBI's translation tables are */
+enum qes_genetic_code {
+    QES_GENETIC_CODE_STANDARD = 1,
+    QES_GENETIC_CODE_VERT_MITO = 2,
+    QES_GENETIC_CODE_YEAST_MITO = 3,
+    QES_GENETIC_CODE_MOLD_MITO = 4,
+    QES_GENETIC_CODE_INVERT_MITO = 5,
+    QES_GENETIC_CODE_CILIATE = 6,
+    QES_GENETIC_CODE_ECHINODERM_MITO = 9,
+    QES_GENETIC_CODE_EUPLOTID = 10,
+    QES_GENETIC_CODE_BACTERIAL = 11,
+    QES_GENETIC_CODE_ALT_YEAST = 12,
+    QES_GENETIC_CODE_ASCIDIAN_MITO = 13,
+    QES_GENETIC_CODE_ALT_FLATWORM_MITO = 14,
+    /* One more than the highest */
+    QES_N_GENETIC_CODES,
+};
+
+/* The amino acids coded for by each codon of each genetic code, or NULL for
+ * the NCBI numbers not listed above. Codon ``b1 b2 b3`` is at
+ * ``16 * b1 + 4 * b2 + b3``, with bases numbered T=0, C=1, A=2, G=3 as in
+ * NCBI's tables. Generated by util/make_codon_map.py. */
+extern const char *const qes_codon_maps[QES_N_GENETIC_CODES];
+
+/* Returns the standard code's amino acid for the three bases of ``codon``,
+ * 'X' if any isn't one of ACGTU (in either case), or -1 if ``codon`` isn't
+ * three characters long. Stops are '*'. */
 extern int qes_sequtil_translate_codon(const char *codon);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_sequtil_translate_seq
+Parameters:     char *dest: Buffer of at least ``len / 3 + 1`` bytes.
+                const char *seq: Bases to translate.
+                size_t len: Number of bases in ``seq``.
+                enum qes_genetic_code code: Genetic code to translate with.
+Description:    Translate the ``len / 3`` whole codons of ``seq`` into
+                ``dest``, and NUL-terminate it. Codons are looked up in
+                qes_codon_maps, so there is no call per codon. Codons with
+                bases other than ACGTU are translated as 'X'.
+Returns:        ssize_t: Number of amino acids, or -2 on bad arguments or an
+                unknown ``code``.
+ *===========================================================================*/
+extern ssize_t qes_sequtil_translate_seq(char *dest, const char *seq,
+                                         size_t len,
+                                         enum qes_genetic_code code);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_sequtil_translate_6frame
+Parameters:     char *frames[6]: Buffers of at least ``len / 3 + 1`` bytes.
+                    The first three get the forward frames, from bases 0, 1
+                    and 2 of ``seq``, and the last three the frames from
+                    bases 0, 1 and 2 of its reverse complement.
+                const char *seq: Bases to translate.
+                size_t len: Number of bases in ``seq``.
+                enum qes_genetic_code code: Genetic code to translate with.
+Description:    Translate ``seq`` in all six frames at once, as for
+                qes_sequtil_translate_seq, without making its reverse
+                complement. Each base is looked up once: the codons ending
+                at it, forwards and reverse complemented, are kept as they
+                roll along, so each codon is then one table lookup.
+Returns:        int: 0 on success, or -2 on bad arguments or an unknown
+                ``code``.
+ *===========================================================================*/
+extern int qes_sequtil_translate_6frame(char *frames[6], const char *seq,
+                                        size_t len,
+                                        enum qes_genetic_code code);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_sequtil_revcomp_into
+Parameters:     char *dest: Buffer of at least ``len`` bytes. May be ``seq``.
+                const char *seq: Bases to reverse complement.
+                size_t len: Number of bases in ``seq``.
+                int keep_case: If non-zero, lower case bases give lower case
+                    complements. Otherwise all are upper case.
+Description:    Write the reverse complement of ``seq`` to ``dest``, by
+                lookup table, and with SSSE3 or AVX2 byte shuffles where the
+                CPU has them. IUPAC codes are complemented (e.g. R gives Y),
+                '-' and '.' are kept, and anything else gives N. ``dest`` is
+                not NUL-terminated.
+Returns:        void.
+ *===========================================================================*/
+extern void qes_sequtil_revcomp_into(char *dest, const char *seq, size_t len,
+                                     int keep_case);
+
+/* Returns a newly allocated, upper case reverse complement of the first
+ * ``len`` bases of ``seq``, less any trailing whitespace, or NULL on error */
 extern char *qes_sequtil_revcomp(const char *seq, size_t len);
+
+/* Reverse complement ``seq`` in place, as for qes_sequtil_revcomp. Trailing
+ * whitespace is replaced with NULs. */
 extern void qes_sequtil_revcomp_inplace(char *seq, size_t len);
 
+/* Use ``impl`` for all later reverse complements. Returns 0, or -1 if
+ * ``impl`` isn't supported by this CPU or build. Mostly useful for
+ * testing. */
+extern int qes_sequtil_use(enum qes_sequtil_impl impl);
+
 #endif /* QES_SEQUTIL_H */
@@ -0,0 +1,302 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_seqwriter.c
+ *
+ *    Description:  Writing batches of sequences from parallel producers, in
+ *                  input order.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_seqwriter.h"
+#include "qes_seqfile.h"
+
+#include <sched.h>
+#include <time.h>
+#ifdef PTHREADS_FOUND
+#   include <pthread.h>
+#endif
+#ifdef OPENMP_FOUND
+#   include <omp.h>
+#endif
+
+/* Number of times a waiting thread yields before it starts sleeping */
+#define QES_SEQWRITER_SPINS 64
+
+/* The reorder window is a ring of slots, where batch ``id`` goes in slot
+ * ``id & mask``. A slot's sequence number is ``id`` while it's free for batch
+ * ``id``, and ``id + 1`` once that batch is in it. Writing the batch frees
+ * the slot for batch ``id + window``. As ids sharing a slot are at least two
+ * apart, the states can't be confused. */
+struct qes_seqwriter_slot {
+    size_t seq;
+    struct qes_seq_batch *batch;
+};
+
+struct qes_seqwriter {
+    struct qes_seqfile *sf;
+    struct qes_seqwriter_slot *slots;
+    size_t window;
+    size_t mask;
+    /* Id of the next batch to write. Only touched by whoever holds
+     * ``draining``, or the writer thread. */
+    size_t next_id;
+    /* Number of batches put */
+    size_t n_put;
+    /* Held by the thread writing out batches, without a writer thread */
+    int draining;
+    int finished;
+    /* Set to ask the writer thread to exit once all is written */
+    int stop;
+    int error;
+#ifdef PTHREADS_FOUND
+    pthread_t thread;
+    int running;
+#endif
+};
+
+/* Wait a little while for another thread. Yield at first, as batches don't
+ * take long, then sleep so idle threads don't burn CPU. */
+static void
+__qes_seqwriter_backoff (size_t *spins)
+{
+    struct timespec ts = {0, 100000};
+
+    if (*spins < QES_SEQWRITER_SPINS) {
+        sched_yield();
+    } else {
+        nanosleep(&ts, NULL);
+    }
+    (*spins)++;
+}
+
+/* Write out batches for as long as the next one in order is waiting.
+ * Returns the number of batches written. After an error, batches are
+ * dropped rather than written, so that producers don't wait forever. */
+static size_t
+__qes_seqwriter_drain (struct qes_seqwriter *writer)
+{
+    struct qes_seqwriter_slot *slot = NULL;
+    ssize_t res = 0;
+    size_t n = 0;
+
+    while (1) {
+        slot = &writer->slots[writer->next_id & writer->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) !=
+                writer->next_id + 1) {
+            break;
+        }
+        if (__atomic_load_n(&writer->error, __ATOMIC_RELAXED) == 0) {
+            res = qes_seqfile_write_batch(writer->sf, slot->batch);
+            if (res < 0) {
+                __atomic_store_n(&writer->error, (int)res, __ATOMIC_RELAXED);
+            }
+        }
+        qes_seq_batch_clear(slot->batch);
+        __atomic_store_n(&slot->seq, writer->next_id + writer->window,
+                         __ATOMIC_RELEASE);
+        writer->next_id++;
+        n++;
+    }
+    return n;
+}
+
+/* Without a writer thread, write out waiting batches unless another thread
+ * is already doing so. Checks again after letting go, in case the next
+ * batch was put just before. */
+static void
+__qes_seqwriter_try_drain (struct qes_seqwriter *writer)
+{
+    struct qes_seqwriter_slot *slot = NULL;
+    size_t next_id = 0;
+    int unheld = 0;
+
+    do {
+        unheld = 0;
+        if (!__atomic_compare_exchange_n(&writer->draining, &unheld, 1, 0,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        __qes_seqwriter_drain(writer);
+        next_id = writer->next_id;
+        __atomic_store_n(&writer->draining, 0, __ATOMIC_RELEASE);
+        slot = &writer->slots[next_id & writer->mask];
+    } while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == next_id + 1);
+}
+
+#ifdef PTHREADS_FOUND
+static void *
+__qes_seqwriter_thread (void *arg)
+{
+    struct qes_seqwriter *writer = arg;
+    size_t spins = 0;
+
+    while (1) {
+        if (__qes_seqwriter_drain(writer) > 0) {
+            spins = 0;
+            continue;
+        }
+        if (__atomic_load_n(&writer->stop, __ATOMIC_ACQUIRE)) {
+            /* Everything was put before we were stopped */
+            __qes_seqwriter_drain(writer);
+            break;
+        }
+        __qes_seqwriter_backoff(&spins);
+    }
+    return NULL;
+}
+#endif
+
+struct qes_seqwriter *
+qes_seqwriter_create (struct qes_seqfile *sf, size_t window)
+{
+    struct qes_seqwriter *writer = NULL;
+    size_t iii;
+
+    if (!qes_seqfile_ok(sf)) {
+        return NULL;
+    }
+    if (window == 0) {
+        window = QES_SEQWRITER_DEFAULT_WINDOW;
+#ifdef OPENMP_FOUND
+        if (window < 2 * (size_t)omp_get_max_threads()) {
+            window = 2 * omp_get_max_threads();
+        }
+#endif
+    }
+    /* See struct qes_seqwriter_slot for why there must be two */
+    window = qes_roundupz(window < 2 ? 2 : window);
+    writer = qes_calloc_errnil(1, sizeof(*writer));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->sf = sf;
+    writer->slots = qes_calloc_errnil(window, sizeof(*writer->slots));
+    if (writer->slots == NULL) {
+        goto error;
+    }
+    writer->window = window;
+    writer->mask = window - 1;
+    for (iii = 0; iii < window; iii++) {
+        writer->slots[iii].seq = iii;
+        writer->slots[iii].batch = qes_seq_batch_create(0, 0);
+        if (writer->slots[iii].batch == NULL) {
+            goto error;
+        }
+    }
+#ifdef PTHREADS_FOUND
+    /* If we can't start the thread, producers write batches themselves */
+    writer->running = pthread_create(&writer->thread, NULL,
+                                     __qes_seqwriter_thread, writer) == 0;
+#endif
+    return writer;
+error:
+    qes_seqwriter_destroy(writer);
+    return NULL;
+}
+
+int
+qes_seqwriter_put (struct qes_seqwriter *writer, size_t id,
+                   struct qes_seq_batch **batch)
+{
+    struct qes_seqwriter_slot *slot = NULL;
+    struct qes_seq_batch *mine = NULL;
+    size_t spins = 0;
+    size_t seq = 0;
+    int running = 0;
+
+    if (writer == NULL || batch == NULL || *batch == NULL ||
+            __atomic_load_n(&writer->finished, __ATOMIC_RELAXED)) {
+        return -2;
+    }
+#ifdef PTHREADS_FOUND
+    running = writer->running;
+#endif
+    slot = &writer->slots[id & writer->mask];
+    while ((seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)) != id) {
+        if ((ssize_t)(seq - id) > 0) {
+            /* Put already, and maybe written */
+            return -2;
+        }
+        /* An earlier batch is still waiting in this slot */
+        if (!running) {
+            __qes_seqwriter_try_drain(writer);
+        }
+        __qes_seqwriter_backoff(&spins);
+    }
+    mine = slot->batch;
+    slot->batch = *batch;
+    *batch = mine;
+    __atomic_fetch_add(&writer->n_put, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, id + 1, __ATOMIC_RELEASE);
+    if (!running) {
+        __qes_seqwriter_try_drain(writer);
+    }
+    return __atomic_load_n(&writer->error, __ATOMIC_RELAXED);
+}
+
+int
+qes_seqwriter_finish (struct qes_seqwriter *writer)
+{
+    if (writer == NULL) {
+        return -2;
+    }
+    if (writer->finished) {
+        return writer->error;
+    }
+    __atomic_store_n(&writer->finished, 1, __ATOMIC_RELAXED);
+#ifdef PTHREADS_FOUND
+    if (writer->running) {
+        __atomic_store_n(&writer->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(writer->thread, NULL);
+        writer->running = 0;
+    }
+#endif
+    __qes_seqwriter_drain(writer);
+    if (writer->error == 0 && qes_file_flush(writer->sf->qf) != 0) {
+        writer->error = -1;
+    }
+    if (writer->error == 0 &&
+            __atomic_load_n(&writer->n_put, __ATOMIC_RELAXED) !=
+            writer->next_id) {
+        writer->error = -2;
+    }
+    return writer->error;
+}
+
+void
+qes_seqwriter_destroy_ (struct qes_seqwriter *writer)
+{
+    size_t iii;
+
+    if (writer == NULL) {
+        return;
+    }
+    if (writer->slots != NULL) {
+        qes_seqwriter_finish(writer);
+        for (iii = 0; iii < writer->window; iii++) {
+            qes_seq_batch_destroy(writer->slots[iii].batch);
+        }
+    }
+    qes_free(writer->slots);
+    qes_free(writer);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_seqwriter.h
+ *
+ *    Description:  Writing batches of sequences from parallel producers, in
+ *                  input order.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#ifndef QES_SEQWRITER_H
+#define QES_SEQWRITER_H
+
+#include <qes_util.h>
+#include <qes_seqbatch.h>
+
+/* Number of batches the reorder window holds, if not given */
+#define QES_SEQWRITER_DEFAULT_WINDOW (16)
+
+struct qes_seqfile;
+struct qes_seqwriter;
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqwriter_create
+Parameters:     struct qes_seqfile *sf: File to write to.
+                size_t window: Number of batches that may be waiting for an
+                    earlier batch to be written, or 0 for
+                    QES_SEQWRITER_DEFAULT_WINDOW or two per OpenMP thread,
+                    whichever is more.
+Description:    Create a writer which writes batches to ``sf`` in the order
+                of their ids (e.g. the ids of the struct qes_seqwork they were
+                made from), however they are handed in, on a background
+                thread. Without threads, batches are written by whichever
+                caller of qes_seqwriter_put completes the next one in order.
+                ``sf`` must not be used elsewhere until the writer is
+                finished.
+Returns:        A ``struct qes_seqwriter *``, or NULL on error.
+ *===========================================================================*/
+struct qes_seqwriter *qes_seqwriter_create
+                               (struct qes_seqfile     *sf,
+                                size_t                  window);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqwriter_put
+Parameters:     struct qes_seqwriter *writer: Writer to hand the batch to.
+                size_t id: Place of the batch in the output. Ids start at 0,
+                    and each must be put exactly once, even if its batch is
+                    empty.
+                struct qes_seq_batch **batch: Batch to write. The writer
+                    takes ``*batch``, and swaps in an empty batch of its own
+                    for the caller to fill next time.
+Description:    Queue a batch for writing. This may be called from many
+                threads at once. If ``id`` is a whole window ahead of the
+                earliest batch not yet written, wait for that to be put.
+Returns:        int: 0 on success, -2 on bad arguments or if ``id`` has been
+                put before, or the error which stopped ``writer`` (see
+                qes_seqwriter_finish).
+ *===========================================================================*/
+int qes_seqwriter_put          (struct qes_seqwriter   *writer,
+                                size_t                  id,
+                                struct qes_seq_batch  **batch);
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_seqwriter_finish
+Parameters:     struct qes_seqwriter *writer: Writer to finish.
+Description:    Write out every batch put so far, and flush the file. Call once
+                all calls to qes_seqwriter_put have returned. No more batches
+                may be put afterwards.
+Returns:        int: 0 on success, -2 if a batch was never put so those after
+                it couldn't be written, or a negative code from
+                qes_seqfile_write or qes_file_flush on error.
+ *===========================================================================*/
+int qes_seqwriter_finish       (struct qes_seqwriter   *writer);
+
+/* Finish ``writer`` if need be, and free it. The file is not closed. */
+void qes_seqwriter_destroy_    (struct qes_seqwriter   *writer);
+#define qes_seqwriter_destroy(writer) do {                                  \
+            qes_seqwriter_destroy_(writer);                                 \
+            writer = NULL;                                                  \
+        } while(0)
+
+#endif /* QES_SEQWRITER_H */
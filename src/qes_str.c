@@ -40,7 +40,7 @@ qes_str_print (const struct qes_str *str, FILE *stream)
 void
 qes_str_destroy_cp (struct qes_str *str)
 {
-    if (str != NULL) qes_free(str->str);
+    if (str != NULL && str->arena == NULL) qes_free(str->str);
 }
 
 void
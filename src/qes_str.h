@@ -30,11 +30,22 @@
 #define QES_STR_H
 
 #include <qes_util.h>
+#include <qes_arena.h>
 
 struct qes_str {
     char *str;
     size_t len;
     size_t capacity;
+    /* Arena ``str`` was allocated from (see qes_str_init_in), or NULL if it
+     * is on the heap */
+    struct qes_arena *arena;
+};
+
+/* A read-only slice of some other buffer. ``str`` is NOT NUL-terminated, and
+ * is only valid for as long as the buffer it points into. */
+struct qes_strview {
+    const char *str;
+    size_t len;
 };
 
 
@@ -67,6 +78,31 @@ qes_str_init (struct qes_str *str, size_t capacity)
     str->len = 0;
     str->str = qes_calloc(capacity, sizeof(*str->str));
     str->capacity = capacity;
+    str->arena = NULL;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_str_init_in
+Parameters:     struct qes_arena *arena: Arena to allocate from.
+                struct qes_str *str: String to initialise.
+                size_t len: Initial capacity of `struct qes_str`.
+Description:    As for qes_str_init, but the string's memory comes from
+                `arena` and isn't zero-filled. It grows within `arena`, and is
+                freed when `arena` is reset or destroyed, not by
+                qes_str_destroy_cp.
+Returns:        void
+ *===========================================================================*/
+static inline void
+qes_str_init_in (struct qes_arena *arena, struct qes_str *str,
+                 size_t capacity)
+{
+    if (str == NULL) return;
+    if (capacity == 0) capacity = 1;
+    str->len = 0;
+    str->str = qes_arena_alloc(arena, capacity);
+    str->capacity = str->str != NULL ? capacity : 0;
+    str->arena = arena;
+    if (str->str != NULL) str->str[0] = '\0';
 }
 
 /*===  FUNCTION  ============================================================*
@@ -87,19 +123,68 @@ qes_str_create (size_t capacity)
     return str;
 }
 
+/* Move ``str`` to a buffer of ``capacity`` characters, keeping its
+ * contents. Returns 1 on success, 0 on error. */
 static inline int
-qes_str_resize (struct qes_str *str, size_t len)
+__qes_str_realloc (struct qes_str *str, size_t capacity)
 {
-    if (str == NULL) return 0;
-    if (str->capacity < len + 1) {
-        while (str->capacity < len + 1) {
-            str->capacity = qes_roundupz(str->capacity);
+    char *grown = NULL;
+
+    if (str->arena != NULL) {
+        /* Arena memory can't be realloc-ed, so move to a bigger piece.
+         * The old one is freed with the rest of the arena. Only the string
+         * and its NUL are copied, as the rest was never written. */
+        grown = qes_arena_alloc(str->arena, capacity);
+        if (grown != NULL && str->str != NULL) {
+            memcpy(grown, str->str, str->len < str->capacity ?
+                                    str->len + 1 : str->capacity);
         }
-        str->str = qes_realloc(str->str, str->capacity * sizeof(*str->str));
+    } else {
+        grown = qes_realloc(str->str, capacity * sizeof(*str->str));
     }
+    if (grown == NULL) return 0;
+    str->str = grown;
+    str->capacity = capacity;
     return 1;
 }
 
+/*===  FUNCTION  ============================================================*
+Name:           qes_str_resize
+Parameters:     struct qes_str *str: String to grow.
+                size_t len: Number of characters ``str`` must have room for,
+                    not counting the NUL.
+Description:    Make sure ``str`` can hold ``len`` characters. If it must grow,
+                it grows at once to the next power of two above ``len``, so
+                that strings grown a little at a time are copied only
+                O(log n) times.
+Returns:        int: 1 on success, 0 on error.
+ *===========================================================================*/
+static inline int
+qes_str_resize (struct qes_str *str, size_t len)
+{
+    if (str == NULL) return 0;
+    if (str->capacity >= len + 1) return 1;
+    return __qes_str_realloc(str, qes_roundupz(len + 1));
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           qes_str_reserve
+Parameters:     struct qes_str *str: String to grow.
+                size_t len: Number of characters ``str`` will need room for,
+                    not counting the NUL.
+Description:    As for qes_str_resize, but grows ``str`` to exactly the size
+                asked for. Use it when the size needed is known beforehand,
+                e.g. from the lengths of earlier records.
+Returns:        int: 1 on success, 0 on error.
+ *===========================================================================*/
+static inline int
+qes_str_reserve (struct qes_str *str, size_t len)
+{
+    if (str == NULL) return 0;
+    if (str->capacity >= len + 1) return 1;
+    return __qes_str_realloc(str, len + 1);
+}
+
 static inline int
 qes_str_fill_charptr (struct qes_str *str, const char *cp, size_t len)
 {
@@ -107,7 +192,7 @@ qes_str_fill_charptr (struct qes_str *str, const char *cp, size_t len)
     if (len == 0) {
         len = strlen(cp);
     }
-    qes_str_resize(str, len);
+    if (!qes_str_resize(str, len)) return 0;
     memcpy(str->str, cp, len);
     str->str[len] = '\0';
     str->len = len;
@@ -129,13 +214,19 @@ qes_str_nullify (struct qes_str *str)
     return 0;
 }
 
+/* Copy the contents of ``src`` to ``dest``, initialising ``dest`` if need
+ * be. Only ``src->len`` characters are copied, whatever its capacity.
+ * Returns 0 on success, otherwise 1. */
 static inline int
 qes_str_copy (struct qes_str *dest, const struct qes_str *src)
 {
     if (!qes_str_ok(src) || dest == NULL) return 1;
-    if (!qes_str_ok(dest)) qes_str_init(dest, src->capacity);
-    else qes_str_resize(dest, src->capacity);
-    memcpy(dest->str, src->str, src->capacity);
+    if (!qes_str_ok(dest)) qes_str_init(dest, src->len + 1);
+    else if (!qes_str_resize(dest, src->len)) return 1;
+    if (!qes_str_ok(dest)) return 1;
+    memcpy(dest->str, src->str, src->len);
+    dest->str[src->len] = '\0';
+    dest->len = src->len;
     return 0;
 }
 
@@ -143,8 +234,8 @@ static inline int
 qes_str_cat (struct qes_str *dest, const struct qes_str *src)
 {
     if (!qes_str_ok(src) || dest == NULL) return 1;
-    if (!qes_str_ok(dest)) qes_str_init(dest, src->capacity);
-    else qes_str_resize(dest, dest->len + src->len);
+    if (!qes_str_ok(dest)) qes_str_init(dest, src->len + 1);
+    if (!qes_str_resize(dest, dest->len + src->len)) return 1;
 
     memcpy(dest->str + dest->len, src->str, src->len);
     dest->len += src->len;
@@ -177,6 +268,7 @@ Name:           qes_str_destroy_cp
 Parameters:     struct qes_str *: String to destrop
 Description:    Frees `str->str` without freeing the struct qes_str struct
                 itself. For use on `struct qes_str`s allocated on the stack.
+                Strings from an arena are left for the arena to free.
 Returns:        void
  *===========================================================================*/
 extern void qes_str_destroy_cp (struct qes_str *str);
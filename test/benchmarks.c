@@ -49,6 +49,14 @@ void bench_qes_file_readline_file(int silent);
 void bench_gnu_getline_file(int silent);
 #endif
 void bench_qes_seqfile_parse_fq(int silent);
+void bench_qes_seqfile_parse_fq_async(int silent);
+void bench_qes_seqfile_parse_fq_batch(int silent);
+#ifdef ZLIB_FOUND
+void bench_qes_seqfile_parse_fq_zlib(int silent);
+#endif
+#ifdef LIBDEFLATE_FOUND
+void bench_qes_seqfile_parse_fq_libdeflate(int silent);
+#endif
 void bench_kseq_parse_fq(int silent);
 void bench_qes_seqfile_write(int silent);
 #ifdef OPENMP_FOUND
@@ -177,6 +185,92 @@ bench_qes_seqfile_parse_fq(int silent)
     qes_seq_destroy(seq);
 }
 
+void
+bench_qes_seqfile_parse_fq_async(int silent)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_file_opts opts = {0};
+    struct qes_seqfile *sf = NULL;
+    ssize_t res = 0;
+    size_t seq_len = 0;
+
+    opts.async_buffers = 4;
+    sf = qes_seqfile_create_opts(infile, "r", &opts);
+    while ((res = qes_seqfile_read(sf, seq)) > 0) {
+        seq_len += res;
+    }
+    if (!silent) {
+        printf("[qes_seqfile_fq_async] Total seq len %lu\n",
+               (long unsigned)seq_len);
+    }
+    qes_seqfile_destroy(sf);
+    qes_seq_destroy(seq);
+}
+
+void
+bench_qes_seqfile_parse_fq_batch(int silent)
+{
+    struct qes_seq_batch *batch = qes_seq_batch_create(0, 0);
+    struct qes_seqfile *sf = qes_seqfile_create(infile, "r");
+    size_t seq_len = 0;
+    size_t iii;
+
+    while (qes_seqfile_read_batch(sf, batch, 0, 0) > 0) {
+        for (iii = 0; iii < batch->n_records; iii++) {
+            seq_len += batch->seq_len[iii];
+        }
+    }
+    if (!silent) {
+        printf("[qes_seqfile_fq_batch] Total seq len %lu\n",
+               (long unsigned)seq_len);
+    }
+    qes_seqfile_destroy(sf);
+    qes_seq_batch_destroy(batch);
+}
+
+#if defined(ZLIB_FOUND) || defined(LIBDEFLATE_FOUND)
+/* Parse with the given backend, to compare gzip decompressors */
+static void
+bench_parse_fq_backend(const char *name,
+                       const struct qes_file_backend *backend, int silent)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_file_opts opts = {0};
+    struct qes_seqfile *sf = NULL;
+    ssize_t res = 0;
+    size_t seq_len = 0;
+
+    opts.backend = backend;
+    sf = qes_seqfile_create_opts(infile, "r", &opts);
+    while ((res = qes_seqfile_read(sf, seq)) > 0) {
+        seq_len += res;
+    }
+    if (!silent) {
+        printf("[%s] Total seq len %lu\n", name, (long unsigned)seq_len);
+    }
+    qes_seqfile_destroy(sf);
+    qes_seq_destroy(seq);
+}
+#endif
+
+#ifdef ZLIB_FOUND
+void
+bench_qes_seqfile_parse_fq_zlib(int silent)
+{
+    bench_parse_fq_backend("qes_seqfile_fq_zlib", &qes_file_backend_zlib,
+                           silent);
+}
+#endif
+
+#ifdef LIBDEFLATE_FOUND
+void
+bench_qes_seqfile_parse_fq_libdeflate(int silent)
+{
+    bench_parse_fq_backend("qes_seqfile_fq_libdeflate",
+                           &qes_file_backend_libdeflate, silent);
+}
+#endif
+
 void
 bench_kseq_parse_fq(int silent)
 {
@@ -243,6 +337,14 @@ static const bench_t benchmarks[] = {
     { "gnu_getline", &bench_gnu_getline_file},
 #endif
     { "qes_seqfile_parse_fq", &bench_qes_seqfile_parse_fq},
+    { "qes_seqfile_parse_fq_async", &bench_qes_seqfile_parse_fq_async},
+    { "qes_seqfile_parse_fq_batch", &bench_qes_seqfile_parse_fq_batch},
+#ifdef ZLIB_FOUND
+    { "qes_seqfile_parse_fq_zlib", &bench_qes_seqfile_parse_fq_zlib},
+#endif
+#ifdef LIBDEFLATE_FOUND
+    { "qes_seqfile_parse_fq_libdeflate", &bench_qes_seqfile_parse_fq_libdeflate},
+#endif
 #ifdef OPENMP_FOUND
     { "qes_seqfile_par_iter_fq_macro", &bench_qes_seqfile_par_iter_fq_macro},
 #endif
@@ -31,12 +31,21 @@
 
 struct testgroup_t libqes_tests[] = {
     {"qes/util/", qes_util_tests},
+    {"qes/arena/", qes_arena_tests},
+    {"qes/str/", qes_str_tests},
     {"qes/match/", qes_match_tests},
     {"qes/file/", qes_file_tests},
+    {"qes/scan/", qes_scan_tests},
+    {"qes/gzindex/", qes_gzindex_tests},
+    {"qes/fai/", qes_fai_tests},
     {"qes/seqfile/", qes_seqfile_tests},
     {"qes/seq/", qes_seq_tests},
+    {"qes/seqbatch/", qes_seqbatch_tests},
+    {"qes/seqreader/", qes_seqreader_tests},
+    {"qes/seqwriter/", qes_seqwriter_tests},
     {"qes/log/", qes_log_tests},
     {"qes/sequtil/", qes_sequtil_tests},
+    {"qes/packedseq/", qes_packedseq_tests},
     {"testdata/", data_tests},
     {"testhelpers/", helper_tests},
     END_OF_GROUPS
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_arena.c
+ *
+ *    Description:  Test qes_arena.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_arena.h>
+#include <qes_seqfile.h>
+
+
+static void
+test_qes_arena (void *ptr)
+{
+    struct qes_arena *arena = NULL;
+    struct qes_arena_block *block = NULL;
+    struct qes_arena_block *first = NULL;
+    char *allocs[100];
+    char *big = NULL;
+    size_t n_blocks = 0;
+    size_t iii;
+
+    (void) ptr;
+    arena = qes_arena_create(1024);
+    tt_assert(arena != NULL);
+    tt_ptr_op(arena->blocks, ==, NULL);
+    for (iii = 0; iii < 100; iii++) {
+        allocs[iii] = qes_arena_alloc(arena, iii + 1);
+        tt_assert(allocs[iii] != NULL);
+        tt_int_op((uintptr_t)allocs[iii] % QES_ARENA_ALIGN, ==, 0);
+        memset(allocs[iii], (int)iii, iii + 1);
+        tt_assert(qes_arena_owns(arena, allocs[iii]));
+    }
+    /* Nothing overlaps */
+    for (iii = 0; iii < 100; iii++) {
+        tt_int_op(allocs[iii][0], ==, (char)iii);
+        tt_int_op(allocs[iii][iii], ==, (char)iii);
+    }
+    /* Too big for a block, so it gets one of its own */
+    big = qes_arena_alloc(arena, 5000);
+    tt_assert(big != NULL);
+    memset(big, 'x', 5000);
+    for (block = arena->blocks; block != NULL; block = block->next) {
+        n_blocks++;
+    }
+    tt_int_op(n_blocks, >, 3);
+    /* Refilling after a reset reuses the same blocks */
+    first = arena->blocks;
+    qes_arena_reset(arena);
+    tt_ptr_op(arena->current, ==, first);
+    tt_ptr_op(qes_arena_alloc(arena, 10), ==, allocs[0]);
+    for (iii = 1; iii < 100; iii++) {
+        tt_assert(qes_arena_alloc(arena, iii + 1) != NULL);
+    }
+    tt_assert(qes_arena_alloc(arena, 5000) != NULL);
+    iii = 0;
+    for (block = arena->blocks; block != NULL; block = block->next) {
+        iii++;
+    }
+    tt_int_op(iii, ==, n_blocks);
+    tt_assert(!qes_arena_owns(arena, &iii));
+    tt_assert(!qes_arena_owns(NULL, big));
+    tt_ptr_op(qes_arena_alloc(NULL, 1), ==, NULL);
+end:
+    qes_arena_destroy(arena);
+}
+
+static void
+test_qes_arena_str (void *ptr)
+{
+    struct qes_arena *arena = NULL;
+    struct qes_str str = {NULL, 0, 0, NULL};
+    struct qes_str line = {NULL, 0, 0, NULL};
+    struct qes_file *file = NULL;
+    struct qes_file *small = NULL;
+    struct qes_file_opts opts;
+    char *fname = NULL;
+    ssize_t len = 0;
+    ssize_t arena_len = 0;
+
+    (void) ptr;
+    arena = qes_arena_create(64);
+    qes_str_init_in(arena, &str, 4);
+    tt_assert(qes_str_ok(&str));
+    tt_ptr_op(str.arena, ==, arena);
+    tt_str_op(str.str, ==, "");
+    tt_assert(qes_str_fill_charptr(&str, "GATTACA GATTACA", 15));
+    tt_str_op(str.str, ==, "GATTACA GATTACA");
+    tt_assert(qes_arena_owns(arena, str.str));
+    /* A no-op, as the arena frees it */
+    qes_str_destroy_cp(&str);
+    /* Lines longer than the initial capacity and the arena's blocks, which
+     * can't be realloc-ed */
+    fname = find_data_file("loremipsum.txt");
+    tt_assert(fname != NULL);
+    qes_str_init(&line, 8);
+    file = qes_file_open(fname, "r");
+    qes_str_init_in(arena, &str, 8);
+    while ((len = qes_file_readline_str(file, &line)) > 0) {
+        arena_len += len;
+    }
+    tt_int_op(len, ==, EOF);
+    qes_file_close(file);
+    file = qes_file_open(fname, "r");
+    while ((len = qes_file_readline_str(file, &str)) > 0) {
+        arena_len -= len;
+        tt_int_op(str.str[len - 1], ==, '\n');
+        tt_int_op(strlen(str.str), ==, len);
+    }
+    tt_int_op(len, ==, EOF);
+    tt_int_op(arena_len, ==, 0);
+    tt_assert(qes_arena_owns(arena, str.str));
+    /* Lines that span many refills of a small buffer are kept whole as the
+     * string grows */
+    qes_file_close(file);
+    file = qes_file_open(fname, "r");
+    memset(&opts, 0, sizeof(opts));
+    opts.backend = &qes_file_backend_fd;
+    opts.buffer_len = 7;
+    small = qes_file_open_opts(fname, "r", &opts);
+    tt_assert(file != NULL && small != NULL);
+    qes_str_init_in(arena, &str, 1);
+    while ((len = qes_file_readline_str(file, &line)) > 0) {
+        tt_int_op(qes_file_readline_str(small, &str), ==, len);
+        tt_str_op(str.str, ==, line.str);
+    }
+    tt_int_op(qes_file_readline_str(small, &str), ==, EOF);
+end:
+    qes_file_close(file);
+    qes_file_close(small);
+    qes_str_destroy_cp(&line);
+    qes_arena_destroy(arena);
+    if (fname != NULL) free(fname);
+}
+
+/* Read every record of ``fname`` into seqs from an arena, checking them
+ * against seqs read as usual */
+static int
+test_arena_read_seqs (struct qes_arena *arena, const char *fname)
+{
+    struct qes_seqfile *sf = qes_seqfile_create(fname, "r");
+    struct qes_seqfile *ref = qes_seqfile_create(fname, "r");
+    struct qes_seq *refseq = qes_seq_create();
+    struct qes_seq *seq = NULL;
+    ssize_t res = 0;
+    int ok = 0;
+
+    while (1) {
+        seq = qes_seq_create_in(arena);
+        if (seq == NULL) {
+            goto end;
+        }
+        res = qes_seqfile_read(sf, seq);
+        if (res != qes_seqfile_read(ref, refseq)) {
+            goto end;
+        }
+        if (res < 0) {
+            break;
+        }
+        if (strcmp(seq->name.str, refseq->name.str) != 0 ||
+                strcmp(seq->comment.str, refseq->comment.str) != 0 ||
+                strcmp(seq->seq.str, refseq->seq.str) != 0 ||
+                strcmp(seq->qual.str, refseq->qual.str) != 0) {
+            goto end;
+        }
+    }
+    ok = res == EOF;
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(ref);
+    qes_seq_destroy(refseq);
+    return ok;
+}
+
+static void
+test_qes_arena_seqs (void *ptr)
+{
+    struct qes_arena *arena = NULL;
+    char *fname = NULL;
+
+    (void) ptr;
+    /* Small blocks, so that many records span blocks */
+    arena = qes_arena_create(300);
+    fname = find_data_file("test.fastq");
+    tt_assert(test_arena_read_seqs(arena, fname));
+    free(fname);
+    /* A whole file's worth of records is freed at once */
+    qes_arena_reset(arena);
+    fname = find_data_file("test.fasta");
+    tt_assert(test_arena_read_seqs(arena, fname));
+end:
+    qes_arena_destroy(arena);
+    if (fname != NULL) free(fname);
+}
+
+
+struct testcase_t qes_arena_tests[] = {
+    { "qes_arena", test_qes_arena, 0, NULL, NULL},
+    { "qes_arena_str", test_qes_arena_str, 0, NULL, NULL},
+    { "qes_arena_seqs", test_qes_arena_seqs, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
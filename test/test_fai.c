@@ -0,0 +1,188 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_fai.c
+ *
+ *    Description:  Test qes_fai.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_fai.h>
+
+/* Write ``contents`` to ``path``. Returns 1 on success. */
+static int
+test_fai_write (const char *path, const char *contents)
+{
+    FILE *fp = fopen(path, "wb");
+    size_t len = strlen(contents);
+
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fwrite(contents, 1, len, fp) != len) {
+        fclose(fp);
+        return 0;
+    }
+    return fclose(fp) == 0;
+}
+
+/* Index the FASTA ``contents`` */
+static struct qes_fai *
+test_fai_build (const char *path, const char *contents)
+{
+    struct qes_file *file = NULL;
+    struct qes_fai *fai = NULL;
+
+    if (!test_fai_write(path, contents)) {
+        return NULL;
+    }
+    file = qes_file_open(path, "r");
+    fai = qes_fai_build(file);
+    qes_file_close(file);
+    return fai;
+}
+
+static void
+test_qes_fai (void *ptr)
+{
+    struct qes_fai *fai = NULL;
+    struct qes_fai *loaded = NULL;
+    const struct qes_fai_entry *entry = NULL;
+    struct qes_file *file = NULL;
+    char *fname = NULL;
+    char *faname = NULL;
+    char *idxname = NULL;
+    char buf[256];
+    size_t iii;
+    const char *fasta =
+        ">chr1 some description\nACGTACGTAC\nGGGG\n"
+        ">chr2\r\nACG\r\nTTT\r\nA\r\n"
+        ">empty\n"
+        ">chr3\nACGTA";
+    const char *fai_text =
+        "chr1\t14\t23\t10\t11\n"
+        "chr2\t7\t46\t3\t5\n"
+        "empty\t0\t66\t0\t0\n"
+        "chr3\t5\t72\t5\t5\n";
+
+    (void) ptr;
+    faname = get_writable_file();
+    idxname = get_writable_file();
+    tt_assert(faname != NULL && idxname != NULL);
+    fai = test_fai_build(faname, fasta);
+    tt_assert(fai != NULL);
+    tt_int_op(fai->n_entries, ==, 4);
+    tt_str_op(fai->entries[0].name, ==, "chr1");
+    tt_str_op(fai->entries[3].name, ==, "chr3");
+    /* Each base is where the index says */
+    for (iii = 0; iii < fai->n_entries; iii++) {
+        entry = &fai->entries[iii];
+        if (entry->length > 0) {
+            tt_int_op(fasta[qes_fai_entry_offset(entry, 0)], ==, 'A');
+        }
+    }
+    entry = qes_fai_find(fai, "chr1");
+    tt_ptr_op(entry, ==, &fai->entries[0]);
+    tt_int_op(fasta[qes_fai_entry_offset(entry, 10)], ==, 'G');
+    entry = qes_fai_find(fai, "chr2");
+    tt_ptr_op(entry, ==, &fai->entries[1]);
+    tt_int_op(fasta[qes_fai_entry_offset(entry, 3)], ==, 'T');
+    tt_int_op(fasta[qes_fai_entry_offset(entry, 6)], ==, 'A');
+    tt_ptr_op(qes_fai_find(fai, "chr"), ==, NULL);
+    tt_ptr_op(qes_fai_find(fai, "some"), ==, NULL);
+    tt_ptr_op(qes_fai_find(fai, NULL), ==, NULL);
+    tt_ptr_op(qes_fai_find(NULL, "chr1"), ==, NULL);
+    /* Saved as samtools would */
+    tt_int_op(qes_fai_save(fai, idxname), ==, 0);
+    file = qes_file_open(idxname, "r");
+    tt_assert(file != NULL);
+    buf[0] = '\0';
+    for (iii = 0; iii < 4; iii++) {
+        tt_int_op(qes_file_readline(file, buf + strlen(buf),
+                                    sizeof(buf) - strlen(buf)), >, 0);
+    }
+    tt_str_op(buf, ==, fai_text);
+    qes_file_close(file);
+    loaded = qes_fai_load(idxname);
+    tt_assert(loaded != NULL);
+    tt_int_op(loaded->n_entries, ==, fai->n_entries);
+    for (iii = 0; iii < fai->n_entries; iii++) {
+        tt_str_op(loaded->entries[iii].name, ==, fai->entries[iii].name);
+        tt_int_op(loaded->entries[iii].length, ==, fai->entries[iii].length);
+        tt_int_op(loaded->entries[iii].offset, ==, fai->entries[iii].offset);
+        tt_int_op(loaded->entries[iii].line_bases, ==,
+                  fai->entries[iii].line_bases);
+        tt_int_op(loaded->entries[iii].line_width, ==,
+                  fai->entries[iii].line_width);
+    }
+    tt_ptr_op(qes_fai_find(loaded, "empty"), ==, &loaded->entries[2]);
+    qes_fai_destroy(loaded);
+    tt_int_op(qes_fai_save(NULL, idxname), ==, -2);
+    qes_fai_destroy(fai);
+    /* Not indices */
+    tt_assert(test_fai_write(idxname, "chr1\t14\t23\t10\t11\t0\n"));
+    tt_ptr_op(qes_fai_load(idxname), ==, NULL);
+    tt_assert(test_fai_write(idxname, "chr1\t14\t23\t10\n"));
+    tt_ptr_op(qes_fai_load(idxname), ==, NULL);
+    tt_assert(test_fai_write(idxname, "chr1\t14\t23\t12\t11\n"));
+    tt_ptr_op(qes_fai_load(idxname), ==, NULL);
+    tt_assert(test_fai_write(idxname, "chr1\t14\t2\t1\t2\nchr1\t1\t3\t1\t2\n"));
+    tt_ptr_op(qes_fai_load(idxname), ==, NULL);
+    tt_ptr_op(qes_fai_load(faname), ==, NULL);
+    tt_ptr_op(qes_fai_load(NULL), ==, NULL);
+    /* Indexable, barely */
+    fai = test_fai_build(faname, "\n>a\n\nAC\nA\n\n>b\nACGT\n");
+    tt_assert(fai != NULL);
+    tt_int_op(fai->entries[0].length, ==, 3);
+    tt_int_op(fai->entries[0].offset, ==, 5);
+    tt_int_op(fai->entries[1].length, ==, 4);
+    qes_fai_destroy(fai);
+    /* Not indexable: lines of different lengths, duplicate names, and
+     * bases before a header */
+    tt_ptr_op(test_fai_build(faname, ">a\nAC\nACG\n"), ==, NULL);
+    tt_ptr_op(test_fai_build(faname, ">a\nACG\nA\nAC\n"), ==, NULL);
+    tt_ptr_op(test_fai_build(faname, ">a\nACG\n\nACG\n"), ==, NULL);
+    tt_ptr_op(test_fai_build(faname, ">a\nACG\r\nACG\nACG\n"), ==, NULL);
+    tt_ptr_op(test_fai_build(faname, ">a\nACG\n>a\nACG\n"), ==, NULL);
+    tt_ptr_op(test_fai_build(faname, "ACG\n>a\nACG\n"), ==, NULL);
+    tt_ptr_op(test_fai_build(faname, ">\nACG\n"), ==, NULL);
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "r");
+    tt_ptr_op(qes_fai_build(file), ==, NULL);
+    qes_file_close(file);
+    tt_ptr_op(qes_fai_build(NULL), ==, NULL);
+end:
+    qes_file_close(file);
+    qes_fai_destroy(fai);
+    qes_fai_destroy(loaded);
+    if (fname != NULL) free(fname);
+    clean_writable_file(faname);
+    clean_writable_file(idxname);
+}
+
+
+struct testcase_t qes_fai_tests[] = {
+    { "qes_fai", test_qes_fai, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
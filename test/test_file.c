@@ -28,6 +28,7 @@
 
 #include "tests.h"
 #include <qes_file.h>
+#include <qes_seqfile.h>
 
 
 static void
@@ -122,7 +123,10 @@ test_qes_file_rewind (void *ptr)
         res = qes_file_readline(file, buffer, bufsize);
     }
     tt_int_op(file->filepos, ==, loremipsum_fsize);
-    tt_int_op(QES_ZTELL(file->fp), ==, loremipsum_fsize);
+    /* Mapped files never read from fp */
+    if (!file->mmapped) {
+        tt_int_op(QES_ZTELL(file->fp), ==, loremipsum_fsize);
+    }
     tt_assert(file->eof);
     tt_assert(file->feof);
     qes_file_rewind(file);
@@ -130,6 +134,12 @@ test_qes_file_rewind (void *ptr)
     tt_assert(!file->eof);
     tt_assert(!file->feof);
     tt_int_op(QES_ZTELL(file->fp), ==, 0);
+    /* And check we can read it all again */
+    res = 0;
+    while (res != EOF) {
+        res = qes_file_readline(file, buffer, bufsize);
+    }
+    tt_int_op(file->filepos, ==, loremipsum_fsize);
 end:
     qes_file_close(file);
     free(fname);
@@ -432,6 +442,974 @@ end:
 
 }
 
+static void
+test_qes_file_mmap (void *ptr)
+{
+    struct qes_file *file = NULL;
+    size_t bufsize = 1<<10;
+    char buffer[bufsize];
+    ssize_t res_len = 0;
+    size_t iii;
+    char *fname = NULL;
+
+    (void) ptr;
+    /* A plain file should be mapped, if we can */
+    fname = find_data_file("loremipsum.txt");
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file));
+#ifdef MMAP_FOUND
+    tt_assert(file->mmapped);
+    tt_int_op(file->mmap_len, ==, loremipsum_fsize);
+#endif
+    tt_int_op(qes_file_peek(file), ==, loremipsum_lines[0][0]);
+    tt_int_op(qes_file_getc(file), ==, loremipsum_lines[0][0]);
+    res_len = qes_file_readline(file, buffer, bufsize);
+    tt_int_op(res_len, ==, loremipsum_line_lens[0] - 1);
+    tt_str_op(buffer, ==, loremipsum_lines[0] + 1);
+    for (iii = 1; iii < n_loremipsum_lines; iii++) {
+        res_len = qes_file_readline(file, buffer, bufsize);
+        tt_int_op(res_len, ==, loremipsum_line_lens[iii]);
+        tt_str_op(buffer, ==, loremipsum_lines[iii]);
+    }
+    tt_int_op(qes_file_readline(file, buffer, bufsize), ==, EOF);
+    tt_assert(file->eof);
+    qes_file_close(file);
+    free(fname);
+#if defined(ZLIB_FOUND) || defined(LIBDEFLATE_FOUND)
+    /* Gzipped files fall back to buffered reading */
+    fname = find_data_file("loremipsum.txt.gz");
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file));
+    tt_assert(!file->mmapped);
+    res_len = qes_file_readline(file, buffer, bufsize);
+    tt_int_op(res_len, ==, loremipsum_line_lens[0]);
+    tt_str_op(buffer, ==, loremipsum_lines[0]);
+    qes_file_close(file);
+    free(fname);
+#endif
+    /* Empty files aren't mapped either */
+    fname = find_data_file("empty.txt");
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file));
+    tt_assert(!file->mmapped);
+    tt_int_op(qes_file_readline(file, buffer, bufsize), ==, EOF);
+end:
+    qes_file_close(file);
+    if (fname != NULL) free(fname);
+}
+
+static void
+test_qes_file_buffered_lines (void *ptr)
+{
+    struct qes_file *file = NULL;
+    size_t bufsize = 1<<10;
+    char buffer[bufsize];
+    const char *ends[QES_FILE_LINES_LEN + 1];
+    const char *line = NULL;
+    size_t n_found = 0;
+    size_t iii;
+    size_t jjj;
+    char *fname = NULL;
+    struct qes_file_opts opts = {0};
+    /* Mapped, then read into the buffer, plain and gzipped */
+    const char *files[] = {
+        "loremipsum.txt",
+        "loremipsum.txt",
+#ifdef ZLIB_FOUND
+        "loremipsum.txt.gz",
+#endif
+    };
+    const struct qes_file_backend *backends[] = {
+        NULL,
+        &qes_file_backend_fd,
+#ifdef ZLIB_FOUND
+        NULL,
+#endif
+    };
+    const size_t n_files = sizeof(files) / sizeof(*files);
+
+    (void) ptr;
+    for (jjj = 0; jjj < n_files; jjj++) {
+        fname = find_data_file(files[jjj]);
+        tt_assert(fname != NULL);
+        opts.backend = backends[jjj];
+        file = qes_file_open_opts(fname, "r", &opts);
+        tt_assert(qes_file_ok(file));
+        /* Nothing is buffered until the first read */
+        tt_int_op(qes_file_buffered_lines(file, ends, 4), ==, 0);
+        tt_int_op(qes_file_readable(file), ==, 1);
+        /* Interleave reads with lookups, which mustn't move the file */
+        for (iii = 0; iii < n_loremipsum_lines; iii++) {
+            line = file->bufiter;
+            n_found = qes_file_buffered_lines(file, ends, 3);
+            tt_int_op(n_found, ==, n_loremipsum_lines - iii < 3 ?
+                                   n_loremipsum_lines - iii : 3);
+            tt_ptr_op(file->bufiter, ==, line);
+            tt_int_op(ends[0] + 1 - line, ==, loremipsum_line_lens[iii]);
+            if (n_found > 1) {
+                tt_int_op(ends[1] - ends[0], ==,
+                          loremipsum_line_lens[iii + 1]);
+            }
+            tt_int_op(qes_file_readline(file, buffer, bufsize), ==,
+                      loremipsum_line_lens[iii]);
+            tt_str_op(buffer, ==, loremipsum_lines[iii]);
+        }
+        tt_int_op(qes_file_buffered_lines(file, ends, 3), ==, 0);
+        /* Rewinding must forget the old lines */
+        qes_file_rewind(file);
+        tt_int_op(qes_file_readable(file), ==, 1);
+        n_found = qes_file_buffered_lines(file, ends,
+                                          QES_FILE_LINES_LEN + 1);
+        tt_int_op(n_found, ==, n_loremipsum_lines);
+        tt_int_op(ends[0] + 1 - file->bufiter, ==, loremipsum_line_lens[0]);
+        qes_file_close(file);
+        free(fname);
+        fname = NULL;
+    }
+    /* Check with bad params that nothing is found */
+    tt_int_op(qes_file_buffered_lines(NULL, ends, 1), ==, 0);
+    fname = find_data_file("loremipsum.txt");
+    file = qes_file_open(fname, "r");
+    tt_int_op(qes_file_buffered_lines(file, NULL, 1), ==, 0);
+end:
+    qes_file_close(file);
+    if (fname != NULL) free(fname);
+}
+
+static void
+test_qes_file_async (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_file *async = NULL;
+    struct qes_file_opts opts = {0};
+    char *line = NULL;
+    char *aline = NULL;
+    size_t linesz = 0;
+    size_t alinesz = 0;
+    ssize_t res = 0;
+    ssize_t ares = 0;
+    size_t n_lines = 0;
+    size_t rep;
+    char *fname = NULL;
+
+    (void) ptr;
+    /* Read through the fd backend, so it isn't mapped, and in small buffers
+     * so that many are needed */
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    opts.async_buffers = 3;
+    opts.backend = &qes_file_backend_fd;
+    opts.buffer_len = 4096;
+    file = qes_file_open(fname, "r");
+    async = qes_file_open_opts(fname, "r", &opts);
+    tt_assert(qes_file_ok(file));
+    tt_assert(qes_file_ok(async));
+#ifdef PTHREADS_FOUND
+    tt_ptr_op(async->async, !=, NULL);
+#endif
+    for (rep = 0; rep < 2; rep++) {
+        n_lines = 0;
+        do {
+            res = qes_file_readline_realloc(file, &line, &linesz);
+            ares = qes_file_readline_realloc(async, &aline, &alinesz);
+            tt_int_op(ares, ==, res);
+            if (res < 0) break;
+            tt_str_op(aline, ==, line);
+            n_lines++;
+            /* Rewind part way through the first time around */
+            if (rep == 0 && n_lines == 1000) break;
+        } while (1);
+        tt_int_op(async->filepos, ==, file->filepos);
+        qes_file_rewind(file);
+        qes_file_rewind(async);
+    }
+    tt_int_op(n_lines, ==, 4000);
+end:
+    qes_file_close(file);
+    qes_file_close(async);
+    if (line != NULL) free(line);
+    if (aline != NULL) free(aline);
+    if (fname != NULL) free(fname);
+}
+
+#ifdef ZLIB_FOUND
+static void
+test_qes_file_bgzf (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_file *bgzf = NULL;
+    struct qes_file_opts opts = {0};
+    char *line = NULL;
+    char *bline = NULL;
+    size_t linesz = 0;
+    size_t blinesz = 0;
+    ssize_t res = 0;
+    ssize_t bres = 0;
+    size_t n_lines = 0;
+    size_t rep;
+    char *fname = NULL;
+    char *bfname = NULL;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    bfname = find_data_file("test.fastq.bgz");
+    tt_assert(fname != NULL);
+    tt_assert(bfname != NULL);
+    /* Two threads, so that a batch is smaller than the file */
+    opts.threads = 2;
+    file = qes_file_open(fname, "r");
+    bgzf = qes_file_open_opts(bfname, "r", &opts);
+    tt_assert(qes_file_ok(file));
+    tt_assert(qes_file_ok(bgzf));
+    tt_ptr_op(bgzf->bgzf, !=, NULL);
+    for (rep = 0; rep < 2; rep++) {
+        n_lines = 0;
+        do {
+            res = qes_file_readline_realloc(file, &line, &linesz);
+            bres = qes_file_readline_realloc(bgzf, &bline, &blinesz);
+            tt_int_op(bres, ==, res);
+            if (res < 0) break;
+            tt_str_op(bline, ==, line);
+            n_lines++;
+            /* Rewind part way through the first time around */
+            if (rep == 0 && n_lines == 1000) break;
+        } while (1);
+        tt_int_op(bgzf->filepos, ==, file->filepos);
+        qes_file_rewind(file);
+        qes_file_rewind(bgzf);
+    }
+    tt_int_op(n_lines, >, 1000);
+end:
+    qes_file_close(file);
+    qes_file_close(bgzf);
+    if (line != NULL) free(line);
+    if (bline != NULL) free(bline);
+    if (fname != NULL) free(fname);
+    if (bfname != NULL) free(bfname);
+}
+#endif
+
+static void
+test_qes_file_write (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_str str;
+    char *fname = NULL;
+    char *line = NULL;
+    size_t linesz = 0;
+    size_t iii = 0;
+    const size_t n_lines = 5000;
+
+    (void) ptr;
+    qes_str_init(&str, 32);
+    qes_str_fill_charptr(&str, "GATTACA", 7);
+    fname = get_writable_file();
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "wT");
+    tt_assert(qes_file_ok(file));
+    /* Enough lines to fill the buffer several times */
+    for (iii = 0; iii < n_lines; iii++) {
+        tt_int_op(qes_file_putc(file, '>'), ==, 1);
+        tt_int_op(qes_file_puts(file, "seq "), ==, 4);
+        tt_int_op(qes_file_putstr(file, &str), ==, 7);
+        tt_int_op(qes_file_putc(file, '\n'), ==, 1);
+    }
+    tt_int_op(qes_file_flush(file), ==, 0);
+    tt_int_op(file->filepos, ==, n_lines * 13);
+    qes_file_close(file);
+    /* Read it back */
+    file = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file));
+    for (iii = 0; iii < n_lines; iii++) {
+        tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 13);
+        tt_str_op(line, ==, ">seq GATTACA\n");
+    }
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, EOF);
+    /* Can't write to files open for reading */
+    tt_int_op(qes_file_putc(file, 'A'), ==, -2);
+    tt_int_op(qes_file_flush(file), ==, -2);
+end:
+    qes_file_close(file);
+    qes_str_destroy_cp(&str);
+    if (line != NULL) free(line);
+    clean_writable_file(fname);
+}
+
+static void
+test_qes_file_opts (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_file_opts opts;
+    char *fname = NULL;
+    char *wfname = NULL;
+    char *line = NULL;
+    size_t linesz = 0;
+    size_t iii;
+    size_t jjj;
+    size_t kkk;
+    /* Mapped, then read into the buffer, plain and gzipped */
+    const char *files[] = {
+        "loremipsum.txt",
+        "loremipsum.txt",
+#ifdef ZLIB_FOUND
+        "loremipsum.txt.gz",
+#endif
+    };
+    const struct qes_file_backend *backends[] = {
+        NULL,
+        &qes_file_backend_fd,
+#ifdef ZLIB_FOUND
+        NULL,
+#endif
+    };
+    const size_t n_files = sizeof(files) / sizeof(*files);
+    /* Buffers shorter than a line, a few lines, and many */
+    const size_t buffer_lens[] = {1, 7, 100, 1<<20};
+    const size_t n_buffer_lens = sizeof(buffer_lens) / sizeof(*buffer_lens);
+
+    (void) ptr;
+    for (iii = 0; iii < n_files; iii++) {
+        fname = find_data_file(files[iii]);
+        tt_assert(fname != NULL);
+        for (jjj = 0; jjj < n_buffer_lens; jjj++) {
+            memset(&opts, 0, sizeof(opts));
+            opts.backend = backends[iii];
+            opts.buffer_len = buffer_lens[jjj];
+            opts.zbuffer_len = 1<<16;
+            opts.fadvise = 1;
+            opts.readahead = 1<<20;
+            /* Both with and without a background reader */
+            opts.async_buffers = jjj % 2 ? 3 : 0;
+            file = qes_file_open_opts(fname, "r", &opts);
+            tt_assert(qes_file_ok(file));
+            if (!file->mmapped) {
+                tt_int_op(file->buflen, ==, buffer_lens[jjj] < 2 ? 2 :
+                                            buffer_lens[jjj]);
+            }
+            for (kkk = 0; kkk < n_loremipsum_lines; kkk++) {
+                tt_int_op(qes_file_readline_realloc(file, &line, &linesz),
+                          ==, loremipsum_line_lens[kkk]);
+                tt_str_op(line, ==, loremipsum_lines[kkk]);
+            }
+            tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+                      EOF);
+            tt_int_op(file->filepos, ==, loremipsum_fsize);
+            qes_file_close(file);
+        }
+        free(fname);
+        fname = NULL;
+    }
+    /* The default is QES_FILEBUFFER_LEN */
+    fname = find_data_file("loremipsum.txt");
+    memset(&opts, 0, sizeof(opts));
+    opts.backend = &qes_file_backend_fd;
+    file = qes_file_open_opts(fname, "r", &opts);
+    tt_int_op(file->buflen, ==, QES_FILEBUFFER_LEN);
+    tt_int_op(file->fd, ==, -1);
+    qes_file_close(file);
+    /* Writes through a tiny buffer */
+    wfname = get_writable_file();
+    tt_assert(wfname != NULL);
+    memset(&opts, 0, sizeof(opts));
+    opts.buffer_len = 5;
+    file = qes_file_open_opts(wfname, "wT", &opts);
+    tt_assert(qes_file_ok(file));
+    for (kkk = 0; kkk < 100; kkk++) {
+        tt_int_op(qes_file_puts(file, ">seq GATTACA\n"), ==, 13);
+        tt_int_op(qes_file_putc(file, 'A'), ==, 1);
+    }
+    qes_file_close(file);
+    file = qes_file_open(wfname, "r");
+    for (kkk = 0; kkk < 100; kkk++) {
+        tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+                  kkk ? 14 : 13);
+    }
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 1);
+    tt_str_op(line, ==, "A");
+end:
+    qes_file_close(file);
+    if (fname != NULL) free(fname);
+    if (line != NULL) free(line);
+    if (wfname != NULL) {
+        clean_writable_file(wfname);
+    }
+}
+
+/* An in-memory backend, as a user might supply */
+struct test_membackend {
+    const char *data;
+    size_t len;
+    size_t pos;
+    int closed;
+};
+
+static void *
+test_membackend_open (const char *path, const char *mode, void *arg)
+{
+    (void) path;
+    (void) mode;
+    return arg;
+}
+
+static ssize_t
+test_membackend_read (void *handle, void *buf, size_t len)
+{
+    struct test_membackend *mem = handle;
+
+    if (len > mem->len - mem->pos) {
+        len = mem->len - mem->pos;
+    }
+    memcpy(buf, mem->data + mem->pos, len);
+    mem->pos += len;
+    return len;
+}
+
+static int
+test_membackend_seek (void *handle, off_t offset)
+{
+    struct test_membackend *mem = handle;
+
+    mem->pos = offset;
+    return 0;
+}
+
+static int
+test_membackend_close (void *handle)
+{
+    struct test_membackend *mem = handle;
+
+    mem->closed = 1;
+    return 0;
+}
+
+static void
+test_qes_file_backend (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_file_opts opts;
+    struct test_membackend mem = {"first\nsecond\nthird", 18, 0, 0};
+    const struct qes_file_backend membackend = {
+        "mem", test_membackend_open, NULL, test_membackend_read, NULL,
+        test_membackend_seek, NULL, test_membackend_close, NULL, NULL, NULL,
+    };
+    const struct qes_file_backend *backends[] = {
+        &qes_file_backend_fd,
+        &qes_file_backend_stdio,
+#ifdef ZLIB_FOUND
+        &qes_file_backend_zlib,
+#endif
+#ifdef LIBDEFLATE_FOUND
+        &qes_file_backend_libdeflate,
+#endif
+#ifdef MMAP_FOUND
+        &qes_file_backend_mmap,
+#endif
+    };
+    const size_t n_backends = sizeof(backends) / sizeof(*backends);
+    char *fname = NULL;
+    char *wfname = NULL;
+    char *line = NULL;
+    size_t linesz = 0;
+    size_t iii;
+    size_t jjj;
+
+    (void) ptr;
+    fname = find_data_file("loremipsum.txt");
+    wfname = get_writable_file();
+    tt_assert(fname != NULL && wfname != NULL);
+    for (iii = 0; iii < n_backends; iii++) {
+        memset(&opts, 0, sizeof(opts));
+        opts.backend = backends[iii];
+        /* With hints, we open the descriptor and pass it to dopen */
+        opts.fadvise = iii % 2;
+        /* Backends must give complete reads, even to the background reader */
+        opts.async_buffers = iii % 2 ? 0 : 2;
+        file = qes_file_open_opts(fname, "r", &opts);
+        tt_assert(qes_file_ok(file));
+        tt_ptr_op(file->backend, ==, backends[iii]);
+        if (backends[iii] != QES_FILE_BACKEND_DEFAULT) {
+            tt_ptr_op(file->fp, ==, NULL);
+        }
+        for (jjj = 0; jjj < 2; jjj++) {
+            /* Read it all, rewind and do it again */
+            size_t kkk;
+            for (kkk = 0; kkk < n_loremipsum_lines; kkk++) {
+                tt_int_op(qes_file_readline_realloc(file, &line, &linesz),
+                          ==, loremipsum_line_lens[kkk]);
+                tt_str_op(line, ==, loremipsum_lines[kkk]);
+            }
+            tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+                      EOF);
+            qes_file_rewind(file);
+        }
+        tt_str_op(qes_file_error(file), ==, "");
+        qes_file_close(file);
+        /* Write with those that can */
+        if (backends[iii]->write == NULL) {
+            file = qes_file_open_opts(wfname, "w", &opts);
+            tt_ptr_op(file, ==, NULL);
+            continue;
+        }
+        file = qes_file_open_opts(wfname, "wT", &opts);
+        tt_assert(qes_file_ok(file));
+        tt_int_op(qes_file_puts(file, "some\nlines\n"), ==, 11);
+        tt_int_op(qes_file_flush(file), ==, 0);
+        qes_file_close(file);
+        file = qes_file_open_opts(wfname, "r", &opts);
+        tt_assert(qes_file_ok(file));
+        tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 5);
+        tt_str_op(line, ==, "some\n");
+        tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 6);
+        tt_str_op(line, ==, "lines\n");
+        qes_file_close(file);
+    }
+#ifdef MMAP_FOUND
+    /* Mapped backends are read in place */
+    memset(&opts, 0, sizeof(opts));
+    opts.backend = &qes_file_backend_mmap;
+    file = qes_file_open_opts(fname, "r", &opts);
+    tt_assert(file->mmapped);
+    tt_int_op(file->mmap_len, ==, loremipsum_fsize);
+    qes_file_close(file);
+#endif
+    /* A user backend, with no path at all */
+    memset(&opts, 0, sizeof(opts));
+    opts.backend = &membackend;
+    opts.backend_arg = &mem;
+    file = qes_file_open_opts("memory", "r", &opts);
+    tt_assert(qes_file_ok(file));
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 6);
+    tt_str_op(line, ==, "first\n");
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 7);
+    tt_str_op(line, ==, "second\n");
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 5);
+    tt_str_op(line, ==, "third");
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, EOF);
+    qes_file_rewind(file);
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 6);
+    tt_str_op(line, ==, "first\n");
+    /* It can't write */
+    tt_ptr_op(qes_file_open_opts("memory", "w", &opts), ==, NULL);
+    qes_file_close(file);
+    tt_int_op(mem.closed, ==, 1);
+end:
+    qes_file_close(file);
+    if (fname != NULL) free(fname);
+    if (line != NULL) free(line);
+    if (wfname != NULL) {
+        clean_writable_file(wfname);
+    }
+}
+
+/* Read ``a`` and ``b`` line by line, checking they match */
+static int
+test_qes_file_same_lines (struct qes_file *a, struct qes_file *b)
+{
+    char *aline = NULL;
+    char *bline = NULL;
+    size_t asz = 0;
+    size_t bsz = 0;
+    ssize_t alen = 0;
+    ssize_t blen = 0;
+    int ret = 0;
+
+    do {
+        alen = qes_file_readline_realloc(a, &aline, &asz);
+        blen = qes_file_readline_realloc(b, &bline, &bsz);
+        if (alen != blen || (alen > 0 && strcmp(aline, bline) != 0)) {
+            goto end;
+        }
+    } while (alen != EOF);
+    ret = 1;
+end:
+    free(aline);
+    free(bline);
+    return ret;
+}
+
+#if defined(LIBDEFLATE_FOUND) && defined(ZLIB_FOUND)
+static void
+test_qes_file_libdeflate (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_file *plain = NULL;
+    struct qes_file_opts opts;
+    gzFile gzf = NULL;
+    FILE *fp = NULL;
+    /* A header, then a stored block that claims to be longer than it is */
+    const unsigned char bad[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3,
+                                 0x01, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0};
+    char *fname = NULL;
+    char *wfname = NULL;
+    char *line = NULL;
+    size_t linesz = 0;
+    size_t iii;
+
+    (void) ptr;
+    /* Gzip files are read with libdeflate by default */
+    fname = find_data_file("loremipsum.txt.gz");
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file));
+    tt_ptr_op(file->backend, ==, &qes_file_backend_libdeflate);
+    tt_ptr_op(file->fp, ==, NULL);
+    for (iii = 0; iii < n_loremipsum_lines; iii++) {
+        tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+                  loremipsum_line_lens[iii]);
+        tt_str_op(line, ==, loremipsum_lines[iii]);
+    }
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, EOF);
+    qes_file_rewind(file);
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+              loremipsum_line_lens[0]);
+    qes_file_close(file);
+    free(fname);
+    /* BGZF files aren't, but libdeflate can read them, a block at a time */
+    fname = find_data_file("test.fastq.bgz");
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file));
+    tt_ptr_op(file->backend, !=, &qes_file_backend_libdeflate);
+    qes_file_close(file);
+    memset(&opts, 0, sizeof(opts));
+    opts.backend = &qes_file_backend_libdeflate;
+    file = qes_file_open_opts(fname, "r", &opts);
+    free(fname);
+    fname = find_data_file("test.fastq");
+    plain = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file) && qes_file_ok(plain));
+    tt_assert(test_qes_file_same_lines(file, plain));
+    qes_file_close(file);
+    qes_file_close(plain);
+    /* Concatenated members, with small buffers */
+    wfname = get_writable_file();
+    tt_assert(wfname != NULL);
+    gzf = gzopen(wfname, "wb");
+    tt_assert(gzf != NULL);
+    tt_int_op(gzputs(gzf, "first member\n"), ==, 13);
+    gzclose(gzf);
+    gzf = gzopen(wfname, "ab");
+    tt_assert(gzf != NULL);
+    tt_int_op(gzputs(gzf, "second\nmember\n"), ==, 14);
+    gzclose(gzf);
+    opts.buffer_len = 4;
+    file = qes_file_open_opts(wfname, "r", &opts);
+    tt_assert(qes_file_ok(file));
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 13);
+    tt_str_op(line, ==, "first member\n");
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 7);
+    tt_str_op(line, ==, "second\n");
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, 7);
+    tt_str_op(line, ==, "member\n");
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, EOF);
+    qes_file_close(file);
+    /* Corrupt data is an error */
+    fp = fopen(wfname, "wb");
+    tt_assert(fp != NULL);
+    tt_int_op(fwrite(bad, 1, sizeof(bad), fp), ==, sizeof(bad));
+    fclose(fp);
+    file = qes_file_open_opts(wfname, "r", &opts);
+    tt_assert(qes_file_ok(file));
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), <, 0);
+    tt_str_op(qes_file_error(file), ==, "invalid or corrupt gzip data");
+end:
+    qes_file_close(file);
+    if (fname != NULL) free(fname);
+    if (line != NULL) free(line);
+    if (wfname != NULL) {
+        clean_writable_file(wfname);
+    }
+}
+#endif
+
+static void
+test_qes_file_decoders (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_file *plain = NULL;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_file_opts opts;
+    const struct {
+        const char *name;
+        const struct qes_file_backend *backend;
+    } files[] = {
+#ifdef ZLIB_FOUND
+        /* gzip is left to the default backend, or libdeflate */
+        {"test.fastq.gz", NULL},
+#endif
+        {"test.fastq", NULL},
+#ifdef ZSTD_FOUND
+        /* Two frames */
+        {"test.fastq.zst", &qes_file_backend_zstd},
+#endif
+#ifdef BZIP2_FOUND
+        {"test.fastq.bz2", &qes_file_backend_bzip2},
+        /* Two streams, as pbzip2 writes */
+        {"test_multi.fastq.bz2", &qes_file_backend_bzip2},
+#endif
+#ifdef LIBLZMA_FOUND
+        /* Two streams */
+        {"test.fastq.xz", &qes_file_backend_xz},
+#endif
+    };
+    const size_t n_files = sizeof(files) / sizeof(*files);
+    unsigned char *data = NULL;
+    char *fname = NULL;
+    char *plainname = NULL;
+    char *wfname = NULL;
+    char *line = NULL;
+    size_t linesz = 0;
+    FILE *fp = NULL;
+    long len = 0;
+    ssize_t res = 0;
+    size_t n_recs = 0;
+    size_t iii;
+
+    (void) ptr;
+    plainname = find_data_file("test.fastq");
+    wfname = get_writable_file();
+    tt_assert(plainname != NULL && wfname != NULL);
+    for (iii = 0; iii < n_files; iii++) {
+        fname = find_data_file(files[iii].name);
+        tt_assert(fname != NULL);
+        /* Picked by magic bytes, not by name */
+        file = qes_file_open(fname, "r");
+        plain = qes_file_open(plainname, "r");
+        tt_assert(qes_file_ok(file) && qes_file_ok(plain));
+        if (files[iii].backend != NULL) {
+            tt_ptr_op(file->backend, ==, files[iii].backend);
+#ifdef PTHREADS_FOUND
+            tt_ptr_op(file->async, !=, NULL);
+#endif
+        }
+        tt_assert(test_qes_file_same_lines(file, plain));
+        qes_file_rewind(file);
+        qes_file_rewind(plain);
+        tt_assert(test_qes_file_same_lines(file, plain));
+        qes_file_close(file);
+        qes_file_close(plain);
+        /* Seqfiles need no changes */
+        sf = qes_seqfile_create(fname, "r");
+        tt_assert(sf != NULL);
+        n_recs = 0;
+        while ((res = qes_seqfile_read(sf, seq)) > 0) {
+            n_recs++;
+        }
+        tt_int_op(res, ==, EOF);
+        tt_int_op(n_recs, ==, 1000);
+        qes_seqfile_destroy(sf);
+        if (files[iii].backend == NULL) {
+            free(fname);
+            fname = NULL;
+            continue;
+        }
+        /* A truncated file is an error, not a short read */
+        fp = fopen(fname, "rb");
+        tt_assert(fp != NULL);
+        fseek(fp, 0, SEEK_END);
+        len = ftell(fp);
+        rewind(fp);
+        data = malloc(len);
+        tt_assert(data != NULL);
+        tt_int_op(fread(data, 1, len, fp), ==, len);
+        fclose(fp);
+        fp = fopen(wfname, "wb");
+        tt_assert(fp != NULL);
+        tt_int_op(fwrite(data, 1, len / 3, fp), ==, len / 3);
+        fclose(fp);
+        fp = NULL;
+        memset(&opts, 0, sizeof(opts));
+        opts.backend = files[iii].backend;
+        file = qes_file_open_opts(wfname, "r", &opts);
+        tt_assert(qes_file_ok(file));
+        while ((res = qes_file_readline_realloc(file, &line, &linesz)) > 0);
+        tt_int_op(res, !=, EOF);
+        tt_str_op(qes_file_error(file), ==,
+                  "invalid or truncated compressed data");
+        qes_file_close(file);
+        /* They can't write */
+        tt_ptr_op(qes_file_open_opts(wfname, "w", &opts), ==, NULL);
+        free(data);
+        data = NULL;
+        free(fname);
+        fname = NULL;
+    }
+    /* Nothing is sniffed from too little */
+    tt_ptr_op(qes_file_backend_sniff(NULL, 10), ==, NULL);
+    tt_ptr_op(qes_file_backend_sniff((const unsigned char *)"BZh", 3), ==,
+              NULL);
+    tt_ptr_op(qes_file_backend_sniff((const unsigned char *)"@read1\n", 7),
+              ==, NULL);
+end:
+    qes_file_close(file);
+    qes_file_close(plain);
+    qes_seq_destroy(seq);
+    if (fp != NULL) fclose(fp);
+    if (data != NULL) free(data);
+    if (fname != NULL) free(fname);
+    if (plainname != NULL) free(plainname);
+    if (line != NULL) free(line);
+    if (wfname != NULL) {
+        clean_writable_file(wfname);
+    }
+}
+
+static void
+test_qes_file_seek (void *ptr)
+{
+    struct qes_file *file = NULL;
+    char *fname = NULL;
+    char *wfname = NULL;
+    char *line = NULL;
+    size_t linesz = 0;
+    off_t offset = 0;
+    size_t iii;
+
+    (void) ptr;
+    /* Mapped files go straight there */
+    fname = find_data_file("loremipsum.txt");
+    tt_assert(fname != NULL);
+    file = qes_file_open(fname, "r");
+    tt_assert(qes_file_ok(file));
+    for (iii = 0; iii < 3; iii++) {
+        offset += loremipsum_line_lens[iii];
+    }
+    tt_int_op(qes_file_seek(file, offset), ==, 0);
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+              loremipsum_line_lens[3]);
+    tt_str_op(line, ==, loremipsum_lines[3]);
+    tt_int_op(qes_file_seek(file, 0), ==, 0);
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+              loremipsum_line_lens[0]);
+    tt_str_op(line, ==, loremipsum_lines[0]);
+    /* Past the end is an error, and leaves us at EOF */
+    tt_int_op(qes_file_seek(file, loremipsum_fsize + 1), ==, -1);
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, EOF);
+    qes_file_rewind(file);
+    tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==,
+              loremipsum_line_lens[0]);
+    tt_int_op(qes_file_seek(file, -1), ==, -2);
+    tt_int_op(qes_file_seek(NULL, 0), ==, -2);
+    /* Only gzip is indexed */
+    tt_int_op(qes_file_build_index(file, 0), ==, -2);
+    tt_int_op(qes_file_build_index(NULL, 0), ==, -2);
+    qes_file_close(file);
+    /* Can't seek while writing */
+    wfname = get_writable_file();
+    tt_assert(wfname != NULL);
+    file = qes_file_open(wfname, "wT");
+    tt_assert(file != NULL);
+    tt_int_op(qes_file_seek(file, 0), ==, -2);
+    tt_int_op(qes_file_build_index(file, 0), ==, -2);
+end:
+    qes_file_close(file);
+    if (fname != NULL) free(fname);
+    if (line != NULL) free(line);
+    if (wfname != NULL) {
+        clean_writable_file(wfname);
+    }
+}
+
+#ifdef ZLIB_FOUND
+static void
+test_qes_file_seek_gzip (void *ptr)
+{
+    struct qes_file *file = NULL;
+    struct qes_file *plain = NULL;
+    struct qes_file_opts opts;
+    struct stat st;
+    char *fname = NULL;
+    char *wfname = NULL;
+    char *idxname = NULL;
+    char *line = NULL;
+    char *pline = NULL;
+    size_t linesz = 0;
+    size_t plinesz = 0;
+    char buf[1<<12];
+    off_t offset = 0;
+    size_t iii;
+    size_t jjj;
+    ssize_t res = 0;
+    FILE *in = NULL;
+    FILE *out = NULL;
+
+    (void) ptr;
+    /* Copy a gzip file somewhere we can write its index */
+    fname = find_data_file("test_large.fasta.gz");
+    wfname = get_writable_file();
+    tt_assert(fname != NULL && wfname != NULL);
+    in = fopen(fname, "rb");
+    out = fopen(wfname, "wb");
+    tt_assert(in != NULL && out != NULL);
+    while ((res = fread(buf, 1, sizeof(buf), in)) > 0) {
+        tt_int_op(fwrite(buf, 1, res, out), ==, res);
+    }
+    fclose(in);
+    fclose(out);
+    in = out = NULL;
+    idxname = malloc(strlen(wfname) + strlen(QES_GZINDEX_EXT) + 1);
+    tt_assert(idxname != NULL);
+    sprintf(idxname, "%s%s", wfname, QES_GZINDEX_EXT);
+    for (iii = 0; iii < 2; iii++) {
+        memset(&opts, 0, sizeof(opts));
+        /* Once with the index we build, then in the background with the
+         * saved one */
+        opts.async_buffers = iii * 2;
+        file = qes_file_open_opts(wfname, "r", &opts);
+        plain = qes_file_open(fname, "r");
+        tt_assert(qes_file_ok(file) && qes_file_ok(plain));
+        if (iii == 0) {
+            tt_int_op(qes_file_build_index(file, 1<<14), ==, 0);
+            tt_int_op(stat(idxname, &st), ==, 0);
+            tt_assert(file->index != NULL);
+        }
+        /* Read through the whole file, remembering where lines start, then
+         * seek back to some of them */
+        offset = 0;
+        for (jjj = 0; jjj < 20000; jjj++) {
+            res = qes_file_readline_realloc(plain, &pline, &plinesz);
+            if (res == EOF) {
+                break;
+            }
+            if (jjj % 997 == 0) {
+                tt_int_op(qes_file_seek(file, offset), ==, 0);
+                tt_ptr_op(file->backend, ==, &qes_file_backend_gzindex);
+                tt_int_op(qes_file_readline_realloc(file, &line, &linesz),
+                          ==, res);
+                tt_str_op(line, ==, pline);
+            }
+            offset += res;
+        }
+        /* Back to the start, and past the end */
+        tt_int_op(qes_file_seek(file, 0), ==, 0);
+        qes_file_rewind(plain);
+        tt_assert(test_qes_file_same_lines(file, plain));
+        tt_int_op(qes_file_seek(file, offset + 1), ==, -1);
+        tt_int_op(qes_file_readline_realloc(file, &line, &linesz), ==, EOF);
+        qes_file_close(file);
+        qes_file_close(plain);
+    }
+end:
+    qes_file_close(file);
+    qes_file_close(plain);
+    if (in != NULL) fclose(in);
+    if (out != NULL) fclose(out);
+    if (fname != NULL) free(fname);
+    if (line != NULL) free(line);
+    if (pline != NULL) free(pline);
+    if (idxname != NULL) {
+        clean_writable_file(idxname);
+    }
+    if (wfname != NULL) {
+        clean_writable_file(wfname);
+    }
+}
+#endif
+
 struct testcase_t qes_file_tests[] = {
     { "qes_file_open", test_qes_file_open, 0, NULL, NULL},
     { "qes_file_peek", test_qes_file_peek, 0, NULL, NULL},
@@ -442,5 +1420,22 @@ struct testcase_t qes_file_tests[] = {
     { "qes_file_rewind", test_qes_file_rewind, 0, NULL, NULL},
     { "qes_file_getuntil", test_qes_file_getuntil, 0, NULL, NULL},
     { "qes_file_ok", test_qes_file_ok, 0, NULL, NULL},
+    { "qes_file_mmap", test_qes_file_mmap, 0, NULL, NULL},
+    { "qes_file_buffered_lines", test_qes_file_buffered_lines, 0, NULL, NULL},
+    { "qes_file_async", test_qes_file_async, 0, NULL, NULL},
+#ifdef ZLIB_FOUND
+    { "qes_file_bgzf", test_qes_file_bgzf, 0, NULL, NULL},
+#endif
+    { "qes_file_write", test_qes_file_write, 0, NULL, NULL},
+    { "qes_file_opts", test_qes_file_opts, 0, NULL, NULL},
+    { "qes_file_backend", test_qes_file_backend, 0, NULL, NULL},
+    { "qes_file_decoders", test_qes_file_decoders, 0, NULL, NULL},
+    { "qes_file_seek", test_qes_file_seek, 0, NULL, NULL},
+#ifdef ZLIB_FOUND
+    { "qes_file_seek_gzip", test_qes_file_seek_gzip, 0, NULL, NULL},
+#endif
+#if defined(LIBDEFLATE_FOUND) && defined(ZLIB_FOUND)
+    { "qes_file_libdeflate", test_qes_file_libdeflate, 0, NULL, NULL},
+#endif
     END_OF_TESTCASES
 };
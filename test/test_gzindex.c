@@ -0,0 +1,225 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_gzindex.c
+ *
+ *    Description:  Test qes_gzindex.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_gzindex.h>
+
+#ifdef ZLIB_FOUND
+/* Inflate all of ``fname`` with zlib, for comparison */
+static char *
+test_gzindex_slurp (const char *fname, size_t *len)
+{
+    gzFile gzf = gzopen(fname, "rb");
+    size_t cap = 1<<20;
+    char *data = malloc(cap);
+    int res = 0;
+
+    *len = 0;
+    if (gzf == NULL || data == NULL) {
+        goto error;
+    }
+    while ((res = gzread(gzf, data + *len, cap - *len)) > 0) {
+        *len += res;
+        if (*len == cap) {
+            cap *= 2;
+            data = realloc(data, cap);
+            if (data == NULL) {
+                goto error;
+            }
+        }
+    }
+    if (res < 0) {
+        goto error;
+    }
+    gzclose(gzf);
+    return data;
+error:
+    if (gzf != NULL) {
+        gzclose(gzf);
+    }
+    free(data);
+    return NULL;
+}
+
+/* Seek the gzindex backend to ``offset`` and check that what's read matches
+ * ``data`` */
+static int
+test_gzindex_seek_read (void *handle, off_t offset, const char *data,
+                        size_t len)
+{
+    char buf[1000];
+    size_t want = len - offset < sizeof(buf) ? len - offset : sizeof(buf);
+
+    if (qes_file_backend_gzindex.seek(handle, offset) != 0) {
+        return 0;
+    }
+    if (qes_file_backend_gzindex.read(handle, buf, sizeof(buf)) !=
+            (ssize_t)want) {
+        return 0;
+    }
+    return memcmp(buf, data + offset, want) == 0;
+}
+
+static void
+test_qes_gzindex (void *ptr)
+{
+    struct qes_gzindex *index = NULL;
+    struct qes_gzindex *loaded = NULL;
+    const struct qes_gzindex_point *point = NULL;
+    void *handle = NULL;
+    gzFile gzf = NULL;
+    struct stat st;
+    char *fname = NULL;
+    char *wfname = NULL;
+    char *idxname = NULL;
+    char *data = NULL;
+    size_t len = 0;
+    size_t iii;
+    off_t offset = 0;
+
+    (void) ptr;
+    fname = find_data_file("test_large.fasta.gz");
+    wfname = get_writable_file();
+    idxname = get_writable_file();
+    tt_assert(fname != NULL && wfname != NULL && idxname != NULL);
+    data = test_gzindex_slurp(fname, &len);
+    tt_assert(data != NULL);
+    /* Checkpoints every 16K */
+    index = qes_gzindex_build(fname, 1<<14);
+    tt_assert(index != NULL);
+    tt_int_op(index->size, ==, len);
+    tt_int_op(stat(fname, &st), ==, 0);
+    tt_int_op(index->zsize, ==, st.st_size);
+    /* Checkpoints are only possible between deflate blocks */
+    tt_int_op(index->n_points, >, 3);
+    tt_int_op(index->points[0].out, ==, 0);
+    tt_int_op(index->points[0].window_len, ==, 0);
+    for (iii = 1; iii < index->n_points; iii++) {
+        tt_int_op(index->points[iii].out - index->points[iii - 1].out, >=,
+                  1<<14);
+        tt_int_op(index->points[iii].window_len, ==, QES_GZINDEX_WINDOW_LEN);
+    }
+    /* Finding the nearest point */
+    point = qes_gzindex_find(index, index->points[3].out + 1);
+    tt_ptr_op(point, ==, &index->points[3]);
+    point = qes_gzindex_find(index, index->points[3].out - 1);
+    tt_ptr_op(point, ==, &index->points[2]);
+    point = qes_gzindex_find(index, len * 2);
+    tt_ptr_op(point, ==, &index->points[index->n_points - 1]);
+    tt_ptr_op(qes_gzindex_find(NULL, 0), ==, NULL);
+    /* Seek about, from the checkpoints */
+    handle = qes_file_backend_gzindex.open(fname, "r", index);
+    tt_assert(handle != NULL);
+    srand(1);
+    for (iii = 0; iii < 50; iii++) {
+        offset = rand() % len;
+        tt_assert(test_gzindex_seek_read(handle, offset, data, len));
+    }
+    tt_assert(test_gzindex_seek_read(handle, 0, data, len));
+    tt_assert(test_gzindex_seek_read(handle, len - 10, data, len));
+    tt_assert(test_gzindex_seek_read(handle, index->points[5].out, data, len));
+    tt_int_op(qes_file_backend_gzindex.seek(handle, len + 1), ==, -1);
+    qes_file_backend_gzindex.close(handle);
+    handle = NULL;
+    /* It needs an index */
+    tt_ptr_op(qes_file_backend_gzindex.open(fname, "r", NULL), ==, NULL);
+    tt_ptr_op(qes_file_backend_gzindex.open(fname, "w", index), ==, NULL);
+    /* Save and load it */
+    tt_int_op(qes_gzindex_save(index, idxname), ==, 0);
+    loaded = qes_gzindex_load(idxname, st.st_size);
+    tt_assert(loaded != NULL);
+    tt_int_op(loaded->n_points, ==, index->n_points);
+    tt_int_op(loaded->size, ==, index->size);
+    tt_int_op(loaded->span, ==, index->span);
+    for (iii = 0; iii < index->n_points; iii++) {
+        tt_int_op(loaded->points[iii].out, ==, index->points[iii].out);
+        tt_int_op(loaded->points[iii].in, ==, index->points[iii].in);
+        tt_int_op(loaded->points[iii].bits, ==, index->points[iii].bits);
+        tt_int_op(loaded->points[iii].window_len, ==,
+                  index->points[iii].window_len);
+        if (index->points[iii].window_len > 0) {
+            tt_int_op(memcmp(loaded->points[iii].window,
+                             index->points[iii].window,
+                             index->points[iii].window_len), ==, 0);
+        }
+    }
+    qes_gzindex_destroy(loaded);
+    /* Stale, or not an index at all */
+    tt_ptr_op(qes_gzindex_load(idxname, st.st_size + 1), ==, NULL);
+    tt_ptr_op(qes_gzindex_load(fname, -1), ==, NULL);
+    tt_ptr_op(qes_gzindex_load(NULL, -1), ==, NULL);
+    tt_int_op(qes_gzindex_save(NULL, idxname), ==, -2);
+    qes_gzindex_destroy(index);
+    /* Concatenated members are one stream */
+    gzf = gzopen(wfname, "wb");
+    tt_assert(gzf != NULL);
+    tt_int_op(gzwrite(gzf, data, len / 3), ==, len / 3);
+    gzclose(gzf);
+    gzf = gzopen(wfname, "ab");
+    tt_assert(gzf != NULL);
+    tt_int_op(gzwrite(gzf, data + len / 3, len - len / 3), ==, len - len / 3);
+    gzclose(gzf);
+    index = qes_gzindex_build(wfname, 1<<14);
+    tt_assert(index != NULL);
+    tt_int_op(index->size, ==, len);
+    handle = qes_file_backend_gzindex.open(wfname, "r", index);
+    tt_assert(handle != NULL);
+    for (iii = 0; iii < 50; iii++) {
+        offset = rand() % len;
+        tt_assert(test_gzindex_seek_read(handle, offset, data, len));
+    }
+    /* Across the join, from a checkpoint in the first member */
+    tt_assert(test_gzindex_seek_read(handle, len / 3 - 500, data, len));
+    qes_file_backend_gzindex.close(handle);
+    handle = NULL;
+    qes_gzindex_destroy(index);
+    /* Only gzip can be indexed */
+    free(fname);
+    fname = find_data_file("loremipsum.txt");
+    tt_ptr_op(qes_gzindex_build(fname, 0), ==, NULL);
+    tt_ptr_op(qes_gzindex_build(NULL, 0), ==, NULL);
+end:
+    if (handle != NULL) {
+        qes_file_backend_gzindex.close(handle);
+    }
+    qes_gzindex_destroy(index);
+    qes_gzindex_destroy(loaded);
+    free(data);
+    free(fname);
+    clean_writable_file(wfname);
+    clean_writable_file(idxname);
+}
+#endif
+
+
+struct testcase_t qes_gzindex_tests[] = {
+#ifdef ZLIB_FOUND
+    { "qes_gzindex", test_qes_gzindex, 0, NULL, NULL},
+#endif
+    END_OF_TESTCASES
+};
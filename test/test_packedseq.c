@@ -0,0 +1,205 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_packedseq.c
+ *
+ *    Description:  Test qes_packedseq.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_packedseq.h>
+
+
+/* Fill ``seq`` with random bases of either case, and some ambiguity codes */
+static void
+test_packedseq_random (char *seq, size_t len)
+{
+    const char bases[] = "ACGTACGTacgtNnRY-";
+    size_t iii;
+
+    for (iii = 0; iii < len; iii++) {
+        seq[iii] = bases[rand() % (sizeof(bases) - 1)];
+    }
+    seq[len] = '\0';
+}
+
+/* What unpacking ``seq`` should give */
+static void
+test_packedseq_expect (char *expect, const char *seq, size_t len, int rc)
+{
+    size_t iii;
+    char base;
+
+    for (iii = 0; iii < len; iii++) {
+        base = toupper(seq[rc ? len - 1 - iii : iii]);
+        if (base != 'A' && base != 'C' && base != 'G' && base != 'T') {
+            base = 'N';
+        } else if (rc) {
+            base = base == 'A' ? 'T' : base == 'T' ? 'A' :
+                   base == 'C' ? 'G' : 'C';
+        }
+        expect[iii] = base;
+    }
+    expect[len] = '\0';
+}
+
+static void
+test_qes_packedseq_pack (void *ptr)
+{
+    const enum qes_packedseq_impl impls[] = {
+        QES_PACKEDSEQ_SCALAR,
+        QES_PACKEDSEQ_AVX2,
+        QES_PACKEDSEQ_AUTO,
+    };
+    const size_t n_impls = sizeof(impls) / sizeof(*impls);
+    struct qes_packedseq *ps = NULL;
+    struct qes_packedseq *rc = NULL;
+    char seq[301];
+    char expect[301];
+    char got[301];
+    size_t iii;
+    size_t len;
+
+    (void) ptr;
+    ps = qes_packedseq_create(0);
+    rc = qes_packedseq_create(16);
+    tt_assert(ps != NULL && rc != NULL);
+    tt_int_op(ps->len, ==, 0);
+    srand(1);
+    test_packedseq_random(seq, sizeof(seq) - 1);
+    for (iii = 0; iii < n_impls; iii++) {
+        if (qes_packedseq_use(impls[iii]) != 0) {
+            /* Not supported on this CPU or build */
+            continue;
+        }
+        /* Each length, so the SIMD tails and partial words are tested */
+        for (len = 0; len < sizeof(seq); len++) {
+            tt_int_op(qes_packedseq_pack_str(ps, seq, len), ==, 0);
+            tt_int_op(ps->len, ==, len);
+            tt_int_op(ps->capacity, >=, len);
+            tt_int_op(qes_packedseq_unpack_str(ps, got), ==, 0);
+            test_packedseq_expect(expect, seq, len, 0);
+            tt_str_op(got, ==, expect);
+            if (len > 0) {
+                tt_int_op(qes_packedseq_base(ps, len - 1), ==,
+                          expect[len - 1]);
+            }
+            tt_int_op(qes_packedseq_revcomp(rc, ps), ==, 0);
+            tt_int_op(qes_packedseq_unpack_str(rc, got), ==, 0);
+            test_packedseq_expect(expect, seq, len, 1);
+            tt_str_op(got, ==, expect);
+            /* Twice gets back where we started */
+            tt_int_op(qes_packedseq_revcomp(ps, rc), ==, 0);
+            tt_int_op(qes_packedseq_unpack_str(ps, got), ==, 0);
+            test_packedseq_expect(expect, seq, len, 0);
+            tt_str_op(got, ==, expect);
+        }
+    }
+    tt_int_op(qes_packedseq_use(QES_PACKEDSEQ_SCALAR), ==, 0);
+    tt_int_op(qes_packedseq_use((enum qes_packedseq_impl)-1), ==, -1);
+    /* Check with bad params */
+    tt_int_op(qes_packedseq_pack_str(NULL, seq, 10), ==, -2);
+    tt_int_op(qes_packedseq_pack_str(ps, NULL, 10), ==, -2);
+    tt_int_op(qes_packedseq_pack_str(ps, NULL, 0), ==, 0);
+    tt_int_op(qes_packedseq_unpack_str(ps, NULL), ==, -2);
+    tt_int_op(qes_packedseq_unpack_str(NULL, got), ==, -2);
+    tt_int_op(qes_packedseq_revcomp(ps, ps), ==, -2);
+    tt_int_op(qes_packedseq_revcomp(NULL, ps), ==, -2);
+end:
+    qes_packedseq_use(QES_PACKEDSEQ_AUTO);
+    qes_packedseq_destroy(ps);
+    qes_packedseq_destroy(rc);
+}
+
+static void
+test_qes_packedseq_seq (void *ptr)
+{
+    struct qes_packedseq *ps = NULL;
+    struct qes_seq *seq = NULL;
+    struct qes_seq *out = NULL;
+
+    (void) ptr;
+    ps = qes_packedseq_create(4);
+    seq = qes_seq_create();
+    out = qes_seq_create();
+    tt_assert(ps != NULL && seq != NULL && out != NULL);
+    tt_int_op(qes_seq_fill_seq(seq, "ACGTNacgtacgtACGTACGTACGTACGTACGTACGTA",
+                               38), ==, 0);
+    tt_int_op(qes_packedseq_pack(ps, seq), ==, 0);
+    tt_int_op(ps->len, ==, 38);
+    tt_int_op(qes_packedseq_unpack(ps, out), ==, 0);
+    tt_int_op(out->seq.len, ==, 38);
+    tt_str_op(out->seq.str, ==, "ACGTNACGTACGTACGTACGTACGTACGTACGTACGTA");
+    tt_int_op(qes_packedseq_pack(ps, NULL), ==, -2);
+    tt_int_op(qes_packedseq_unpack(ps, NULL), ==, -2);
+    tt_int_op(qes_packedseq_unpack(NULL, out), ==, -2);
+end:
+    qes_packedseq_destroy(ps);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(out);
+}
+
+static void
+test_qes_packedseq_equal (void *ptr)
+{
+    struct qes_packedseq *a = NULL;
+    struct qes_packedseq *b = NULL;
+
+    (void) ptr;
+    a = qes_packedseq_create(0);
+    b = qes_packedseq_create(0);
+    tt_assert(a != NULL && b != NULL);
+    /* Case doesn't matter, and nor does the ambiguity code */
+    tt_int_op(qes_packedseq_pack_str(a, "ACGTNACGTACGTACGTACGTACGTACGTACGTT", 34),
+              ==, 0);
+    tt_int_op(qes_packedseq_pack_str(b, "acgtRACGTACGTACGTACGTACGTACGTACGTT", 34),
+              ==, 0);
+    tt_assert(qes_packedseq_equal(a, b));
+    tt_int_op(qes_packedseq_hash(a), ==, qes_packedseq_hash(b));
+    /* N isn't A, though they're packed alike */
+    tt_int_op(qes_packedseq_pack_str(b, "ACGTAACGTACGTACGTACGTACGTACGTACGTT", 34),
+              ==, 0);
+    tt_assert(!qes_packedseq_equal(a, b));
+    tt_int_op(qes_packedseq_hash(a), !=, qes_packedseq_hash(b));
+    /* Nor is a shorter sequence, even after a longer one was packed */
+    tt_int_op(qes_packedseq_pack_str(a, "ACGTA", 5), ==, 0);
+    tt_int_op(qes_packedseq_pack_str(b, "ACGTAA", 6), ==, 0);
+    tt_assert(!qes_packedseq_equal(a, b));
+    tt_int_op(qes_packedseq_hash(a), !=, qes_packedseq_hash(b));
+    tt_int_op(qes_packedseq_pack_str(b, "ACGTA", 5), ==, 0);
+    tt_assert(qes_packedseq_equal(a, b));
+    tt_int_op(qes_packedseq_hash(a), ==, qes_packedseq_hash(b));
+    tt_assert(!qes_packedseq_equal(a, NULL));
+    tt_int_op(qes_packedseq_hash(NULL), ==, 0);
+end:
+    qes_packedseq_destroy(a);
+    qes_packedseq_destroy(b);
+}
+
+
+struct testcase_t qes_packedseq_tests[] = {
+    { "qes_packedseq_pack", test_qes_packedseq_pack, 0, NULL, NULL},
+    { "qes_packedseq_seq", test_qes_packedseq_seq, 0, NULL, NULL},
+    { "qes_packedseq_equal", test_qes_packedseq_equal, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
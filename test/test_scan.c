@@ -0,0 +1,117 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_scan.c
+ *
+ *    Description:  Test qes_scan.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_scan.h>
+
+
+static void
+test_qes_scan_delim (void *ptr)
+{
+    const enum qes_scan_impl impls[] = {
+        QES_SCAN_SCALAR,
+        QES_SCAN_SSE2,
+        QES_SCAN_AVX2,
+        QES_SCAN_AUTO,
+    };
+    const size_t n_impls = sizeof(impls) / sizeof(*impls);
+    const size_t buflen = 1000;
+    const size_t max_hits[] = {0, 1, 3, 17, 1000};
+    const size_t n_max_hits = sizeof(max_hits) / sizeof(*max_hits);
+    char *buf = malloc(buflen);
+    size_t *hits = calloc(buflen, sizeof(*hits));
+    size_t expect[1000];
+    size_t n_expect = 0;
+    size_t n_hits = 0;
+    size_t scanned = 0;
+    size_t iii;
+    size_t jjj;
+    size_t start;
+    size_t mmm;
+
+    (void) ptr;
+    tt_assert(buf != NULL && hits != NULL);
+    /* Short and long runs between delimiters, and some runs of them */
+    srand(1);
+    for (iii = 0; iii < buflen; iii++) {
+        buf[iii] = rand() % 7 == 0 || (iii > 500 && iii < 540) ? '\n' : 'A';
+    }
+    for (iii = 0; iii < n_impls; iii++) {
+        if (qes_scan_use(impls[iii]) != 0) {
+            /* Not supported on this CPU or build */
+            continue;
+        }
+        /* Scan at each alignment and length, so the SIMD tails are tested */
+        for (start = 0; start < 70; start++) {
+            n_expect = 0;
+            for (jjj = start; jjj < buflen; jjj++) {
+                if (buf[jjj] == '\n') {
+                    expect[n_expect++] = jjj - start;
+                }
+            }
+            for (mmm = 0; mmm < n_max_hits; mmm++) {
+                n_hits = qes_scan_delim(buf + start, buflen - start, '\n',
+                                        hits, max_hits[mmm], &scanned);
+                if (max_hits[mmm] < n_expect) {
+                    tt_int_op(n_hits, ==, max_hits[mmm]);
+                    tt_int_op(scanned, ==,
+                              n_hits ? hits[n_hits - 1] + 1 : 0);
+                } else {
+                    tt_int_op(n_hits, ==, n_expect);
+                    tt_int_op(scanned, ==, buflen - start);
+                }
+                for (jjj = 0; jjj < n_hits; jjj++) {
+                    tt_int_op(hits[jjj], ==, expect[jjj]);
+                }
+            }
+        }
+        /* No delimiters, and an empty buffer */
+        tt_int_op(qes_scan_delim(buf, buflen, 'C', hits, 10, &scanned), ==, 0);
+        tt_int_op(scanned, ==, buflen);
+        tt_int_op(qes_scan_delim(buf, 0, '\n', hits, 10, &scanned), ==, 0);
+        tt_int_op(scanned, ==, 0);
+    }
+    /* The scalar scanner is always there */
+    tt_int_op(qes_scan_use(QES_SCAN_SCALAR), ==, 0);
+    /* Check with bad params that nothing is found */
+    tt_int_op(qes_scan_delim(NULL, buflen, '\n', hits, 10, &scanned), ==, 0);
+    tt_int_op(scanned, ==, 0);
+    tt_int_op(qes_scan_delim(buf, buflen, '\n', NULL, 10, &scanned), ==, 0);
+    tt_int_op(qes_scan_delim(buf, buflen, '\n', hits, 10, NULL), ==, 0);
+    tt_int_op(qes_scan_use((enum qes_scan_impl)-1), ==, -1);
+end:
+    qes_scan_use(QES_SCAN_AUTO);
+    free(buf);
+    free(hits);
+}
+
+
+struct testcase_t qes_scan_tests[] = {
+    { "qes_scan_delim", test_qes_scan_delim, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
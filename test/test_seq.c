@@ -363,6 +363,77 @@ end:
     qes_seq_destroy(seq);
 }
 
+static void
+test_qes_seq_create_in (void *ptr)
+{
+    struct qes_arena *arena = NULL;
+    struct qes_seq *seq = NULL;
+    char *name = NULL;
+
+    (void) ptr;
+    arena = qes_arena_create(0);
+    tt_assert(arena != NULL);
+    seq = qes_seq_create_in(arena);
+    tt_assert(qes_seq_ok(seq));
+    tt_assert(qes_arena_owns(arena, seq));
+    tt_assert(qes_arena_owns(arena, seq->qual.str));
+    tt_int_op(seq->name.len, ==, 0);
+    tt_str_op(seq->name.str, ==, "");
+    tt_int_op(qes_seq_fill(seq, "TEST", "Comment 1", "AGCT", "IIII"), ==, 0);
+    tt_str_op(seq->comment.str, ==, "Comment 1");
+    /* Members grow within the arena */
+    name = malloc(1000);
+    tt_assert(name != NULL);
+    memset(name, 'N', 999);
+    name[999] = '\0';
+    tt_int_op(qes_seq_fill_name(seq, name, 999), ==, 0);
+    tt_str_op(seq->name.str, ==, name);
+    tt_int_op(seq->name.capacity, >=, 1000);
+    tt_assert(qes_arena_owns(arena, seq->name.str));
+    /* Left for the arena to free */
+    qes_seq_destroy(seq);
+    tt_ptr_op(qes_seq_create_in(NULL), ==, NULL);
+end:
+    qes_arena_destroy(arena);
+    free(name);
+}
+
+static void
+test_qes_seq_pool (void *ptr)
+{
+    struct qes_seq_pool *pool = NULL;
+    struct qes_seq *seqs[3] = {NULL, NULL, NULL};
+    struct qes_seq *seq = NULL;
+    size_t iii;
+
+    (void) ptr;
+    pool = qes_seq_pool_create();
+    tt_assert(pool != NULL);
+    for (iii = 0; iii < 3; iii++) {
+        seqs[iii] = qes_seq_pool_get(pool);
+        tt_assert(qes_seq_ok(seqs[iii]));
+        qes_seq_fill(seqs[iii], "TEST", "Comment", "AGCT", "IIII");
+    }
+    for (iii = 0; iii < 3; iii++) {
+        qes_seq_pool_put(pool, seqs[iii]);
+    }
+    tt_int_op(pool->n_seqs, ==, 3);
+    /* The same seqs come back out, emptied */
+    for (iii = 3; iii > 0; iii--) {
+        seq = qes_seq_pool_get(pool);
+        tt_ptr_op(seq, ==, seqs[iii - 1]);
+        tt_int_op(seq->name.len, ==, 0);
+        tt_str_op(seq->seq.str, ==, "");
+    }
+    tt_int_op(pool->n_seqs, ==, 0);
+    for (iii = 0; iii < 3; iii++) {
+        qes_seq_pool_put(pool, seqs[iii]);
+    }
+    tt_ptr_op(qes_seq_pool_get(NULL), ==, NULL);
+end:
+    qes_seq_pool_destroy(pool);
+}
+
 static void
 test_qes_seq_copy(void *ptr)
 {
@@ -394,6 +465,38 @@ end:
     qes_seq_destroy(copy);
 }
 
+static void
+test_qes_seq_revcomp (void *ptr)
+{
+    struct qes_seq *seq = NULL;
+
+    (void) ptr;
+    seq = qes_seq_create();
+    tt_int_op(qes_seq_fill(seq, "TEST", "Comment", "AACGTtgcaNR",
+                           "ABCDEFGHIJK"), ==, 0);
+    tt_int_op(qes_seq_revcomp(seq), ==, 0);
+    tt_str_op(seq->seq.str, ==, "YNtgcaACGTT");
+    tt_str_op(seq->qual.str, ==, "KJIHGFEDCBA");
+    tt_int_op(qes_seq_revcomp(seq), ==, 0);
+    tt_str_op(seq->seq.str, ==, "AACGTtgcaNR");
+    tt_str_op(seq->qual.str, ==, "ABCDEFGHIJK");
+    /* Without qualities */
+    qes_seq_destroy(seq);
+    seq = qes_seq_create_no_qual();
+    tt_int_op(qes_seq_fill_seq(seq, "ACCGT", 5), ==, 0);
+    tt_int_op(qes_seq_revcomp(seq), ==, 0);
+    tt_str_op(seq->seq.str, ==, "ACGGT");
+    /* Qualities must match up */
+    qes_seq_destroy(seq);
+    seq = qes_seq_create();
+    tt_int_op(qes_seq_fill(seq, "TEST", "Comment", "ACGT", "III"), ==, 0);
+    tt_int_op(qes_seq_revcomp(seq), ==, -2);
+    tt_str_op(seq->seq.str, ==, "ACGT");
+    tt_int_op(qes_seq_revcomp(NULL), ==, -2);
+end:
+    qes_seq_destroy(seq);
+}
+
 static void
 test_qes_seq_fill_funcs(void *ptr)
 {
@@ -493,8 +596,11 @@ struct testcase_t qes_seq_tests[] = {
     { "qes_seq_ok_no_comment_or_qual", test_qes_seq_ok_no_comment_or_qual, 0,
         NULL, NULL},
     { "qes_seq_destroy", test_qes_seq_destroy, 0, NULL, NULL},
+    { "qes_seq_create_in", test_qes_seq_create_in, 0, NULL, NULL},
+    { "qes_seq_pool", test_qes_seq_pool, 0, NULL, NULL},
     { "qes_seq_fill", test_qes_seq_fill_funcs, 0, NULL, NULL},
     { "qes_seq_copy", test_qes_seq_copy, 0, NULL, NULL},
+    { "qes_seq_revcomp", test_qes_seq_revcomp, 0, NULL, NULL},
     { "qes_seq_print", test_qes_seq_print, 0, NULL, NULL},
     END_OF_TESTCASES
 };
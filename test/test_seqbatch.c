@@ -0,0 +1,107 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_seqbatch.c
+ *
+ *    Description:  Test qes_seqbatch.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_seqbatch.h>
+
+
+static void
+test_qes_seq_batch_create (void *ptr)
+{
+    struct qes_seq_batch *batch = NULL;
+    (void) ptr;
+    batch = qes_seq_batch_create(0, 0);
+    tt_assert(qes_seq_batch_ok(batch));
+    tt_int_op(batch->n_records, ==, 0);
+    tt_int_op(batch->arena_len, ==, 0);
+    tt_int_op(batch->capacity, ==, QES_SEQBATCH_DEFAULT_RECORDS);
+    tt_int_op(batch->arena_cap, >, 0);
+    qes_seq_batch_destroy(batch);
+    tt_ptr_op(batch, ==, NULL);
+    batch = qes_seq_batch_create(1, 1);
+    tt_assert(qes_seq_batch_ok(batch));
+    tt_int_op(batch->capacity, ==, 1);
+    tt_int_op(batch->arena_cap, ==, 1);
+    tt_assert(!qes_seq_batch_ok(NULL));
+end:
+    qes_seq_batch_destroy(batch);
+}
+
+static void
+test_qes_seq_batch_append (void *ptr)
+{
+    struct qes_seq_batch *batch = NULL;
+    struct qes_seqview view;
+    struct qes_seqview got;
+    char name[32];
+    size_t iii;
+    const size_t n_recs = 100;
+
+    (void) ptr;
+    memset(&view, 0, sizeof(view));
+    view.seq.str = "ACGTACGT";
+    view.seq.len = 8;
+    view.qual.str = "IIIIIIII";
+    view.qual.len = 8;
+    /* Start tiny, so both the arena and the arrays must grow */
+    batch = qes_seq_batch_create(1, 1);
+    for (iii = 0; iii < n_recs; iii++) {
+        view.name.len = snprintf(name, sizeof(name), "read_%zu", iii);
+        view.name.str = name;
+        tt_int_op(qes_seq_batch_append(batch, &view), ==, 0);
+    }
+    tt_int_op(batch->n_records, ==, n_recs);
+    tt_int_op(batch->capacity, >=, n_recs);
+    for (iii = 0; iii < n_recs; iii++) {
+        snprintf(name, sizeof(name), "read_%zu", iii);
+        tt_int_op(qes_seq_batch_view(batch, iii, &got), ==, 0);
+        tt_str_op(got.name.str, ==, name);
+        tt_str_op(got.comment.str, ==, "");
+        tt_int_op(got.comment.len, ==, 0);
+        tt_str_op(got.seq.str, ==, "ACGTACGT");
+        tt_str_op(got.qual.str, ==, "IIIIIIII");
+    }
+    tt_int_op(qes_seq_batch_view(batch, n_recs, &got), ==, -1);
+    /* Clearing keeps the memory */
+    qes_seq_batch_clear(batch);
+    tt_int_op(batch->n_records, ==, 0);
+    tt_int_op(batch->arena_len, ==, 0);
+    tt_int_op(batch->capacity, >=, n_recs);
+    tt_int_op(qes_seq_batch_view(batch, 0, &got), ==, -1);
+    tt_int_op(qes_seq_batch_append(NULL, &view), ==, -1);
+    tt_int_op(qes_seq_batch_append(batch, NULL), ==, -1);
+end:
+    qes_seq_batch_destroy(batch);
+}
+
+
+struct testcase_t qes_seqbatch_tests[] = {
+    { "qes_seq_batch_create", test_qes_seq_batch_create, 0, NULL, NULL},
+    { "qes_seq_batch_append", test_qes_seq_batch_append, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
@@ -343,6 +343,286 @@ end:
 }
 
 
+static void
+test_qes_seqfile_read_view (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seqview view;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *vsf = NULL;
+    ssize_t res = 0;
+    ssize_t vres = 0;
+    size_t iii;
+    char *fname = NULL;
+    const char *files[] = {
+        "test.fastq",
+        "test.fastq.gz",
+        "test.fasta",
+        "test_large.fasta.gz",
+        "nocomment.fasta",
+        "bad_diff_lens.fastq",
+        "bad_noqual.fastq",
+        "bad_noqualhdrchr.fastq",
+        "bad_noqualhdreol.fastq",
+        "empty.fastq",
+        "loremipsum.txt",
+    };
+    const size_t n_files = sizeof(files) / sizeof(*files);
+#define CHECK_VIEW_MEMBER(mbr)                                              \
+    tt_int_op(view.mbr.len, ==, seq->mbr.len);                              \
+    tt_assert(strncmp(view.mbr.str, seq->mbr.str, view.mbr.len) == 0)
+
+    (void) ptr;
+    /* Views should always match what qes_seqfile_read gives us */
+    for (iii = 0; iii < n_files; iii++) {
+        fname = find_data_file(files[iii]);
+        tt_assert(fname != NULL);
+        sf = qes_seqfile_create(fname, "r");
+        vsf = qes_seqfile_create(fname, "r");
+        tt_assert(sf != NULL && vsf != NULL);
+        do {
+            res = qes_seqfile_read(sf, seq);
+            vres = qes_seqfile_read_view(vsf, &view);
+            tt_int_op(vres, ==, res);
+            if (res < 0) break;
+            CHECK_VIEW_MEMBER(name);
+            CHECK_VIEW_MEMBER(comment);
+            CHECK_VIEW_MEMBER(seq);
+            CHECK_VIEW_MEMBER(qual);
+        } while (1);
+        tt_int_op(vsf->n_records, ==, sf->n_records);
+        qes_seqfile_destroy(sf);
+        qes_seqfile_destroy(vsf);
+        free(fname);
+        fname = NULL;
+    }
+    /* Check with bad params that it returns -2 */
+    tt_int_op(qes_seqfile_read_view(NULL, &view), ==, -2);
+    fname = find_data_file("test.fastq");
+    vsf = qes_seqfile_create(fname, "r");
+    tt_int_op(qes_seqfile_read_view(vsf, NULL), ==, -2);
+#undef CHECK_VIEW_MEMBER
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(vsf);
+    qes_seq_destroy(seq);
+    if (fname != NULL) free(fname);
+}
+
+
+/*===  FUNCTION  ============================================================*
+Name:           test_qes_seqfile_read_batch
+Description:    Tests the qes_seqfile_read_batch function from qes_seqfile.c
+ *===========================================================================*/
+static void
+test_qes_seqfile_read_batch (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seq_batch *batch = qes_seq_batch_create(4, 64);
+    struct qes_seqview view;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *bsf = NULL;
+    ssize_t res = 0;
+    ssize_t bres = 0;
+    size_t iii;
+    size_t jjj;
+    size_t n_recs = 0;
+    char *fname = NULL;
+    const char *files[] = {
+        "test.fastq",
+        "test.fastq.gz",
+        "test.fasta",
+        "test_large.fasta.gz",
+        "nocomment.fasta",
+        "empty.fastq",
+    };
+    const size_t n_files = sizeof(files) / sizeof(*files);
+#define CHECK_BATCH_MEMBER(mbr)                                             \
+    tt_int_op(view.mbr.len, ==, seq->mbr.len);                              \
+    tt_str_op(view.mbr.str, ==, seq->mbr.str)
+
+    (void) ptr;
+    tt_assert(qes_seq_batch_ok(batch));
+    /* Batches should hold exactly what qes_seqfile_read gives us */
+    for (iii = 0; iii < n_files; iii++) {
+        fname = find_data_file(files[iii]);
+        tt_assert(fname != NULL);
+        sf = qes_seqfile_create(fname, "r");
+        bsf = qes_seqfile_create(fname, "r");
+        tt_assert(sf != NULL && bsf != NULL);
+        n_recs = 0;
+        while ((bres = qes_seqfile_read_batch(bsf, batch, 100, 0)) > 0) {
+            tt_int_op(bres, ==, batch->n_records);
+            tt_int_op(bres, <=, 100);
+            for (jjj = 0; jjj < batch->n_records; jjj++) {
+                res = qes_seqfile_read(sf, seq);
+                tt_int_op(res, >=, 0);
+                tt_int_op(qes_seq_batch_view(batch, jjj, &view), ==, 0);
+                CHECK_BATCH_MEMBER(name);
+                CHECK_BATCH_MEMBER(seq);
+                if (seq->comment.len > 0) {
+                    CHECK_BATCH_MEMBER(comment);
+                }
+                if (seq->qual.len > 0) {
+                    CHECK_BATCH_MEMBER(qual);
+                }
+                n_recs++;
+            }
+        }
+        /* Both should end the same way, including for empty files */
+        tt_int_op(bres, ==, qes_seqfile_read(sf, seq));
+        tt_int_op(n_recs, ==, sf->n_records);
+        qes_seqfile_destroy(sf);
+        qes_seqfile_destroy(bsf);
+        free(fname);
+        fname = NULL;
+    }
+    /* A byte limit stops the batch once it's reached */
+    fname = find_data_file("test.fastq");
+    bsf = qes_seqfile_create(fname, "r");
+    bres = qes_seqfile_read_batch(bsf, batch, 0, 1000);
+    tt_int_op(bres, >, 1);
+    tt_int_op(batch->arena_len, >=, 1000);
+    tt_int_op(qes_seq_batch_view(batch, bres - 1, &view), ==, 0);
+    tt_int_op(batch->arena_len - (view.name.str - batch->arena), <, 1000);
+    /* With no limits, we get up to the default number of records, which is
+     * more than the rest of the file */
+    res = bres;
+    bres = qes_seqfile_read_batch(bsf, batch, 0, 0);
+    tt_int_op(bres, ==, 1000 - res);
+    /* Check with bad params that it returns -2 */
+    tt_int_op(qes_seqfile_read_batch(NULL, batch, 1, 0), ==, -2);
+    tt_int_op(qes_seqfile_read_batch(bsf, NULL, 1, 0), ==, -2);
+#undef CHECK_BATCH_MEMBER
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(bsf);
+    qes_seq_destroy(seq);
+    qes_seq_batch_destroy(batch);
+    if (fname != NULL) free(fname);
+}
+
+
+/*===  FUNCTION  ============================================================*
+Name:           test_qes_seqfile_split
+Description:    Tests the qes_seqfile_split and qes_seqfile_chunk_read_view
+                functions from qes_seqfile.c
+ *===========================================================================*/
+static void
+test_qes_seqfile_split (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seqfile_chunk chunks[64];
+    struct qes_seqview view;
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *csf = NULL;
+    FILE *fp = NULL;
+    ssize_t res = 0;
+    ssize_t n_chunks = 0;
+    ssize_t ccc;
+    size_t iii;
+    size_t n_recs = 0;
+    char *fname = NULL;
+    char *tmpfname = NULL;
+    const size_t splits[] = {1, 2, 3, 7, 64};
+    const size_t n_splits = sizeof(splits) / sizeof(*splits);
+    /* Quality lines which look like headers and separators */
+    const char *tricky =
+        "@r1 c1\nACGT\n+\n@@@@\n"
+        "@r2\nAC\n+\n+I\n"
+        "@r3\nGGGG\n+r3\n@II@\n"
+        "@r4\nT\n+\n@\n";
+
+    (void) ptr;
+    /* Chunks must hold exactly what qes_seqfile_read gives us, in order */
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    for (iii = 0; iii < n_splits; iii++) {
+        sf = qes_seqfile_create(fname, "r");
+        csf = qes_seqfile_create(fname, "r");
+        tt_assert(sf != NULL && csf != NULL);
+        n_chunks = qes_seqfile_split(csf, chunks, splits[iii]);
+        tt_int_op(n_chunks, >, 0);
+        tt_int_op(n_chunks, <=, splits[iii]);
+        n_recs = 0;
+        for (ccc = 0; ccc < n_chunks; ccc++) {
+            if (ccc > 0) {
+                tt_assert(chunks[ccc].start == chunks[ccc - 1].end);
+            }
+            while ((res = qes_seqfile_chunk_read_view(&chunks[ccc], &view))
+                    != EOF) {
+                tt_int_op(res, ==, qes_seqfile_read(sf, seq));
+                tt_int_op(view.name.len, ==, seq->name.len);
+                tt_assert(strncmp(view.name.str, seq->name.str,
+                                  seq->name.len) == 0);
+                tt_int_op(view.comment.len, ==, seq->comment.len);
+                tt_assert(strncmp(view.seq.str, seq->seq.str,
+                                  seq->seq.len) == 0);
+                tt_assert(strncmp(view.qual.str, seq->qual.str,
+                                  seq->qual.len) == 0);
+                n_recs++;
+            }
+        }
+        tt_int_op(n_recs, ==, 1000);
+        tt_int_op(qes_seqfile_read(sf, seq), ==, EOF);
+        qes_seqfile_destroy(sf);
+        qes_seqfile_destroy(csf);
+    }
+    /* Records whose quality starts with '@' or '+' mustn't be split on */
+    tmpfname = get_writable_file();
+    fp = fopen(tmpfname, "w");
+    tt_assert(fp != NULL);
+    fputs(tricky, fp);
+    fclose(fp);
+    fp = NULL;
+    for (iii = 1; iii <= strlen(tricky); iii++) {
+        sf = qes_seqfile_create(tmpfname, "r");
+        csf = qes_seqfile_create(tmpfname, "r");
+        tt_assert(sf != NULL && csf != NULL);
+        n_chunks = qes_seqfile_split(csf, chunks, iii < 64 ? iii : 64);
+        tt_int_op(n_chunks, >, 0);
+        n_recs = 0;
+        for (ccc = 0; ccc < n_chunks; ccc++) {
+            while ((res = qes_seqfile_chunk_read_view(&chunks[ccc], &view))
+                    != EOF) {
+                tt_int_op(res, ==, qes_seqfile_read(sf, seq));
+                tt_assert(strncmp(view.qual.str, seq->qual.str,
+                                  seq->qual.len) == 0);
+                n_recs++;
+            }
+        }
+        tt_int_op(n_recs, ==, 4);
+        qes_seqfile_destroy(sf);
+        qes_seqfile_destroy(csf);
+    }
+    /* Only mmapped FASTQ can be split */
+    free(fname);
+    fname = find_data_file("test.fastq.gz");
+    csf = qes_seqfile_create(fname, "r");
+    tt_int_op(qes_seqfile_split(csf, chunks, 4), ==, -2);
+    qes_seqfile_destroy(csf);
+    free(fname);
+    fname = find_data_file("test.fasta");
+    csf = qes_seqfile_create(fname, "r");
+    tt_int_op(qes_seqfile_split(csf, chunks, 4), ==, -2);
+    /* Check with bad params that it returns -2 */
+    tt_int_op(qes_seqfile_split(NULL, chunks, 4), ==, -2);
+    tt_int_op(qes_seqfile_split(csf, NULL, 4), ==, -2);
+    tt_int_op(qes_seqfile_split(csf, chunks, 0), ==, -2);
+    tt_int_op(qes_seqfile_chunk_read_view(NULL, &view), ==, -2);
+    tt_int_op(qes_seqfile_chunk_read_view(&chunks[0], NULL), ==, -2);
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(csf);
+    qes_seq_destroy(seq);
+    if (fp != NULL) fclose(fp);
+    if (fname != NULL) free(fname);
+    if (tmpfname != NULL) {
+        clean_writable_file(tmpfname);
+    }
+}
+
+
 /*===  FUNCTION  ============================================================*
 Name:           test_qes_seqfile_write
 Description:    Tests the qes_seqfile_write function from qes_seqfile.c
@@ -406,6 +686,522 @@ end:
     if (crc != NULL) free(crc);
 }
 
+/*===  FUNCTION  ============================================================*
+Name:           test_qes_seqfile_write_bgzf
+Description:    Tests writing BGZF with qes_seqfile_write, by reading it back.
+ *===========================================================================*/
+static void
+test_qes_seqfile_write_bgzf (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seq *back = qes_seq_create();
+    struct qes_seqfile *in = NULL;
+    struct qes_seqfile *out = NULL;
+    struct qes_file_opts opts = {0};
+    ssize_t res = 0;
+    ssize_t bres = 0;
+    size_t n_recs = 0;
+    size_t rep;
+    char *infname = NULL;
+    char *fname = NULL;
+
+    (void) ptr;
+    infname = find_data_file("test.fastq");
+    tt_assert(infname != NULL);
+    fname = get_writable_file();
+    tt_assert(fname != NULL);
+    /* Write the input out a few times, so that it spans several batches */
+    opts.bgzf = 1;
+    opts.threads = 2;
+    opts.level = 1;
+    out = qes_seqfile_create_opts(fname, "w", &opts);
+    tt_assert(qes_seqfile_ok(out));
+#ifdef ZLIB_FOUND
+    tt_ptr_op(out->qf->bgzf, !=, NULL);
+#endif
+    qes_seqfile_set_format(out, FASTQ_FMT);
+    for (rep = 0; rep < 4; rep++) {
+        in = qes_seqfile_create(infname, "r");
+        while (qes_seqfile_read(in, seq) > 0) {
+            tt_int_op(qes_seqfile_write(out, seq), >, 0);
+        }
+        qes_seqfile_destroy(in);
+    }
+    qes_seqfile_destroy(out);
+    /* Read it back, which should also be as BGZF */
+    out = qes_seqfile_create(fname, "r");
+    tt_assert(qes_seqfile_ok(out));
+#ifdef ZLIB_FOUND
+    tt_ptr_op(out->qf->bgzf, !=, NULL);
+#endif
+    for (rep = 0; rep < 4; rep++) {
+        in = qes_seqfile_create(infname, "r");
+        while ((res = qes_seqfile_read(in, seq)) > 0) {
+            bres = qes_seqfile_read(out, back);
+            tt_int_op(bres, ==, res);
+            tt_str_op(back->name.str, ==, seq->name.str);
+            tt_str_op(back->comment.str, ==, seq->comment.str);
+            tt_str_op(back->seq.str, ==, seq->seq.str);
+            tt_str_op(back->qual.str, ==, seq->qual.str);
+            n_recs++;
+        }
+        qes_seqfile_destroy(in);
+    }
+    tt_int_op(qes_seqfile_read(out, back), ==, EOF);
+    tt_int_op(n_recs, ==, 4000);
+end:
+    qes_seqfile_destroy(in);
+    qes_seqfile_destroy(out);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(back);
+    if (fname != NULL) {
+        clean_writable_file(fname);
+    }
+    if (infname != NULL) free(infname);
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           test_qes_seqfile_read_fasta_lines
+Description:    Tests reading multi-line FASTA records, with odd line ends and
+                with lines split between buffers.
+ *===========================================================================*/
+static void
+test_qes_seqfile_read_fasta_lines (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seq *ref_seq = qes_seq_create();
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *ref = NULL;
+    struct qes_file_opts opts;
+    char *fname = NULL;
+    char *wfname = NULL;
+    FILE *fp = NULL;
+    ssize_t res = 0;
+    size_t n_recs = 0;
+    const char *fasta =
+        ">a one\r\nACGT\r\nAC\r\n"
+        ">b\n\nACGTA\n\n"
+        ">empty\n"
+        ">c\nACG\nT";
+
+    (void) ptr;
+    memset(&opts, 0, sizeof(opts));
+    wfname = get_writable_file();
+    tt_assert(wfname != NULL);
+    fp = fopen(wfname, "wb");
+    tt_assert(fp != NULL);
+    tt_int_op(fwrite(fasta, 1, strlen(fasta), fp), ==, strlen(fasta));
+    fclose(fp);
+    fp = NULL;
+    sf = qes_seqfile_create(wfname, "r");
+    tt_int_op(qes_seqfile_read(sf, seq), ==, 6);
+    tt_str_op(seq->name.str, ==, "a");
+    tt_str_op(seq->seq.str, ==, "ACGTAC");
+    tt_int_op(qes_seqfile_read(sf, seq), ==, 5);
+    tt_str_op(seq->seq.str, ==, "ACGTA");
+    tt_int_op(qes_seqfile_read(sf, seq), ==, 0);
+    tt_str_op(seq->name.str, ==, "empty");
+    tt_str_op(seq->seq.str, ==, "");
+    tt_int_op(qes_seqfile_read(sf, seq), ==, 4);
+    tt_str_op(seq->seq.str, ==, "ACGT");
+    tt_int_op(qes_seqfile_read(sf, seq), ==, EOF);
+    qes_seqfile_destroy(sf);
+#ifdef ZLIB_FOUND
+    /* Lines split between many small buffers */
+    fname = find_data_file("test_large.fasta.gz");
+    tt_assert(fname != NULL);
+    opts.buffer_len = 1000;
+    sf = qes_seqfile_create_opts(fname, "r", &opts);
+    ref = qes_seqfile_create(fname, "r");
+    tt_assert(qes_seqfile_ok(sf) && qes_seqfile_ok(ref));
+    while ((res = qes_seqfile_read(ref, ref_seq)) >= 0) {
+        tt_int_op(qes_seqfile_read(sf, seq), ==, res);
+        tt_str_op(seq->name.str, ==, ref_seq->name.str);
+        tt_str_op(seq->seq.str, ==, ref_seq->seq.str);
+        n_recs++;
+    }
+    tt_int_op(res, ==, EOF);
+    tt_int_op(qes_seqfile_read(sf, seq), ==, EOF);
+    tt_int_op(n_recs, >, 0);
+#else
+    (void) ref_seq;
+    (void) res;
+    (void) n_recs;
+#endif
+end:
+    if (fp != NULL) fclose(fp);
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(ref);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(ref_seq);
+    if (fname != NULL) free(fname);
+    clean_writable_file(wfname);
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           test_qes_seqfile_read_presize
+Description:    Tests that seqs are grown up front to fit the longest records
+                seen, so long reads aren't grown a piece at a time.
+ *===========================================================================*/
+static void
+test_qes_seqfile_read_presize (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seq *fresh = NULL;
+    struct qes_seqfile *sf = NULL;
+    char *fname = NULL;
+    char *before = NULL;
+    FILE *fp = NULL;
+    const size_t lens[] = {1000, 300000, 5000, 300000, 20};
+    size_t iii;
+    size_t jjj;
+
+    (void) ptr;
+    fname = get_writable_file();
+    tt_assert(fname != NULL);
+    fp = fopen(fname, "wb");
+    tt_assert(fp != NULL);
+    for (iii = 0; iii < sizeof(lens) / sizeof(*lens); iii++) {
+        fprintf(fp, "@read%zu some comment\n", iii);
+        for (jjj = 0; jjj < lens[iii]; jjj++) fputc("ACGT"[jjj % 4], fp);
+        fputs("\n+\n", fp);
+        for (jjj = 0; jjj < lens[iii]; jjj++) fputc('I', fp);
+        fputc('\n', fp);
+    }
+    fclose(fp);
+    fp = NULL;
+    sf = qes_seqfile_create(fname, "r");
+    tt_int_op(qes_seqfile_read(sf, seq), ==, 1000);
+    tt_int_op(qes_seqfile_read(sf, seq), ==, 300000);
+    tt_int_op(sf->max_seq_len, ==, 300000);
+    tt_int_op(sf->max_name_len, ==, 5);
+    tt_int_op(sf->max_comment_len, ==, 12);
+    /* A fresh seq is made big enough for the longest record at once */
+    fresh = qes_seq_create();
+    tt_int_op(qes_seqfile_read(sf, fresh), ==, 5000);
+    tt_int_op(fresh->seq.capacity, >=, 300001);
+    tt_int_op(fresh->qual.capacity, >=, 300001);
+    before = fresh->seq.str;
+    tt_int_op(qes_seqfile_read(sf, fresh), ==, 300000);
+    tt_ptr_op(fresh->seq.str, ==, before);
+    tt_int_op(fresh->qual.len, ==, 300000);
+    tt_int_op(qes_seqfile_read(sf, fresh), ==, 20);
+    tt_ptr_op(fresh->seq.str, ==, before);
+    tt_str_op(fresh->name.str, ==, "read4");
+    tt_str_op(fresh->qual.str, ==, "IIIIIIIIIIIIIIIIIIII");
+    tt_int_op(qes_seqfile_read(sf, fresh), ==, EOF);
+end:
+    if (fp != NULL) fclose(fp);
+    qes_seqfile_destroy(sf);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(fresh);
+    clean_writable_file(fname);
+}
+
+/* Read all of ``sf`` in windows, checking each sequence rebuilt from its
+ * windows against reading ``ref`` whole. Returns the number of sequences, or
+ * -1 if they differ. */
+static ssize_t
+test_seqfile_windows (struct qes_seqfile *sf, struct qes_seqfile *ref,
+                      size_t window, size_t overlap)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seq *whole = qes_seq_create();
+    struct qes_str rebuilt;
+    struct qes_seqfile_window pos = {0, 0};
+    ssize_t n_seqs = 0;
+    ssize_t res = 0;
+    int last = 1;
+
+    qes_str_init(&rebuilt, __INIT_LINE_LEN);
+    while ((res = qes_seqfile_read_window(sf, seq, window, overlap, &pos))
+            >= 0) {
+        if ((size_t)res > window || (!pos.last && (size_t)res != window) ||
+                (pos.start == 0) != last) {
+            goto fail;
+        }
+        if (pos.start == 0) {
+            qes_str_nullify(&rebuilt);
+        } else {
+            /* Windows pick up where the last left off, less the overlap */
+            if (pos.start != rebuilt.len - overlap ||
+                    memcmp(seq->seq.str, rebuilt.str + pos.start,
+                           overlap) != 0) {
+                goto fail;
+            }
+            qes_str_truncate(&rebuilt, pos.start);
+        }
+        qes_str_cat(&rebuilt, &seq->seq);
+        last = pos.last;
+        if (last) {
+            if (qes_seqfile_read(ref, whole) < 0 ||
+                    strcmp(whole->name.str, seq->name.str) != 0 ||
+                    strcmp(whole->comment.str, seq->comment.str) != 0 ||
+                    strcmp(whole->seq.str, rebuilt.str) != 0) {
+                goto fail;
+            }
+            n_seqs++;
+        }
+    }
+    if (res != EOF || !last || qes_seqfile_read(ref, whole) != EOF) {
+        goto fail;
+    }
+    goto done;
+fail:
+    n_seqs = -1;
+done:
+    qes_seq_destroy(seq);
+    qes_seq_destroy(whole);
+    qes_str_destroy_cp(&rebuilt);
+    return n_seqs;
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           test_qes_seqfile_read_window
+Description:    Tests qes_seqfile_read_window against qes_seqfile_read.
+ *===========================================================================*/
+static void
+test_qes_seqfile_read_window (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *ref = NULL;
+    struct qes_seqfile_window pos;
+    struct qes_file_opts opts;
+    char *fname = NULL;
+    char *wfname = NULL;
+    FILE *fp = NULL;
+    size_t iii;
+    const size_t windows[][2] = {
+        {1, 0}, {7, 3}, {10, 0}, {33, 32}, {79, 10}, {100000, 0},
+    };
+    const char *fasta =
+        ">a one\r\nACGT\r\nAC\r\n"
+        ">b\n\nACGTA\n\n"
+        ">empty\n"
+        ">c\nACG\nT";
+
+    (void) ptr;
+    memset(&opts, 0, sizeof(opts));
+    fname = find_data_file("test.fasta");
+    tt_assert(fname != NULL);
+    for (iii = 0; iii < sizeof(windows) / sizeof(*windows); iii++) {
+        sf = qes_seqfile_create(fname, "r");
+        ref = qes_seqfile_create(fname, "r");
+        tt_int_op(test_seqfile_windows(sf, ref, windows[iii][0],
+                                       windows[iii][1]), ==, 813);
+        tt_int_op(sf->n_records, ==, 813);
+        qes_seqfile_destroy(sf);
+        qes_seqfile_destroy(ref);
+    }
+#ifdef ZLIB_FOUND
+    /* Long lines, across many small buffers */
+    free(fname);
+    fname = find_data_file("test_large.fasta.gz");
+    tt_assert(fname != NULL);
+    opts.buffer_len = 1000;
+    for (iii = 0; iii < sizeof(windows) / sizeof(*windows); iii++) {
+        sf = qes_seqfile_create_opts(fname, "r", &opts);
+        ref = qes_seqfile_create(fname, "r");
+        tt_int_op(test_seqfile_windows(sf, ref, windows[iii][0] * 101,
+                                       windows[iii][1] * 101), >, 0);
+        qes_seqfile_destroy(sf);
+        qes_seqfile_destroy(ref);
+    }
+#endif
+    /* Line ends, blank lines and empty sequences */
+    wfname = get_writable_file();
+    tt_assert(wfname != NULL);
+    fp = fopen(wfname, "wb");
+    tt_assert(fp != NULL);
+    tt_int_op(fwrite(fasta, 1, strlen(fasta), fp), ==, strlen(fasta));
+    fclose(fp);
+    fp = NULL;
+    sf = qes_seqfile_create(wfname, "r");
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, &pos), ==, 4);
+    tt_str_op(seq->name.str, ==, "a");
+    tt_str_op(seq->comment.str, ==, "one");
+    tt_str_op(seq->seq.str, ==, "ACGT");
+    tt_int_op(pos.start, ==, 0);
+    tt_int_op(pos.last, ==, 0);
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, &pos), ==, 3);
+    tt_str_op(seq->seq.str, ==, "TAC");
+    tt_int_op(pos.start, ==, 3);
+    tt_int_op(pos.last, ==, 1);
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, &pos), ==, 4);
+    tt_str_op(seq->name.str, ==, "b");
+    tt_str_op(seq->seq.str, ==, "ACGT");
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, NULL), ==, 2);
+    tt_str_op(seq->seq.str, ==, "TA");
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, &pos), ==, 0);
+    tt_str_op(seq->name.str, ==, "empty");
+    tt_int_op(pos.last, ==, 1);
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, &pos), ==, 4);
+    tt_str_op(seq->name.str, ==, "c");
+    tt_str_op(seq->seq.str, ==, "ACGT");
+    tt_int_op(pos.last, ==, 1);
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, &pos), ==, EOF);
+    /* Bad arguments */
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 4, &pos), ==, -2);
+    tt_int_op(qes_seqfile_read_window(sf, seq, 0, 0, &pos), ==, -2);
+    tt_int_op(qes_seqfile_read_window(sf, NULL, 4, 1, &pos), ==, -2);
+    tt_int_op(qes_seqfile_read_window(NULL, seq, 4, 1, &pos), ==, -2);
+    qes_seqfile_destroy(sf);
+    free(fname);
+    fname = find_data_file("test.fastq");
+    sf = qes_seqfile_create(fname, "r");
+    tt_int_op(qes_seqfile_read_window(sf, seq, 4, 1, &pos), ==, -2);
+end:
+    if (fp != NULL) fclose(fp);
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(ref);
+    qes_seq_destroy(seq);
+    if (fname != NULL) free(fname);
+    clean_writable_file(wfname);
+}
+
+/*===  FUNCTION  ============================================================*
+Name:           test_qes_seqfile_fetch
+Description:    Tests qes_seqfile_build_fai and qes_seqfile_fetch against
+                reading each record in turn.
+ *===========================================================================*/
+static void
+test_qes_seqfile_fetch (void *ptr)
+{
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seq *region = qes_seq_create();
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *all = NULL;
+    char *fname = NULL;
+    char *wfname = NULL;
+    char *idxname = NULL;
+    char buf[1<<12];
+    size_t n_recs = 0;
+    size_t len = 0;
+    size_t iii;
+    size_t rep;
+    ssize_t res = 0;
+    FILE *in = NULL;
+    FILE *out = NULL;
+#ifdef ZLIB_FOUND
+    gzFile gzout = NULL;
+#endif
+
+    (void) ptr;
+    /* Copy test.fasta somewhere we can write its index */
+    fname = find_data_file("test.fasta");
+    wfname = get_writable_file();
+    tt_assert(fname != NULL && wfname != NULL);
+    idxname = malloc(strlen(wfname) + strlen(QES_FAI_EXT) + 1);
+    tt_assert(idxname != NULL);
+    sprintf(idxname, "%s%s", wfname, QES_FAI_EXT);
+    for (rep = 0; rep < 2; rep++) {
+        in = fopen(fname, "rb");
+        tt_assert(in != NULL);
+        if (rep == 0) {
+            out = fopen(wfname, "wb");
+            tt_assert(out != NULL);
+        } else {
+#ifdef ZLIB_FOUND
+            /* Again, gzipped */
+            gzout = gzopen(wfname, "wb");
+            tt_assert(gzout != NULL);
+#else
+            fclose(in);
+            in = NULL;
+            break;
+#endif
+        }
+        while ((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+            if (out != NULL) {
+                tt_int_op(fwrite(buf, 1, len, out), ==, len);
+            }
+#ifdef ZLIB_FOUND
+            if (gzout != NULL) {
+                tt_int_op(gzwrite(gzout, buf, len), ==, len);
+            }
+#endif
+        }
+        fclose(in);
+        in = NULL;
+        if (out != NULL) {
+            fclose(out);
+            out = NULL;
+        }
+#ifdef ZLIB_FOUND
+        if (gzout != NULL) {
+            gzclose(gzout);
+            gzout = NULL;
+        }
+#endif
+        remove(idxname);
+        sf = qes_seqfile_create(wfname, "r");
+        tt_assert(qes_seqfile_ok(sf));
+        /* Not yet indexed */
+        tt_int_op(qes_seqfile_fetch(sf, "HWI-ST960:105:D10GVACXX:2:1101:1122:2186",
+                                    0, 10, region), ==, -2);
+        tt_int_op(qes_seqfile_build_fai(sf), ==, 0);
+        tt_ptr_op(sf->fai, !=, NULL);
+        qes_seqfile_destroy(sf);
+        /* The saved index is loaded on the first fetch */
+        sf = qes_seqfile_create(wfname, "r");
+        all = qes_seqfile_create(fname, "r");
+        tt_assert(qes_seqfile_ok(sf) && qes_seqfile_ok(all));
+        n_recs = 0;
+        while ((res = qes_seqfile_read(all, seq)) >= 0) {
+            n_recs++;
+            if (rep == 1 && n_recs % 17 != 0) {
+                /* Seeking in gzip files without an index is slow */
+                continue;
+            }
+            tt_int_op(qes_seqfile_fetch(sf, seq->name.str, 0, SIZE_MAX,
+                                        region), ==, res);
+            tt_str_op(region->name.str, ==, seq->name.str);
+            tt_str_op(region->seq.str, ==, seq->seq.str);
+            /* Parts, across line ends */
+            for (iii = 0; iii + 11 < (size_t)res; iii += 7) {
+                tt_int_op(qes_seqfile_fetch(sf, seq->name.str, iii, iii + 11,
+                                            region), ==, 11);
+                tt_int_op(strncmp(region->seq.str, seq->seq.str + iii, 11),
+                          ==, 0);
+                tt_int_op(region->seq.str[11], ==, '\0');
+            }
+            tt_int_op(qes_seqfile_fetch(sf, seq->name.str, res, res + 5,
+                                        region), ==, 0);
+            tt_str_op(region->seq.str, ==, "");
+            tt_int_op(qes_seqfile_fetch(sf, seq->name.str, res + 1, res + 5,
+                                        region), ==, -2);
+        }
+        tt_int_op(res, ==, EOF);
+        tt_int_op(n_recs, >, 500);
+        tt_int_op(qes_seqfile_fetch(sf, "nonexistent", 0, 10, region), ==, -2);
+        tt_int_op(qes_seqfile_fetch(sf, NULL, 0, 10, region), ==, -2);
+        tt_int_op(qes_seqfile_fetch(sf, seq->name.str, 0, 10, NULL), ==, -2);
+        qes_seqfile_destroy(sf);
+        qes_seqfile_destroy(all);
+    }
+    /* Only FASTA can be indexed */
+    free(fname);
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    sf = qes_seqfile_create(fname, "r");
+    tt_int_op(qes_seqfile_build_fai(sf), ==, -2);
+    tt_int_op(qes_seqfile_build_fai(NULL), ==, -2);
+end:
+    if (in != NULL) fclose(in);
+    if (out != NULL) fclose(out);
+#ifdef ZLIB_FOUND
+    if (gzout != NULL) gzclose(gzout);
+#endif
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(all);
+    qes_seq_destroy(seq);
+    qes_seq_destroy(region);
+    if (fname != NULL) free(fname);
+    clean_writable_file(idxname);
+    clean_writable_file(wfname);
+}
+
 
 struct testcase_t qes_seqfile_tests[] = {
     { "qes_seqfile_create", test_qes_seqfile_create, 0, NULL, NULL},
@@ -413,6 +1209,14 @@ struct testcase_t qes_seqfile_tests[] = {
     { "qes_seqfile_destroy", test_qes_seqfile_destroy, 0, NULL, NULL},
     { "qes_seqfile_read_vs_kseq", test_qes_seqfile_read_vs_kseq, 0, NULL, NULL},
     { "qes_seqfile_read", test_qes_seqfile_read, 0, NULL, NULL},
+    { "qes_seqfile_read_view", test_qes_seqfile_read_view, 0, NULL, NULL},
+    { "qes_seqfile_read_batch", test_qes_seqfile_read_batch, 0, NULL, NULL},
+    { "qes_seqfile_split", test_qes_seqfile_split, 0, NULL, NULL},
+    { "qes_seqfile_read_fasta_lines", test_qes_seqfile_read_fasta_lines, 0, NULL, NULL},
+    { "qes_seqfile_read_presize", test_qes_seqfile_read_presize, 0, NULL, NULL},
+    { "qes_seqfile_read_window", test_qes_seqfile_read_window, 0, NULL, NULL},
+    { "qes_seqfile_fetch", test_qes_seqfile_fetch, 0, NULL, NULL},
     { "qes_seqfile_write", test_qes_seqfile_write, 0, NULL, NULL},
+    { "qes_seqfile_write_bgzf", test_qes_seqfile_write_bgzf, 0, NULL, NULL},
     END_OF_TESTCASES
 };
@@ -0,0 +1,411 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_seqreader.c
+ *
+ *    Description:  Test qes_seqreader.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_seqfile.h>
+#include <qes_seqreader.h>
+
+
+static void
+test_qes_seqreader_single (void *ptr)
+{
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *rsf = NULL;
+    struct qes_seqreader *reader = NULL;
+    struct qes_seqwork *work = NULL;
+    struct qes_seq *seq = qes_seq_create();
+    struct qes_seqview view;
+    size_t iii;
+    size_t n_recs = 0;
+    size_t next_id = 0;
+    char *fname = NULL;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    sf = qes_seqfile_create(fname, "r");
+    rsf = qes_seqfile_create(fname, "r");
+    /* Small batches and few of them, so the reader has to wait for us */
+    reader = qes_seqreader_create(QES_SEQREADER_SINGLE, rsf, NULL, 64, 2);
+    tt_ptr_op(reader, !=, NULL);
+    while ((work = qes_seqreader_get(reader)) != NULL) {
+        tt_int_op(work->id, ==, next_id++);
+        tt_int_op(work->r1->n_records, <=, 64);
+        tt_int_op(work->r2->n_records, ==, 0);
+        for (iii = 0; iii < work->r1->n_records; iii++) {
+            tt_int_op(qes_seqfile_read(sf, seq), >, 0);
+            tt_int_op(qes_seq_batch_view(work->r1, iii, &view), ==, 0);
+            tt_str_op(view.name.str, ==, seq->name.str);
+            tt_str_op(view.seq.str, ==, seq->seq.str);
+            tt_str_op(view.qual.str, ==, seq->qual.str);
+            n_recs++;
+        }
+        qes_seqreader_put(reader, work);
+    }
+    tt_int_op(n_recs, ==, 1000);
+    tt_int_op(qes_seqreader_error(reader), ==, 0);
+    /* Once finished, it stays finished */
+    tt_ptr_op(qes_seqreader_get(reader), ==, NULL);
+    qes_seqreader_destroy(reader);
+    tt_ptr_op(reader, ==, NULL);
+    /* Destroying a reader part way through is fine */
+    qes_seqfile_destroy(sf);
+    sf = qes_seqfile_create(fname, "r");
+    reader = qes_seqreader_create(QES_SEQREADER_SINGLE, sf, NULL, 10, 2);
+    work = qes_seqreader_get(reader);
+    tt_ptr_op(work, !=, NULL);
+    tt_ptr_op(qes_seqreader_create(QES_SEQREADER_PAIRED, rsf, NULL, 0, 0), ==,
+              NULL);
+end:
+    qes_seqreader_destroy(reader);
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(rsf);
+    qes_seq_destroy(seq);
+    if (fname != NULL) free(fname);
+}
+
+static void
+test_qes_seqreader_pairs (void *ptr)
+{
+    struct qes_seqfile *sf1 = NULL;
+    struct qes_seqfile *sf2 = NULL;
+    struct qes_seqreader *reader = NULL;
+    struct qes_seqwork *work = NULL;
+    struct qes_seqview view1;
+    struct qes_seqview view2;
+    size_t iii;
+    size_t n_pairs = 0;
+    char *fname = NULL;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    /* A file paired with itself has identical pairs */
+    sf1 = qes_seqfile_create(fname, "r");
+    sf2 = qes_seqfile_create(fname, "r");
+    reader = qes_seqreader_create(QES_SEQREADER_PAIRED, sf1, sf2, 100, 0);
+    tt_ptr_op(reader, !=, NULL);
+    while ((work = qes_seqreader_get(reader)) != NULL) {
+        tt_int_op(work->r1->n_records, ==, work->r2->n_records);
+        for (iii = 0; iii < work->r1->n_records; iii++) {
+            tt_int_op(qes_seq_batch_view(work->r1, iii, &view1), ==, 0);
+            tt_int_op(qes_seq_batch_view(work->r2, iii, &view2), ==, 0);
+            tt_str_op(view1.name.str, ==, view2.name.str);
+            n_pairs++;
+        }
+        qes_seqreader_put(reader, work);
+    }
+    tt_int_op(n_pairs, ==, 1000);
+    tt_int_op(qes_seqreader_error(reader), ==, 0);
+    qes_seqreader_destroy(reader);
+    qes_seqfile_destroy(sf1);
+    qes_seqfile_destroy(sf2);
+    /* Interleaved, consecutive records pair up */
+    sf1 = qes_seqfile_create(fname, "r");
+    sf2 = qes_seqfile_create(fname, "r");
+    reader = qes_seqreader_create(QES_SEQREADER_INTERLEAVED, sf1, NULL, 100,
+                                  0);
+    n_pairs = 0;
+    while ((work = qes_seqreader_get(reader)) != NULL) {
+        for (iii = 0; iii < work->r1->n_records; iii++) {
+            tt_int_op(qes_seqfile_read_view(sf2, &view2), >, 0);
+            tt_int_op(qes_seq_batch_view(work->r1, iii, &view1), ==, 0);
+            tt_assert(strncmp(view1.name.str, view2.name.str,
+                              view2.name.len) == 0);
+            tt_int_op(qes_seqfile_read_view(sf2, &view2), >, 0);
+            tt_int_op(qes_seq_batch_view(work->r2, iii, &view1), ==, 0);
+            tt_assert(strncmp(view1.name.str, view2.name.str,
+                              view2.name.len) == 0);
+            n_pairs++;
+        }
+        qes_seqreader_put(reader, work);
+    }
+    tt_int_op(n_pairs, ==, 500);
+    tt_int_op(qes_seqreader_error(reader), ==, 0);
+end:
+    qes_seqreader_destroy(reader);
+    qes_seqfile_destroy(sf1);
+    qes_seqfile_destroy(sf2);
+    if (fname != NULL) free(fname);
+}
+
+static void
+test_qes_seqreader_unpaired (void *ptr)
+{
+    struct qes_seqfile *sf1 = NULL;
+    struct qes_seqfile *sf2 = NULL;
+    struct qes_seqreader *reader = NULL;
+    struct qes_seqwork *work = NULL;
+    char *fname1 = NULL;
+    char *fname2 = NULL;
+
+    (void) ptr;
+    /* Files with different numbers of records are an error */
+    fname1 = find_data_file("test.fastq");
+    fname2 = find_data_file("test_large.fasta.gz");
+    sf1 = qes_seqfile_create(fname1, "r");
+    sf2 = qes_seqfile_create(fname2, "r");
+    reader = qes_seqreader_create(QES_SEQREADER_PAIRED, sf1, sf2, 0, 0);
+    while ((work = qes_seqreader_get(reader)) != NULL) {
+        qes_seqreader_put(reader, work);
+    }
+    tt_int_op(qes_seqreader_error(reader), ==, -2);
+end:
+    qes_seqreader_destroy(reader);
+    qes_seqfile_destroy(sf1);
+    qes_seqfile_destroy(sf2);
+    if (fname1 != NULL) free(fname1);
+    if (fname2 != NULL) free(fname2);
+}
+
+/* Write ``n`` FASTQ records named read<i>/<mate> to ``path``, misnaming
+ * record ``bad``. Returns 1 on success. */
+static int
+test_seqreader_write_mates (const char *path, size_t n, int mate, size_t bad)
+{
+    FILE *fp = fopen(path, "w");
+    size_t iii;
+
+    if (fp == NULL) {
+        return 0;
+    }
+    for (iii = 0; iii < n; iii++) {
+        fprintf(fp, "@read%zu%s/%d comment\nACGT%zu\n+\nIIII%zu\n", iii,
+                iii == bad ? "x" : "", mate, iii % 10, iii % 10);
+    }
+    return fclose(fp) == 0;
+}
+
+/* Read ``fname1`` and ``fname2`` as pairs. Returns the number of pairs, or
+ * -1 if they're out of order, and sets ``*error``. */
+static ssize_t
+test_seqreader_count_mates (const char *fname1, const char *fname2,
+                            struct qes_seqreader_opts *opts, int *error)
+{
+    struct qes_seqfile *sf1 = qes_seqfile_create(fname1, "r");
+    struct qes_seqfile *sf2 = qes_seqfile_create(fname2, "r");
+    struct qes_seqreader *reader = NULL;
+    struct qes_seqwork *work = NULL;
+    struct qes_seqview view1;
+    struct qes_seqview view2;
+    ssize_t n_pairs = 0;
+    size_t next_id = 0;
+    size_t iii;
+
+    reader = qes_seqreader_create_opts(QES_SEQREADER_PAIRED, sf1, sf2, opts);
+    if (reader == NULL) {
+        n_pairs = -1;
+        goto end;
+    }
+    while ((work = qes_seqreader_get(reader)) != NULL) {
+        if (work->id != next_id++ ||
+                work->r1->n_records != work->r2->n_records) {
+            n_pairs = -1;
+        }
+        for (iii = 0; n_pairs >= 0 && iii < work->r1->n_records; iii++) {
+            if (qes_seq_batch_view(work->r1, iii, &view1) != 0 ||
+                    qes_seq_batch_view(work->r2, iii, &view2) != 0 ||
+                    strcmp(view1.seq.str, view2.seq.str) != 0) {
+                n_pairs = -1;
+                break;
+            }
+            n_pairs++;
+        }
+        qes_seqreader_put(reader, work);
+    }
+    *error = qes_seqreader_error(reader);
+end:
+    qes_seqreader_destroy(reader);
+    qes_seqfile_destroy(sf1);
+    qes_seqfile_destroy(sf2);
+    return n_pairs;
+}
+
+static void
+test_qes_seqreader_mates (void *ptr)
+{
+    struct qes_seqreader_opts opts;
+    char *fname1 = NULL;
+    char *fname2 = NULL;
+    int io_threads = 0;
+    int error = 0;
+
+    (void) ptr;
+    tt_assert(qes_seqreader_names_pair("read1/1", 7, "read1/2", 7));
+    tt_assert(qes_seqreader_names_pair("read1/1", 7, "read1", 5));
+    tt_assert(qes_seqreader_names_pair("read1", 5, "read1", 5));
+    tt_assert(qes_seqreader_names_pair("/1", 2, "/2", 2));
+    tt_assert(!qes_seqreader_names_pair("read1/1", 7, "read2/2", 7));
+    tt_assert(!qes_seqreader_names_pair("read1/3", 7, "read1/2", 7));
+    tt_assert(!qes_seqreader_names_pair("read1", 5, "read12", 6));
+    fname1 = get_writable_file();
+    fname2 = get_writable_file();
+    tt_assert(fname1 != NULL && fname2 != NULL);
+    tt_assert(test_seqreader_write_mates(fname1, 1000, 1, SIZE_MAX));
+    memset(&opts, 0, sizeof(opts));
+    opts.batch_records = 7;
+    opts.n_batches = 3;
+    opts.check_names = 1;
+    for (io_threads = 1; io_threads <= 2; io_threads++) {
+        opts.io_threads = io_threads;
+        /* Mates, batched and in order */
+        tt_assert(test_seqreader_write_mates(fname2, 1000, 2, SIZE_MAX));
+        tt_int_op(test_seqreader_count_mates(fname1, fname2, &opts, &error),
+                  ==, 1000);
+        tt_int_op(error, ==, 0);
+        /* A misnamed mate */
+        tt_assert(test_seqreader_write_mates(fname2, 1000, 2, 500));
+        tt_int_op(test_seqreader_count_mates(fname1, fname2, &opts, &error),
+                  <, 1000);
+        tt_int_op(error, ==, -2);
+        /* Too few or too many mates */
+        tt_assert(test_seqreader_write_mates(fname2, 999, 2, SIZE_MAX));
+        tt_int_op(test_seqreader_count_mates(fname1, fname2, &opts, &error),
+                  <, 1000);
+        tt_int_op(error, ==, -2);
+        tt_assert(test_seqreader_write_mates(fname2, 1001, 2, SIZE_MAX));
+        tt_int_op(test_seqreader_count_mates(fname1, fname2, &opts, &error),
+                  ==, 1000);
+        tt_int_op(error, ==, -2);
+    }
+    /* Names are only checked if asked */
+    opts.check_names = 0;
+    tt_assert(test_seqreader_write_mates(fname2, 1000, 2, 500));
+    tt_int_op(test_seqreader_count_mates(fname1, fname2, &opts, &error), ==,
+              1000);
+    tt_int_op(error, ==, 0);
+    /* Defaults */
+    tt_int_op(test_seqreader_count_mates(fname1, fname2, NULL, &error), ==,
+              1000);
+    tt_int_op(error, ==, 0);
+end:
+    clean_writable_file(fname1);
+    clean_writable_file(fname2);
+}
+
+#ifdef OPENMP_FOUND
+static void
+test_qes_seqreader_iter_macros (void *ptr)
+{
+    struct qes_seqfile *sf = NULL;
+    struct qes_seqfile *sf2 = NULL;
+    size_t n_recs = 0;
+    size_t total_len = 0;
+    size_t n_mismatch = 0;
+    char *fname = NULL;
+    char *wname = NULL;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    tt_assert(fname != NULL);
+    sf = qes_seqfile_create(fname, "r");
+    QES_SEQFILE_ITER_PARALLEL_SINGLE_BEGIN(sf, seq, len,
+            shared(n_recs, total_len) num_threads(4))
+        #pragma omp atomic
+        n_recs++;
+        #pragma omp atomic
+        total_len += len;
+    QES_SEQFILE_ITER_PARALLEL_SINGLE_END(seq)
+    tt_int_op(n_recs, ==, 1000);
+    tt_int_op(total_len, ==, 32385);
+    qes_seqfile_destroy(sf);
+    /* A break stops the thread, not just its batch */
+    n_recs = 0;
+    wname = get_writable_file();
+    tt_assert(wname != NULL);
+    tt_assert(test_seqreader_write_mates(wname, 5 * QES_SEQBATCH_DEFAULT_RECORDS,
+                                         1, SIZE_MAX));
+    sf = qes_seqfile_create(wname, "r");
+    QES_SEQFILE_ITER_PARALLEL_SINGLE_BEGIN(sf, seq, len,
+            shared(n_recs) num_threads(1))
+        (void) len;
+        n_recs++;
+        break;
+    QES_SEQFILE_ITER_PARALLEL_SINGLE_END(seq)
+    tt_int_op(n_recs, ==, 1);
+    qes_seqfile_destroy(sf);
+    n_recs = 0;
+    sf = qes_seqfile_create(fname, "r");
+    sf2 = qes_seqfile_create(fname, "r");
+    QES_SEQFILE_ITER_PARALLEL_PAIRED_BEGIN(sf, sf2, seq1, seq2, len1, len2,
+            shared(n_recs, n_mismatch) num_threads(4))
+        #pragma omp atomic
+        n_recs++;
+        if (len1 != len2 || strcmp(seq1->name.str, seq2->name.str) != 0) {
+            #pragma omp atomic
+            n_mismatch++;
+        }
+    QES_SEQFILE_ITER_PARALLEL_PAIRED_END(seq1, seq2)
+    tt_int_op(n_recs, ==, 1000);
+    tt_int_op(n_mismatch, ==, 0);
+    qes_seqfile_destroy(sf);
+    n_recs = 0;
+    sf = qes_seqfile_create(fname, "r");
+    QES_SEQFILE_ITER_PARALLEL_INTERLEAVED_BEGIN(sf, seq1, seq2, len1, len2,
+            shared(n_recs) num_threads(4))
+        (void) len1;
+        (void) len2;
+        (void) seq1;
+        (void) seq2;
+        #pragma omp atomic
+        n_recs++;
+    QES_SEQFILE_ITER_PARALLEL_INTERLEAVED_END(seq1, seq2)
+    tt_int_op(n_recs, ==, 500);
+    qes_seqfile_destroy(sf);
+    n_recs = 0;
+    total_len = 0;
+    sf = qes_seqfile_create(fname, "r");
+    QES_SEQFILE_ITER_PARALLEL_CHUNKED_BEGIN(sf, view, len,
+            shared(n_recs, total_len) num_threads(4))
+        #pragma omp atomic
+        n_recs++;
+        #pragma omp atomic
+        total_len += len;
+    QES_SEQFILE_ITER_PARALLEL_CHUNKED_END(view)
+    tt_int_op(n_recs, ==, 1000);
+    tt_int_op(total_len, ==, 32385);
+end:
+    qes_seqfile_destroy(sf);
+    qes_seqfile_destroy(sf2);
+    if (fname != NULL) free(fname);
+    clean_writable_file(wname);
+}
+#endif
+
+
+struct testcase_t qes_seqreader_tests[] = {
+    { "qes_seqreader_single", test_qes_seqreader_single, 0, NULL, NULL},
+    { "qes_seqreader_pairs", test_qes_seqreader_pairs, 0, NULL, NULL},
+    { "qes_seqreader_unpaired", test_qes_seqreader_unpaired, 0, NULL, NULL},
+    { "qes_seqreader_mates", test_qes_seqreader_mates, 0, NULL, NULL},
+#ifdef OPENMP_FOUND
+    { "qes_seqreader_iter_macros", test_qes_seqreader_iter_macros, 0, NULL,
+        NULL},
+#endif
+    END_OF_TESTCASES
+};
@@ -46,6 +46,9 @@ test_qes_sequtil_translate_codon (void *ptr)
     tt_int_op(qes_sequtil_translate_codon("XACACA"), ==, -1);
     tt_int_op(qes_sequtil_translate_codon("A"), ==, -1);
     tt_int_op(qes_sequtil_translate_codon(NULL), ==, -1);
+    /* Lower case is fine too */
+    tt_int_op(qes_sequtil_translate_codon("atg"), ==, 'M');
+    tt_int_op(qes_sequtil_translate_codon("uGa"), ==, '*');
     /* Try with mutations */
     for (iii = 0; iii < n_codons; iii++) {
         for (jjj = 0; jjj < 3; jjj++) {
@@ -61,7 +64,232 @@ end:
     if (cdn != NULL) free(cdn);
 }
 
+static void
+test_qes_sequtil_translate_seq (void *ptr)
+{
+    char seq[3 * 125 + 2];
+    char aas[128];
+    size_t iii;
+
+    (void) ptr;
+    /* Every codon at once */
+    for (iii = 0; iii < n_codons; iii++) {
+        memcpy(seq + 3 * iii, codon_list[iii], 3);
+    }
+    tt_int_op(qes_sequtil_translate_seq(aas, seq, 3 * n_codons,
+                                        QES_GENETIC_CODE_STANDARD), ==,
+              n_codons);
+    for (iii = 0; iii < n_codons; iii++) {
+        tt_assert_op_type(aas[iii], ==, aa_list[iii], char, "%c");
+    }
+    tt_int_op(aas[n_codons], ==, '\0');
+    /* Only whole codons are translated */
+    tt_int_op(qes_sequtil_translate_seq(aas, "ATGGCNTGAta", 11,
+                                        QES_GENETIC_CODE_STANDARD), ==, 3);
+    tt_str_op(aas, ==, "MX*");
+    tt_int_op(qes_sequtil_translate_seq(aas, "AT", 2,
+                                        QES_GENETIC_CODE_STANDARD), ==, 0);
+    tt_str_op(aas, ==, "");
+    /* Other codes */
+    tt_int_op(qes_sequtil_translate_seq(aas, "AGATGAATAAGG", 12,
+                                        QES_GENETIC_CODE_STANDARD), ==, 4);
+    tt_str_op(aas, ==, "R*IR");
+    tt_int_op(qes_sequtil_translate_seq(aas, "AGATGAATAAGG", 12,
+                                        QES_GENETIC_CODE_VERT_MITO), ==, 4);
+    tt_str_op(aas, ==, "*WM*");
+    tt_int_op(qes_sequtil_translate_seq(aas, "TAATAGCTG", 9,
+                                        QES_GENETIC_CODE_CILIATE), ==, 3);
+    tt_str_op(aas, ==, "QQL");
+    tt_int_op(qes_sequtil_translate_seq(aas, "CTGTAA", 6,
+                                        QES_GENETIC_CODE_YEAST_MITO), ==, 2);
+    tt_str_op(aas, ==, "T*");
+    /* Check with bad params */
+    tt_int_op(qes_sequtil_translate_seq(aas, "ATG", 3, 7), ==, -2);
+    tt_int_op(qes_sequtil_translate_seq(aas, "ATG", 3, 0), ==, -2);
+    tt_int_op(qes_sequtil_translate_seq(aas, "ATG", 3, QES_N_GENETIC_CODES),
+              ==, -2);
+    tt_int_op(qes_sequtil_translate_seq(NULL, "ATG", 3,
+                                        QES_GENETIC_CODE_STANDARD), ==, -2);
+    tt_int_op(qes_sequtil_translate_seq(aas, NULL, 3,
+                                        QES_GENETIC_CODE_STANDARD), ==, -2);
+end:
+    ;
+}
+
+static void
+test_qes_sequtil_translate_6frame (void *ptr)
+{
+    const char *bases = "ACGTACGTACGTacgtUN";
+    const enum qes_genetic_code codes[] = {
+        QES_GENETIC_CODE_STANDARD,
+        QES_GENETIC_CODE_VERT_MITO,
+        QES_GENETIC_CODE_ALT_FLATWORM_MITO,
+    };
+    char seq[202];
+    char rc[202];
+    char expect[70];
+    char buf[6][70];
+    char *frames[6];
+    size_t len;
+    size_t iii;
+    size_t ccc;
+
+    (void) ptr;
+    for (iii = 0; iii < 6; iii++) {
+        frames[iii] = buf[iii];
+    }
+    srand(1);
+    for (iii = 0; iii < sizeof(seq) - 1; iii++) {
+        seq[iii] = bases[rand() % strlen(bases)];
+    }
+    /* Each frame matches translating it, or its reverse complement, alone */
+    for (ccc = 0; ccc < sizeof(codes) / sizeof(*codes); ccc++) {
+        for (len = 0; len < sizeof(seq); len++) {
+            tt_int_op(qes_sequtil_translate_6frame(frames, seq, len,
+                                                   codes[ccc]), ==, 0);
+            qes_sequtil_revcomp_into(rc, seq, len, 0);
+            for (iii = 0; iii < 3; iii++) {
+                qes_sequtil_translate_seq(expect, seq + iii,
+                                          len > iii ? len - iii : 0,
+                                          codes[ccc]);
+                tt_str_op(frames[iii], ==, expect);
+                qes_sequtil_translate_seq(expect, rc + iii,
+                                          len > iii ? len - iii : 0,
+                                          codes[ccc]);
+                tt_str_op(frames[3 + iii], ==, expect);
+            }
+        }
+    }
+    tt_int_op(qes_sequtil_translate_6frame(frames, "ATGAAACCC", 9,
+                                           QES_GENETIC_CODE_STANDARD), ==, 0);
+    tt_str_op(frames[0], ==, "MKP");
+    tt_str_op(frames[1], ==, "*N");
+    tt_str_op(frames[2], ==, "ET");
+    tt_str_op(frames[3], ==, "GFH");
+    tt_str_op(frames[4], ==, "GF");
+    tt_str_op(frames[5], ==, "VS");
+    /* Check with bad params */
+    tt_int_op(qes_sequtil_translate_6frame(frames, "ATG", 3, 8), ==, -2);
+    tt_int_op(qes_sequtil_translate_6frame(NULL, "ATG", 3,
+                                           QES_GENETIC_CODE_STANDARD), ==, -2);
+    frames[4] = NULL;
+    tt_int_op(qes_sequtil_translate_6frame(frames, "ATG", 3,
+                                           QES_GENETIC_CODE_STANDARD), ==, -2);
+end:
+    ;
+}
+
+/* Reverse complement ``seq`` one base at a time */
+static void
+test_sequtil_revcomp_naive (char *dest, const char *seq, size_t len,
+                            int keep_case)
+{
+    const char *from = "ACGTURYKMBVDHSWN-.";
+    const char *to = "TGCAAYRMKVBHDSWN-.";
+    const char *pos = NULL;
+    size_t iii;
+    char base;
+
+    for (iii = 0; iii < len; iii++) {
+        base = seq[len - 1 - iii];
+        pos = strchr(from, toupper(base));
+        if (pos == NULL || base == '\0') {
+            dest[iii] = keep_case && islower(base) ? 'n' : 'N';
+            continue;
+        }
+        dest[iii] = to[pos - from];
+        if (keep_case && islower(base)) {
+            dest[iii] = tolower(dest[iii]);
+        }
+    }
+    dest[len] = '\0';
+}
+
+static void
+test_qes_sequtil_revcomp (void *ptr)
+{
+    const enum qes_sequtil_impl impls[] = {
+        QES_SEQUTIL_SCALAR,
+        QES_SEQUTIL_SSSE3,
+        QES_SEQUTIL_AVX2,
+        QES_SEQUTIL_AUTO,
+    };
+    const size_t n_impls = sizeof(impls) / sizeof(*impls);
+    const char *bases = "ACGTACGTacgtNnRYKMbvdhswUuXx";
+    char seq[301];
+    char got[301];
+    char expect[301];
+    char *rc = NULL;
+    size_t iii;
+    size_t len;
+    int keep_case;
+
+    (void) ptr;
+    srand(1);
+    for (iii = 0; iii < sizeof(seq) - 1; iii++) {
+        seq[iii] = bases[rand() % strlen(bases)];
+    }
+    seq[sizeof(seq) - 1] = '\0';
+    for (iii = 0; iii < n_impls; iii++) {
+        if (qes_sequtil_use(impls[iii]) != 0) {
+            /* Not supported on this CPU or build */
+            continue;
+        }
+        /* Each length, so the SIMD tails and middles are tested */
+        for (len = 0; len < sizeof(seq); len++) {
+            for (keep_case = 0; keep_case < 2; keep_case++) {
+                test_sequtil_revcomp_naive(expect, seq, len, keep_case);
+                qes_sequtil_revcomp_into(got, seq, len, keep_case);
+                got[len] = '\0';
+                tt_str_op(got, ==, expect);
+                memcpy(got, seq, len);
+                qes_sequtil_revcomp_into(got, got, len, keep_case);
+                tt_str_op(got, ==, expect);
+            }
+        }
+        /* Gaps and other non-letters, in the middle of SIMD blocks */
+        memcpy(got, seq, sizeof(seq));
+        got[20] = '-';
+        got[100] = '.';
+        got[250] = '*';
+        got[280] = '\n';
+        test_sequtil_revcomp_naive(expect, got, 300, 1);
+        qes_sequtil_revcomp_into(got, got, 300, 1);
+        got[300] = '\0';
+        tt_str_op(got, ==, expect);
+        tt_int_op(got[279], ==, '-');
+        tt_int_op(got[199], ==, '.');
+    }
+    tt_int_op(qes_sequtil_use(QES_SEQUTIL_SCALAR), ==, 0);
+    tt_int_op(qes_sequtil_use((enum qes_sequtil_impl)-1), ==, -1);
+    qes_sequtil_use(QES_SEQUTIL_AUTO);
+    /* Upper cased, with trailing whitespace trimmed */
+    rc = qes_sequtil_revcomp("AACGTtgcaNR\n", 12);
+    tt_str_op(rc, ==, "YNTGCAACGTT");
+    free(rc);
+    /* Only ``len`` bases are used */
+    rc = qes_sequtil_revcomp("AACGTT", 3);
+    tt_str_op(rc, ==, "GTT");
+    free(rc);
+    rc = qes_sequtil_revcomp("", 0);
+    tt_str_op(rc, ==, "");
+    free(rc);
+    rc = NULL;
+    tt_ptr_op(qes_sequtil_revcomp(NULL, 3), ==, NULL);
+    strcpy(got, "AACGTtgcaNR \n");
+    qes_sequtil_revcomp_inplace(got, strlen(got));
+    tt_str_op(got, ==, "YNTGCAACGTT");
+    qes_sequtil_revcomp_inplace(got, strlen(got));
+    tt_str_op(got, ==, "AACGTTGCANR");
+end:
+    qes_sequtil_use(QES_SEQUTIL_AUTO);
+    if (rc != NULL) free(rc);
+}
+
 struct testcase_t qes_sequtil_tests[] = {
     { "qes_sequtil_translate_codon", test_qes_sequtil_translate_codon, 0, NULL, NULL},
+    { "qes_sequtil_translate_seq", test_qes_sequtil_translate_seq, 0, NULL, NULL},
+    { "qes_sequtil_translate_6frame", test_qes_sequtil_translate_6frame, 0, NULL, NULL},
+    { "qes_sequtil_revcomp", test_qes_sequtil_revcomp, 0, NULL, NULL},
     END_OF_TESTCASES
 };
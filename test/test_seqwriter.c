@@ -0,0 +1,168 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_seqwriter.c
+ *
+ *    Description:  Test qes_seqwriter.c
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_seqfile.h>
+#include <qes_seqreader.h>
+#include <qes_seqwriter.h>
+
+#define N_BATCHES 10
+
+
+static void
+test_qes_seqwriter_order (void *ptr)
+{
+    struct qes_seqfile *in = NULL;
+    struct qes_seqfile *out = NULL;
+    struct qes_seqwriter *writer = NULL;
+    struct qes_seq_batch *batches[N_BATCHES] = {NULL};
+    char *fname = NULL;
+    char *outname = NULL;
+    size_t iii;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    outname = get_writable_file();
+    tt_assert(fname != NULL && outname != NULL);
+    in = qes_seqfile_create(fname, "r");
+    for (iii = 0; iii < N_BATCHES; iii++) {
+        batches[iii] = qes_seq_batch_create(0, 0);
+        tt_int_op(qes_seqfile_read_batch(in, batches[iii], 100, 0), ==, 100);
+    }
+    qes_seqfile_destroy(in);
+    /* Batches put out of order are written in order */
+    out = qes_seqfile_create(outname, "wT");
+    qes_seqfile_set_format(out, FASTQ_FMT);
+    writer = qes_seqwriter_create(out, 2);
+    tt_assert(writer != NULL);
+    for (iii = 0; iii < N_BATCHES; iii++) {
+        size_t id = iii ^ 1;
+        tt_int_op(qes_seqwriter_put(writer, id, &batches[id]), ==, 0);
+        /* We get an empty batch back */
+        tt_assert(batches[id] != NULL);
+        tt_int_op(batches[id]->n_records, ==, 0);
+    }
+    tt_int_op(qes_seqwriter_finish(writer), ==, 0);
+    tt_int_op(qes_seqwriter_finish(writer), ==, 0);
+    tt_int_op(filecmp(outname, fname), ==, 0);
+    /* Nothing may be put once finished */
+    tt_int_op(qes_seqwriter_put(writer, N_BATCHES, &batches[0]), ==, -2);
+    qes_seqwriter_destroy(writer);
+    qes_seqfile_destroy(out);
+    /* Ids may only be put once, and none may be missed */
+    out = qes_seqfile_create(outname, "wT");
+    qes_seqfile_set_format(out, FASTQ_FMT);
+    writer = qes_seqwriter_create(out, 0);
+    tt_assert(writer != NULL);
+    tt_int_op(qes_seqwriter_put(writer, 0, &batches[0]), ==, 0);
+    tt_int_op(qes_seqwriter_put(writer, 0, &batches[0]), ==, -2);
+    tt_int_op(qes_seqwriter_put(writer, 2, &batches[2]), ==, 0);
+    tt_int_op(qes_seqwriter_finish(writer), ==, -2);
+    qes_seqwriter_destroy(writer);
+    /* Bad arguments */
+    tt_ptr_op(qes_seqwriter_create(NULL, 0), ==, NULL);
+    tt_int_op(qes_seqwriter_put(NULL, 0, &batches[0]), ==, -2);
+    writer = qes_seqwriter_create(out, 0);
+    tt_int_op(qes_seqwriter_put(writer, 0, NULL), ==, -2);
+    tt_int_op(qes_seqwriter_finish(NULL), ==, -2);
+end:
+    qes_seqwriter_destroy(writer);
+    qes_seqfile_destroy(in);
+    qes_seqfile_destroy(out);
+    for (iii = 0; iii < N_BATCHES; iii++) {
+        qes_seq_batch_destroy(batches[iii]);
+    }
+    if (fname != NULL) free(fname);
+    clean_writable_file(outname);
+}
+
+#ifdef OPENMP_FOUND
+static void
+test_qes_seqwriter_parallel (void *ptr)
+{
+    struct qes_seqfile *in = NULL;
+    struct qes_seqfile *out = NULL;
+    struct qes_seqreader *reader = NULL;
+    struct qes_seqwriter *writer = NULL;
+    char *fname = NULL;
+    char *outname = NULL;
+    int n_errors = 0;
+
+    (void) ptr;
+    fname = find_data_file("test.fastq");
+    outname = get_writable_file();
+    tt_assert(fname != NULL && outname != NULL);
+    in = qes_seqfile_create(fname, "r");
+    out = qes_seqfile_create(outname, "wT");
+    qes_seqfile_set_format(out, FASTQ_FMT);
+    reader = qes_seqreader_create(QES_SEQREADER_SINGLE, in, NULL, 7, 0);
+    writer = qes_seqwriter_create(out, 4);
+    tt_assert(reader != NULL && writer != NULL);
+    /* Each thread copies its batches, record by record, to the output */
+    #pragma omp parallel num_threads(4) shared(reader, writer) \
+            reduction(+:n_errors) default(none)
+    {
+        struct qes_seq_batch *batch = qes_seq_batch_create(0, 0);
+        struct qes_seqwork *work = NULL;
+        struct qes_seqview view;
+        size_t iii;
+
+        while ((work = qes_seqreader_get(reader)) != NULL) {
+            for (iii = 0; iii < work->r1->n_records; iii++) {
+                qes_seq_batch_view(work->r1, iii, &view);
+                qes_seq_batch_append(batch, &view);
+            }
+            if (qes_seqwriter_put(writer, work->id, &batch) != 0) {
+                n_errors++;
+            }
+            qes_seqreader_put(reader, work);
+        }
+        qes_seq_batch_destroy(batch);
+    }
+    tt_int_op(n_errors, ==, 0);
+    tt_int_op(qes_seqreader_error(reader), ==, 0);
+    tt_int_op(qes_seqwriter_finish(writer), ==, 0);
+    tt_int_op(filecmp(outname, fname), ==, 0);
+end:
+    qes_seqreader_destroy(reader);
+    qes_seqwriter_destroy(writer);
+    qes_seqfile_destroy(in);
+    qes_seqfile_destroy(out);
+    if (fname != NULL) free(fname);
+    clean_writable_file(outname);
+}
+#endif
+
+
+struct testcase_t qes_seqwriter_tests[] = {
+    { "qes_seqwriter_order", test_qes_seqwriter_order, 0, NULL, NULL},
+#ifdef OPENMP_FOUND
+    { "qes_seqwriter_parallel", test_qes_seqwriter_parallel, 0, NULL, NULL},
+#endif
+    END_OF_TESTCASES
+};
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  test_str.c
+ *
+ *    Description:  Test qes_str.h
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "tests.h"
+#include <qes_str.h>
+
+
+static void
+test_qes_str_resize (void *ptr)
+{
+    struct qes_str str = {NULL, 0, 0, NULL};
+    char *before = NULL;
+
+    (void) ptr;
+    qes_str_init(&str, 16);
+    tt_assert(qes_str_fill_charptr(&str, "GATTACA", 7));
+    /* Big enough already, so nothing moves */
+    before = str.str;
+    tt_assert(qes_str_resize(&str, 15));
+    tt_ptr_op(str.str, ==, before);
+    tt_int_op(str.capacity, ==, 16);
+    /* Straight to the power of two above, in one step */
+    tt_assert(qes_str_resize(&str, 1000));
+    tt_int_op(str.capacity, ==, 1024);
+    tt_str_op(str.str, ==, "GATTACA");
+    tt_assert(qes_str_resize(&str, 1023));
+    tt_int_op(str.capacity, ==, 1024);
+    tt_assert(qes_str_resize(&str, 1024));
+    tt_int_op(str.capacity, ==, 2048);
+    /* Reserving gives exactly what's asked for */
+    tt_assert(qes_str_reserve(&str, 5000));
+    tt_int_op(str.capacity, ==, 5001);
+    tt_str_op(str.str, ==, "GATTACA");
+    tt_assert(qes_str_reserve(&str, 10));
+    tt_int_op(str.capacity, ==, 5001);
+    tt_int_op(qes_str_resize(NULL, 10), ==, 0);
+    tt_int_op(qes_str_reserve(NULL, 10), ==, 0);
+end:
+    qes_str_destroy_cp(&str);
+}
+
+static void
+test_qes_str_copy (void *ptr)
+{
+    struct qes_str src = {NULL, 0, 0, NULL};
+    struct qes_str dest = {NULL, 0, 0, NULL};
+    struct qes_str fresh = {NULL, 0, 0, NULL};
+
+    (void) ptr;
+    qes_str_init(&src, 1<<16);
+    qes_str_init(&dest, 4);
+    tt_assert(qes_str_fill_charptr(&src, "GATTACA", 7));
+    tt_assert(qes_str_fill_charptr(&dest, "CAT", 3));
+    /* Only as much as src holds is copied, not its capacity */
+    tt_int_op(qes_str_copy(&dest, &src), ==, 0);
+    tt_str_op(dest.str, ==, "GATTACA");
+    tt_int_op(dest.len, ==, 7);
+    tt_int_op(dest.capacity, <, 1<<16);
+    tt_int_op(qes_str_copy(&fresh, &src), ==, 0);
+    tt_str_op(fresh.str, ==, "GATTACA");
+    tt_int_op(fresh.len, ==, 7);
+    tt_int_op(fresh.capacity, ==, 8);
+    tt_int_op(qes_str_cat(&fresh, &dest), ==, 0);
+    tt_str_op(fresh.str, ==, "GATTACAGATTACA");
+    tt_int_op(fresh.len, ==, 14);
+    tt_int_op(qes_str_copy(NULL, &src), ==, 1);
+    tt_int_op(qes_str_copy(&dest, NULL), ==, 1);
+end:
+    qes_str_destroy_cp(&src);
+    qes_str_destroy_cp(&dest);
+    qes_str_destroy_cp(&fresh);
+}
+
+
+struct testcase_t qes_str_tests[] = {
+    { "qes_str_resize", test_qes_str_resize, 0, NULL, NULL},
+    { "qes_str_copy", test_qes_str_copy, 0, NULL, NULL},
+    END_OF_TESTCASES
+};
@@ -39,16 +39,34 @@
 
 /* test_util tests */
 extern struct testcase_t qes_util_tests[];
+/* test_arena tests */
+extern struct testcase_t qes_arena_tests[];
+/* test_str tests */
+extern struct testcase_t qes_str_tests[];
 /* test_match tests */
 extern struct testcase_t qes_match_tests[];
 /* test_qes_file tests */
 extern struct testcase_t qes_file_tests[];
+/* test_scan tests */
+extern struct testcase_t qes_scan_tests[];
+/* test_gzindex tests */
+extern struct testcase_t qes_gzindex_tests[];
+/* test_fai tests */
+extern struct testcase_t qes_fai_tests[];
 /* test_seqfile tests */
 extern struct testcase_t qes_seqfile_tests[];
+/* test_seqbatch tests */
+extern struct testcase_t qes_seqbatch_tests[];
+/* test_seqreader tests */
+extern struct testcase_t qes_seqreader_tests[];
+/* test_seqwriter tests */
+extern struct testcase_t qes_seqwriter_tests[];
 /* test_seq tests */
 extern struct testcase_t qes_seq_tests[];
 /* test_sequtil tests */
 extern struct testcase_t qes_sequtil_tests[];
+/* test_packedseq tests */
+extern struct testcase_t qes_packedseq_tests[];
 /* test_log tests */
 extern struct testcase_t qes_log_tests[];
 /* test_helpers tests */
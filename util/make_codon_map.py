@@ -1,21 +1,79 @@
-from Bio.Data import CodonTable
+# Generate src/qes_codon_map.c, the codon to amino acid tables of each genetic
+# code, from NCBI's translation tables (ftp.ncbi.nih.gov/entrez/misc/data/gc.prt).
+#
+# Usage: python util/make_codon_map.py > src/qes_codon_map.c
+from __future__ import print_function
 
-nts = "ACGTU"
+# NCBI lists amino acids by codon, with each base in the order TCAG
+bases = "TCAG"
 
-codon_tab = CodonTable.generic_by_name["Standard"].forward_table
-print "char\ntranslate_codon(char *codon)\n{"
-for a in nts:
-    print "    else if (codon[0] == '%s') {" % a
-    for b in nts:
-        print "        else if (codon[1] == '%s') {" % b
-        for c in nts:
-            print "            else if (codon[2] == '%s')" % c ,
-            codon = "".join((a,b,c))
-            try:
-                aa = codon_tab[codon]
-            except KeyError:
-                aa = "*"
-            print "return '%s'" % aa
-        print "         }"
-    print "    }"
-print "}"
+# (enum qes_genetic_code suffix, NCBI id, name, amino acids)
+codes = [
+    ("STANDARD", 1, "Standard",
+     "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"),
+    ("VERT_MITO", 2, "Vertebrate Mitochondrial",
+     "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSS**VVVVAAAADDEEGGGG"),
+    ("YEAST_MITO", 3, "Yeast Mitochondrial",
+     "FFLLSSSSYY**CCWWTTTTPPPPHHQQRRRRIIMMTTTTNNKKSSRRVVVVAAAADDEEGGGG"),
+    ("MOLD_MITO", 4, "Mold, Protozoan and Coelenterate Mitochondrial",
+     "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"),
+    ("INVERT_MITO", 5, "Invertebrate Mitochondrial",
+     "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSSSSVVVVAAAADDEEGGGG"),
+    ("CILIATE", 6, "Ciliate, Dasycladacean and Hexamita Nuclear",
+     "FFLLSSSSYYQQCC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"),
+    ("ECHINODERM_MITO", 9, "Echinoderm and Flatworm Mitochondrial",
+     "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNNKSSSSVVVVAAAADDEEGGGG"),
+    ("EUPLOTID", 10, "Euplotid Nuclear",
+     "FFLLSSSSYY**CCCWLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"),
+    ("BACTERIAL", 11, "Bacterial, Archaeal and Plant Plastid",
+     "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"),
+    ("ALT_YEAST", 12, "Alternative Yeast Nuclear",
+     "FFLLSSSSYY**CC*WLLLSPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"),
+    ("ASCIDIAN_MITO", 13, "Ascidian Mitochondrial",
+     "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSSGGVVVVAAAADDEEGGGG"),
+    ("ALT_FLATWORM_MITO", 14, "Alternative Flatworm Mitochondrial",
+     "FFLLSSSSYYY*CCWWLLLLPPPPHHQQRRRRIIIMTTTTNNNKSSSSVVVVAAAADDEEGGGG"),
+]
+
+print("""/*
+ * Copyright 2015 Kevin Murray <spam@kdmurray.id.au>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * ============================================================================
+ *
+ *       Filename:  qes_codon_map.c
+ *
+ *    Description:  Codon tables of each genetic code. Generated by
+ *                  util/make_codon_map.py; edit that, not this.
+ *        License:  GPLv3+
+ *         Author:  Kevin Murray, spam@kdmurray.id.au
+ *
+ * ============================================================================
+ */
+
+#include "qes_sequtil.h"
+
+""")
+print("const char *const qes_codon_maps[QES_N_GENETIC_CODES] = {")
+for enum, ncbi_id, name, aas in codes:
+    assert len(aas) == 64
+    print("    /* %d: %s */" % (ncbi_id, name))
+    print("    [QES_GENETIC_CODE_%s] =" % enum)
+    for first in range(4):
+        row = aas[first * 16:(first + 1) * 16]
+        end = "," if first == 3 else ""
+        print('        /* %s.. */ "%s"%s' % (bases[first], row, end))
+print("};")